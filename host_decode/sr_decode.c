@@ -0,0 +1,537 @@
+#include "sr_decode.h"
+
+//Escape for the control bytes in binary framing, the same as the device BIN_ESC
+#define BIN_ESC '#'
+//Escape to a full analog value in delta blocks, the same as the device DELTA_ESC
+#define DELTA_ESC 0x8
+//Start of a gap marker, the same as the device GAP_MARK
+#define GAP_MARK '-'
+//Start of a hold marker, the same as the device HOLD_MARK
+#define HOLD_MARK '.'
+//Start of a frame marker, the same as the device FRAME_MARK
+#define FRAME_MARK '/'
+
+bool dec_init(sr_decoder_t *d, uint32_t d_chan_cnt, uint32_t a_chan_cnt, sr_run_fn run, void *ctx)
+{
+   if ((d_chan_cnt > 32) || (a_chan_cnt > DEC_MAX_A_CHAN) || ((d_chan_cnt + a_chan_cnt) == 0))
+   {
+      return false;
+   }
+   d->d_chan_cnt = d_chan_cnt;
+   d->a_chan_cnt = a_chan_cnt;
+   d->d_tx_bps = (d_chan_cnt + 6) / 7;
+   d->d4 = (d_chan_cnt <= 4) && (a_chan_cnt == 0);
+   d->run = run;
+   d->ctx = ctx;
+   d->slice_pos = 0;
+   d->cval = 0;
+   d->lval = 0;
+   d->rcnt = 0;
+   d->have_lval = false;
+   d->in_trailer = false;
+   d->pk_hdr = 0;
+   d->pk_left = 0;
+   d->pk_acc = 0;
+   d->pk_bits = 0;
+   d->pk_field = 0;
+   d->pk_esc = false;
+   d->pk_delta = false;
+   d->pk_sub = false;
+   d->binary = false;
+   d->adc12 = false;
+   d->gap = 0;
+   d->gap_hdr = 0;
+   d->gap_cnt = 0;
+   d->gap_hold = false;
+   d->gap_frame = false;
+   d->gaps = 0;
+   d->frames = 0;
+   d->gap_samples = 0;
+   d->dev_bytecnt = 0;
+   d->samples = 0;
+   d->bytecnt = 0;
+   d->ctrlcnt = 0;
+   d->status = DEC_RUNNING;
+   return true;
+}
+
+void dec_flush(sr_decoder_t *d)
+{
+   if (d->rcnt)
+   {
+      d->run(d->ctx, d->lval, d->rcnt, 0);
+      d->samples += d->rcnt;
+      d->rcnt = 0;
+   }
+}
+
+//Add cnt samples of val, merging them with the pending run if the value is the same
+static inline void dec_add(sr_decoder_t *d, uint32_t val, uint32_t cnt)
+{
+   if ((val != d->lval) || (d->rcnt > 0x7FFFFFFF))
+   {
+      dec_flush(d);
+      d->lval = val;
+   }
+   d->rcnt += cnt;
+   d->have_lval = true;
+}
+
+//Repeat the last value, which must exist
+static inline bool dec_rle(sr_decoder_t *d, uint32_t cnt)
+{
+   if (!d->have_lval)
+   {
+      return false;
+   }
+   d->rcnt += cnt;
+   return true;
+}
+
+//Handle the bytes that aren't sample data.  Returns false if decoding must stop.
+static bool dec_ctrl(sr_decoder_t *d, uint8_t b)
+{
+   d->ctrlcnt++;
+   if (d->in_trailer)
+   {
+      if ((b >= '0') && (b <= '9'))
+      {
+         d->dev_bytecnt = d->dev_bytecnt * 10 + (b - '0');
+         return true;
+      }
+      dec_flush(d);
+      d->status = (b == '+') ? DEC_DONE : DEC_ERROR;
+      return false;
+   }
+   if (b == '$')
+   {
+      d->in_trailer = true;
+      return true;
+   }
+   dec_flush(d);
+   d->status = (b == '!') ? DEC_ABORTED : DEC_ERROR;
+   return false;
+}
+
+//Width of the analog values in packed and delta blocks, the same as the device enc_a_bits
+static inline uint32_t dec_a_bits(sr_decoder_t *d)
+{
+   if (d->adc12)
+   {
+      return 12;
+   }
+   return d->binary ? 8 : 7;
+}
+
+//Take n bits from the block bit stream if they have arrived
+static inline bool dec_take(sr_decoder_t *d, uint32_t n, uint32_t *val)
+{
+   if (d->pk_bits < n)
+   {
+      return false;
+   }
+   *val = (uint32_t)d->pk_acc & ((n >= 32) ? 0xFFFFFFFF : (1u << n) - 1);
+   d->pk_acc >>= n;
+   d->pk_bits -= n;
+   return true;
+}
+
+//The last field of a block slice was decoded
+static void dec_slice(sr_decoder_t *d)
+{
+   if (d->a_chan_cnt)
+   {
+      d->run(d->ctx, d->cval, 1, d->aval);
+      d->samples++;
+   }
+   else
+   {
+      dec_add(d, d->cval, 1);
+   }
+   d->pk_field = (d->d_chan_cnt) ? 0 : 1;
+   d->pk_left--;
+}
+
+//Packed block slices are d_chan_cnt digital bits and dec_a_bits per analog channel
+static void dec_packed_fields(sr_decoder_t *d)
+{
+   uint32_t val;
+   while (d->pk_left &&
+          dec_take(d, (d->pk_field == 0) ? d->d_chan_cnt : dec_a_bits(d), &val))
+   {
+      if (d->pk_field == 0)
+      {
+         d->cval = val;
+      }
+      else
+      {
+         d->aval[d->pk_field - 1] = val;
+      }
+      if (++d->pk_field > d->a_chan_cnt)
+      {
+         dec_slice(d);
+      }
+   }
+}
+
+//Delta block slices are a digital changed flag and the digital bits if set, then for each
+//analog channel a 4 bit signed step, or the escape and the full value.  pk_sub is set while
+//waiting for the bits after a flag or escape.
+static void dec_delta_fields(sr_decoder_t *d)
+{
+   uint32_t val;
+   while (d->pk_left)
+   {
+      if (d->pk_sub)
+      {
+         if (!dec_take(d, (d->pk_field == 0) ? d->d_chan_cnt : dec_a_bits(d), &val))
+         {
+            return;
+         }
+         if (d->pk_field == 0)
+         {
+            d->cval = val;
+         }
+         else
+         {
+            d->aval[d->pk_field - 1] = val;
+         }
+         d->pk_sub = false;
+      }
+      else if (d->pk_field == 0)
+      {
+         if (!dec_take(d, 1, &val))
+         {
+            return;
+         }
+         if (val)
+         {
+            d->pk_sub = true;
+            continue;
+         }
+      }
+      else
+      {
+         if (!dec_take(d, 4, &val))
+         {
+            return;
+         }
+         if (val == DELTA_ESC)
+         {
+            d->pk_sub = true;
+            continue;
+         }
+         //Sign extend the 4 bit step
+         d->aval[d->pk_field - 1] += (int32_t)(val << 28) >> 28;
+      }
+      if (++d->pk_field > d->a_chan_cnt)
+      {
+         dec_slice(d);
+      }
+   }
+}
+
+//Packed and delta blocks:  '&' or '%', the sample count in three 7 bit bytes (lowest first),
+//then the slices as a bit stream in 7 bit bytes, or 8 bit bytes with escapes for binary framing.
+//Called with each byte after the '&' or '%' until the block ends.
+static bool dec_packed(sr_decoder_t *d, uint8_t b)
+{
+   if (d->pk_hdr)
+   {
+      if (!(b & 0x80))
+      {
+         return false;
+      }
+      d->pk_left |= (uint32_t)(b & 0x7F) << (7 * (3 - d->pk_hdr));
+      d->pk_hdr--;
+      return true;
+   }
+   if (d->binary)
+   {
+      if (d->pk_esc)
+      {
+         b ^= 0x20;
+         d->pk_esc = false;
+      }
+      else if (b == BIN_ESC)
+      {
+         d->pk_esc = true;
+         return true;
+      }
+      d->pk_acc |= (uint64_t)b << d->pk_bits;
+      d->pk_bits += 8;
+   }
+   else
+   {
+      if (!(b & 0x80))
+      {
+         return false;
+      }
+      d->pk_acc |= (uint64_t)(b & 0x7F) << d->pk_bits;
+      d->pk_bits += 7;
+   }
+   if (d->pk_delta)
+   {
+      dec_delta_fields(d);
+   }
+   else
+   {
+      dec_packed_fields(d);
+   }
+   //The zero fill at the end of the block is dropped, and the normal encodings build cval up
+   //from 0
+   if (d->pk_left == 0)
+   {
+      d->pk_acc = 0;
+      d->pk_bits = 0;
+      d->cval = 0;
+   }
+   return true;
+}
+
+//Gap, hold and frame markers:  GAP_MARK, HOLD_MARK or FRAME_MARK and a count in four 7 bit
+//bytes (lowest first).  Gaps are only sent between segments, so any pending run ends before
+//the gap.  Holds repeat the last value.  Frame markers start each frame of an 'N' segmented
+//capture, and their count is the frame index.
+static bool dec_gap(sr_decoder_t *d, uint8_t b)
+{
+   if (!d->gap_hdr)
+   {
+      d->gap_hdr = 4;
+      d->gap_cnt = 0;
+      d->gap_hold = (b == HOLD_MARK);
+      d->gap_frame = (b == FRAME_MARK);
+      return true;
+   }
+   if (!(b & 0x80))
+   {
+      d->status = DEC_ERROR;
+      return false;
+   }
+   d->gap_cnt |= (uint32_t)(b & 0x7F) << (7 * (4 - d->gap_hdr));
+   if ((--d->gap_hdr == 0) && d->gap_hold)
+   {
+      //Keep the pending run within the range dec_add allows
+      if (d->rcnt > 0x7FFFFFFF)
+      {
+         dec_flush(d);
+      }
+      if (!dec_rle(d, d->gap_cnt))
+      {
+         d->status = DEC_ERROR;
+         return false;
+      }
+   }
+   else if ((d->gap_hdr == 0) && d->gap_frame)
+   {
+      dec_flush(d);
+      d->frames++;
+   }
+   else if (d->gap_hdr == 0)
+   {
+      dec_flush(d);
+      d->gaps++;
+      d->gap_samples += d->gap_cnt;
+      if (d->gap)
+      {
+         d->gap(d->ctx, d->gap_cnt);
+      }
+   }
+   return true;
+}
+
+//True if b starts a gap, hold or frame marker
+static inline bool dec_is_mark(uint8_t b)
+{
+   return (b == GAP_MARK) || (b == HOLD_MARK) || (b == FRAME_MARK);
+}
+
+//True if b is part of a block or a gap, hold or frame marker, or starts one
+static inline bool dec_in_block(sr_decoder_t *d, uint8_t b)
+{
+   return d->pk_hdr || d->pk_left || d->gap_hdr ||
+          (((b == '&') || (b == '%') || dec_is_mark(b)) && !d->in_trailer);
+}
+
+//Handle a byte while in a packed or delta block or a gap, hold or frame marker, or their
+//start.  Returns false if decoding must stop, with the status set.
+static bool dec_block(sr_decoder_t *d, uint8_t b)
+{
+   if (d->gap_hdr || (!d->pk_hdr && !d->pk_left && dec_is_mark(b)))
+   {
+      return dec_gap(d, b);
+   }
+   if (!d->pk_hdr && !d->pk_left)
+   {
+      d->pk_hdr = 3;
+      d->pk_left = 0;
+      d->pk_field = (d->d_chan_cnt) ? 0 : 1;
+      d->pk_esc = false;
+      d->pk_delta = (b == '%');
+      d->pk_sub = false;
+      return true;
+   }
+   //With binary framing an unescaped '!' or '$' ends the block early
+   if (d->binary && d->pk_left && !d->pk_esc && ((b == '!') || (b == '$')))
+   {
+      d->pk_left = 0;
+      return dec_ctrl(d, b);
+   }
+   if (!dec_packed(d, b))
+   {
+      d->status = DEC_ERROR;
+      return false;
+   }
+   return true;
+}
+
+//D4 mode:  0x80-0xFF are a 0-7 rle of the last value followed by a new value in bits 3:0,
+//and 48-127 are rles of 8 to 640 in steps of 8.
+static size_t dec_feed_d4(sr_decoder_t *d, const uint8_t *buf, size_t n)
+{
+   size_t i;
+   for (i = 0; i < n; i++)
+   {
+      uint8_t b = buf[i];
+      if (dec_in_block(d, b))
+      {
+         if (!dec_block(d, b))
+         {
+            return (d->status == DEC_ERROR) ? i : i + 1;
+         }
+      }
+      else if ((b & 0x80) && !d->in_trailer)
+      {
+         uint32_t rle = (b >> 4) & 0x7;
+         if (rle && !dec_rle(d, rle))
+         {
+            d->status = DEC_ERROR;
+            return i;
+         }
+         dec_add(d, b & 0xF, 1);
+      }
+      else if ((b >= 48) && !d->in_trailer)
+      {
+         if (!dec_rle(d, (b - 47) * 8))
+         {
+            d->status = DEC_ERROR;
+            return i;
+         }
+      }
+      else if (!dec_ctrl(d, b))
+      {
+         return i + 1;
+      }
+   }
+   return i;
+}
+
+//5 or more digital channels:  0x80-0xFF are 7 bit pieces of a value, lowest first,
+//48-79 are rles of 1 to 32, and 80-127 are rles of (N-78)*32.
+static size_t dec_feed_dig(sr_decoder_t *d, const uint8_t *buf, size_t n)
+{
+   size_t i;
+   for (i = 0; i < n; i++)
+   {
+      uint8_t b = buf[i];
+      if (dec_in_block(d, b))
+      {
+         if (!dec_block(d, b))
+         {
+            return (d->status == DEC_ERROR) ? i : i + 1;
+         }
+      }
+      else if ((b & 0x80) && !d->in_trailer)
+      {
+         d->cval |= (uint32_t)(b & 0x7F) << (7 * d->slice_pos);
+         if (++d->slice_pos == d->d_tx_bps)
+         {
+            dec_add(d, d->cval, 1);
+            d->cval = 0;
+            d->slice_pos = 0;
+         }
+      }
+      else if ((b >= 48) && !d->in_trailer)
+      {
+         uint32_t cnt = (b < 80) ? b - 47 : (b - 78) * 32;
+         if (d->slice_pos || !dec_rle(d, cnt))
+         {
+            d->status = DEC_ERROR;
+            return i;
+         }
+      }
+      else if (!dec_ctrl(d, b))
+      {
+         return i + 1;
+      }
+   }
+   return i;
+}
+
+//Any analog channels:  each slice is the digital bytes followed by one byte per analog
+//channel, all 0x80-0xFF, and there is no rle.  With binary framing the slices are sent in
+//packed blocks instead.
+static size_t dec_feed_analog(sr_decoder_t *d, const uint8_t *buf, size_t n)
+{
+   size_t i;
+   uint32_t dbytes = (d->d_chan_cnt) ? d->d_tx_bps : 0;
+   for (i = 0; i < n; i++)
+   {
+      uint8_t b = buf[i];
+      if (dec_in_block(d, b))
+      {
+         if (!dec_block(d, b))
+         {
+            return (d->status == DEC_ERROR) ? i : i + 1;
+         }
+      }
+      else if ((b & 0x80) && !d->in_trailer)
+      {
+         if (d->slice_pos < dbytes)
+         {
+            d->cval |= (uint32_t)(b & 0x7F) << (7 * d->slice_pos);
+         }
+         else
+         {
+            d->aval[d->slice_pos - dbytes] = b & 0x7F;
+         }
+         if (++d->slice_pos == dbytes + d->a_chan_cnt)
+         {
+            d->run(d->ctx, d->cval, 1, d->aval);
+            d->samples++;
+            d->cval = 0;
+            d->slice_pos = 0;
+         }
+      }
+      else if (!dec_ctrl(d, b))
+      {
+         return i + 1;
+      }
+   }
+   return i;
+}
+
+size_t dec_feed(sr_decoder_t *d, const uint8_t *buf, size_t n)
+{
+   size_t used;
+   uint64_t ctrlcnt = d->ctrlcnt;
+   if (d->status != DEC_RUNNING)
+   {
+      return 0;
+   }
+   if (d->a_chan_cnt)
+   {
+      used = dec_feed_analog(d, buf, n);
+   }
+   else if (d->d4)
+   {
+      used = dec_feed_d4(d, buf, n);
+   }
+   else
+   {
+      used = dec_feed_dig(d, buf, n);
+   }
+   //The trailer and abort aren't counted by the device
+   d->bytecnt += used - (d->ctrlcnt - ctrlcnt);
+   return used;
+}
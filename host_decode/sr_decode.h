@@ -0,0 +1,89 @@
+#ifndef SR_DECODE_H
+#define SR_DECODE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//Host side decoder for the sample data sent by the device, see SerialProtocol.md.
+//Bytes can be fed in pieces of any size and the decoded samples are passed to a callback
+//as runs of a repeated digital value, so long RLE runs cost nothing to decode.
+//Digital only captures can also contain the '&' packed blocks sent when the 'E' command
+//enables adaptive encoding, and captures with analog channels can contain '%' delta blocks
+//after 'E2'.  With binary framing or the 12 bit ADC mode, captures with analog
+//channels only use packed blocks, where aval has the full 8 or 12 bit analog values.
+//With analog channels enabled there is no RLE and each slice is a run of 1 along with
+//its analog values.
+//Captures in the 'O1' lossy continuous mode can contain gap markers for samples the device
+//dropped, which are passed to the optional gap callback.  Event captures from the 'x1'
+//command can contain hold markers, which are long rles of the last value.  'N' segmented
+//captures send a frame marker before each frame, after a gap for the samples between frames.
+
+// dval is the digital value, count the number of samples it repeats, and aval the 7, 8 or 12 bit
+// analog values (NULL without analog channels)
+typedef void (*sr_run_fn)(void *ctx, uint32_t dval, uint32_t count, const uint16_t *aval);
+
+// count samples were dropped by the device at this point
+typedef void (*sr_gap_fn)(void *ctx, uint32_t count);
+
+typedef enum
+{
+   DEC_RUNNING = 0,
+   DEC_DONE,    // "$<bytecnt>+" end of capture seen
+   DEC_ABORTED, // '!' device abort seen
+   DEC_ERROR    // a byte that isn't valid for the channel configuration
+} dec_status;
+
+#define DEC_MAX_A_CHAN 8
+
+typedef struct
+{
+   uint32_t d_chan_cnt, a_chan_cnt;
+   uint32_t d_tx_bps; // 7 bit bytes per digital value
+   bool d4;           // 1-4 digital channels and no analog use the D4 RLE encoding
+   sr_run_fn run;
+   void *ctx;
+   uint32_t slice_pos; // byte position in the current slice
+   uint32_t cval;      // digital value being assembled
+   uint16_t aval[DEC_MAX_A_CHAN];
+   uint32_t lval;      // value of the pending run
+   uint32_t rcnt;      // length of the pending run, 0 if none
+   bool have_lval;     // a sample has been seen so RLEs have something to repeat
+   bool in_trailer;    // in the "$<bytecnt>+"
+   uint32_t pk_hdr;    // count bytes left in a packed block header
+   uint32_t pk_left;   // samples left in a packed block
+   uint64_t pk_acc;    // packed bits not yet used
+   uint32_t pk_bits;   // number of bits in pk_acc
+   uint32_t pk_field;  // slice field being unpacked, 0 is digital and 1.. are analog
+   bool pk_esc;        // the last byte was the binary framing escape
+   bool pk_delta;      // the block is a '%' delta block
+   bool pk_sub;        // a delta block flag or escape was seen, the full value is next
+   bool binary;        // set after dec_init if the capture used 'B1' binary framing
+   bool adc12;         // set after dec_init if the capture used the 'H1' 12 bit ADC mode
+   sr_gap_fn gap;      // set after dec_init to be told of gaps, with the same ctx as run
+   uint32_t gap_hdr;   // count bytes left in a gap, hold or frame marker
+   bool gap_hold;      // the marker is a hold marker
+   bool gap_frame;     // the marker is a frame marker
+   uint32_t gap_cnt;   // samples in the gap marker being read
+   uint32_t gaps;      // gap markers seen
+   uint64_t gap_samples; // samples dropped by the device, or between frames
+   uint32_t frames;    // frame markers seen
+   uint32_t dev_bytecnt; // byte count sent by the device in the trailer
+   uint64_t samples;   // samples decoded
+   uint64_t bytecnt;   // sample data bytes seen, should match dev_bytecnt
+   uint64_t ctrlcnt;   // abort and trailer bytes seen
+   dec_status status;
+} sr_decoder_t;
+
+// Setup a decoder for the enabled channel counts.  The first d_chan_cnt digital channels
+// must be the enabled ones, as the device packs them from the lowest channel up.
+// Returns false if the counts aren't supported.
+bool dec_init(sr_decoder_t *d, uint32_t d_chan_cnt, uint32_t a_chan_cnt, sr_run_fn run, void *ctx);
+
+// Decode n bytes.  Returns the number of bytes used, which is less than n only if the end
+// of the capture, an abort or an error is seen.
+size_t dec_feed(sr_decoder_t *d, const uint8_t *buf, size_t n);
+
+// Pass any pending run to the callback, i.e. at the end of the input
+void dec_flush(sr_decoder_t *d);
+
+#endif /* SR_DECODE_H */
@@ -0,0 +1,371 @@
+#include "sr_output.h"
+#include <stdlib.h>
+#include <string.h>
+
+//Standard zip/gzip CRC32
+static uint32_t crc_table[256];
+
+static void crc_init(void)
+{
+   for (uint32_t i = 0; i < 256; i++)
+   {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++)
+      {
+         c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      }
+      crc_table[i] = c;
+   }
+}
+
+static uint32_t crc32_buf(const uint8_t *buf, size_t n)
+{
+   uint32_t c = 0xFFFFFFFF;
+   for (size_t i = 0; i < n; i++)
+   {
+      c = crc_table[(c ^ buf[i]) & 0xFF] ^ (c >> 8);
+   }
+   return c ^ 0xFFFFFFFF;
+}
+
+static void put16(uint8_t *p, uint32_t v)
+{
+   p[0] = v;
+   p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+   put16(p, v);
+   put16(p + 2, v >> 16);
+}
+
+static void out_write(sr_out_t *o, const void *buf, size_t n)
+{
+   if (fwrite(buf, 1, n, o->f) != n)
+   {
+      o->err = true;
+   }
+   o->offset += n;
+}
+
+//Add one uncompressed file to the zip.  Zip64 isn't supported so the .sr is limited to 4GB.
+static void zip_add(sr_out_t *o, const char *name, const void *data, uint32_t size)
+{
+   uint8_t hdr[30];
+   out_zip_ent_t *e;
+   uint32_t nlen = strlen(name);
+   if (o->ent_cnt == o->ent_max)
+   {
+      o->ent_max = (o->ent_max) ? o->ent_max * 2 : 64;
+      o->ent = realloc(o->ent, o->ent_max * sizeof(out_zip_ent_t));
+      if (!o->ent)
+      {
+         o->err = true;
+         o->ent_cnt = o->ent_max = 0;
+         return;
+      }
+   }
+   e = &(o->ent[o->ent_cnt++]);
+   snprintf(e->name, sizeof(e->name), "%s", name);
+   e->crc = crc32_buf(data, size);
+   e->size = size;
+   e->offset = o->offset;
+   memset(hdr, 0, sizeof(hdr));
+   put32(hdr, 0x04034b50);
+   put16(hdr + 4, 10); // version needed
+   put32(hdr + 14, e->crc);
+   put32(hdr + 18, size);
+   put32(hdr + 22, size);
+   put16(hdr + 26, nlen);
+   out_write(o, hdr, sizeof(hdr));
+   out_write(o, name, nlen);
+   out_write(o, data, size);
+}
+
+static void zip_end(sr_out_t *o)
+{
+   uint8_t hdr[46];
+   uint32_t dir_start = o->offset;
+   for (uint32_t i = 0; i < o->ent_cnt; i++)
+   {
+      out_zip_ent_t *e = &(o->ent[i]);
+      uint32_t nlen = strlen(e->name);
+      memset(hdr, 0, sizeof(hdr));
+      put32(hdr, 0x02014b50);
+      put16(hdr + 4, 10); // version made by
+      put16(hdr + 6, 10); // version needed
+      put32(hdr + 16, e->crc);
+      put32(hdr + 20, e->size);
+      put32(hdr + 24, e->size);
+      put16(hdr + 28, nlen);
+      put32(hdr + 42, e->offset);
+      out_write(o, hdr, sizeof(hdr));
+      out_write(o, e->name, nlen);
+   }
+   memset(hdr, 0, 22);
+   put32(hdr, 0x06054b50);
+   put16(hdr + 8, o->ent_cnt);
+   put16(hdr + 10, o->ent_cnt);
+   put32(hdr + 12, o->offset - dir_start);
+   put32(hdr + 16, dir_start);
+   out_write(o, hdr, 22);
+}
+
+//Same format as the sigrok samplerate strings
+static void rate_str(char *s, size_t n, uint32_t rate)
+{
+   if ((rate % 1000000) == 0)
+   {
+      snprintf(s, n, "%u MHz", rate / 1000000);
+   }
+   else if ((rate % 1000) == 0)
+   {
+      snprintf(s, n, "%u kHz", rate / 1000);
+   }
+   else
+   {
+      snprintf(s, n, "%u Hz", rate);
+   }
+}
+
+static void srzip_start(sr_out_t *o)
+{
+   char meta[4096];
+   char rate[32];
+   int len;
+   zip_add(o, "version", "2", 1);
+   rate_str(rate, sizeof(rate), o->rate);
+   len = snprintf(meta, sizeof(meta), "[global]\nsigrok version=0.5.2\n\n[device 1]\n");
+   if (o->d_chan_cnt)
+   {
+      len += snprintf(meta + len, sizeof(meta) - len, "capturefile=logic-1\ntotal probes=%u\n",
+                      o->d_chan_cnt);
+   }
+   len += snprintf(meta + len, sizeof(meta) - len, "samplerate=%s\ntotal analog=%u\n", rate,
+                   o->a_chan_cnt);
+   for (uint32_t i = 0; i < o->d_chan_cnt; i++)
+   {
+      len += snprintf(meta + len, sizeof(meta) - len, "probe%u=D%u\n", i + 1, i);
+   }
+   //Analog channels are numbered after the logic channels
+   for (uint32_t i = 0; i < o->a_chan_cnt; i++)
+   {
+      len += snprintf(meta + len, sizeof(meta) - len, "analog%u=A%u\n", o->d_chan_cnt + i + 1, i);
+   }
+   if (o->d_chan_cnt)
+   {
+      len += snprintf(meta + len, sizeof(meta) - len, "unitsize=%u\n", o->unitsize);
+   }
+   zip_add(o, "metadata", meta, len);
+}
+
+static void srzip_chunk(sr_out_t *o)
+{
+   char name[32];
+   if (o->chunk_cnt == 0)
+   {
+      return;
+   }
+   o->chunk_num++;
+   if (o->d_chan_cnt)
+   {
+      snprintf(name, sizeof(name), "logic-1-%u", o->chunk_num);
+      zip_add(o, name, o->lbuf, o->chunk_cnt * o->unitsize);
+   }
+   for (uint32_t i = 0; i < o->a_chan_cnt; i++)
+   {
+      snprintf(name, sizeof(name), "analog-1-%u-%u", o->d_chan_cnt + i + 1, o->chunk_num);
+      zip_add(o, name, &(o->abuf[i * OUT_CHUNK_SAMPLES]), o->chunk_cnt * sizeof(float));
+   }
+   o->chunk_cnt = 0;
+}
+
+bool out_open(sr_out_t *o, const char *path, out_type type, uint32_t d_chan_cnt,
+              uint32_t a_chan_cnt, uint32_t rate, double ascale, double aoffset)
+{
+   memset(o, 0, sizeof(*o));
+   o->type = type;
+   o->d_chan_cnt = d_chan_cnt;
+   o->a_chan_cnt = a_chan_cnt;
+   o->rate = rate;
+   o->ascale = ascale;
+   o->aoffset = aoffset;
+   o->unitsize = (d_chan_cnt > 16) ? 4 : (d_chan_cnt > 8) ? 2 : 1;
+   o->f = fopen(path, "wb");
+   if (!o->f)
+   {
+      return false;
+   }
+   setvbuf(o->f, 0, _IOFBF, 1 << 20);
+   if (type == OUT_VCD)
+   {
+      fprintf(o->f, "$comment sigrok-pico capture $end\n$timescale 1 ns $end\n$scope module pico $end\n");
+      //Identifiers are single printable characters starting at '!'
+      for (uint32_t i = 0; i < d_chan_cnt; i++)
+      {
+         fprintf(o->f, "$var wire 1 %c D%u $end\n", '!' + i, i);
+      }
+      for (uint32_t i = 0; i < a_chan_cnt; i++)
+      {
+         fprintf(o->f, "$var real 64 %c A%u $end\n", '!' + d_chan_cnt + i, i);
+      }
+      fprintf(o->f, "$upscope $end\n$enddefinitions $end\n");
+      return true;
+   }
+   crc_init();
+   o->lbuf = malloc((size_t)OUT_CHUNK_SAMPLES * o->unitsize);
+   o->abuf = malloc((size_t)OUT_CHUNK_SAMPLES * sizeof(float) * (a_chan_cnt ? a_chan_cnt : 1));
+   if (!o->lbuf || !o->abuf)
+   {
+      fclose(o->f);
+      return false;
+   }
+   srzip_start(o);
+   return true;
+}
+
+static void vcd_run(sr_out_t *o, uint32_t dval, const uint16_t *aval)
+{
+   uint32_t chg = o->have_last ? (dval ^ o->last_dval) : 0xFFFFFFFF;
+   bool achg = false;
+   for (uint32_t i = 0; i < o->a_chan_cnt; i++)
+   {
+      achg |= !o->have_last || (aval[i] != o->last_aval[i]);
+   }
+   if (o->d_chan_cnt < 32)
+   {
+      chg &= (1u << o->d_chan_cnt) - 1;
+   }
+   if (!chg && !achg)
+   {
+      return;
+   }
+   //ns time stamps, split to avoid overflow on long captures
+   fprintf(o->f, "#%llu\n", (unsigned long long)((o->idx / o->rate) * 1000000000ULL
+                                                 + (o->idx % o->rate) * 1000000000ULL / o->rate));
+   for (uint32_t i = 0; chg; i++, chg >>= 1)
+   {
+      if (chg & 1)
+      {
+         putc((dval >> i) & 1 ? '1' : '0', o->f);
+         putc('!' + i, o->f);
+         putc('\n', o->f);
+      }
+   }
+   for (uint32_t i = 0; i < o->a_chan_cnt; i++)
+   {
+      if (!o->have_last || (aval[i] != o->last_aval[i]))
+      {
+         fprintf(o->f, "r%.6g %c\n", aval[i] * o->ascale + o->aoffset, '!' + o->d_chan_cnt + i);
+      }
+      o->last_aval[i] = aval[i];
+   }
+   o->last_dval = dval;
+   o->have_last = true;
+}
+
+static void srzip_run(sr_out_t *o, uint32_t dval, uint32_t count, const uint16_t *aval)
+{
+   while (count)
+   {
+      uint32_t n = OUT_CHUNK_SAMPLES - o->chunk_cnt;
+      if (n > count)
+      {
+         n = count;
+      }
+      if (o->d_chan_cnt)
+      {
+         uint8_t *p = &(o->lbuf[o->chunk_cnt * o->unitsize]);
+         if (o->unitsize == 1)
+         {
+            memset(p, dval, n);
+         }
+         else
+         {
+            for (uint32_t i = 0; i < n; i++, p += o->unitsize)
+            {
+               memcpy(p, &dval, o->unitsize); // little endian host
+            }
+         }
+      }
+      for (uint32_t i = 0; i < o->a_chan_cnt; i++)
+      {
+         float v = aval[i] * o->ascale + o->aoffset;
+         for (uint32_t j = 0; j < n; j++)
+         {
+            o->abuf[i * OUT_CHUNK_SAMPLES + o->chunk_cnt + j] = v;
+         }
+      }
+      o->chunk_cnt += n;
+      count -= n;
+      if (o->chunk_cnt == OUT_CHUNK_SAMPLES)
+      {
+         srzip_chunk(o);
+      }
+   }
+}
+
+void out_run(void *ctx, uint32_t dval, uint32_t count, const uint16_t *aval)
+{
+   sr_out_t *o = ctx;
+   static const uint16_t no_analog[DEC_MAX_A_CHAN];
+   if (!aval)
+   {
+      aval = no_analog;
+   }
+   if (o->type == OUT_VCD)
+   {
+      vcd_run(o, dval, aval);
+   }
+   else
+   {
+      srzip_run(o, dval, count, aval);
+      o->last_dval = dval;
+      memcpy(o->last_aval, aval, sizeof(o->last_aval));
+   }
+   o->idx += count;
+}
+
+void out_gap(void *ctx, uint32_t count)
+{
+   sr_out_t *o = ctx;
+   if (o->type == OUT_VCD)
+   {
+      fprintf(o->f, "#%llu\n", (unsigned long long)((o->idx / o->rate) * 1000000000ULL
+                                                    + (o->idx % o->rate) * 1000000000ULL / o->rate));
+      for (uint32_t i = 0; i < o->d_chan_cnt; i++)
+      {
+         fprintf(o->f, "x%c\n", '!' + i);
+      }
+      //Send every value again after the gap
+      o->have_last = false;
+   }
+   else
+   {
+      srzip_run(o, o->last_dval, count, o->last_aval);
+   }
+   o->idx += count;
+}
+
+bool out_close(sr_out_t *o)
+{
+   bool ok;
+   if (o->type == OUT_VCD)
+   {
+      //Mark the end time so the last value has a length
+      fprintf(o->f, "#%llu\n", (unsigned long long)((o->idx / o->rate) * 1000000000ULL
+                                                    + (o->idx % o->rate) * 1000000000ULL / o->rate));
+   }
+   else
+   {
+      srzip_chunk(o);
+      zip_end(o);
+   }
+   ok = !o->err && !ferror(o->f);
+   ok &= (fclose(o->f) == 0);
+   free(o->lbuf);
+   free(o->abuf);
+   free(o->ent);
+   return ok;
+}
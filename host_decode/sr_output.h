@@ -0,0 +1,67 @@
+#ifndef SR_OUTPUT_H
+#define SR_OUTPUT_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "sr_decode.h"
+
+//Streaming writers for decoded samples, used as the sr_decode run callback.
+//VCD only writes the changes, and the sigrok .sr session (a zip of the metadata and
+//chunks of packed samples) only holds one chunk in memory, so memory use is bounded
+//no matter how long the capture is.
+
+typedef enum
+{
+   OUT_VCD = 0,
+   OUT_SRZIP
+} out_type;
+
+// Samples per .sr chunk, the same size that sigrok uses
+#define OUT_CHUNK_SAMPLES (4 * 1024 * 1024)
+
+typedef struct
+{
+   char name[32];
+   uint32_t crc, size, offset;
+} out_zip_ent_t;
+
+typedef struct
+{
+   FILE *f;
+   out_type type;
+   uint32_t d_chan_cnt, a_chan_cnt;
+   uint32_t rate;
+   double ascale, aoffset; // analog volts are code*ascale+aoffset
+   uint64_t idx;           // samples written
+   // VCD
+   uint32_t last_dval;
+   uint16_t last_aval[DEC_MAX_A_CHAN];
+   bool have_last;
+   // .sr
+   uint32_t unitsize;   // bytes per packed logic sample
+   uint8_t *lbuf;       // logic samples of the current chunk
+   float *abuf;         // analog samples of the current chunk, one block per channel
+   uint32_t chunk_cnt;  // samples in the current chunk
+   uint32_t chunk_num;  // chunks written
+   out_zip_ent_t *ent;  // zip directory entries written so far
+   uint32_t ent_cnt, ent_max;
+   uint32_t offset;     // bytes written to the zip
+   bool err;
+} sr_out_t;
+
+// Create the output file.  Returns false if it can't be created.
+bool out_open(sr_out_t *o, const char *path, out_type type, uint32_t d_chan_cnt,
+              uint32_t a_chan_cnt, uint32_t rate, double ascale, double aoffset);
+
+// Write count samples, with the same arguments as sr_run_fn
+void out_run(void *ctx, uint32_t dval, uint32_t count, const uint16_t *aval);
+
+// Skip count samples dropped by the device, with the same arguments as sr_gap_fn.  VCD marks
+// the digital channels unknown for the gap, and .sr repeats the last values since it can't
+// hold a gap.
+void out_gap(void *ctx, uint32_t count);
+
+// Write anything pending and close the file.  Returns false if any write failed.
+bool out_close(sr_out_t *o);
+
+#endif /* SR_OUTPUT_H */
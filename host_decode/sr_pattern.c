@@ -0,0 +1,60 @@
+#include "sr_pattern.h"
+
+const char *const pat_names[PAT_COUNT] = {"idle", "1%", "20%", "100%", "counter", "random"};
+
+static uint32_t pat_rnd(uint32_t *rs)
+{
+   *rs = *rs * 1103515245u + 12345u;
+   return *rs >> 1;
+}
+
+//The k-th set bit of mask, counting from 0
+static uint32_t pat_bit(uint32_t mask, uint32_t k)
+{
+   while (k--)
+   {
+      mask &= mask - 1;
+   }
+   return mask & -mask;
+}
+
+//Sample i of a pattern, continuing from the last value v
+static uint32_t pat_next(int pat, uint32_t v, uint32_t i, uint32_t mask, uint32_t *rs)
+{
+   uint32_t chans = __builtin_popcount(mask);
+   switch (pat)
+   {
+   case PAT_1PCT: if (chans && ((pat_rnd(rs) % 100) == 0)) v ^= pat_bit(mask, pat_rnd(rs) % chans); break;
+   case PAT_20PCT: if (chans && ((pat_rnd(rs) % 5) == 0)) v ^= pat_bit(mask, pat_rnd(rs) % chans); break;
+   case PAT_FULL: v = v + 1 + (pat_rnd(rs) % 3); break;
+   case PAT_COUNTER: v = i; break;
+   case PAT_RANDOM: v = pat_rnd(rs) ^ (pat_rnd(rs) << 16); break;
+   }
+   return v & mask;
+}
+
+void pat_fill(uint8_t *buf, uint32_t n, uint8_t bps, uint32_t mask, int pat, uint32_t seed)
+{
+   uint32_t v = 0x5 & mask;
+   uint32_t rs = seed;
+   for (uint32_t i = 0; i < n; i++)
+   {
+      v = pat_next(pat, v, i, mask, &rs);
+      if (bps == 0)
+      {
+         buf[i >> 1] = (i & 1) ? ((buf[i >> 1] & 0xF) | (v << 4)) : ((buf[i >> 1] & 0xF0) | v);
+      }
+      else if (bps == 1)
+      {
+         buf[i] = v;
+      }
+      else if (bps == 2)
+      {
+         ((uint16_t *)buf)[i] = v;
+      }
+      else
+      {
+         ((uint32_t *)buf)[i] = v;
+      }
+   }
+}
@@ -0,0 +1,23 @@
+#ifndef SR_PATTERN_H
+#define SR_PATTERN_H
+#include <stdint.h>
+
+//Synthetic sample patterns for srbench and the host tests.  The 1% and 20% patterns change
+//one of the channels in the mask on that share of the samples, so their activity doesn't
+//depend on how many channels are enabled.
+
+#define PAT_IDLE 0    // no changes
+#define PAT_1PCT 1    // one channel changes on 1% of the samples
+#define PAT_20PCT 2   // one channel changes on 20% of the samples
+#define PAT_FULL 3    // every sample changes
+#define PAT_COUNTER 4 // the sample index
+#define PAT_RANDOM 5  // random values
+#define PAT_COUNT 6
+
+extern const char *const pat_names[PAT_COUNT];
+
+// Fill n samples of pattern pat on the channels of mask, stored as bps bytes each with 0 for
+// two 4 bit samples per byte.  The same seed gives the same samples.
+void pat_fill(uint8_t *buf, uint32_t n, uint8_t bps, uint32_t mask, int pat, uint32_t seed);
+
+#endif /* SR_PATTERN_H */
@@ -0,0 +1,53 @@
+#include "sr_stats.h"
+
+#include <stdlib.h>
+
+bool stats_parse(const char *rsp, sr_stats_t *st)
+{
+   uint32_t v[STATS_FIELDS];
+   const char *p = rsp;
+   char *end;
+   for (int i = 0; i < STATS_FIELDS; i++)
+   {
+      if ((*p < '0') || (*p > '9'))
+      {
+         return false;
+      }
+      unsigned long n = strtoul(p, &end, 10);
+      if ((n > 0xFFFFFFFFul) || (*end != ((i < STATS_FIELDS - 1) ? 'x' : 0)))
+      {
+         return false;
+      }
+      v[i] = (uint32_t)n;
+      p = end + 1;
+   }
+   st->bytes = v[0];
+   st->segs = v[1];
+   st->headroom = v[2];
+   st->enc_us = v[3];
+   st->usb_us = v[4];
+   st->stalls = v[5];
+   st->peak_us = v[6];
+   return true;
+}
+
+stats_limit stats_limit_of(const sr_stats_t *st)
+{
+   if (st->headroom)
+   {
+      return LIMIT_NONE;
+   }
+   return (st->usb_us > st->enc_us) ? LIMIT_USB : LIMIT_ENCODE;
+}
+
+void stats_print(FILE *f, const sr_stats_t *st)
+{
+   static const char *limits[] = {"none", "USB", "encoding"};
+   uint32_t segs = st->segs ? st->segs : 1;
+   fprintf(f, "bytes %u segments %u (%u bytes each)\n", st->bytes, st->segs, st->bytes / segs);
+   fprintf(f, "min free segments %u\n", st->headroom);
+   fprintf(f, "encode %u us (%u per segment) usb wait %u us (%u per segment)\n", st->enc_us,
+           st->enc_us / segs, st->usb_us, st->usb_us / segs);
+   fprintf(f, "usb stalls %u peak segment %u us\n", st->stalls, st->peak_us);
+   fprintf(f, "limited by %s\n", limits[stats_limit_of(st)]);
+}
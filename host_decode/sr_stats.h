@@ -0,0 +1,40 @@
+#ifndef SR_STATS_H
+#define SR_STATS_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+//Parser for the reply to the device's 's' stats command, which reports how the last
+//capture kept up, see SerialProtocol.md.  The fields are the same as the device's sr_stats_t.
+
+#define STATS_FIELDS 7
+
+typedef struct
+{
+   uint32_t bytes;    // encoded bytes sent
+   uint32_t segs;     // DMA segments sent
+   uint32_t headroom; // fewest free segments left in the DMA ring when a segment was sent
+   uint32_t enc_us;   // time in the encoders, less the USB waits
+   uint32_t usb_us;   // time waiting for room in the USB fifo and flushing it
+   uint32_t stalls;   // writes that found the USB fifo full
+   uint32_t peak_us;  // longest time to encode and send one segment
+} sr_stats_t;
+
+typedef enum
+{
+   LIMIT_NONE = 0, // the ring always had a free segment
+   LIMIT_USB,      // the ring filled while mostly waiting on USB
+   LIMIT_ENCODE    // the ring filled while mostly encoding
+} stats_limit;
+
+// Parse a reply of the form "bytesxsegsxheadroomxenc_usxusb_usxstallsxpeak_us".
+// Returns false if it doesn't have exactly STATS_FIELDS decimal fields.
+bool stats_parse(const char *rsp, sr_stats_t *st);
+
+// What kept the ring from draining, if anything
+stats_limit stats_limit_of(const sr_stats_t *st);
+
+// Print the fields and the per segment averages
+void stats_print(FILE *f, const sr_stats_t *st);
+
+#endif /* SR_STATS_H */
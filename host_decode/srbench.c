@@ -0,0 +1,130 @@
+//Throughput benchmark of the firmware's send_slices_* encoders, compiled for the host.
+//Synthetic segments of each activity pattern are encoded into a sink that only counts the
+//bytes, and the wire bytes per sample and the samples encoded per second are printed.  The
+//host is much faster than the PICO, so the rates are for comparing encoders and changes
+//to them rather than for predicting the device's limits.  The bytes per sample don't depend
+//on the host, so they are checked against a limit and the exit status is 1 if any is over.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sr_device.h"
+#include "sr_encode.h"
+#include "sr_pattern.h"
+
+#define BENCH_SAMPLES 16384
+
+typedef enum
+{
+   ENC_D4 = 0,
+   ENC_1B,
+   ENC_2B,
+   ENC_4B,
+   ENC_ANALOG,
+   ENC_PACKED,
+   ENC_DELTA_A,
+   ENC_COUNT
+} bench_enc;
+
+static const char *enc_names[ENC_COUNT] = {"D4", "1B", "2B", "4B", "analog", "packed", "delta"};
+static const uint32_t enc_d_mask[ENC_COUNT] = {0xF, 0xFF, 0xFFFF, 0xFFFFFFFF, 0xFF, 0xFF, 0xFF};
+
+//Most wire bytes per sample for each encoder and pattern, a few percent over what they took
+//when the table was made, so ctest fails when a change makes an encoder less compact
+static const double enc_limit[ENC_COUNT][PAT_COUNT] = {
+   {0.005, 0.025, 0.24, 1.01, 1.01, 1.01},
+   {0.005, 0.045, 0.58, 2.01, 2.01, 2.01},
+   {0.005, 0.055, 0.78, 3.01, 3.01, 3.01},
+   {0.005, 0.075, 1.19, 5.01, 5.01, 5.01},
+   {5.01, 5.01, 5.01, 5.01, 5.01, 5.01},
+   {1.15, 1.15, 1.15, 1.15, 1.15, 1.15},
+   {1.92, 1.97, 2.97, 3.17, 3.09, 5.89},
+};
+
+static uint64_t sunk;
+
+static void count_sink(const char *buf, int length)
+{
+   sunk += length;
+}
+
+static double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//Returns false if the encoder took more bytes per sample than its limit
+static bool bench(bench_enc which, int pat, uint32_t halves, uint8_t *dbuf, uint8_t *abuf)
+{
+   sr_device_t dev;
+   sr_encoder_t enc;
+   double t0, t, bps;
+   init(&dev);
+   dev.d_mask = enc_d_mask[which];
+   dev.cont = true;
+   chan_counts(&dev);
+   //Only the digital modes are built in, so the analog channels are counted here
+   if ((which == ENC_ANALOG) || (which == ENC_DELTA_A))
+   {
+      dev.a_chan_cnt = 3;
+      if (dev.d_nps == 1)
+      {
+         dev.d_nps = 2;
+      }
+   }
+   dev.samples_per_half = BENCH_SAMPLES;
+   enc_init(&enc, count_sink);
+   enc.d_dma_bps = dev.d_nps >> 1;
+   pat_fill(dbuf, BENCH_SAMPLES, enc.d_dma_bps, dev.d_mask, pat, 777 + pat);
+   pat_fill(abuf, BENCH_SAMPLES * dev.a_chan_cnt, 1, 0xFF, (pat == PAT_COUNTER) ? PAT_IDLE : pat, 999 + pat);
+   sunk = 0;
+   t0 = now();
+   for (uint32_t h = 0; h < halves; h++)
+   {
+      switch (which)
+      {
+      case ENC_D4: send_slices_D4(&dev, &enc, dbuf); break;
+      case ENC_1B: send_slices_1B(&dev, &enc, dbuf); break;
+      case ENC_2B: send_slices_2B(&dev, &enc, dbuf); break;
+      case ENC_4B: send_slices_4B(&dev, &enc, dbuf); break;
+      case ENC_ANALOG: send_slices_analog(&dev, &enc, dbuf, abuf); break;
+      case ENC_PACKED: send_slices_packed(&dev, &enc, dbuf, 0); break;
+      default: send_slices_delta(&dev, &enc, dbuf, abuf); break;
+      }
+   }
+   t = now() - t0;
+   bps = (double)sunk / ((double)BENCH_SAMPLES * halves);
+   printf("%-7s %-8s %8.3f %10.1f%s\n", enc_names[which], pat_names[pat], bps,
+          (t > 0) ? BENCH_SAMPLES * (double)halves / t / 1e6 : 0.0, (bps > enc_limit[which][pat]) ? "  over limit" : "");
+   return bps <= enc_limit[which][pat];
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t halves = (argc > 1) ? strtoul(argv[1], 0, 10) : 200;
+   uint8_t *dbuf, *abuf;
+   int ret = 0;
+   if (halves == 0)
+   {
+      fprintf(stderr, "usage: srbench [<segments per test>]\n");
+      return 1;
+   }
+   dbuf = malloc(BENCH_SAMPLES * 4);
+   abuf = malloc(BENCH_SAMPLES * 3);
+   printf("encoder pattern  bytes/sample Msamples/s\n");
+   for (int e = 0; e < ENC_COUNT; e++)
+   {
+      for (int p = 0; p < PAT_COUNT; p++)
+      {
+         if (!bench(e, p, halves, dbuf, abuf))
+         {
+            ret = 1;
+         }
+      }
+   }
+   free(dbuf);
+   free(abuf);
+   return ret;
+}
@@ -0,0 +1,217 @@
+//Read the sample data of a capture from the device's vendor bulk interface, for firmware built
+//with the SR_VBULK option.  The device is configured and started on its serial port by another
+//program, with a 'v1' command before the 'F' or 'C', and the bytes it sends on the bulk endpoint
+//are written out as they arrive, i.e. piped into srdecode.  Several transfers are kept in
+//flight so that the host is always ready for the next packet.
+//The end of capture string still comes on the serial port, so the read stops after -c bytes
+//(the count from the "$<bytecnt>+"), when no data has come for the -t timeout, or on ctrl-C.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <libusb.h>
+
+#define VB_VID 0x2E8A
+#define VB_SUBCLASS 0x53
+#define VB_PROTOCOL 0x01
+
+typedef struct
+{
+   FILE *out;
+   unsigned long long bytes;  // bytes written to out
+   unsigned long long limit;  // stop after this many bytes, 0 for no limit
+   int inflight;              // transfers submitted and not yet completed
+   volatile int stop;
+   struct timespec last;      // time data last arrived
+} bulk_t;
+
+static bulk_t bk;
+
+static void usage(void)
+{
+   fprintf(stderr,
+           "usage: srbulk [-n <transfers>] [-s <transfer size>] [-t <idle timeout ms>] [-c <bytes>]\n"
+           "              [-o <output>]\n"
+           "The output defaults to stdout.  Reading stops after -c bytes, after -t ms (default 2000)\n"
+           "without data once data has started, or on ctrl-C.\n");
+   exit(1);
+}
+
+static void on_signal(int sig)
+{
+   (void)sig;
+   bk.stop = 1;
+}
+
+static double since_ms(const struct timespec *t)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (now.tv_sec - t->tv_sec) * 1e3 + (now.tv_nsec - t->tv_nsec) / 1e6;
+}
+
+static void LIBUSB_CALL on_xfer(struct libusb_transfer *t)
+{
+   bulk_t *b = (bulk_t *)t->user_data;
+   if ((t->status == LIBUSB_TRANSFER_COMPLETED) && t->actual_length)
+   {
+      int n = t->actual_length;
+      if (b->limit && (b->bytes + n > b->limit))
+      {
+         n = (int)(b->limit - b->bytes);
+      }
+      fwrite(t->buffer, 1, n, b->out);
+      b->bytes += n;
+      clock_gettime(CLOCK_MONOTONIC, &b->last);
+      if (b->limit && (b->bytes >= b->limit))
+      {
+         b->stop = 1;
+      }
+   }
+   else if ((t->status != LIBUSB_TRANSFER_COMPLETED) && (t->status != LIBUSB_TRANSFER_TIMED_OUT)
+            && (t->status != LIBUSB_TRANSFER_CANCELLED))
+   {
+      fprintf(stderr, "transfer error %s\n", libusb_error_name(t->status));
+      b->stop = 1;
+   }
+   if (b->stop || (libusb_submit_transfer(t) != 0))
+   {
+      b->inflight--;
+   }
+}
+
+//Find the first device with the bulk interface.  Returns the open handle, or NULL.
+static libusb_device_handle *open_bulk(int *itf, unsigned char *ep)
+{
+   libusb_device **list;
+   libusb_device_handle *h = 0;
+   ssize_t cnt = libusb_get_device_list(0, &list);
+   for (ssize_t i = 0; (i < cnt) && !h; i++)
+   {
+      struct libusb_device_descriptor dd;
+      struct libusb_config_descriptor *cfg;
+      if ((libusb_get_device_descriptor(list[i], &dd) != 0) || (dd.idVendor != VB_VID)
+          || (libusb_get_active_config_descriptor(list[i], &cfg) != 0))
+      {
+         continue;
+      }
+      for (int j = 0; (j < cfg->bNumInterfaces) && !h; j++)
+      {
+         const struct libusb_interface_descriptor *id = &cfg->interface[j].altsetting[0];
+         if ((id->bInterfaceClass == LIBUSB_CLASS_VENDOR_SPEC) && (id->bInterfaceSubClass == VB_SUBCLASS)
+             && (id->bInterfaceProtocol == VB_PROTOCOL) && (id->bNumEndpoints == 1)
+             && (libusb_open(list[i], &h) == 0))
+         {
+            *itf = id->bInterfaceNumber;
+            *ep = id->endpoint[0].bEndpointAddress;
+         }
+      }
+      libusb_free_config_descriptor(cfg);
+   }
+   libusb_free_device_list(list, 1);
+   return h;
+}
+
+int main(int argc, char **argv)
+{
+   int ntransfers = 8, size = 16384, itf, rc;
+   double timeout_ms = 2000;
+   const char *outpath = 0;
+   unsigned char ep;
+   libusb_device_handle *h;
+   struct libusb_transfer **xfers;
+   for (int i = 1; i < argc; i++)
+   {
+      if ((argv[i][0] == '-') && (i + 1 < argc))
+      {
+         switch (argv[i][1])
+         {
+         case 'n': ntransfers = atoi(argv[++i]); break;
+         case 's': size = atoi(argv[++i]); break;
+         case 't': timeout_ms = atof(argv[++i]); break;
+         case 'c': bk.limit = strtoull(argv[++i], 0, 10); break;
+         case 'o': outpath = argv[++i]; break;
+         default: usage();
+         }
+      }
+      else
+      {
+         usage();
+      }
+   }
+   //Whole packets, so that a transfer only ends early on the device's short packets
+   size &= ~63;
+   if ((ntransfers < 1) || (size < 64))
+   {
+      usage();
+   }
+   bk.out = outpath ? fopen(outpath, "wb") : stdout;
+   if (!bk.out)
+   {
+      fprintf(stderr, "can't open %s\n", outpath);
+      return 1;
+   }
+   if (libusb_init(0) != 0)
+   {
+      fprintf(stderr, "libusb_init failed\n");
+      return 1;
+   }
+   h = open_bulk(&itf, &ep);
+   if (!h)
+   {
+      fprintf(stderr, "no device with the bulk interface, is the firmware built with SR_VBULK?\n");
+      libusb_exit(0);
+      return 1;
+   }
+   rc = libusb_claim_interface(h, itf);
+   if (rc != 0)
+   {
+      fprintf(stderr, "can't claim interface %d: %s\n", itf, libusb_error_name(rc));
+      libusb_close(h);
+      libusb_exit(0);
+      return 1;
+   }
+   signal(SIGINT, on_signal);
+   xfers = calloc(ntransfers, sizeof(*xfers));
+   for (int i = 0; i < ntransfers; i++)
+   {
+      xfers[i] = libusb_alloc_transfer(0);
+      libusb_fill_bulk_transfer(xfers[i], h, ep, malloc(size), size, on_xfer, &bk, 0);
+      if (libusb_submit_transfer(xfers[i]) == 0)
+      {
+         bk.inflight++;
+      }
+   }
+   while (bk.inflight)
+   {
+      struct timeval tv = {0, 100000};
+      if (!bk.stop && bk.bytes && (since_ms(&bk.last) > timeout_ms))
+      {
+         bk.stop = 1;
+      }
+      if (bk.stop)
+      {
+         for (int i = 0; i < ntransfers; i++)
+         {
+            libusb_cancel_transfer(xfers[i]);
+         }
+      }
+      libusb_handle_events_timeout_completed(0, &tv, 0);
+   }
+   fprintf(stderr, "%llu bytes\n", bk.bytes);
+   for (int i = 0; i < ntransfers; i++)
+   {
+      free(xfers[i]->buffer);
+      libusb_free_transfer(xfers[i]);
+   }
+   free(xfers);
+   libusb_release_interface(h, itf);
+   libusb_close(h);
+   libusb_exit(0);
+   if (bk.out != stdout)
+   {
+      fclose(bk.out);
+   }
+   return 0;
+}
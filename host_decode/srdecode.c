@@ -0,0 +1,146 @@
+//Decode a sample data stream captured from the device into a VCD or sigrok .sr file.
+//The input is the raw bytes the device sent after the 'F' or 'C' command, either saved
+//to a file or read live from the serial port (i.e. /dev/ttyACM0) once the device is
+//configured and started by another program.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sr_decode.h"
+#include "sr_output.h"
+
+#define IN_BUF_SIZE (1 << 20)
+
+static void usage(void)
+{
+   fprintf(stderr,
+           "usage: srdecode -d <digital channels> [-a <analog channels>] -r <sample rate> [-b] [-H]\n"
+           "                [-s <analog scale uV>] [-f <analog offset uV>] [-i <input>] <output.vcd|output.sr>\n"
+           "The input defaults to stdin.  The analog scale and offset are the values from the 'a'\n"
+           "command, without them the analog values are the 7 bit codes (8 bit with -b, 12 bit with -H).\n"
+           "Use -b if the capture was started after a 'B1' binary framing command, and -H\n"
+           "after an 'H1' 12 bit ADC command.\n");
+   exit(1);
+}
+
+int main(int argc, char **argv)
+{
+   uint32_t d_chan_cnt = 0, a_chan_cnt = 0, rate = 0;
+   double ascale = 1.0, aoffset = 0.0;
+   bool binary = false, adc12 = false;
+   const char *inpath = 0, *outpath = 0;
+   FILE *in = stdin;
+   sr_decoder_t dec;
+   sr_out_t out;
+   out_type type;
+   uint8_t *buf;
+   size_t n;
+   for (int i = 1; i < argc; i++)
+   {
+      if (strcmp(argv[i], "-b") == 0)
+      {
+         binary = true;
+      }
+      else if (strcmp(argv[i], "-H") == 0)
+      {
+         adc12 = true;
+      }
+      else if ((argv[i][0] == '-') && (i + 1 < argc))
+      {
+         switch (argv[i][1])
+         {
+         case 'd': d_chan_cnt = atoi(argv[++i]); break;
+         case 'a': a_chan_cnt = atoi(argv[++i]); break;
+         case 'r': rate = strtoul(argv[++i], 0, 10); break;
+         case 's': ascale = atof(argv[++i]) / 1e6; break;
+         case 'f': aoffset = atof(argv[++i]) / 1e6; break;
+         case 'i': inpath = argv[++i]; break;
+         default: usage();
+         }
+      }
+      else if (!outpath)
+      {
+         outpath = argv[i];
+      }
+      else
+      {
+         usage();
+      }
+   }
+   if (!outpath || (rate == 0))
+   {
+      usage();
+   }
+   //The 'a' scale is for the 7 bit codes, binary framing sends all 8 bits.  In the 12 bit
+   //mode the 'a' scale is already for the 12 bit values.
+   if (binary && !adc12)
+   {
+      ascale /= 2;
+   }
+   n = strlen(outpath);
+   type = ((n > 3) && (strcmp(outpath + n - 3, ".sr") == 0)) ? OUT_SRZIP : OUT_VCD;
+   if (inpath && !(in = fopen(inpath, "rb")))
+   {
+      fprintf(stderr, "can't open %s\n", inpath);
+      return 1;
+   }
+   if (!out_open(&out, outpath, type, d_chan_cnt, a_chan_cnt, rate, ascale, aoffset))
+   {
+      fprintf(stderr, "can't create %s\n", outpath);
+      return 1;
+   }
+   if (!dec_init(&dec, d_chan_cnt, a_chan_cnt, out_run, &out))
+   {
+      fprintf(stderr, "unsupported channel counts d %u a %u\n", d_chan_cnt, a_chan_cnt);
+      return 1;
+   }
+   dec.binary = binary;
+   dec.adc12 = adc12;
+   dec.gap = out_gap;
+   buf = malloc(IN_BUF_SIZE);
+   //A pty returns whatever is available, so this decodes as the samples arrive
+   while ((dec.status == DEC_RUNNING) && (n = fread(buf, 1, IN_BUF_SIZE, in)) > 0)
+   {
+      dec_feed(&dec, buf, n);
+   }
+   dec_flush(&dec);
+   free(buf);
+   if (!out_close(&out))
+   {
+      fprintf(stderr, "error writing %s\n", outpath);
+      return 1;
+   }
+   fprintf(stderr, "%llu samples from %llu bytes\n", (unsigned long long)dec.samples,
+           (unsigned long long)dec.bytecnt);
+   if (dec.frames)
+   {
+      fprintf(stderr, "%u frames with %llu samples between them\n", dec.frames,
+              (unsigned long long)dec.gap_samples);
+   }
+   else if (dec.gaps)
+   {
+      fprintf(stderr, "%u gaps with %llu samples dropped by the device\n", dec.gaps,
+              (unsigned long long)dec.gap_samples);
+   }
+   switch (dec.status)
+   {
+   case DEC_DONE:
+      if (dec.dev_bytecnt != dec.bytecnt)
+      {
+         fprintf(stderr, "device sent %u bytes but %llu were received\n", dec.dev_bytecnt,
+                 (unsigned long long)dec.bytecnt);
+         return 2;
+      }
+      break;
+   case DEC_ABORTED:
+      fprintf(stderr, "device aborted the capture\n");
+      return 2;
+   case DEC_ERROR:
+      fprintf(stderr, "invalid byte in the data at offset %llu\n",
+              (unsigned long long)(dec.bytecnt + dec.ctrlcnt));
+      return 2;
+   default:
+      fprintf(stderr, "end of input before the end of the capture\n");
+      break;
+   }
+   return 0;
+}
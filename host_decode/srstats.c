@@ -0,0 +1,29 @@
+//Print the reply to the device's 's' stats command in a readable form.  The reply is taken
+//from the command line, or the first line of stdin, i.e. from a script that sends the 's'.
+#include <stdio.h>
+#include <string.h>
+#include "sr_stats.h"
+
+int main(int argc, char **argv)
+{
+   char line[128];
+   sr_stats_t st;
+   if (argc > 1)
+   {
+      snprintf(line, sizeof(line), "%s", argv[1]);
+   }
+   else if (!fgets(line, sizeof(line), stdin))
+   {
+      fprintf(stderr, "usage: srstats [<'s' reply>]\n");
+      return 1;
+   }
+   line[strcspn(line, "\r\n")] = 0;
+   if (!stats_parse(line, &st))
+   {
+      fprintf(stderr, "not a stats reply: %s\n", line);
+      return 1;
+   }
+   stats_print(stdout, &st);
+   //Exit status 2 lets scripts spot captures that ran out of ring space
+   return (stats_limit_of(&st) == LIMIT_NONE) ? 0 : 2;
+}
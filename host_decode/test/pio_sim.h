@@ -0,0 +1,184 @@
+//A cycle by cycle model of one PIO state machine, enough to run the programs that the
+//firmware builds: jmp, wait pin, in pins with the shift to the left and no autopush, push,
+//mov including the rx fifo level status, and irq set, with delays.  The pins are read through a callback with the cycle number,
+//and pushed words wait in an rx fifo for the test to read.
+#ifndef PIO_SIM_H
+#define PIO_SIM_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define PIO_SIM_FIFO 8
+
+typedef struct
+{
+   const uint16_t *instr;
+   uint32_t wrap;             // last instruction of the loop, 31 if not set
+   uint32_t wrap_target;      // where it goes after it
+   uint32_t jmp_pin;          // relative to the in pins, as the pin tables are
+   uint32_t (*pins)(uint64_t cycle, void *ctx);
+   void *ctx;
+   uint32_t fifo_depth;       // 4, or 8 when the tx fifo is joined to the rx
+   uint32_t status_n;         // mov status is all ones while the rx fifo holds fewer words
+   uint32_t pc, x, y, isr, osr, delay;
+   uint32_t fifo[PIO_SIM_FIFO];
+   uint32_t fifo_rd, fifo_cnt;
+   uint32_t irq;              // irq flags that have been set
+   uint64_t cycle;
+   uint64_t stalls;           // cycles spent waiting on a full fifo
+   bool bad;                  // an instruction the model doesn't know
+} pio_sim_t;
+
+static inline void pio_sim_init(pio_sim_t *s, const uint16_t *instr, uint32_t entry,
+                                uint32_t (*pins)(uint64_t, void *), void *ctx)
+{
+   memset(s, 0, sizeof(*s));
+   s->instr = instr;
+   s->wrap = 31;
+   s->pc = entry;
+   s->pins = pins;
+   s->ctx = ctx;
+   s->fifo_depth = 4;
+   //Registers aren't cleared by a restart, so don't let a program rely on them
+   s->x = 0x5A5A5A5A;
+   s->y = 0x12345678;
+   s->isr = 0x77;
+   s->osr = 0x99;
+}
+
+static inline bool pio_sim_pop(pio_sim_t *s, uint32_t *v)
+{
+   if (s->fifo_cnt == 0)
+   {
+      return false;
+   }
+   *v = s->fifo[s->fifo_rd];
+   s->fifo_rd = (s->fifo_rd + 1) % PIO_SIM_FIFO;
+   s->fifo_cnt--;
+   return true;
+}
+
+static inline uint32_t pio_sim_src(pio_sim_t *s, uint32_t src, uint32_t pins)
+{
+   switch (src)
+   {
+   case 0: return pins;
+   case 1: return s->x;
+   case 2: return s->y;
+   case 3: return 0;
+   case 5: return (s->fifo_cnt < s->status_n) ? 0xFFFFFFFF : 0;
+   case 6: return s->isr;
+   case 7: return s->osr;
+   }
+   s->bad = true;
+   return 0;
+}
+
+// Run one clock cycle
+static inline void pio_sim_step(pio_sim_t *s)
+{
+   uint16_t in = s->instr[s->pc];
+   uint32_t pins = s->pins(s->cycle, s->ctx);
+   uint32_t next = (s->pc == s->wrap) ? s->wrap_target : s->pc + 1;
+   uint32_t arg = in & 31;
+   uint32_t v;
+   bool stall = false;
+   s->cycle++;
+   if (s->delay)
+   {
+      s->delay--;
+      return;
+   }
+   switch (in >> 13)
+   {
+   case 0: //jmp
+   {
+      bool take;
+      switch ((in >> 5) & 7)
+      {
+      case 0: take = true; break;
+      case 1: take = (s->x == 0); break;
+      case 2: take = (s->x-- != 0); break;
+      case 3: take = (s->y == 0); break;
+      case 4: take = (s->y-- != 0); break;
+      case 5: take = (s->x != s->y); break;
+      case 6: take = (pins >> s->jmp_pin) & 1; break;
+      default: take = false; s->bad = true; break;
+      }
+      if (take)
+      {
+         next = arg;
+      }
+      break;
+   }
+   case 1: //wait, only on pins
+      if (((in >> 5) & 3) != 1)
+      {
+         s->bad = true;
+      }
+      stall = ((pins >> arg) & 1) != ((in >> 7) & 1);
+      break;
+   case 2: //in, shifting left
+   {
+      uint32_t n = arg ? arg : 32;
+      v = pio_sim_src(s, (in >> 5) & 7, pins);
+      s->isr = (n == 32) ? v : ((s->isr << n) | (v & ((1u << n) - 1)));
+      break;
+   }
+   case 4: //push, the pull half isn't used
+      if (in & 0x80)
+      {
+         s->bad = true;
+      }
+      if (s->fifo_cnt == s->fifo_depth)
+      {
+         //A non blocking push drops the word and carries on
+         stall = (in & 0x20) != 0;
+         if (!stall)
+         {
+            s->isr = 0;
+         }
+         break;
+      }
+      s->fifo[(s->fifo_rd + s->fifo_cnt) % PIO_SIM_FIFO] = s->isr;
+      s->fifo_cnt++;
+      s->isr = 0;
+      break;
+   case 5: //mov
+      v = pio_sim_src(s, in & 7, pins);
+      switch ((in >> 3) & 3)
+      {
+      case 0: break;
+      case 1: v = ~v; break;
+      default: s->bad = true; break;
+      }
+      switch ((in >> 5) & 7)
+      {
+      case 1: s->x = v; break;
+      case 2: s->y = v; break;
+      case 6: s->isr = v; break;
+      case 7: s->osr = v; break;
+      default: s->bad = true; break;
+      }
+      break;
+   case 6: //irq set
+      if (in & 0x60)
+      {
+         s->bad = true;
+      }
+      s->irq |= 1u << (in & 7);
+      break;
+   default:
+      s->bad = true;
+      break;
+   }
+   if (stall)
+   {
+      s->stalls += ((in >> 13) == 4);
+      return;
+   }
+   s->delay = (in >> 8) & 31;
+   s->pc = next;
+}
+
+#endif /* PIO_SIM_H */
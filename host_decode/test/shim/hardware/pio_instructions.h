@@ -0,0 +1,38 @@
+//Host stand in for the PICO SDK hardware/pio_instructions.h.  The encodings are those of the
+//PIO instruction set, so the tests can run the programs built by the firmware.
+#ifndef SHIM_HARDWARE_PIO_INSTRUCTIONS_H
+#define SHIM_HARDWARE_PIO_INSTRUCTIONS_H
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+enum pio_src_dest
+{
+   pio_pins = 0,
+   pio_x = 1,
+   pio_y = 2,
+   pio_null = 3,
+   pio_status = 5,
+   pio_isr = 6,
+   pio_osr = 7,
+};
+
+static inline uint pio_encode_delay(uint cycles) { return cycles << 8; }
+static inline uint pio_encode_jmp(uint addr) { return 0x0000 | addr; }
+static inline uint pio_encode_jmp_not_x(uint addr) { return 0x0000 | (1u << 5) | addr; }
+static inline uint pio_encode_jmp_x_dec(uint addr) { return 0x0000 | (2u << 5) | addr; }
+static inline uint pio_encode_jmp_not_y(uint addr) { return 0x0000 | (3u << 5) | addr; }
+static inline uint pio_encode_jmp_y_dec(uint addr) { return 0x0000 | (4u << 5) | addr; }
+static inline uint pio_encode_jmp_x_ne_y(uint addr) { return 0x0000 | (5u << 5) | addr; }
+static inline uint pio_encode_jmp_pin(uint addr) { return 0x0000 | (6u << 5) | addr; }
+static inline uint pio_encode_wait_gpio(bool polarity, uint gpio) { return 0x2000 | (polarity ? 0x80 : 0) | (0u << 5) | gpio; }
+static inline uint pio_encode_wait_pin(bool polarity, uint pin) { return 0x2000 | (polarity ? 0x80 : 0) | (1u << 5) | pin; }
+static inline uint pio_encode_in(enum pio_src_dest src, uint count) { return 0x4000 | (src << 5) | (count & 31); }
+static inline uint pio_encode_push(bool if_full, bool block) { return 0x8000 | (if_full ? 0x40 : 0) | (block ? 0x20 : 0); }
+static inline uint pio_encode_mov(enum pio_src_dest dest, enum pio_src_dest src) { return 0xA000 | (dest << 5) | src; }
+static inline uint pio_encode_mov_not(enum pio_src_dest dest, enum pio_src_dest src) { return 0xA000 | (dest << 5) | (1u << 3) | src; }
+static inline uint pio_encode_irq_set(bool relative, uint irq) { return 0xC000 | (relative ? 0x10 : 0) | irq; }
+static inline uint pio_encode_irq_wait(bool relative, uint irq) { return 0xC020 | (relative ? 0x10 : 0) | irq; }
+
+#endif
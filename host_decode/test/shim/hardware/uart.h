@@ -0,0 +1,15 @@
+//Host stand in for the PICO SDK hardware/uart.h, with just what sr_device.c uses.
+//The functions are in shim.c and discard the debug output.
+#ifndef SHIM_HARDWARE_UART_H
+#define SHIM_HARDWARE_UART_H
+#include <stdint.h>
+
+typedef struct uart_inst uart_inst_t;
+#define uart0 ((uart_inst_t *)0)
+
+void uart_puts(uart_inst_t *uart, const char *s);
+void uart_tx_wait_blocking(uart_inst_t *uart);
+void sleep_ms(uint32_t ms);
+void rom_reset_usb_boot(uint32_t gpio_mask, uint32_t disable_mask);
+
+#endif
@@ -0,0 +1,7 @@
+//Host stand in for the PICO SDK pico/stdio_usb.h, with its default timeout
+#ifndef SHIM_PICO_STDIO_USB_H
+#define SHIM_PICO_STDIO_USB_H
+
+#define PICO_STDIO_USB_STDOUT_TIMEOUT_US 500000
+
+#endif
@@ -0,0 +1,9 @@
+//Host stand in for the PICO SDK pico/time.h, the tests provide the clock
+#ifndef SHIM_PICO_TIME_H
+#define SHIM_PICO_TIME_H
+#include <stdint.h>
+
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+
+#endif
@@ -0,0 +1,18 @@
+//Host versions of the few PICO SDK functions the firmware modules call
+#include "hardware/uart.h"
+
+void uart_puts(uart_inst_t *uart, const char *s)
+{
+}
+
+void uart_tx_wait_blocking(uart_inst_t *uart)
+{
+}
+
+void sleep_ms(uint32_t ms)
+{
+}
+
+void rom_reset_usb_boot(uint32_t gpio_mask, uint32_t disable_mask)
+{
+}
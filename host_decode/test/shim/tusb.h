@@ -0,0 +1,101 @@
+//Host stand in for the tinyusb device API used by the firmware, and the descriptor types of
+//the vendor bulk class driver.  The tests that link the modules which call it provide the
+//functions, as mocks of the device and the host.
+#ifndef SHIM_TUSB_H
+#define SHIM_TUSB_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CFG_TUSB_DEBUG 0
+
+#define TU_ATTR_PACKED __attribute__((packed))
+#define TU_VERIFY_1(c) do { if (!(c)) return false; } while (0)
+#define TU_VERIFY_2(c, r) do { if (!(c)) return r; } while (0)
+#define TU_GET_VERIFY(_1, _2, f, ...) f
+#define TU_VERIFY(...) TU_GET_VERIFY(__VA_ARGS__, TU_VERIFY_2, TU_VERIFY_1, x)(__VA_ARGS__)
+
+enum
+{
+   TUSB_DESC_INTERFACE = 4,
+   TUSB_DESC_ENDPOINT = 5,
+};
+
+enum
+{
+   TUSB_CLASS_VENDOR_SPECIFIC = 0xFF,
+};
+
+enum
+{
+   TUSB_XFER_BULK = 2,
+};
+
+typedef enum
+{
+   TUSB_DIR_OUT = 0,
+   TUSB_DIR_IN = 1
+} tusb_dir_t;
+
+typedef enum
+{
+   XFER_RESULT_SUCCESS = 0,
+   XFER_RESULT_FAILED,
+   XFER_RESULT_STALLED,
+   XFER_RESULT_TIMEOUT
+} xfer_result_t;
+
+typedef struct TU_ATTR_PACKED
+{
+   uint8_t bLength;
+   uint8_t bDescriptorType;
+   uint8_t bInterfaceNumber;
+   uint8_t bAlternateSetting;
+   uint8_t bNumEndpoints;
+   uint8_t bInterfaceClass;
+   uint8_t bInterfaceSubClass;
+   uint8_t bInterfaceProtocol;
+   uint8_t iInterface;
+} tusb_desc_interface_t;
+
+typedef struct TU_ATTR_PACKED
+{
+   uint8_t bLength;
+   uint8_t bDescriptorType;
+   uint8_t bEndpointAddress;
+   uint8_t bmAttributes;
+   uint16_t wMaxPacketSize;
+   uint8_t bInterval;
+} tusb_desc_endpoint_t;
+
+typedef struct TU_ATTR_PACKED
+{
+   uint8_t bmRequestType;
+   uint8_t bRequest;
+   uint16_t wValue;
+   uint16_t wIndex;
+   uint16_t wLength;
+} tusb_control_request_t;
+
+static inline uint8_t const *tu_desc_next(void const *desc)
+{
+   uint8_t const *p = (uint8_t const *)desc;
+   return p + p[0];
+}
+
+static inline tusb_dir_t tu_edpt_dir(uint8_t addr)
+{
+   return (addr & 0x80) ? TUSB_DIR_IN : TUSB_DIR_OUT;
+}
+
+static inline uint16_t tu_edpt_packet_size(tusb_desc_endpoint_t const *desc_ep)
+{
+   return desc_ep->wMaxPacketSize & 0x7FF;
+}
+
+bool tud_ready(void);
+void tud_task(void);
+uint32_t tud_cdc_write_available(void);
+uint32_t tud_cdc_write(const void *buffer, uint32_t bufsize);
+uint32_t tud_cdc_write_flush(void);
+
+#endif
@@ -0,0 +1,103 @@
+//The 'E1' adaptive encoding and the packed blocks.  Captures that mix quiet and busy segments
+//are sent with send_slices, so the codec is picked per segment as on the device, and must
+//decode to the same samples.  Then for each channel count and activity the wire bytes per
+//sample of RLE, packed and adaptive are printed, and adaptive must come close to the better
+//of the two.
+#include "test_util.h"
+#include "test_roundtrip.h"
+
+#define SPH 16384
+#define SEGS 12
+
+static uint8_t dbuf[SPH * 4] __attribute__((aligned(4)));
+static uint8_t abuf[SPH * RT_MAX_A_CHAN * 2] __attribute__((aligned(4)));
+
+typedef struct
+{
+   uint32_t d_mask, a_chans;
+   uint8_t enc_mode;
+} cfg_t;
+
+//Round trip of a capture with every pattern.  Returns the number of segments sent packed.
+static uint32_t round_trip(const cfg_t *c, uint32_t seed)
+{
+   sr_device_t dev;
+   sr_encoder_t enc;
+   uint32_t packed = 0;
+   rt_dev(&dev, &enc, c->d_mask, c->a_chans, SPH);
+   dev.enc_mode = c->enc_mode;
+   for (uint32_t s = 0; s < SEGS; s++)
+   {
+      rt_fill(&dev, &enc, dbuf, abuf, s % PAT_COUNT, s % 3, seed + s);
+      packed += (dev.a_mask == 0) && enc_pick_packed(&dev, &enc, dbuf);
+      send_slices(&dev, &enc, dbuf, abuf);
+   }
+   if (!rt_check(&dev, &enc))
+   {
+      printf("digital 0x%X analog %u mode %u\n", c->d_mask, c->a_chans, c->enc_mode);
+      test_fails++;
+   }
+   return packed;
+}
+
+//Wire bytes per sample of one pattern with RLE, packed and adaptive
+static void ratios(uint32_t d_mask, int pat, double *rle, double *packed, double *adapt)
+{
+   sr_device_t dev;
+   sr_encoder_t enc;
+   double *out[3] = {rle, packed, adapt};
+   for (int k = 0; k < 3; k++)
+   {
+      *out[k] = 0;
+      rt_dev(&dev, &enc, d_mask, 0, SPH);
+      dev.enc_mode = (k == 2) ? ENC_ADAPT : ENC_RLE;
+      for (uint32_t s = 0; s < 4; s++)
+      {
+         pat_fill(dbuf, SPH, enc.d_dma_bps, d_mask, pat, 10 + s);
+         if (k == 1)
+         {
+            send_slices_packed(&dev, &enc, dbuf, 0);
+         }
+         else
+         {
+            send_slices(&dev, &enc, dbuf, 0);
+         }
+      }
+      *out[k] = (double)test_len / (4.0 * SPH);
+   }
+}
+
+int main(void)
+{
+   cfg_t cfgs[] = {
+      {0x1, 0, ENC_ADAPT}, {0xF, 0, ENC_ADAPT}, {0x1F, 0, ENC_ADAPT}, {0xFF, 0, ENC_ADAPT},
+      {0x3FF, 0, ENC_ADAPT}, {0xFFFF, 0, ENC_ADAPT}, {0x1FFFFF, 0, ENC_ADAPT},
+      {0xFFFFFFFF, 0, ENC_ADAPT},
+   };
+   uint32_t chan_cnts[] = {1, 4, 5, 8, 12, 16, 24, 32};
+   uint32_t packed = 0;
+   for (uint32_t c = 0; c < sizeof(cfgs) / sizeof(cfgs[0]); c++)
+   {
+      packed += round_trip(&cfgs[c], c * 1000);
+   }
+   //Both codecs have been picked
+   CHECK((packed > 0) && (packed < 8 * SEGS));
+
+   printf("chans pattern    rle  packed  adapt\n");
+   for (uint32_t n = 0; n < sizeof(chan_cnts) / sizeof(chan_cnts[0]); n++)
+   {
+      uint32_t chans = chan_cnts[n];
+      uint32_t mask = (chans == 32) ? 0xFFFFFFFF : (1u << chans) - 1;
+      for (int pat = 0; pat < PAT_COUNT; pat++)
+      {
+         double rle, pk, ad, best;
+         ratios(mask, pat, &rle, &pk, &ad);
+         best = (rle < pk) ? rle : pk;
+         printf("%5u %-8s %6.3f %6.3f %6.3f\n", chans, pat_names[pat], rle, pk, ad);
+         //Packed has to win by 1/8 to be picked, and the activity is an estimate
+         CHECK(ad <= best * 1.2 + 0.01);
+         CHECK(ad <= rle + 0.01);
+      }
+   }
+   return TEST_RESULT();
+}
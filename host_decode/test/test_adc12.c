@@ -0,0 +1,78 @@
+//The 'H1' 12 bit ADC mode.  Every segment with analog channels is sent as a packed block with
+//12 bits per analog value, in 7 bit bytes or with binary framing, and must decode to the
+//same samples with and without digital channels.  The 'a' scale must be for the 12 bit
+//values, and 'i' must still report one byte per analog sample, as the mode is shown by 'H'
+//in its features.
+#include "test_util.h"
+#include "test_roundtrip.h"
+
+#define SPH 16384
+#define SEGS 12
+
+static uint8_t dbuf[SPH * 4] __attribute__((aligned(4)));
+static uint8_t abuf[SPH * RT_MAX_A_CHAN * 2] __attribute__((aligned(4)));
+
+typedef struct
+{
+   uint32_t d_mask, a_chans;
+   uint8_t enc_mode;
+   bool binary;
+} cfg_t;
+
+static void round_trip(const cfg_t *c, uint32_t seed)
+{
+   sr_device_t dev;
+   sr_encoder_t enc;
+   rt_dev(&dev, &enc, c->d_mask, c->a_chans, SPH);
+   dev.enc_mode = c->enc_mode;
+   dev.binary = c->binary;
+   dev.adc12 = true;
+   for (uint32_t s = 0; s < SEGS; s++)
+   {
+      rt_fill(&dev, &enc, dbuf, abuf, s % PAT_COUNT, s % 3, seed + s);
+      size_t start = test_len;
+      send_slices(&dev, &enc, dbuf, abuf);
+      CHECK(test_out[start] == '&');
+   }
+   if (!rt_check(&dev, &enc))
+   {
+      printf("digital 0x%X analog %u mode %u binary %u\n", c->d_mask, c->a_chans, c->enc_mode, c->binary);
+      test_fails++;
+   }
+}
+
+static const char *reply(sr_device_t *d, const char *cmd)
+{
+   int r = 0;
+   while (*cmd)
+   {
+      r = process_char(d, *cmd++);
+   }
+   CHECK(r == 1);
+   return d->rspstr;
+}
+
+int main(void)
+{
+   const cfg_t cfgs[] = {
+      {0, 1, ENC_RLE, false}, {0, 3, ENC_RLE, true}, {0xF, 1, ENC_ADAPT, false},
+      {0xFF, 2, ENC_RLE, false}, {0xFFFF, 3, ENC_RLE, true}, {0x1FFFFF, 3, ENC_ADAPT, true},
+   };
+   sr_device_t dev;
+   char id[16];
+   for (uint32_t c = 0; c < sizeof(cfgs) / sizeof(cfgs[0]); c++)
+   {
+      round_trip(&cfgs[c], c * 1000);
+   }
+
+   memset(&dev, 0, sizeof(dev));
+   init(&dev);
+   sprintf(id, "SRPICO,A%02d1D", NUM_A_CHAN);
+   CHECK(strncmp(reply(&dev, "i\n"), id, strlen(id)) == 0);
+   CHECK(strcmp(reply(&dev, "H1\n"), "*") == 0);
+   CHECK(strcmp(reply(&dev, "a0\n"), "803x0") == 0);
+   CHECK(strcmp(reply(&dev, "B1\n"), "*") == 0);
+   CHECK(strcmp(reply(&dev, "a2\n"), "803x0") == 0);
+   CHECK(strncmp(reply(&dev, "i\n"), id, strlen(id)) == 0);
+   return TEST_RESULT();
+}
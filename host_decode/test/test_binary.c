@@ -0,0 +1,119 @@
+//The 'B1' binary framing.  Captures with and without analog channels must decode to the same
+//samples, with the busy digital segments sent packed even in the RLE mode and every segment
+//with analog channels packed.  A segment whose slices are all the bytes the host treats as
+//control must have each of them escaped, with no bare '!' or '$' left before the trailer.
+//The 'a' scale must be for the 8 bit analog values it sends.
+#include "test_util.h"
+#include "test_roundtrip.h"
+
+#define SPH 16384
+#define SEGS 12
+
+static uint8_t dbuf[SPH * 4] __attribute__((aligned(4)));
+static uint8_t abuf[SPH * RT_MAX_A_CHAN * 2] __attribute__((aligned(4)));
+
+typedef struct
+{
+   uint32_t d_mask, a_chans;
+   uint8_t enc_mode;
+} cfg_t;
+
+//Round trip of a capture with every pattern.  Returns the number of segments sent packed.
+static uint32_t round_trip(const cfg_t *c, uint32_t seed)
+{
+   sr_device_t dev;
+   sr_encoder_t enc;
+   uint32_t packed = 0;
+   rt_dev(&dev, &enc, c->d_mask, c->a_chans, SPH);
+   dev.enc_mode = c->enc_mode;
+   dev.binary = true;
+   for (uint32_t s = 0; s < SEGS; s++)
+   {
+      rt_fill(&dev, &enc, dbuf, abuf, s % PAT_COUNT, s % 3, seed + s);
+      packed += (dev.a_mask == 0) && enc_pick_packed(&dev, &enc, dbuf);
+      send_slices(&dev, &enc, dbuf, abuf);
+   }
+   if (!rt_check(&dev, &enc))
+   {
+      printf("digital 0x%X analog %u mode %u\n", c->d_mask, c->a_chans, c->enc_mode);
+      test_fails++;
+   }
+   return packed;
+}
+
+static bool is_ctl(uint8_t b)
+{
+   return (b == '!') || (b == '$') || (b == '#');
+}
+
+//8 digital and one 8 bit analog channel make each slice two whole bytes, so the bytes of the
+//stream are set directly.  Half are '!', '$' and '#', and the rest are what they escape to.
+static void escapes(void)
+{
+   static const uint8_t ctl[] = {'!', '$', '#', '!' ^ 0x20, '$' ^ 0x20, '#' ^ 0x20};
+   sr_device_t dev;
+   sr_encoder_t enc;
+   uint32_t want_len = 4, esc = 0;
+   rt_dev(&dev, &enc, 0xFF, 1, SPH);
+   dev.binary = true;
+   for (uint32_t i = 0; i < SPH; i++)
+   {
+      dbuf[i] = ctl[test_rnd() % 6];
+      abuf[i] = ctl[test_rnd() % 6];
+      rt_want[i] = dbuf[i];
+      rt_awant[i * RT_MAX_A_CHAN] = abuf[i];
+      want_len += 2 + is_ctl(dbuf[i]) + is_ctl(abuf[i]);
+   }
+   rt_nwant = SPH;
+   send_slices(&dev, &enc, dbuf, abuf);
+   CHECK((test_len == want_len) && (test_out[0] == '&'));
+   for (uint32_t i = 4; i < test_len; i++)
+   {
+      CHECK((test_out[i] != '!') && (test_out[i] != '$'));
+      if (test_out[i] == '#')
+      {
+         CHECK((i + 1 < test_len) && is_ctl(test_out[i + 1] ^ 0x20));
+         esc++;
+         i++;
+      }
+   }
+   CHECK(esc == want_len - 4 - 2 * SPH);
+   CHECK(rt_check(&dev, &enc));
+}
+
+static void scale(sr_device_t *d, const char *want)
+{
+   const char *cmd = "a0\n";
+   int r = 0;
+   while (*cmd)
+   {
+      r = process_char(d, *cmd++);
+   }
+   CHECK((r == 1) && (strcmp(d->rspstr, want) == 0));
+}
+
+int main(void)
+{
+   const cfg_t cfgs[] = {
+      {0xFF, 0, ENC_RLE}, {0xFFFF, 0, ENC_ADAPT}, {0xFFFFFFFF, 0, ENC_ADAPT},
+      {0, 2, ENC_RLE}, {0xFF, 3, ENC_RLE}, {0xF, 1, ENC_ADAPT},
+   };
+   sr_device_t dev;
+   for (uint32_t c = 0; c < sizeof(cfgs) / sizeof(cfgs[0]); c++)
+   {
+      uint32_t packed = round_trip(&cfgs[c], c * 1000);
+      //The busy patterns are packed without 'E1', the quiet ones aren't
+      if (cfgs[c].a_chans == 0)
+      {
+         CHECK((packed > 0) && (packed < SEGS));
+      }
+   }
+   escapes();
+
+   memset(&dev, 0, sizeof(dev));
+   init(&dev);
+   scale(&dev, "25700x0");
+   dev.binary = true;
+   scale(&dev, "12850x0");
+   return TEST_RESULT();
+}
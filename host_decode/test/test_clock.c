@@ -0,0 +1,94 @@
+//clk_solve against a brute force search of the PLL settings for every profile that sets the
+//clock, over whole divides of the profile's limit, a sweep of rates and random ones.  The
+//settings must be ones the PLL can make within the profile's limits, and the clock must be
+//the fastest whole multiple of the PIO clock when there is one, else the fastest clock.
+#include "sr_clock.h"
+#include "test_util.h"
+
+//The fastest clk_sys up to max_hz, and the fastest that is a whole multiple of pio_hz within
+//the divider range, or 0 if there is none
+static void brute(uint32_t max_hz, uint32_t pio_hz, uint32_t *fastest, uint32_t *exact)
+{
+   *fastest = 0;
+   *exact = 0;
+   for (uint64_t fb = (CLK_VCO_MIN + CLK_XOSC_HZ - 1) / CLK_XOSC_HZ; fb * CLK_XOSC_HZ <= CLK_VCO_MAX; fb++)
+   {
+      uint64_t vco = fb * CLK_XOSC_HZ;
+      for (uint32_t a = 1; a <= CLK_POSTDIV_MAX; a++)
+      {
+         for (uint32_t b = 1; b <= CLK_POSTDIV_MAX; b++)
+         {
+            uint64_t sys = vco / (a * b);
+            if ((vco % (a * b)) || (sys > max_hz) || (sys < CLK_SYS_MIN))
+            {
+               continue;
+            }
+            *fastest = (sys > *fastest) ? (uint32_t)sys : *fastest;
+            if ((sys % pio_hz == 0) && (sys / pio_hz <= CLK_DIV_MAX) && (sys > *exact))
+            {
+               *exact = (uint32_t)sys;
+            }
+         }
+      }
+   }
+}
+
+static void check(const sr_clk_profile_t *prof, uint32_t pio_hz)
+{
+   sr_clk_t c;
+   uint32_t fastest, exact;
+   bool ret = clk_solve(&c, prof, pio_hz);
+   brute(prof->max_hz, pio_hz, &fastest, &exact);
+   CHECK(ret == c.exact);
+   CHECK((c.postdiv1 >= 1) && (c.postdiv1 <= CLK_POSTDIV_MAX) && (c.postdiv2 >= 1) && (c.postdiv2 <= c.postdiv1));
+   CHECK((c.vco_hz >= CLK_VCO_MIN) && (c.vco_hz <= CLK_VCO_MAX) && (c.vco_hz % CLK_XOSC_HZ == 0));
+   CHECK((uint64_t)c.sys_hz * c.postdiv1 * c.postdiv2 == c.vco_hz);
+   CHECK((c.sys_hz <= prof->max_hz) && (c.sys_hz >= CLK_SYS_MIN) && (c.vreg_mv == prof->vreg_mv));
+   CHECK(c.exact == (exact != 0));
+   CHECK(c.sys_hz == (c.exact ? exact : fastest));
+   if (c.exact)
+   {
+      CHECK((c.sys_hz % pio_hz == 0) && (clk_rate(c.sys_hz, c.sys_hz / pio_hz, 0) == pio_hz));
+   }
+   if (test_fails)
+   {
+      printf("max %u pio %u: sys %u vco %u /%u/%u exact %d, want %u\n", prof->max_hz, pio_hz, c.sys_hz, c.vco_hz,
+             c.postdiv1, c.postdiv2, c.exact, c.exact ? exact : fastest);
+   }
+}
+
+int main(void)
+{
+   uint32_t exacts = 0;
+   CHECK((clk_profiles[0].max_hz == 0) && (clk_pio_max(0) == CLK_BOOT_PIO_MAX));
+   CHECK(clk_pio_max(CLK_PROFILES) == CLK_BOOT_PIO_MAX);
+   for (uint32_t k = 1; (k < CLK_PROFILES) && !test_fails; k++)
+   {
+      const sr_clk_profile_t *prof = &clk_profiles[k];
+      CHECK((clk_pio_max(k) == prof->max_hz) && (prof->max_hz <= CLK_MAX_HZ));
+      for (uint32_t i = 1; (i <= 64) && !test_fails; i++)
+      {
+         check(prof, prof->max_hz / i);
+      }
+      for (uint32_t r = 5000; (r < prof->max_hz) && !test_fails; r += 250007)
+      {
+         check(prof, r);
+      }
+      for (uint32_t i = 0; (i < 300) && !test_fails; i++)
+      {
+         check(prof, 5000 + test_rnd() % prof->max_hz);
+      }
+      //The limit itself is a clock the PLL makes, so the top rate is exact
+      sr_clk_t c;
+      CHECK(clk_solve(&c, prof, prof->max_hz) && (c.sys_hz == prof->max_hz));
+      exacts += clk_solve(&c, prof, 1000000);
+   }
+   CHECK(exacts == CLK_PROFILES - 1);
+
+   //clk_rate rounds to the nearest Hz
+   CHECK(clk_rate(125000000, 1, 0) == 125000000);
+   CHECK(clk_rate(125000000, 2, 128) == 50000000);
+   CHECK(clk_rate(125000000, 3, 0) == 41666667);
+   CHECK(clk_rate(1, 0, 0) == 0);
+   return TEST_RESULT();
+}
@@ -0,0 +1,152 @@
+//The 'c' command parser against a table of lines that must be taken or refused, then the
+//fields a line applies and the ones it leaves alone, and the whole command through
+//process_char, which must change nothing on a bad line and ack a good one once.  'R', 'K'
+//and 'c' must refuse a sample rate above the PIO limit of the clock profile.
+#include "sr_config.h"
+#include "sr_clock.h"
+#include "test_util.h"
+
+typedef struct
+{
+   const char *line;
+   bool ok;
+} cfg_case_t;
+
+#define STR2(x) #x
+#define STR(x) STR2(x)
+
+static const cfg_case_t cases[] =
+{
+   {"", true},
+   {"R1000000,L50000,DFF,A0,T203,P1000", true},
+   {"R5000", true},
+   {"R4999", false},
+   {"R" STR(CLK_MAX_HZ), true},
+   {"R4294967296", false},
+   {"R", false},
+   {"R1000 ", false},
+   {"R+1000", false},
+   {"R1000000,R2000000", false},
+   {"L1", true},
+   {"L0", false},
+   {"L2147483647", true},
+   {"L2147483648", false},
+   {"DFFFFFFFF", true},
+   {"Ddeadbeef", true},
+   {"D100000000", false},
+   {"DFG", false},
+   {"D0x1", false},
+   {"A3", true},
+   {"P0", true},
+   {"P-1", false},
+   {"T", true},
+   {"T200110", true},
+   {"T20", false},
+   {"T2001", false},
+   {"T599", false},
+   {"T2a0", false},
+   {"N0", true},
+   {"N" STR(FRAME_MAX), true},
+   {"K0", true},
+   {"K" STR(CLK_PROFILES), false},
+   {"R5000,", true},
+   {",R5000", false},
+   {"R100000,,L5", false},
+   {"X1", false},
+   {"r5000", false},
+   {"L10,DF,A0,P0,T,N0,K0,R5000", true},
+};
+
+static int send_line(sr_device_t *d, const char *line)
+{
+   int r = 0;
+   for (const char *p = line; *p; p++)
+   {
+      r = process_char(d, *p);
+   }
+   return r;
+}
+
+int main(void)
+{
+   sr_config_t c;
+   sr_device_t d;
+   char line[CMD_STR_SIZE + 8];
+   for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+   {
+      if (cfg_parse(&c, cases[i].line) != cases[i].ok)
+      {
+         printf("\"%s\" should be %s\n", cases[i].line, cases[i].ok ? "taken" : "refused");
+         test_fails++;
+      }
+   }
+   //'R' allows 16 over the top rate for the cfg_bits, as the single command does
+   sprintf(line, "R%u", CLK_MAX_HZ + 16);
+   CHECK(cfg_parse(&c, line));
+   sprintf(line, "R%u", CLK_MAX_HZ + 17);
+   CHECK(!cfg_parse(&c, line));
+   CHECK(cfg_parse(&c, "") && (c.given == 0));
+
+   //Only the fields given are applied
+   memset(&d, 0, sizeof(d));
+   init(&d);
+   CHECK(cfg_parse(&c, "R1000000,L50000,DFF,A0,T203,P1000"));
+   cfg_apply(&d, &c);
+   CHECK((d.sample_rate == 1000000) && (d.num_samples == 50000) && (d.d_mask == 0xFF) && (d.a_mask == 0)
+         && (d.pretrig == 1000));
+   CHECK((d.trig.risemask == (1u << 3)) && trig_enabled(&d.trig));
+   CHECK(cfg_parse(&c, "DFFFFFFFF"));
+   cfg_apply(&d, &c);
+   CHECK((d.d_mask == 0xFFFFFFFF) && (d.sample_rate == 1000000) && (d.trig.risemask == (1u << 3)));
+   CHECK(cfg_parse(&c, "T200110,Ddeadbeef"));
+   cfg_apply(&d, &c);
+   CHECK((d.trig.risemask == 1) && (d.trig.lvl1mask == (1u << 10)) && (d.d_mask == 0xDEADBEEF));
+   CHECK(cfg_parse(&c, "T"));
+   cfg_apply(&d, &c);
+   CHECK(!trig_enabled(&d.trig) && (d.d_mask == 0xDEADBEEF));
+   CHECK(cfg_parse(&c, "N7,K1"));
+   cfg_apply(&d, &c);
+   CHECK((d.frames == 7) && (d.clk_profile == 1) && (d.pretrig == 1000));
+
+   //A full 32 channel setup with a condition on every channel is one line and one ack
+   memset(&d, 0, sizeof(d));
+   init(&d);
+   strcpy(line, "cR2000000,L100000,DFFFFFFFF,A0,P500,T");
+   for (uint32_t i = 0; i < 32; i++)
+   {
+      sprintf(line + strlen(line), "%u%02u", i % 5, i);
+   }
+   strcat(line, "\n");
+   CHECK(strlen(line) < CMD_STR_SIZE);
+   CHECK((send_line(&d, line) == 1) && (strcmp(d.rspstr, "*") == 0));
+   CHECK((d.sample_rate == 2000000) && (d.num_samples == 100000) && (d.d_mask == 0xFFFFFFFF) && (d.pretrig == 500));
+   CHECK((d.trig.chgmask & (1u << 29)) && (d.trig.lvl0mask & (1u << 30)) && (d.trig.fallmask & (1u << 28)));
+
+   //A bad field leaves everything as it was, including the good fields before it
+   CHECK(send_line(&d, "cR2500000,L0\n") == 0);
+   CHECK((d.sample_rate == 2000000) && (d.num_samples == 100000));
+
+   //Rates above the PIO limit of the clock profile are refused, by 'R', 'K' and 'c' alike
+   sprintf(line, "R%u\n", CLK_BOOT_PIO_MAX + 16);
+   CHECK((send_line(&d, line) == 1) && (d.sample_rate == CLK_BOOT_PIO_MAX + 16));
+   sprintf(line, "R%u\n", CLK_BOOT_PIO_MAX + 17);
+   CHECK((send_line(&d, line) == 0) && (d.sample_rate == CLK_BOOT_PIO_MAX + 16));
+   CHECK((send_line(&d, "K3\n") == 1) && (d.clk_profile == 3));
+   sprintf(line, "R%u\n", CLK_MAX_HZ);
+   CHECK((send_line(&d, line) == 1) && (d.sample_rate == CLK_MAX_HZ));
+   CHECK((send_line(&d, "K0\n") == 0) && (d.clk_profile == 3));
+   CHECK((send_line(&d, "cK0\n") == 0) && (d.clk_profile == 3));
+   CHECK((send_line(&d, "cK0,R1000000\n") == 1) && (d.clk_profile == 0) && (d.sample_rate == 1000000));
+   sprintf(line, "cR%u\n", CLK_MAX_HZ);
+   CHECK((send_line(&d, line) == 0) && (d.sample_rate == 1000000));
+   sprintf(line, "cR%u,K%u\n", clk_profiles[1].max_hz, 1);
+   CHECK((send_line(&d, line) == 1) && (d.sample_rate == clk_profiles[1].max_hz) && (d.clk_profile == 1));
+
+   //A line too long for cmdstr is dropped and the next one is read from its start
+   for (uint32_t i = 0; i < 2 * CMD_STR_SIZE; i++)
+   {
+      process_char(&d, 'R');
+   }
+   CHECK((send_line(&d, "\ni\n") == 1) && (strncmp(d.rspstr, "SRPICO", 6) == 0));
+   return TEST_RESULT();
+}
@@ -0,0 +1,94 @@
+//The 'E2' delta encoding of analog channels.  Captures of slow, flat and noisy inputs are
+//sent with send_slices, which picks delta blocks for the quiet segments, and must decode to
+//the same samples in the 7 bit, binary framed and 12 bit ADC modes.  The wire bytes per
+//sample of the delta and the plain analog encodings are then printed for each kind of input,
+//and delta must win on the slow inputs without losing on noise.
+#include "test_util.h"
+#include "test_roundtrip.h"
+
+#define SPH 16384
+#define SEGS 9
+
+static uint8_t dbuf[SPH * 4] __attribute__((aligned(4)));
+static uint8_t abuf[SPH * RT_MAX_A_CHAN * 2] __attribute__((aligned(4)));
+
+//Round trip of a capture with every analog pattern.  Returns the segments sent as delta.
+static uint32_t round_trip(uint32_t d_mask, uint32_t a_chans, bool binary, bool adc12, uint32_t seed)
+{
+   sr_device_t dev;
+   sr_encoder_t enc;
+   uint32_t delta = 0;
+   rt_dev(&dev, &enc, d_mask, a_chans, SPH);
+   dev.enc_mode = ENC_DELTA;
+   dev.binary = binary;
+   dev.adc12 = adc12;
+   for (uint32_t s = 0; s < SEGS; s++)
+   {
+      rt_fill(&dev, &enc, dbuf, abuf, s % PAT_COUNT, s % 3, seed + s);
+      delta += enc_pick_delta(&dev, &enc, abuf);
+      send_slices(&dev, &enc, dbuf, abuf);
+   }
+   if (!rt_check(&dev, &enc))
+   {
+      printf("digital 0x%X analog %u binary %u adc12 %u\n", d_mask, a_chans, binary, adc12);
+      test_fails++;
+   }
+   return delta;
+}
+
+//Wire bytes per sample of an analog pattern, with the delta mode on or off
+static double ratio(uint32_t a_chans, bool adc12, int apat, uint8_t enc_mode)
+{
+   sr_device_t dev;
+   sr_encoder_t enc;
+   rt_dev(&dev, &enc, 0, a_chans, SPH);
+   dev.enc_mode = enc_mode;
+   dev.adc12 = adc12;
+   test_rs = 42;
+   for (uint32_t s = 0; s < 4; s++)
+   {
+      rt_fill(&dev, &enc, dbuf, abuf, PAT_IDLE, apat, 10 + s);
+      send_slices(&dev, &enc, dbuf, abuf);
+   }
+   return (double)test_len / (4.0 * SPH);
+}
+
+int main(void)
+{
+   static const char *apat_names[3] = {"flat", "slow", "noise"};
+   uint32_t delta = 0;
+   delta += round_trip(0, 1, false, false, 100);
+   delta += round_trip(0, 3, false, false, 200);
+   delta += round_trip(0xFF, 3, false, false, 300);
+   delta += round_trip(0xF, 2, true, false, 400);
+   delta += round_trip(0xFFFF, 3, true, false, 500);
+   delta += round_trip(0, 3, false, true, 600);
+   delta += round_trip(0x1FFFFF, 2, false, true, 700);
+   //The flat and slow segments are sent as delta and the noisy ones aren't
+   CHECK(delta == 7 * SEGS * 2 / 3);
+
+   printf("analog adc12 input    plain  delta\n");
+   for (uint32_t a = 1; a <= RT_MAX_A_CHAN; a++)
+   {
+      for (int adc12 = 0; adc12 < 2; adc12++)
+      {
+         for (int apat = PAT_IDLE; apat <= PAT_20PCT; apat++)
+         {
+            double plain = ratio(a, adc12, apat, ENC_RLE);
+            double d = ratio(a, adc12, apat, ENC_DELTA);
+            printf("%6u %5u %-7s %6.3f %6.3f\n", a, adc12, apat_names[apat], plain, d);
+            if (apat == PAT_20PCT)
+            {
+               CHECK(d <= plain + 0.01);
+            }
+            else
+            {
+               //4 bit codes in 7 bit bytes are 4/7 of the byte per value of the analog
+               //slices, and a third of packed 12 bit values
+               CHECK(d <= plain * (adc12 ? 0.35 : 0.6));
+            }
+         }
+      }
+   }
+   return TEST_RESULT();
+}
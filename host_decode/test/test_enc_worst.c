@@ -0,0 +1,122 @@
+//enc_worst_bytes, which sizes the flash erased for a spooled capture, against the bytes
+//send_slices sends.  For every encoding, framing and analog width, segments where every
+//sample changes and segments of random values must never take more than it says.  Where the
+//encoding can't be switched to a smaller one, the segments where every sample changes must
+//come close to it, so that the spool isn't erased for much more than a capture can use.
+#include "sr_encode.h"
+#include "test_util.h"
+
+#define SPH 4096
+#define SEGS 6
+
+static uint8_t dbuf[SPH * 4] __attribute__((aligned(4)));
+static uint8_t abuf[SPH * 8 * 2] __attribute__((aligned(4)));
+
+typedef struct
+{
+   uint32_t d_mask, a_chans;
+   uint8_t enc_mode;
+   bool binary, adc12, tight;
+} cfg_t;
+
+static void setup(sr_device_t *d, sr_encoder_t *e, const cfg_t *c)
+{
+   init(d);
+   d->d_mask = c->d_mask;
+   d->a_mask = (1u << c->a_chans) - 1;
+   d->cont = true;
+   chan_counts(d);
+   d->a_chan_cnt = c->a_chans;
+   if (c->a_chans && (d->d_nps == 1))
+   {
+      d->d_nps = 2;
+   }
+   d->enc_mode = c->enc_mode;
+   d->binary = c->binary;
+   d->adc12 = c->adc12;
+   d->samples_per_half = SPH;
+   enc_init(e, test_sink);
+   e->d_dma_bps = d->d_nps >> 1;
+   test_len = 0;
+}
+
+static void check(const cfg_t *c)
+{
+   sr_device_t dev;
+   sr_encoder_t enc;
+   uint64_t worst, busy = 0;
+   setup(&dev, &enc, c);
+   worst = enc_worst_bytes(&dev, SEGS * SPH, SPH);
+   for (uint32_t s = 0; s < SEGS; s++)
+   {
+      uint32_t v = 0;
+      size_t start = test_len;
+      for (uint32_t i = 0; i < SPH; i++)
+      {
+         //Every other segment flips the lowest channel on each sample, so every sample changes
+         uint32_t r = (test_rnd() >> 8) ^ (test_rnd() << 12);
+         v = (s & 1) ? r & dev.d_mask : (v ^ (r | (dev.d_mask & -dev.d_mask))) & dev.d_mask;
+         test_put(dbuf, i, enc.d_dma_bps, v);
+      }
+      for (uint32_t i = 0; i < SPH * dev.a_chan_cnt; i++)
+      {
+         if (dev.adc12)
+         {
+            ((uint16_t *)abuf)[i] = (test_rnd() >> 8) & 0xFFF;
+         }
+         else
+         {
+            abuf[i] = test_rnd() >> 8;
+         }
+      }
+      send_slices(&dev, &enc, dbuf, abuf);
+      busy += (s & 1) ? 0 : test_len - start;
+   }
+   CHECK(test_len <= worst);
+   //The segments where every sample changes come close to their share of it
+   if (c->tight)
+   {
+      CHECK(worst / 2 <= busy + busy / 16 + SEGS * ENC_SEG_BYTES);
+   }
+   if (test_fails)
+   {
+      printf("digital 0x%X analog %u mode %u binary %u adc12 %u: sent %zu worst %llu\n", c->d_mask, c->a_chans,
+             c->enc_mode, c->binary, c->adc12, test_len, (unsigned long long)worst);
+   }
+}
+
+int main(void)
+{
+   static const cfg_t cfgs[] = {
+      //RLE, D4 and the 1, 2 and 4 byte modes
+      {0x1, 0, ENC_RLE, false, false, true}, {0xF, 0, ENC_RLE, false, false, true},
+      {0xFF, 0, ENC_RLE, false, false, true}, {0x3FFF, 0, ENC_RLE, false, false, true},
+      {0x1FFFFF, 0, ENC_RLE, false, false, true}, {0xFFFFFFFF, 0, ENC_RLE, false, false, true},
+      //Packed digital only blocks, picked for busy segments
+      {0xF, 0, ENC_ADAPT}, {0xFF, 0, ENC_ADAPT}, {0xFFFFFFFF, 0, ENC_ADAPT},
+      {0xFF, 0, ENC_RLE, true}, {0x1FFFFF, 0, ENC_ADAPT, true},
+      //7 bit analog slices
+      {0, 1, ENC_RLE, false, false, true}, {0xFF, 3, ENC_RLE, false, false, true},
+      {0xFFFF, 2, ENC_ADAPT, false, false, true},
+      //Packed analog blocks of binary framing and the 12 bit mode
+      {0, 3, ENC_RLE, true}, {0xFF, 1, ENC_RLE, true}, {0xF, 3, ENC_RLE, false, true, true},
+      {0xFFFF, 3, ENC_RLE, true, true},
+      //Delta blocks, which are only picked for slow analog inputs but may be for any segment
+      {0xFF, 3, ENC_DELTA}, {0, 2, ENC_DELTA, false, true},
+      {0x1FFFFF, 3, ENC_DELTA, true}, {0xF, 1, ENC_DELTA, true, true},
+   };
+   sr_device_t dev;
+   sr_encoder_t enc;
+   cfg_t d4 = {0xF, 0, ENC_RLE};
+   for (uint32_t c = 0; (c < sizeof(cfgs) / sizeof(cfgs[0])) && !test_fails; c++)
+   {
+      check(&cfgs[c]);
+   }
+
+   //D4 is a byte per sample at worst, and the segments only add their overhead
+   setup(&dev, &enc, &d4);
+   CHECK(enc_worst_bytes(&dev, 1000000, 10000) == 1000000 + 100 * ENC_SEG_BYTES);
+   CHECK(enc_worst_bytes(&dev, 1000001, 10000) == 1000001 + 101 * ENC_SEG_BYTES);
+   CHECK(enc_worst_bytes(&dev, 0, 0) == 0);
+   return TEST_RESULT();
+}
@@ -0,0 +1,70 @@
+//The model behind the 'e' estimate.  est_rate is compared with the same model worked out in
+//floating point over a spread of bench results, and must cap at the PIO limit of the clock
+//profile and the ADC limit, never gain from a slower encoder or USB link, and never lose from
+//overlapping the two.
+#include "sr_estimate.h"
+#include "sr_clock.h"
+#include "test_util.h"
+
+//Rate the model predicts, before the hardware limit
+static double ref_rate(const sr_est_bench_t *b, uint32_t usb_bps, bool overlap)
+{
+   double enc = (double)b->enc_us * 1e-6 / b->samples;
+   double usb = (double)b->bytes / usb_bps / b->samples;
+   double t = overlap ? ((enc > usb) ? enc : usb) : enc + usb;
+   return (t > 0) ? EST_MARGIN_PCT / (100.0 * t) : 1e30;
+}
+
+int main(void)
+{
+   sr_est_bench_t b = {16384, 8000, 16384};
+   //Worked by hand: 0.488us to encode and 2.857us to send each sample at the default rate
+   CHECK(est_rate(&b, EST_USB_BPS, false, 0, CLK_BOOT_PIO_MAX) == 239132);
+   CHECK(est_rate(&b, EST_USB_BPS, true, 0, CLK_BOOT_PIO_MAX) == 280000);
+   //Nothing to go on
+   b.samples = 0;
+   CHECK(est_rate(&b, EST_USB_BPS, false, 0, CLK_BOOT_PIO_MAX) == 0);
+   b.samples = 16384;
+   CHECK(est_rate(&b, 0, false, 0, CLK_BOOT_PIO_MAX) == 0);
+   //Free encoding and no bytes are only limited by the hardware
+   b.enc_us = 0;
+   b.bytes = 0;
+   CHECK(est_rate(&b, EST_USB_BPS, false, 0, clk_pio_max(0)) == CLK_BOOT_PIO_MAX);
+   CHECK(est_rate(&b, EST_USB_BPS, false, 0, clk_pio_max(3)) == CLK_MAX_HZ);
+   CHECK(est_rate(&b, EST_USB_BPS, false, 3, clk_pio_max(3)) == EST_ADC_MAX / 3);
+
+   for (uint32_t r = 0; r < 200000; r++)
+   {
+      uint32_t a = test_rnd() % 4;
+      uint32_t pio = clk_pio_max(test_rnd() % CLK_PROFILES);
+      uint32_t hw = a ? EST_ADC_MAX / a : pio;
+      uint32_t usb = 1000 + test_rnd() % 2000000;
+      b.samples = EST_SAMPLES >> (test_rnd() % 4);
+      b.enc_us = test_rnd() % 100000;
+      b.bytes = test_rnd() % (b.samples * 8 + 1);
+      for (int ov = 0; ov < 2; ov++)
+      {
+         uint32_t rate = est_rate(&b, usb, ov, a, pio);
+         double want = ref_rate(&b, usb, ov);
+         if (want > hw)
+         {
+            want = hw;
+         }
+         //Whole picoseconds per sample are a little off the floating point model
+         CHECK((rate <= want * 1.001 + 1) && (rate >= want * 0.999 - 1));
+         //Slower encoding or USB can't raise the rate
+         sr_est_bench_t slow = b;
+         slow.enc_us += 1 + b.enc_us / 8;
+         CHECK(est_rate(&slow, usb, ov, a, pio) <= rate);
+         CHECK(est_rate(&b, usb / 2, ov, a, pio) <= rate);
+         if (test_fails)
+         {
+            printf("samples %u us %u bytes %u usb %u overlap %d analog %u rate %u model %.0f\n",
+                   b.samples, b.enc_us, b.bytes, usb, ov, a, rate, want);
+            return TEST_RESULT();
+         }
+      }
+      CHECK(est_rate(&b, usb, true, a, pio) >= est_rate(&b, usb, false, a, pio));
+   }
+   return TEST_RESULT();
+}
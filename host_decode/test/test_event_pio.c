@@ -0,0 +1,138 @@
+//The event PIO program run on the PIO model against waveforms with runs of at least two
+//samples.  With the FIFO drained as fast as the DMA can, the records must be exactly the
+//changes of the waveform with their sample counts, at EV_PIO_CYCLES clocks per sample.  With
+//a slow drain some records are dropped, but the program must never stall, each record must
+//stay a whole pins and count pair of a real change at the right sample, and irq EV_OVF_IRQ
+//must be set exactly when a record went missing.
+#include "sr_event.h"
+#include "test_util.h"
+#include "pio_sim.h"
+
+#define N 100000
+
+static uint32_t wave[N];
+static uint32_t want_at[N]; // value + 1 of the record expected at each sample, or 0
+static uint32_t want_cnt;
+
+//The first in is 2 clocks after the entry
+static uint32_t wave_pins(uint64_t cycle, void *ctx)
+{
+   uint64_t k = (cycle >= 2) ? (cycle - 2) / EV_PIO_CYCLES : 0;
+   return (k < N) ? wave[k] : wave[N - 1];
+}
+
+//Runs of at least two samples, mostly short bursts or long idles
+static void make_wave(uint32_t pins, uint32_t seed)
+{
+   uint32_t mask = (pins < 32) ? (1u << pins) - 1 : 0xFFFFFFFF;
+   uint32_t v = 0, k = 0, last;
+   test_rs = seed;
+   while (k < N)
+   {
+      uint32_t r = 2 + ((test_rnd() % 4) ? test_rnd() % 3 : test_rnd() % 2000);
+      for (uint32_t i = 0; (i < r) && (k < N); i++)
+      {
+         wave[k++] = v;
+      }
+      v = (v + 1 + test_rnd()) & mask;
+   }
+   //An idle end, so every change has been pushed when the run stops
+   for (k = N - 16; k < N; k++)
+   {
+      wave[k] = wave[N - 17];
+   }
+   //The first sample always makes a record, then each change that isn't on the sample
+   //after a record
+   memset(want_at, 0, sizeof(want_at));
+   want_at[0] = wave[0] + 1;
+   want_cnt = 1;
+   last = wave[0];
+   for (k = 2; k < N; k++)
+   {
+      if (wave[k] != last)
+      {
+         want_at[k] = wave[k] + 1;
+         want_cnt++;
+         last = wave[k];
+         k++;
+      }
+   }
+}
+
+//Run the program over the waveform, popping a word every drain clocks.  Returns the records
+//received.
+static uint32_t run(uint32_t pins, uint32_t drain)
+{
+   uint16_t prog[EV_PIO_MAX_INSTR];
+   uint32_t wrap, entry, len, v, got = 0, words = 0, pair[2];
+   int64_t prev = -1;
+   pio_sim_t s;
+   len = ev_pio_program(pins, prog, &wrap, &entry);
+   CHECK(len <= EV_PIO_MAX_INSTR);
+   pio_sim_init(&s, prog, entry, wave_pins, 0);
+   s.wrap = wrap;
+   s.fifo_depth = 8;
+   s.status_n = EV_FIFO_ROOM;
+   //Stop short of the last samples so that every record made has been pushed
+   while (s.cycle < (uint64_t)(N - 4) * EV_PIO_CYCLES)
+   {
+      pio_sim_step(&s);
+      if ((s.cycle % drain) || !pio_sim_pop(&s, &v))
+      {
+         continue;
+      }
+      pair[words++] = v;
+      if (words < 2)
+      {
+         continue;
+      }
+      words = 0;
+      uint32_t idx = ~pair[1];
+      //A whole record of a change at its own sample, after the one before it
+      if ((idx >= N) || (want_at[idx] != pair[0] + 1) || ((int64_t)idx <= prev))
+      {
+         printf("record %u pins 0x%X count 0x%X\n", got, pair[0], pair[1]);
+         test_fails++;
+         break;
+      }
+      prev = idx;
+      got++;
+   }
+   //Drain what is left
+   while (pio_sim_pop(&s, &v))
+   {
+      pair[words++] = v;
+      if (words == 2)
+      {
+         words = 0;
+         CHECK(((~pair[1]) < N) && (want_at[~pair[1]] == pair[0] + 1));
+         got++;
+      }
+   }
+   CHECK(!s.bad && (s.stalls == 0) && (words == 0));
+   CHECK(((s.irq >> EV_OVF_IRQ) & 1) == (got < want_cnt));
+   CHECK(got <= want_cnt);
+   return got;
+}
+
+int main(void)
+{
+   uint32_t pins[] = {1, 4, 8, 16, 21, 31};
+   uint32_t dropped = 0;
+   for (uint32_t p = 0; p < sizeof(pins) / sizeof(pins[0]); p++)
+   {
+      make_wave(pins[p], 10 + p);
+      //The DMA takes a word a clock, so nothing is lost
+      CHECK(run(pins[p], 1) == want_cnt);
+      //Bursts of changes fill a FIFO that drains at less than a record per two samples
+      dropped += want_cnt - run(pins[p], 20);
+      CHECK(run(pins[p], 4) == want_cnt);
+      if (test_fails)
+      {
+         printf("pins %u\n", pins[p]);
+         return TEST_RESULT();
+      }
+   }
+   CHECK(dropped > 0);
+   return TEST_RESULT();
+}
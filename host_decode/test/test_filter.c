@@ -0,0 +1,145 @@
+//filt_run against a per channel, per sample reference of the glitch filter and of each
+//decimation mode, for every DMA sample width.  The same samples are also filtered in random
+//pieces, as the segments of a capture are, to check that the state carries across calls.
+#include "sr_filter.h"
+#include "test_util.h"
+
+#define SAMPLES 5000
+
+static uint8_t in[SAMPLES * 4] __attribute__((aligned(4)));
+static uint8_t out[SAMPLES * 4] __attribute__((aligned(4)));
+static uint32_t ref[SAMPLES];
+
+//Each channel on its own takes a new level once it has been seen glitch times in a row
+static void ref_glitch(uint32_t *v, uint32_t n, uint32_t chans, uint32_t glitch)
+{
+   uint32_t acc = v[0], run[32] = {0};
+   for (uint32_t i = 0; i < n; i++)
+   {
+      for (uint32_t b = 0; (glitch > 1) && (b < chans); b++)
+      {
+         uint32_t bit = 1u << b;
+         run[b] = ((v[i] ^ acc) & bit) ? run[b] + 1 : 0;
+         if (run[b] >= glitch)
+         {
+            acc ^= bit;
+            run[b] = 0;
+         }
+      }
+      v[i] = (glitch > 1) ? acc : v[i];
+   }
+}
+
+static uint32_t ref_decim(uint32_t *v, uint32_t n, uint32_t chans, uint32_t decim, uint8_t mode)
+{
+   uint32_t j = 0;
+   for (uint32_t g = 0; (g + 1) * decim <= n; g++)
+   {
+      uint32_t o = 0;
+      for (uint32_t b = 0; b < chans; b++)
+      {
+         uint32_t ones = 0;
+         for (uint32_t k = 0; k < decim; k++)
+         {
+            ones += (v[g * decim + k] >> b) & 1;
+         }
+         if (((mode == FILT_OR) && ones) || ((mode == FILT_MAJ) && (ones * 2 > decim)) ||
+             ((mode == FILT_LAST) && ((v[g * decim + decim - 1] >> b) & 1)))
+         {
+            o |= 1u << b;
+         }
+      }
+      v[j++] = o;
+   }
+   return j;
+}
+
+int main(void)
+{
+   uint8_t widths[] = {0, 1, 2, 4};
+   uint32_t glitches[] = {0, 1, 2, 3, 7, 40};
+   uint32_t decims[] = {1, 2, 3, 8, 100};
+   sr_filter_t f;
+   uint32_t runs = 0;
+
+   //A clean edge on D0 gets through while D1 glitches the whole time
+   filt_init(&f, 1, FILT_LAST, 3);
+   for (uint32_t i = 0; i < 40; i++)
+   {
+      in[i] = ((i >= 10) ? 1 : 0) | ((i & 1) ? 2 : 0);
+   }
+   CHECK(filt_run(&f, in, 40, 1) == 40);
+   CHECK((in[11] == 0) && (in[12] == 1) && (in[39] == 1));
+
+   test_rs = 3;
+   for (uint32_t w = 0; w < sizeof(widths); w++)
+   {
+      uint8_t bps = widths[w];
+      uint32_t chans = bps ? bps * 8 : 4;
+      uint32_t mask = (chans == 32) ? 0xFFFFFFFF : (1u << chans) - 1;
+      for (uint32_t g = 0; g < sizeof(glitches) / sizeof(glitches[0]); g++)
+      {
+         for (uint32_t d = 0; d < sizeof(decims) / sizeof(decims[0]); d++)
+         {
+            for (uint8_t mode = FILT_LAST; mode <= FILT_MAJ; mode++)
+            {
+               uint32_t n = 1 + test_rnd() % SAMPLES;
+               uint32_t m, got = 0;
+               pat_fill(in, n, bps, mask, (runs & 1) ? PAT_20PCT : PAT_RANDOM, runs);
+               //Bounces of a few samples around some edges
+               for (uint32_t i = 1; i + 8 < n; i++)
+               {
+                  if ((test_rnd() % 50) == 0)
+                  {
+                     test_put(in, i, bps, test_get(in, i, bps) ^ (1u << (test_rnd() % chans)));
+                  }
+               }
+               for (uint32_t i = 0; i < n; i++)
+               {
+                  ref[i] = test_get(in, i, bps);
+               }
+               ref_glitch(ref, n, chans, glitches[g]);
+               m = (decims[d] > 1) ? ref_decim(ref, n, chans, decims[d], mode) : n;
+
+               filt_init(&f, decims[d], mode, glitches[g]);
+               CHECK(filt_active(&f) == ((glitches[g] > 1) || (decims[d] > 1)));
+               memcpy(out, in, sizeof(in));
+               CHECK(filt_run(&f, out, n, bps) == m);
+               for (uint32_t i = 0; (i < m) && !test_fails; i++)
+               {
+                  CHECK(test_get(out, i, bps) == ref[i]);
+               }
+               //In pieces of an even number of samples, each filtered in place
+               filt_init(&f, decims[d], mode, glitches[g]);
+               memcpy(out, in, sizeof(in));
+               for (uint32_t start = 0; start < n;)
+               {
+                  uint32_t len = 2 + 2 * (test_rnd() % 200);
+                  uint32_t k;
+                  if (len > n - start)
+                  {
+                     len = n - start;
+                  }
+                  k = filt_run(&f, out + (bps ? start * bps : start / 2), len, bps);
+                  for (uint32_t i = 0; (i < k) && !test_fails; i++)
+                  {
+                     CHECK(test_get(out + (bps ? start * bps : start / 2), i, bps) == ref[got + i]);
+                  }
+                  got += k;
+                  start += len;
+               }
+               CHECK(got == m);
+               if (test_fails)
+               {
+                  printf("bps %u glitch %u decim %u mode %u samples %u\n", bps, glitches[g],
+                         decims[d], mode, n);
+                  return TEST_RESULT();
+               }
+               runs++;
+            }
+         }
+      }
+   }
+   printf("%u runs match\n", runs);
+   return TEST_RESULT();
+}
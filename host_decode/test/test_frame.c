@@ -0,0 +1,132 @@
+//The segmented capture bookkeeping: frame_layout for every sample width and a range of frame
+//counts and sizes must give slots that fit the buffer after the ring and don't overlap.
+//Frames filled with frame_copy in pieces from random places in DMA segments must hold the
+//bytes of those pieces in order, in their own slot and nowhere else, and frame_gap must give
+//the sent samples between the frames from their start indexes.
+#include "sr_frame.h"
+#include "sr_device.h"
+#include "test_util.h"
+
+#define BUF_SIZE 200000
+#define SEG_SAMPLES 1024
+#define FILL 0xA5
+
+static uint8_t buf[BUF_SIZE] __attribute__((aligned(4)));
+static uint8_t dseg[SEG_SAMPLES * 4] __attribute__((aligned(4)));
+static uint8_t aseg[SEG_SAMPLES * 6];
+static uint8_t want_d[BUF_SIZE], want_a[BUF_SIZE];
+
+//Fill every slot of f from random pieces of segments, then check each one and the bytes
+//around the slots
+static void fill_check(const sr_frames_t *f, uint32_t d_nibbles, uint32_t a_nibbles)
+{
+   memset(buf, FILL, sizeof(buf));
+   for (uint32_t k = 0; k < f->frames; k++)
+   {
+      uint8_t *slot = &buf[frame_slot(f, k)];
+      uint32_t fill = 0;
+      frame_set_start(slot, ((uint64_t)k << 33) + k);
+      while (fill < f->samples)
+      {
+         uint32_t from = (test_rnd() % (SEG_SAMPLES / 8)) * 8;
+         uint32_t n = (1 + test_rnd() % ((SEG_SAMPLES - from) / 8)) * 8;
+         if (n > f->samples - fill)
+         {
+            n = f->samples - fill;
+         }
+         for (uint32_t i = 0; i < sizeof(dseg); i++)
+         {
+            dseg[i] = test_rnd();
+         }
+         for (uint32_t i = 0; i < sizeof(aseg); i++)
+         {
+            aseg[i] = test_rnd();
+         }
+         frame_copy(f, slot, fill, dseg, aseg, from, n);
+         memcpy(want_d + fill * d_nibbles / 2, dseg + from * d_nibbles / 2, n * d_nibbles / 2);
+         memcpy(want_a + fill * a_nibbles / 2, aseg + from * a_nibbles / 2, n * a_nibbles / 2);
+         fill += n;
+      }
+      CHECK(frame_start(slot) == ((uint64_t)k << 33) + k);
+      CHECK(memcmp(frame_dbuf(slot), want_d, f->d_bytes) == 0);
+      CHECK(memcmp(frame_abuf(f, slot), want_a, f->a_bytes) == 0);
+   }
+   //Nothing is written to the ring, the padding at the end of a slot or past the last slot
+   for (uint32_t i = 0; i < f->base; i++)
+   {
+      CHECK(buf[i] == FILL);
+   }
+   for (uint32_t k = 0; k < f->frames; k++)
+   {
+      for (uint32_t i = FRAME_HDR_SIZE + f->d_bytes + f->a_bytes; i < f->slot_size; i++)
+      {
+         CHECK(buf[frame_slot(f, k) + i] == FILL);
+      }
+   }
+   for (uint32_t i = frame_slot(f, f->frames); i < BUF_SIZE; i++)
+   {
+      CHECK(buf[i] == FILL);
+   }
+}
+
+int main(void)
+{
+   static const uint32_t d_nibs[] = {0, 1, 2, 4, 8};
+   static const uint32_t a_nibs[] = {0, 2, 4, 6};
+   static const uint32_t caps[] = {1, 8, 100, 1001, 5000, 40000};
+   static const uint32_t frames[] = {1, 2, 7, 64, 1000};
+   sr_frames_t f;
+   uint8_t slot[FRAME_HDR_SIZE], prev[FRAME_HDR_SIZE];
+   uint32_t fits = 0;
+   for (uint32_t di = 0; di < sizeof(d_nibs) / sizeof(d_nibs[0]); di++)
+   {
+      for (uint32_t ai = 0; ai < sizeof(a_nibs) / sizeof(a_nibs[0]); ai++)
+      {
+         if (!d_nibs[di] && !a_nibs[ai])
+         {
+            continue;
+         }
+         for (uint32_t ci = 0; ci < sizeof(caps) / sizeof(caps[0]); ci++)
+         {
+            for (uint32_t fi = 0; fi < sizeof(frames) / sizeof(frames[0]); fi++)
+            {
+               bool ok = frame_layout(&f, BUF_SIZE, d_nibs[di], a_nibs[ai], caps[ci], frames[fi], DMA_SEGMENTS);
+               CHECK((f.samples % 8 == 0) && (f.samples >= caps[ci]) && (f.samples < caps[ci] + 8));
+               CHECK((f.base <= BUF_SIZE / FRAME_RING_DIV) && (f.base % 4 == 0));
+               CHECK((f.d_bytes == f.samples * d_nibs[di] / 2) && (f.a_bytes == f.samples * a_nibs[ai] / 2));
+               CHECK((f.slot_size % 4 == 0) && (f.slot_size >= FRAME_HDR_SIZE + f.d_bytes + f.a_bytes)
+                     && (f.slot_size < FRAME_HDR_SIZE + f.d_bytes + f.a_bytes + 4));
+               //It fails only when the slots don't fit
+               CHECK(ok == ((uint64_t)f.slot_size * frames[fi] <= BUF_SIZE - f.base));
+               if (ok)
+               {
+                  fits++;
+                  fill_check(&f, d_nibs[di], a_nibs[ai]);
+               }
+               if (test_fails)
+               {
+                  printf("d_nibbles %u a_nibbles %u samples %u frames %u\n", d_nibs[di], a_nibs[ai], caps[ci],
+                         frames[fi]);
+                  return TEST_RESULT();
+               }
+            }
+         }
+      }
+   }
+   CHECK(fits > 100);
+   CHECK(!frame_layout(&f, BUF_SIZE, 2, 0, 100, 0, DMA_SEGMENTS));
+
+   //The gap before a frame is in sent samples, from the end of the frame before it
+   frame_set_start(slot, 1000);
+   CHECK(frame_gap(NULL, slot, 1, 100) == 1000);
+   CHECK(frame_gap(NULL, slot, 4, 100) == 250);
+   frame_set_start(prev, 400);
+   CHECK(frame_gap(prev, slot, 1, 100) == 500);
+   CHECK(frame_gap(prev, slot, 4, 100) == 50);
+   CHECK(frame_gap(prev, slot, 1, 600) == 0);
+   CHECK(frame_gap(prev, slot, 1, 700) == 0);
+   frame_set_start(prev, 5ull << 34);
+   frame_set_start(slot, (5ull << 34) + 3000);
+   CHECK(frame_gap(prev, slot, 2, 1000) == 500);
+   return TEST_RESULT();
+}
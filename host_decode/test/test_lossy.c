@@ -0,0 +1,118 @@
+//The lossy continuous mode as send_half and send_segment run it: segments are filtered and
+//encoded into the stage, some are dropped as if the DMA overwrote them or their encoding
+//didn't fit, and runs of segments are skipped as if USB stalled.  The capture must decode
+//to the samples of the segments that were kept with a gap in place of each drop, the gap
+//counts must be of filtered samples so the timeline keeps its length, and the glitch filter
+//must start over after a gap.
+#include "test_util.h"
+#include "test_roundtrip.h"
+#include "sr_filter.h"
+#include "sr_stage.h"
+
+#define SPH 4096
+#define SEGS 40
+
+static uint8_t dbuf[SPH * 4] __attribute__((aligned(4)));
+static uint8_t sbuf[SPH * 8];
+static sr_stage_t stage;
+
+static void stage_sink(const char *buf, int length)
+{
+   stage_write(&stage, buf, length);
+}
+
+static void lossy(uint32_t d_mask, uint32_t decim, uint8_t mode, uint32_t glitch, uint32_t stage_size,
+                  uint32_t seed)
+{
+   sr_device_t dev;
+   sr_encoder_t enc;
+   sr_filter_t filt;
+   uint64_t raw = 0;
+   uint32_t gaps = 0, drops = 0, skips = 0;
+   bool after_gap = false;
+   rt_dev(&dev, &enc, d_mask, 0, SPH);
+   stage_init(&stage, sbuf, stage_size, test_sink);
+   enc.sink = stage_sink;
+   filt_init(&filt, decim, mode, glitch);
+   test_rs = seed;
+   for (uint32_t s = 0; s < SEGS; s++)
+   {
+      uint32_t n = SPH, first;
+      //send_half falling behind by a few segments
+      if ((s > 0) && (test_rnd() % 6 == 0))
+      {
+         uint32_t k = 1 + test_rnd() % 3;
+         uint32_t g = filt_gap(&filt, k * SPH);
+         rt_gap(&enc, g);
+         gaps += g;
+         raw += k * SPH;
+         skips++;
+         after_gap = true;
+      }
+      //Quiet segments fit the smaller stages and busy ones don't
+      pat_fill(dbuf, SPH, enc.d_dma_bps, d_mask, (s & 1) ? PAT_RANDOM : PAT_1PCT, seed + s);
+      first = test_get(dbuf, 0, enc.d_dma_bps);
+      stage_begin(&stage, &enc);
+      if (filt_active(&filt))
+      {
+         n = filt_run(&filt, dbuf, SPH, enc.d_dma_bps);
+      }
+      //The glitch filter takes the first sample after a gap as it is
+      if (after_gap && (glitch > 1) && (decim == 1))
+      {
+         CHECK(test_get(dbuf, 0, enc.d_dma_bps) == first);
+      }
+      for (uint32_t i = 0; i < n; i++)
+      {
+         rt_want[rt_nwant + i] = test_get(dbuf, i, enc.d_dma_bps);
+      }
+      dev.samples_per_half = n;
+      if (n)
+      {
+         send_slices(&dev, &enc, dbuf, NULL);
+      }
+      dev.samples_per_half = SPH;
+      raw += SPH;
+      after_gap = stage.over || (test_rnd() % 5 == 0);
+      if (after_gap)
+      {
+         stage_drop(&stage, &enc, n);
+         filt_gap(&filt, 0);
+         rt_expect_gap(n);
+         gaps += n;
+         drops++;
+      }
+      else
+      {
+         rt_nwant += n;
+      }
+      //tx_end_of_half
+      stage_send(&stage);
+   }
+   //Every group of decim samples is either sent or part of a gap
+   CHECK(rt_nwant + gaps == raw / decim);
+   CHECK(drops && skips);
+   if (!rt_check(&dev, &enc) || test_fails)
+   {
+      printf("digital 0x%X decim %u mode %u glitch %u stage %u drops %u skips %u\n", d_mask, decim, mode,
+             glitch, stage_size, drops, skips);
+      test_fails++;
+   }
+}
+
+int main(void)
+{
+   uint32_t masks[] = {0xF, 0xFF, 0xFFFF, 0x1FFFFF};
+   for (uint32_t m = 0; m < 4; m++)
+   {
+      lossy(masks[m], 1, FILT_LAST, 0, sizeof(sbuf), 100 + m);
+      lossy(masks[m], 1, FILT_LAST, 5, sizeof(sbuf), 200 + m);
+      lossy(masks[m], 3, FILT_LAST, 0, sizeof(sbuf), 300 + m);
+      lossy(masks[m], 7, FILT_MAJ, 4, sizeof(sbuf), 400 + m);
+      lossy(masks[m], 10, FILT_OR, 0, sizeof(sbuf), 500 + m);
+      //A stage too small for the busy segments
+      lossy(masks[m], 1, FILT_LAST, 0, SPH / 4, 600 + m);
+      lossy(masks[m], 5, FILT_LAST, 3, SPH / 8, 700 + m);
+   }
+   return TEST_RESULT();
+}
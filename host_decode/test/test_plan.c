@@ -0,0 +1,175 @@
+//plan_update over a sweep of configurations, against the way the start of a capture worked
+//out the rate, decimation, layout, programs and dividers before there was a plan.  An
+//unchanged configuration must keep the plan and a change to any part of the key must make
+//a new one.  With the profiles that set the clock, the PIO clock must be a whole divide of
+//clk_sys when clk_solve says it is.
+#include "sr_plan.h"
+#include "hardware/pio_instructions.h"
+#include "test_util.h"
+
+#define BUF_SIZE 200000
+#define SYS_HZ 125000000
+
+static sr_plan_t p;
+static sr_clk_t boot;
+
+static void setup(sr_device_t *d, uint32_t rate, uint32_t n, uint32_t d_mask, uint32_t a_mask)
+{
+   memset(d, 0, sizeof(*d));
+   init(d);
+   d->buf_size = BUF_SIZE;
+   d->sample_rate = rate;
+   d->num_samples = n;
+   d->d_mask = d_mask;
+   d->a_mask = a_mask;
+}
+
+//Check the plan for d made with the boot clock
+static void check_boot(sr_device_t *d)
+{
+   uint32_t gen = p.gen;
+   sr_layout_t lay;
+   bool triggered, ev, ok;
+   uint32_t sr, n, decim, pins = 0;
+   plan_update(&p, d, &boot);
+   CHECK(p.gen == gen + 1);
+   CHECK(!plan_update(&p, d, &boot) && (p.gen == gen + 1));
+   sr = d->sample_rate & ~1u;
+   n = (d->num_samples < 16) ? 16 : d->num_samples;
+   n = (n + 3) & ~3u;
+   CHECK((p.sample_rate == sr) && (p.num_samples == n));
+   decim = (d->a_chan_cnt) ? 1 : d->decim;
+   if (decim > CLK_BOOT_PIO_MAX / sr)
+   {
+      decim = CLK_BOOT_PIO_MAX / sr;
+   }
+   decim = (decim < 1) ? 1 : decim;
+   CHECK((p.decim == decim) && (p.cap_samples == n * decim));
+   triggered = (d->d_mask == 0) || !trig_enabled(&d->trig);
+   CHECK(p.triggered == triggered);
+   ev = d->events && d->d_mask && !d->a_chan_cnt && triggered && (decim == 1) && !d->glitch
+        && ((uint64_t)sr * EV_PIO_CYCLES <= SYS_HZ);
+   CHECK(p.ev_run == ev);
+   memset(&lay, 0, sizeof(lay));
+   ok = ring_layout(&lay, BUF_SIZE, ev ? EV_REC_WORDS * 8 : d->d_nps, d->a_chan_cnt * 2, n * decim,
+                    !d->cont && triggered && !ev, DMA_SEGMENTS);
+   CHECK((p.lay_ok == ok) && (!ok || (memcmp(&lay, &p.lay, sizeof(lay)) == 0)));
+   pins += (d->d_mask & 0xF) ? 4 : 0;
+   pins += (d->d_mask & 0xF0) ? 4 : 0;
+   pins += (d->d_mask & 0xFF00) ? 8 : 0;
+   pins += (d->d_mask & 0x0FFF0000) ? 16 : 0;
+   pins = ((pins == 4) && d->a_chan_cnt) ? 8 : pins;
+   CHECK(p.pin_count == pins);
+   if (d->d_mask)
+   {
+      uint32_t pio = sr * decim * (ev ? EV_PIO_CYCLES : 1);
+      uint32_t div = SYS_HZ / pio;
+      CHECK((p.pio_rate == pio) && (p.div_int == ((div < 1) ? 1 : div)));
+      CHECK(p.div_frac == ((pio > SYS_HZ) ? 0 : (uint8_t)(((uint64_t)(SYS_HZ % pio) * 256) / pio)));
+      if (ev)
+      {
+         CHECK(p.prog_len > 1);
+      }
+      else
+      {
+         CHECK((p.prog_len == 1) && (p.prog[0] == pio_encode_in(pio_pins, pins)) && (p.wrap == 0) && (p.entry == 0));
+      }
+      //The fractional divider is within 1/256 of a clock of the rate asked for
+      if (pio <= SYS_HZ)
+      {
+         CHECK((p.rate + sr / 256 + 1 >= sr) && (p.rate <= sr + sr / 256 + 1));
+      }
+   }
+   else
+   {
+      CHECK(p.prog_len == 0);
+   }
+   if (d->a_chan_cnt)
+   {
+      uint32_t adi = 48000000ULL / (sr * d->a_chan_cnt);
+      uint8_t af = (uint8_t)(((48000000ULL % sr) * 256ULL) / sr);
+      CHECK(p.adc_div == ((adi <= 96) ? 0 : (((adi - 1) << 8) | af)));
+   }
+   CHECK((p.trig_len != 0) == !triggered);
+   CHECK(!p.fr_run && (p.clk.sys_hz == SYS_HZ));
+}
+
+int main(void)
+{
+   static const uint32_t rates[] = {5000, 10000, 100001, 500000, 1000000, 1999999, 10000000, 24000000,
+                                    50000000, 120000000, 120000016};
+   static const uint32_t ns[] = {1, 10, 17, 1000, 100000, 10000001};
+   static const uint32_t dms[] = {0, 1, 0xF, 0x1F, 0xFF, 0xFFFF, 0x10000, 0x1FFFFFF};
+   static const uint32_t ams[] = {0, 1, 3, 7};
+   static const uint32_t decims[] = {1, 4, 100};
+   sr_device_t d;
+   uint32_t g;
+   boot.sys_hz = SYS_HZ;
+   for (uint32_t ri = 0; ri < sizeof(rates) / sizeof(rates[0]); ri++)
+      for (uint32_t ni = 0; ni < sizeof(ns) / sizeof(ns[0]); ni++)
+         for (uint32_t di = 0; di < sizeof(dms) / sizeof(dms[0]); di++)
+            for (uint32_t ai = 0; ai < sizeof(ams) / sizeof(ams[0]); ai++)
+               for (uint32_t k = 0; k < 3 * 8; k++)
+               {
+                  setup(&d, rates[ri], ns[ni], dms[di], ams[ai]);
+                  d.decim = decims[k % 3];
+                  d.events = (k / 3) & 1;
+                  d.cont = (k / 6) & 1;
+                  if ((k / 12) & 1)
+                  {
+                     trig_add(&d.trig, 2, 0);
+                  }
+                  check_boot(&d);
+                  if (test_fails)
+                  {
+                     printf("rate %u n %u d 0x%X a 0x%X decim %u events %u cont %u\n", d.sample_rate,
+                            d.num_samples, d.d_mask, d.a_mask, d.decim, d.events, d.cont);
+                     return TEST_RESULT();
+                  }
+               }
+
+   //A count that rounds to the same one keeps the plan, and any change to the key makes a new one
+   setup(&d, 1000000, 1001, 0xFF, 0);
+   plan_update(&p, &d, &boot);
+   g = p.gen;
+   d.num_samples = 1003;
+   CHECK(!plan_update(&p, &d, &boot));
+   d.sample_rate++;
+   CHECK(!plan_update(&p, &d, &boot));
+   d.glitch = 2;
+   CHECK(plan_update(&p, &d, &boot) && (p.gen == g + 1));
+   trig_add(&d.trig, 4, 3);
+   CHECK(plan_update(&p, &d, &boot) && !p.triggered);
+   d.frames = 4;
+   CHECK(plan_update(&p, &d, &boot) && p.fr_run && (memcmp(&p.lay, &p.fr.lay, sizeof(p.lay)) == 0));
+   d.cont = true;
+   CHECK(plan_update(&p, &d, &boot) && !p.fr_run);
+   d.adc12 = true;
+   CHECK(plan_update(&p, &d, &boot));
+   d.buf_size /= 2;
+   CHECK(plan_update(&p, &d, &boot));
+   boot.sys_hz++;
+   CHECK(plan_update(&p, &d, &boot));
+   boot.sys_hz = SYS_HZ;
+   d.clk_profile = 1;
+   CHECK(plan_update(&p, &d, &boot));
+   CHECK(!plan_update(&p, &d, &boot));
+
+   //The profiles that set the clock stay under their limit, and an exact clock needs no fraction
+   for (uint32_t prof = 1; prof < CLK_PROFILES; prof++)
+   {
+      for (uint32_t ri = 0; ri < sizeof(rates) / sizeof(rates[0]); ri++)
+      {
+         setup(&d, rates[ri], 1000, 0xFF, 0);
+         d.clk_profile = prof;
+         CHECK(plan_update(&p, &d, &boot));
+         CHECK((p.clk.sys_hz <= clk_profiles[prof].max_hz) && (p.clk.sys_hz >= CLK_SYS_MIN));
+         CHECK(p.decim == 1);
+         if (p.clk.exact)
+         {
+            CHECK((p.div_frac == 0) && (p.clk.sys_hz % p.pio_rate == 0) && (p.rate == p.sample_rate));
+         }
+      }
+   }
+   return TEST_RESULT();
+}
@@ -0,0 +1,132 @@
+//Segment bookkeeping of the DMA ring.  The two DMA channels are walked through their write
+//address tables as the maintenance DMAs do, and a producer that fills one word per tick
+//races a consumer with random speed and stalls.  Every word the consumer reads must be from
+//the segment it is sending unless seg_overflow has already stopped the capture, and
+//seg_overflow must only stop it once the DMA really is writing the segment being sent.
+#include "sr_ring.h"
+#include "test_util.h"
+
+#define MAX_SEGS 16
+#define SEG_WORDS 64
+
+//Follow the two channels around the ring for 3 laps, reading their tables as a DMA ring
+//of seg_ring_bits bytes, and check that segment k is always written at its seg_index
+static void check_tables(uint32_t num_segs)
+{
+   uint32_t tbl[2][MAX_SEGS / 2] __attribute__((aligned(64)));
+   uint32_t addr[2] = {1000, 1000 + 10};
+   uint32_t rd[2] = {0, 0};
+   uint32_t bits = seg_ring_bits(num_segs);
+   seg_addr_table(tbl[0], tbl[1], 1000, 10, num_segs);
+   CHECK((1u << bits) == num_segs / 2 * sizeof(uint32_t));
+   for (uint32_t k = 0; k < 3 * num_segs; k++)
+   {
+      uint32_t ch = k & 1;
+      CHECK(addr[ch] == 1000 + 10 * seg_index(k, num_segs));
+      addr[ch] = tbl[ch][rd[ch] / sizeof(uint32_t)];
+      rd[ch] = (rd[ch] + sizeof(uint32_t)) & ((1u << bits) - 1);
+   }
+}
+
+//One capture.  rate is the consumer's words per 16 ticks.  It stops for stall ticks after
+//every stall_every segments, or for a random time up to stall after a random 20% of them if
+//stall_every is 0.  start is the initial count, to cross the 32 bit wrap.  Returns the
+//segments sent before an overflow, or total if there was none.
+static uint32_t race(uint32_t num_segs, uint32_t rate, uint32_t stall_every, uint32_t stall,
+                     uint32_t start, uint32_t total)
+{
+   static uint32_t stamp[MAX_SEGS][SEG_WORDS];
+   uint32_t dma_halves = start, num_halves = start;
+   uint32_t dma_word = 0, sent_word = 0, acc = 0, wait = 0;
+   memset(stamp, 0xFF, sizeof(stamp));
+   while (num_halves - start < total)
+   {
+      //The producer never waits
+      stamp[seg_index(dma_halves, num_segs)][dma_word] = dma_halves;
+      if (++dma_word == SEG_WORDS)
+      {
+         dma_word = 0;
+         dma_halves++;
+         //dma_int_handler's check, after the count is moved on
+         if (seg_overflow(dma_halves, num_halves, num_segs))
+         {
+            //The segment about to be written is the one being sent
+            CHECK(seg_index(dma_halves, num_segs) == seg_index(num_halves, num_segs));
+            return num_halves - start;
+         }
+      }
+      if (wait)
+      {
+         wait--;
+         continue;
+      }
+      for (acc += rate; acc >= 16; acc -= 16)
+      {
+         //send_half only starts on a filled segment
+         if (dma_halves == num_halves)
+         {
+            break;
+         }
+         if (stamp[seg_index(num_halves, num_segs)][sent_word] != num_halves)
+         {
+            printf("segs %u sent %u word %u from %u\n", num_segs, num_halves, sent_word,
+                   stamp[seg_index(num_halves, num_segs)][sent_word]);
+            test_fails++;
+            return 0;
+         }
+         if (++sent_word == SEG_WORDS)
+         {
+            sent_word = 0;
+            num_halves++;
+            if (stall_every)
+            {
+               wait = ((num_halves - start) % stall_every) ? 0 : stall;
+            }
+            else if ((test_rnd() % 100) < 20)
+            {
+               wait = test_rnd() % (stall + 1);
+            }
+         }
+      }
+   }
+   return total;
+}
+
+int main(void)
+{
+   uint32_t starts[] = {0, 0xFFFFFFFF - 37};
+   for (uint32_t n = 2; n <= MAX_SEGS; n *= 2)
+   {
+      check_tables(n);
+      CHECK(!seg_overflow(n - 1, 0, n));
+      CHECK(seg_overflow(n, 0, n));
+      CHECK(!seg_overflow(n - 1 + 5, 5, n));
+      CHECK(seg_overflow(4, 0xFFFFFFFF - n + 5, n));
+   }
+   CHECK(seg_count(10, 8, false) == 8);
+   CHECK(seg_count(5, 8, false) == 4);
+   CHECK(seg_count(1, 8, false) == 2);
+   CHECK(seg_count(100, 8, true) == 2);
+
+   for (uint32_t s = 0; s < 2; s++)
+   {
+      test_rs = 1234;
+      for (uint32_t n = 2; n <= MAX_SEGS; n *= 2)
+      {
+         //A consumer that is slower than the producer always overflows, and never reads a
+         //segment that was overwritten before it does
+         CHECK(race(n, 12, 0, 0, starts[s], 1000) < 1000);
+         //A faster consumer with random stalls only ever reads whole segments
+         for (uint32_t stall = 0; stall < 100; stall++)
+         {
+            race(n, 24, 0, SEG_WORDS * stall / 10, starts[s], 200);
+         }
+         //A consumer that is twice as fast absorbs a stall of a little under num_segs-1
+         //segment times, as it must still send the next segment before the DMA comes round
+         //to it, but not a stall of num_segs segment times
+         CHECK(race(n, 32, 4 * n, (n - 1) * SEG_WORDS - SEG_WORDS / 2 - 8, starts[s], 2000) == 2000);
+         CHECK(race(n, 32, 4 * n, n * SEG_WORDS, starts[s], 2000) < 2000);
+      }
+   }
+   return TEST_RESULT();
+}
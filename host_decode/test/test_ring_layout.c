@@ -0,0 +1,104 @@
+//ring_layout over a range of buffer sizes, channel widths and capture lengths.  Each layout
+//must fit the buffer, hold whole samples in every segment with the word alignment the DMA
+//needs, use all but a few chunks of the buffer, and only be single pass for a fixed capture
+//that fits.  It is also compared with the sizes that main() computed before the layout was
+//factored out of it.
+#include "sr_ring.h"
+#include "test_util.h"
+
+//The division of the buffer as it was written inline in main()
+static void old_layout(sr_layout_t *l, uint32_t buf_size, uint32_t dn, uint32_t an, uint32_t cap,
+                       bool fixed, uint32_t max_segs)
+{
+   uint32_t t = dn + an;
+   uint32_t cs = t * 32 * (an ? an : 1) * (dn ? dn : 1);
+   uint32_t chs = dn ? (cs * dn / t) * 2 / dn : (cs * 2) / an;
+   uint32_t bc = (buf_size / cs) & ~1u;
+   uint32_t need = ((cap / chs) + 2) & ~1u;
+   l->single_pass = fixed && (bc > need);
+   if (l->single_pass)
+   {
+      bc = need;
+   }
+   l->num_segs = seg_count(bc, max_segs, l->single_pass);
+   bc -= bc % l->num_segs;
+   l->d_size = (bc * cs * dn) / (t * l->num_segs);
+   l->a_size = (bc * cs * an) / (t * l->num_segs);
+   l->samples_per_half = chs * bc / l->num_segs;
+}
+
+int main(void)
+{
+   //Digital nibbles per sample are 0, 1, 2, 4 or 8, and analog nibbles 2 or 4 per channel
+   uint32_t d_nibbles[] = {0, 1, 2, 4, 8};
+   uint32_t runs = 0;
+   sr_layout_t l, o;
+   CHECK(!ring_layout(&l, 100000, 0, 0, 1000, false, 8));
+   CHECK(!ring_layout(&l, 100, 8, 24, 1000, false, 8));
+   for (uint32_t buf = 1000; buf <= 500000; buf = buf * 3 / 2 + 37)
+   {
+      for (uint32_t d = 0; d < sizeof(d_nibbles) / sizeof(d_nibbles[0]); d++)
+      {
+         for (uint32_t an = 0; an <= 24; an += 2)
+         {
+            uint32_t dn = d_nibbles[d];
+            //One digital nibble is stored as a byte with analog channels
+            if (((dn == 0) && (an == 0)) || ((dn == 1) && an))
+            {
+               continue;
+            }
+            for (uint32_t cap = 1; cap < 5000000; cap = cap * 5 + 3)
+            {
+               for (int fixed = 0; fixed < 2; fixed++)
+               {
+                  for (uint32_t max_segs = 2; max_segs <= 16; max_segs *= 2)
+                  {
+                     if (!ring_layout(&l, buf, dn, an, cap, fixed, max_segs))
+                     {
+                        //Only when two chunks don't fit
+                        CHECK(buf < 2 * (dn + an) * 32 * (an ? an : 1) * (dn ? dn : 1));
+                        continue;
+                     }
+                     uint32_t used = l.num_segs * (l.d_size + l.a_size);
+                     CHECK((l.num_segs >= 2) && (l.num_segs <= max_segs));
+                     CHECK((l.num_segs & (l.num_segs - 1)) == 0);
+                     CHECK(l.buff_chunks % l.num_segs == 0);
+                     CHECK(used == l.buff_chunks * l.chunk_size);
+                     CHECK(used <= buf);
+                     CHECK((l.d_size % 4 == 0) && (l.a_size % 4 == 0));
+                     CHECK(l.d_size * 2 == l.samples_per_half * dn);
+                     CHECK(l.a_size * 2 == l.samples_per_half * an);
+                     if (l.single_pass)
+                     {
+                        //The capture fits, with less than two chunks to spare
+                        CHECK(fixed && (l.num_segs == 2));
+                        CHECK(l.samples_per_half * 2 >= cap);
+                        CHECK(l.samples_per_half * 2 < cap + 2 * l.chunk_samples + 2);
+                     }
+                     else
+                     {
+                        //Only the chunks lost to whole segments go unused
+                        CHECK(buf - used < l.chunk_size * (l.num_segs + 2));
+                        //A fixed capture only loops around the ring if it doesn't fit the buffer
+                        CHECK(!fixed || (((buf / l.chunk_size) & ~1u) * l.chunk_samples <= cap + 2 * l.chunk_samples));
+                     }
+                     old_layout(&o, buf, dn, an, cap, fixed, max_segs);
+                     CHECK((l.d_size == o.d_size) && (l.a_size == o.a_size) &&
+                           (l.samples_per_half == o.samples_per_half) && (l.num_segs == o.num_segs) &&
+                           (l.single_pass == o.single_pass));
+                     if (test_fails)
+                     {
+                        printf("buf %u d_nibbles %u a_nibbles %u samples %u fixed %d segs %u\n", buf, dn,
+                               an, cap, fixed, max_segs);
+                        return TEST_RESULT();
+                     }
+                     runs++;
+                  }
+               }
+            }
+         }
+      }
+   }
+   printf("%u layouts\n", runs);
+   return TEST_RESULT();
+}
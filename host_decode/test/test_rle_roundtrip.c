@@ -0,0 +1,81 @@
+//Captures made by the RLE encoders, send_slices_D4, _1B, _2B, _4B and the analog slices,
+//decoded by sr_decode.  Every digital width and a range of analog channel counts are sent
+//as several segments of different activity, and the decoder must give back every sample.
+//A fixed length capture must stop at num_samples.
+#include "test_util.h"
+#include "test_roundtrip.h"
+
+#define SPH 20000
+#define SEGS 6
+
+static uint8_t dbuf[SPH * 4] __attribute__((aligned(4)));
+static uint8_t abuf[SPH * RT_MAX_A_CHAN * 2] __attribute__((aligned(4)));
+
+static void encode(sr_device_t *d, sr_encoder_t *e)
+{
+   if (d->a_mask)
+   {
+      send_slices_analog(d, e, dbuf, abuf);
+   }
+   else if (e->d_dma_bps == 0)
+   {
+      send_slices_D4(d, e, dbuf);
+   }
+   else if (e->d_dma_bps == 1)
+   {
+      send_slices_1B(d, e, dbuf);
+   }
+   else if (e->d_dma_bps == 2)
+   {
+      send_slices_2B(d, e, dbuf);
+   }
+   else
+   {
+      send_slices_4B(d, e, dbuf);
+   }
+}
+
+int main(void)
+{
+   struct
+   {
+      uint32_t d_mask, a_chans;
+   } cfgs[] = {
+      {0x1, 0}, {0x3, 0}, {0xF, 0}, {0x1F, 0}, {0xFF, 0}, {0x3FF, 0}, {0xFFFF, 0},
+      {0x1FFFFF, 0}, {0xFFFFFFFF, 0}, {0, 1}, {0, 3}, {0xF, 1}, {0xFF, 3}, {0xFFFF, 2},
+   };
+   sr_device_t dev;
+   sr_encoder_t enc;
+   for (uint32_t c = 0; c < sizeof(cfgs) / sizeof(cfgs[0]); c++)
+   {
+      rt_dev(&dev, &enc, cfgs[c].d_mask, cfgs[c].a_chans, SPH);
+      for (uint32_t s = 0; s < SEGS; s++)
+      {
+         //Runs that cross the 1568 sample limit, and the worst case, every sample different
+         int pat = (s == 0) ? PAT_IDLE : (s == SEGS - 1) ? PAT_RANDOM : (int)(s % PAT_COUNT);
+         rt_fill(&dev, &enc, dbuf, abuf, pat, s % 3, c * 100 + s);
+         encode(&dev, &enc);
+      }
+      if (!rt_check(&dev, &enc))
+      {
+         printf("digital 0x%X analog %u\n", cfgs[c].d_mask, cfgs[c].a_chans);
+         test_fails++;
+      }
+      //A fixed length capture ends in the middle of its last segment
+      rt_dev(&dev, &enc, cfgs[c].d_mask, cfgs[c].a_chans, SPH);
+      dev.cont = false;
+      dev.num_samples = SPH + 777;
+      for (uint32_t s = 0; s < 2; s++)
+      {
+         rt_fill(&dev, &enc, dbuf, abuf, PAT_20PCT, PAT_1PCT, c * 100 + s);
+         encode(&dev, &enc);
+      }
+      rt_nwant = dev.num_samples;
+      if (!rt_check(&dev, &enc))
+      {
+         printf("fixed, digital 0x%X analog %u\n", cfgs[c].d_mask, cfgs[c].a_chans);
+         test_fails++;
+      }
+   }
+   return TEST_RESULT();
+}
@@ -0,0 +1,123 @@
+//send_slices_1B and send_slices_2B compare a word of samples at a time.  Check that their
+//byte stream is the same as that of the per sample loop they replaced, for every activity
+//pattern, and for segment lengths and start offsets that leave partial words at either end.
+#include "sr_device.h"
+#include "sr_encode.h"
+#include "test_util.h"
+
+static uint8_t ref[1 << 20];
+static size_t ref_len;
+
+static void ref_byte(uint8_t b)
+{
+   ref[ref_len++] = b;
+}
+
+static void ref_samp(const sr_device_t *d, uint32_t cval)
+{
+   for (int b = 0; b < d->d_tx_bps; b++)
+   {
+      ref_byte(cval | 0x80);
+      cval >>= 7;
+   }
+}
+
+static void ref_rle(uint32_t *rlecnt)
+{
+   while (*rlecnt >= 1568)
+   {
+      ref_byte(127);
+      *rlecnt -= 1568;
+   }
+   if (*rlecnt > 32)
+   {
+      ref_byte((*rlecnt >> 5) + 78);
+      *rlecnt &= 31;
+   }
+   if (*rlecnt)
+   {
+      ref_byte(47 + *rlecnt);
+      *rlecnt = 0;
+   }
+}
+
+//The per sample 5+ channel rle: the first sample, then a count of repeats or a new value
+static void ref_encode(const sr_device_t *d, const uint8_t *dbuf, uint8_t bps, uint32_t n)
+{
+   uint32_t lval = test_get(dbuf, 0, bps), cval, rlecnt = 0;
+   ref_samp(d, lval);
+   for (uint32_t i = 1; i < n; i++)
+   {
+      cval = test_get(dbuf, i, bps);
+      if (cval == lval)
+      {
+         rlecnt++;
+      }
+      else
+      {
+         ref_rle(&rlecnt);
+         ref_samp(d, cval);
+      }
+      lval = cval;
+   }
+   ref_rle(&rlecnt);
+}
+
+int main(void)
+{
+   static uint8_t buf[(1 << 16) + 8] __attribute__((aligned(4)));
+   uint32_t lens[] = {1, 2, 3, 4, 5, 7, 8, 9, 31, 33, 1000, 4097, 16384};
+   sr_device_t dev;
+   sr_encoder_t enc;
+   int runs = 0;
+   for (uint8_t bps = 1; bps <= 2; bps++)
+   {
+      for (int pat = 0; pat < PAT_COUNT; pat++)
+      {
+         for (uint32_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+         {
+            //The segment doesn't always start on a word, i.e. after a trigger
+            for (uint32_t off = 0; off < 4; off += bps)
+            {
+               uint32_t n = lens[l];
+               uint8_t *dbuf = buf + off;
+               init(&dev);
+               dev.d_mask = (bps == 1) ? 0xFF : 0xFFFF;
+               dev.cont = true;
+               chan_counts(&dev);
+               dev.samples_per_half = n;
+               pat_fill(dbuf, n, bps, dev.d_mask, pat, 100 + l);
+               //Long runs cross the 1568 sample rle limit
+               if (pat == PAT_IDLE)
+               {
+                  test_put(dbuf, n / 2, bps, 0x81 & dev.d_mask);
+               }
+               enc_init(&enc, test_sink);
+               enc.d_dma_bps = bps;
+               test_len = 0;
+               if (bps == 1)
+               {
+                  send_slices_1B(&dev, &enc, dbuf);
+               }
+               else
+               {
+                  send_slices_2B(&dev, &enc, dbuf);
+               }
+               ref_len = 0;
+               ref_encode(&dev, dbuf, bps, n);
+               CHECK(test_len == ref_len);
+               CHECK(enc.bytecnt == ref_len);
+               CHECK((test_len == ref_len) && (memcmp(test_out, ref, ref_len) == 0));
+               if (test_fails)
+               {
+                  printf("bps %u pattern %d samples %u offset %u\n", bps, pat, n, off);
+                  return TEST_RESULT();
+               }
+               runs++;
+            }
+         }
+      }
+   }
+   printf("%d segments match\n", runs);
+   return TEST_RESULT();
+}
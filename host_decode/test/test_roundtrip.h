@@ -0,0 +1,201 @@
+//Round trip helpers: set up a device for a channel configuration, fill DMA segments while
+//keeping the samples that the host should see, and run the captured bytes back through
+//sr_decode in random sized pieces to compare them.  Include test_util.h first.
+#ifndef TEST_ROUNDTRIP_H
+#define TEST_ROUNDTRIP_H
+#include "sr_device.h"
+#include "sr_encode.h"
+#include "sr_decode.h"
+
+#define RT_MAX_SAMPLES (1 << 20)
+#define RT_MAX_A_CHAN 3
+
+// Samples the host should see, and those it decoded
+static uint32_t rt_want[RT_MAX_SAMPLES], rt_got[RT_MAX_SAMPLES];
+static uint16_t rt_awant[RT_MAX_SAMPLES * RT_MAX_A_CHAN], rt_agot[RT_MAX_SAMPLES * RT_MAX_A_CHAN];
+static uint32_t rt_nwant, rt_ngot;
+// Gap markers the host should see and those it decoded, as sample position and count
+static uint32_t rt_gwant[64][2], rt_ggot[64][2];
+static uint32_t rt_ngwant, rt_nggot;
+
+// Setup dev for the digital channels in d_mask and a_chans analog channels.  Only the
+// digital modes are built in, so the analog channels are counted here.
+static inline void rt_dev(sr_device_t *d, sr_encoder_t *e, uint32_t d_mask, uint32_t a_chans, uint32_t sph)
+{
+   init(d);
+   d->d_mask = d_mask;
+   d->a_mask = (1u << a_chans) - 1;
+   d->cont = true;
+   chan_counts(d);
+   d->a_chan_cnt = a_chans;
+   if (a_chans && (d->d_nps == 1))
+   {
+      d->d_nps = 2;
+   }
+   d->samples_per_half = sph;
+   enc_init(e, test_sink);
+   e->d_dma_bps = d->d_nps >> 1;
+   test_len = 0;
+   rt_nwant = 0;
+   rt_ngwant = 0;
+}
+
+// The analog value the host sees for a raw ADC value
+static inline uint16_t rt_aval(const sr_device_t *d, uint16_t raw)
+{
+   if (d->adc12)
+   {
+      return raw & 0xFFF;
+   }
+   return d->binary ? raw >> 4 : raw >> 5;
+}
+
+// Fill one segment of dbuf and abuf with a digital pattern and, if apat isn't negative, an
+// analog pattern, and add the samples to the ones the host should see.  Analog patterns
+// are PAT_IDLE for flat inputs, PAT_1PCT for a slow drift of a few steps of the values the
+// host sees, and anything else for noise.
+static inline void rt_fill(const sr_device_t *d, const sr_encoder_t *e, uint8_t *dbuf, uint8_t *abuf,
+                           int pat, int apat, uint32_t seed)
+{
+   uint32_t n = d->samples_per_half;
+   uint32_t drift = (d->adc12) ? 11 : 65;
+   static uint32_t aw[RT_MAX_A_CHAN] = {2000, 1000, 3000};
+   pat_fill(dbuf, n, e->d_dma_bps, d->d_mask, pat, seed);
+   test_rs = seed;
+   for (uint32_t i = 0; i < n; i++)
+   {
+      rt_want[rt_nwant + i] = d->d_mask ? test_get(dbuf, i, e->d_dma_bps) : 0;
+      for (uint32_t k = 0; k < d->a_chan_cnt; k++)
+      {
+         if (apat == PAT_1PCT)
+         {
+            aw[k] = (aw[k] + (test_rnd() % drift) - drift / 2) & 0xFFF;
+         }
+         else if (apat != PAT_IDLE)
+         {
+            aw[k] = test_rnd() & 0xFFF;
+         }
+         //The ADC fifo holds 8 bits unless it is in the 12 bit mode
+         if (d->adc12)
+         {
+            ((uint16_t *)abuf)[i * d->a_chan_cnt + k] = aw[k];
+         }
+         else
+         {
+            abuf[i * d->a_chan_cnt + k] = aw[k] >> 4;
+         }
+         rt_awant[(rt_nwant + i) * RT_MAX_A_CHAN + k] = rt_aval(d, (d->adc12) ? aw[k] : (aw[k] >> 4) << 4);
+      }
+   }
+   rt_nwant += n;
+}
+
+// Expect a gap of count samples at the current position, split into markers as send_gap does
+static inline void rt_expect_gap(uint32_t count)
+{
+   while (count)
+   {
+      uint32_t c = (count > GAP_MAX) ? GAP_MAX : count;
+      rt_gwant[rt_ngwant][0] = rt_nwant;
+      rt_gwant[rt_ngwant++][1] = c;
+      count -= c;
+   }
+}
+
+// Send a gap of count samples and expect it at the current position
+static inline void rt_gap(sr_encoder_t *e, uint32_t count)
+{
+   send_gap(e, count);
+   rt_expect_gap(count);
+}
+
+static void rt_run(void *ctx, uint32_t dval, uint32_t count, const uint16_t *aval)
+{
+   const sr_decoder_t *dc = ctx;
+   for (uint32_t i = 0; (i < count) && (rt_ngot < RT_MAX_SAMPLES); i++)
+   {
+      rt_got[rt_ngot] = dval;
+      for (uint32_t k = 0; k < dc->a_chan_cnt; k++)
+      {
+         rt_agot[rt_ngot * RT_MAX_A_CHAN + k] = aval[k];
+      }
+      rt_ngot++;
+   }
+}
+
+static void rt_gapfn(void *ctx, uint32_t count)
+{
+   if (rt_nggot < 64)
+   {
+      rt_ggot[rt_nggot][0] = rt_ngot;
+      rt_ggot[rt_nggot++][1] = count;
+   }
+}
+
+// End the capture with its trailer, decode it in random pieces and compare.  Returns false
+// and says why if anything differs.
+static inline bool rt_check(const sr_device_t *d, sr_encoder_t *e)
+{
+   sr_decoder_t dc;
+   char trailer[16];
+   int tl = sprintf(trailer, "$%u+", e->bytecnt);
+   size_t pos = 0;
+   test_sink(trailer, tl);
+   if (!dec_init(&dc, d->d_chan_cnt, d->a_chan_cnt, rt_run, &dc))
+   {
+      printf("decoder doesn't support %u digital %u analog\n", d->d_chan_cnt, d->a_chan_cnt);
+      return false;
+   }
+   dc.binary = d->binary;
+   dc.adc12 = d->adc12;
+   dc.gap = rt_gapfn;
+   rt_ngot = 0;
+   rt_nggot = 0;
+   while ((pos < test_len) && (dc.status == DEC_RUNNING))
+   {
+      size_t n = 1 + test_rnd() % 3000;
+      if (n > test_len - pos)
+      {
+         n = test_len - pos;
+      }
+      pos += dec_feed(&dc, test_out + pos, n);
+   }
+   dec_flush(&dc);
+   if ((dc.status != DEC_DONE) || (pos != test_len) || (dc.dev_bytecnt != dc.bytecnt))
+   {
+      printf("status %d at byte %zu of %zu, device sent %u decoded %llu\n", dc.status, pos,
+             test_len, dc.dev_bytecnt, (unsigned long long)dc.bytecnt);
+      return false;
+   }
+   if (rt_ngot != rt_nwant)
+   {
+      printf("decoded %u samples, sent %u\n", rt_ngot, rt_nwant);
+      return false;
+   }
+   for (uint32_t i = 0; i < rt_ngot; i++)
+   {
+      if (rt_got[i] != rt_want[i])
+      {
+         printf("sample %u is %x, sent %x\n", i, rt_got[i], rt_want[i]);
+         return false;
+      }
+      for (uint32_t k = 0; k < d->a_chan_cnt; k++)
+      {
+         if (rt_agot[i * RT_MAX_A_CHAN + k] != rt_awant[i * RT_MAX_A_CHAN + k])
+         {
+            printf("sample %u analog %u is %x, sent %x\n", i, k, rt_agot[i * RT_MAX_A_CHAN + k],
+                   rt_awant[i * RT_MAX_A_CHAN + k]);
+            return false;
+         }
+      }
+   }
+   if ((rt_nggot != rt_ngwant) ||
+       memcmp(rt_ggot, rt_gwant, rt_ngwant * sizeof(rt_gwant[0])))
+   {
+      printf("%u gaps decoded, %u sent\n", rt_nggot, rt_ngwant);
+      return false;
+   }
+   return true;
+}
+
+#endif
@@ -0,0 +1,164 @@
+//The spool against a mock of the flash that behaves as NOR flash does: erases set whole
+//sectors to 0xFF and programming a page can only clear bits.  Captures of random block
+//sizes must read back exactly, every page must be programmed once into erased flash, and
+//no erase may happen once the capture has started, since an erase holds the interrupts off
+//for longer than a segment.  A capture that outgrows the erased part must be full.
+#include "sr_spool.h"
+#include "test_util.h"
+
+#define FLASH_SIZE (1 << 20)
+
+static uint8_t flash[FLASH_SIZE];
+static bool erased_sector[FLASH_SIZE / SPOOL_SECTOR];
+static bool capturing;
+static uint32_t erases, programs, bad_ops;
+
+//Each erase is sectors up to the next 64KB boundary, or whole 64KB blocks
+static void mock_erase(uint32_t offset, uint32_t count)
+{
+   erases++;
+   if ((offset % SPOOL_SECTOR) || (count % SPOOL_SECTOR) || (offset + count > FLASH_SIZE) || capturing ||
+       ((offset % SPOOL_ERASE_CHUNK) + count > SPOOL_ERASE_CHUNK))
+   {
+      bad_ops++;
+      return;
+   }
+   memset(flash + offset, 0xFF, count);
+   for (uint32_t s = offset / SPOOL_SECTOR; s < (offset + count) / SPOOL_SECTOR; s++)
+   {
+      erased_sector[s] = true;
+   }
+}
+
+static void mock_program(uint32_t offset, const uint8_t *data, uint32_t count)
+{
+   programs++;
+   if ((offset % SPOOL_PAGE) || (count != SPOOL_PAGE) || (offset + count > FLASH_SIZE) ||
+       !erased_sector[offset / SPOOL_SECTOR])
+   {
+      bad_ops++;
+      return;
+   }
+   for (uint32_t i = 0; i < count; i++)
+   {
+      //A page programmed twice without an erase shows up as a mismatch
+      if (flash[offset + i] != 0xFF)
+      {
+         bad_ops++;
+      }
+      flash[offset + i] &= data[i];
+   }
+}
+
+static const uint8_t *mock_map(uint32_t offset)
+{
+   return flash + offset;
+}
+
+static const sr_flash_t mock_flash = {mock_erase, mock_program, mock_map};
+
+static uint8_t data[FLASH_SIZE];
+
+static void mock_reset(void)
+{
+   memset(flash, 0x5A, sizeof(flash));
+   memset(erased_sector, 0, sizeof(erased_sector));
+   capturing = false;
+   erases = programs = bad_ops = 0;
+}
+
+int main(void)
+{
+   sr_spool_t s;
+   uint32_t len;
+   const uint8_t *blk;
+   for (uint32_t i = 0; i < sizeof(data); i++)
+   {
+      data[i] = test_rnd() >> 7;
+   }
+
+   //The region is trimmed to whole sectors
+   spool_init(&s, &mock_flash, 100, 3 * SPOOL_SECTOR);
+   CHECK((s.base == SPOOL_SECTOR) && (s.size == 2 * SPOOL_SECTOR));
+
+   for (uint32_t r = 0; r < 200; r++)
+   {
+      uint32_t base = SPOOL_SECTOR * (test_rnd() % 40);
+      uint32_t size = SPOOL_SECTOR * (1 + test_rnd() % 150);
+      uint32_t est = test_rnd() % (size + SPOOL_ERASE_CHUNK);
+      uint32_t pos = 0, nblk = 0, lens[SPOOL_MAX_BLOCKS + 50];
+      bool full = false;
+      mock_reset();
+      spool_init(&s, &mock_flash, base, size);
+      //The erase goes on to the end of a 64KB block, or of the region, in whole blocks but for
+      //the ends
+      CHECK(spool_erase(&s, est) >= ((est < size) ? est : size));
+      CHECK((s.erased <= size) && (s.erased < est + SPOOL_ERASE_CHUNK));
+      CHECK(((s.base + s.erased) % SPOOL_ERASE_CHUNK == 0) || (s.erased == size));
+      CHECK(erases <= 2 + s.erased / SPOOL_ERASE_CHUNK);
+      capturing = true;
+      //Segments of random sizes, some empty, until the erased part is full or the index has
+      //merged a few blocks
+      while (!full && (nblk < SPOOL_MAX_BLOCKS + 50))
+      {
+         uint32_t n = (test_rnd() % 8) ? test_rnd() % 3000 : 0;
+         uint32_t k = 0, piece = 0;
+         //The encoders write a segment in pieces of up to a tx buffer
+         while (k < n)
+         {
+            piece = 1 + test_rnd() % 600;
+            if (piece > n - k)
+            {
+               piece = n - k;
+            }
+            if (!spool_write(&s, data + pos + k, piece))
+            {
+               full = true;
+               break;
+            }
+            k += piece;
+         }
+         spool_end_block(&s);
+         if (full)
+         {
+            //It only fills once the next bytes would pass the erased part
+            CHECK(s.full && (pos + k + piece > s.erased));
+            CHECK(!spool_write(&s, data, 1));
+            n = k;
+         }
+         if (n)
+         {
+            lens[nblk++] = n;
+         }
+         pos += n;
+      }
+      spool_close(&s);
+      capturing = false;
+      CHECK(bad_ops == 0);
+      CHECK(programs == (pos + SPOOL_PAGE - 1) / SPOOL_PAGE);
+      //Blocks past the end of the index are merged into the last one
+      CHECK(s.blocks == ((nblk < SPOOL_MAX_BLOCKS) ? nblk : SPOOL_MAX_BLOCKS));
+      uint32_t rd = 0;
+      for (uint32_t i = 0; (blk = spool_block(&s, i, &len)); i++)
+      {
+         uint32_t want = lens[i];
+         if (i == SPOOL_MAX_BLOCKS - 1)
+         {
+            for (uint32_t j = i + 1; j < nblk; j++)
+            {
+               want += lens[j];
+            }
+         }
+         CHECK(len == want);
+         CHECK(memcmp(blk, data + rd, len) == 0);
+         rd += len;
+      }
+      CHECK(rd == pos);
+      if (test_fails)
+      {
+         printf("run %u base %u size %u estimate %u bytes %u blocks %u\n", r, base, size, est, pos, nblk);
+         return TEST_RESULT();
+      }
+   }
+   return TEST_RESULT();
+}
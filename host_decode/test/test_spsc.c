@@ -0,0 +1,101 @@
+//Stress test of the sr_spsc queue with a producer and a consumer thread, as core1 and core0
+//use it in DUAL_CORE_EN mode.  Every block has a different length and carries a running
+//byte sequence, so a block seen before it was fully written, a lost or repeated block, or
+//a length from the wrong slot all show up as a sequence error.
+#include <pthread.h>
+#include <sched.h>
+#include "sr_spsc.h"
+#include "test_util.h"
+
+#define BLOCKS 400000
+
+static sr_spsc_t q;
+static volatile uint32_t full_waits;
+
+static void *producer(void *arg)
+{
+   uint8_t b[SPSC_BLOCK_SIZE];
+   uint8_t seq = 0;
+   for (uint32_t i = 0; i < BLOCKS; i++)
+   {
+      //Zero length blocks are the end of segment marks
+      uint16_t n = i % (SPSC_BLOCK_SIZE + 1);
+      for (uint16_t j = 0; j < n; j++)
+      {
+         b[j] = seq++;
+      }
+      while (!spsc_push(&q, b, n))
+      {
+         full_waits++;
+         sched_yield();
+      }
+      //Reuse the buffer at once, as the encoders do with txbuf
+      memset(b, 0xAA, n);
+   }
+   return 0;
+}
+
+int main(void)
+{
+   pthread_t t;
+   uint8_t seq = 0;
+   uint8_t *p;
+   uint16_t n;
+   uint32_t blocks = 0, empty = 0;
+   uint8_t big[SPSC_BLOCK_SIZE + 10];
+   spsc_init(&q);
+   //A full queue refuses blocks without changing, and long blocks are cut to SPSC_BLOCK_SIZE
+   memset(big, 0x55, sizeof(big));
+   for (uint32_t i = 0; i < SPSC_BLOCKS; i++)
+   {
+      CHECK(spsc_push(&q, big, sizeof(big)));
+   }
+   CHECK(!spsc_push(&q, big, 1));
+   CHECK(spsc_count(&q) == SPSC_BLOCKS);
+   while ((p = spsc_front(&q, &n)))
+   {
+      CHECK(n == SPSC_BLOCK_SIZE);
+      spsc_pop(&q);
+   }
+   CHECK(spsc_count(&q) == 0);
+
+   spsc_init(&q);
+   pthread_create(&t, 0, producer, 0);
+   while (blocks < BLOCKS)
+   {
+      p = spsc_front(&q, &n);
+      if (!p)
+      {
+         empty++;
+         sched_yield();
+         continue;
+      }
+      CHECK(n == blocks % (SPSC_BLOCK_SIZE + 1));
+      for (uint16_t j = 0; j < n; j++)
+      {
+         if (p[j] != seq)
+         {
+            printf("block %u byte %u is %u, expected %u\n", blocks, j, p[j], seq);
+            test_fails++;
+            break;
+         }
+         seq++;
+      }
+      if (test_fails)
+      {
+         break;
+      }
+      spsc_pop(&q);
+      blocks++;
+   }
+   //The producer may be stuck on a full queue after a failure, so only wait for it on success
+   if (test_fails)
+   {
+      return TEST_RESULT();
+   }
+   pthread_join(t, 0);
+   CHECK(spsc_count(&q) == 0);
+   printf("%u blocks, consumer found the queue empty %u times, producer found it full %u times\n",
+          blocks, empty, full_waits);
+   return TEST_RESULT();
+}
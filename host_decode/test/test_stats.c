@@ -0,0 +1,78 @@
+//The host's parser of the 's' stats reply.  Replies printed with the device's format must
+//parse back to the same fields, anything else must be rejected, and the limit must follow
+//the headroom and the split of time between encoding and USB.
+#include "sr_stats.h"
+#include "test_util.h"
+
+//The format of the 's' reply in sr_device.c
+static void reply(char *rsp, const uint32_t *v)
+{
+   sprintf(rsp, "%ux%ux%ux%ux%ux%ux%u", v[0], v[1], v[2], v[3], v[4], v[5], v[6]);
+}
+
+int main(void)
+{
+   static const char *bad[] = {
+      "", "1x2x3x4x5x6", "1x2x3x4x5x6x7x8", " 1x2x3x4x5x6x7", "1x2x3x4x5x6x7\r", "1x2x3x4x5x6x7 ",
+      "1x2x3x-4x5x6x7", "1x2x3x+4x5x6x7", "1x2xx4x5x6x7", "1x2x3x4x5x6x", "1y2x3x4x5x6x7",
+      "1x2x3x4x5x6x4294967296", "1x2x3x4x5x6x99999999999999999999", "0x1Ax2x3x4x5x6", "s1x2x3x4x5x6x7",
+   };
+   char rsp[128];
+   uint32_t v[STATS_FIELDS];
+   sr_stats_t st;
+   for (uint32_t r = 0; r < 10000; r++)
+   {
+      for (int i = 0; i < STATS_FIELDS; i++)
+      {
+         //Mostly small counts, with some at the ends of the range
+         switch (test_rnd() % 4)
+         {
+         case 0: v[i] = 0; break;
+         case 1: v[i] = 0xFFFFFFFF - test_rnd() % 3; break;
+         default: v[i] = test_rnd() >> (test_rnd() % 31); break;
+         }
+      }
+      reply(rsp, v);
+      memset(&st, 0x55, sizeof(st));
+      CHECK(stats_parse(rsp, &st));
+      CHECK((st.bytes == v[0]) && (st.segs == v[1]) && (st.headroom == v[2]) && (st.enc_us == v[3]) &&
+            (st.usb_us == v[4]) && (st.stalls == v[5]) && (st.peak_us == v[6]));
+      if (test_fails)
+      {
+         printf("reply %s\n", rsp);
+         return TEST_RESULT();
+      }
+   }
+   for (uint32_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+   {
+      if (stats_parse(bad[i], &st))
+      {
+         printf("accepted \"%s\"\n", bad[i]);
+         test_fails++;
+      }
+   }
+
+   //Any headroom left means nothing limited the capture, else the larger of the times did
+   CHECK(stats_parse("1000x8x1x10x500x3x40", &st) && (stats_limit_of(&st) == LIMIT_NONE));
+   CHECK(stats_parse("1000x8x0x10x500x3x40", &st) && (stats_limit_of(&st) == LIMIT_USB));
+   CHECK(stats_parse("1000x8x0x500x10x0x40", &st) && (stats_limit_of(&st) == LIMIT_ENCODE));
+   CHECK(stats_parse("0x0x0x0x0x0x0", &st) && (stats_limit_of(&st) == LIMIT_ENCODE));
+
+   //The printout names the limit, and copes with no segments sent
+   FILE *f = tmpfile();
+   CHECK(f);
+   if (f)
+   {
+      char text[1024];
+      size_t n;
+      CHECK(stats_parse("1000x0x0x10x500x3x40", &st));
+      stats_print(f, &st);
+      rewind(f);
+      n = fread(text, 1, sizeof(text) - 1, f);
+      text[n] = 0;
+      CHECK(strstr(text, "limited by USB") != NULL);
+      CHECK(strstr(text, "usb wait 500 us (500 per segment)") != NULL);
+      fclose(f);
+   }
+   return TEST_RESULT();
+}
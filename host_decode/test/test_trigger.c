@@ -0,0 +1,131 @@
+//trig_scan against a per channel reference of the trigger conditions, for random sets of
+//conditions and every DMA sample width.  A buffer is also scanned in random pieces, as the
+//segments of a capture are, to check that edges are followed from one piece to the next.
+#include "sr_trigger.h"
+#include "test_util.h"
+
+#define SAMPLES 4096
+
+typedef struct
+{
+   uint32_t type, chan;
+} cond_t;
+
+//Does channel c of the sample at i meet the condition
+static bool ref_cond(const cond_t *c, uint32_t cval, uint32_t lval, uint32_t i)
+{
+   uint32_t now = (cval >> c->chan) & 1;
+   uint32_t last = (lval >> c->chan) & 1;
+   switch (c->type)
+   {
+   case 0: return now == 0;
+   case 1: return now == 1;
+   case 2: return (i > 0) && !last && now;
+   case 3: return (i > 0) && last && !now;
+   default: return (i > 0) && (last != now);
+   }
+}
+
+//Index of the first sample that meets every condition, or -1
+static int32_t ref_scan(const cond_t *conds, uint32_t ncond, const uint8_t *buf, uint32_t n, uint8_t bps)
+{
+   for (uint32_t i = 0; i < n; i++)
+   {
+      uint32_t cval = test_get(buf, i, bps);
+      uint32_t lval = i ? test_get(buf, i - 1, bps) : 0;
+      bool match = true;
+      for (uint32_t k = 0; k < ncond; k++)
+      {
+         match = match && ref_cond(&conds[k], cval, lval, i);
+      }
+      if (match)
+      {
+         return i;
+      }
+   }
+   return -1;
+}
+
+int main(void)
+{
+   static uint8_t buf[SAMPLES * 4] __attribute__((aligned(4)));
+   uint8_t widths[] = {0, 1, 2, 4};
+   uint32_t found = 0, runs = 0;
+   sr_trig_t t;
+   cond_t conds[4];
+
+   //Conditions that can't be set
+   trig_reset(&t);
+   CHECK(!trig_enabled(&t));
+   CHECK(!trig_add(&t, 5, 0));
+   CHECK(!trig_add(&t, 0, 32));
+   CHECK(!trig_enabled(&t));
+   //Edges can't match the first sample of a capture
+   trig_add(&t, 4, 0);
+   trig_arm(&t);
+   buf[0] = 1;
+   buf[1] = 1;
+   CHECK(trig_scan(&t, buf, 2, 1) == -1);
+
+   test_rs = 99;
+   for (uint32_t w = 0; w < sizeof(widths); w++)
+   {
+      uint8_t bps = widths[w];
+      uint32_t chans = bps ? bps * 8 : 4;
+      for (uint32_t r = 0; r < 3000; r++)
+      {
+         uint32_t ncond = 1 + test_rnd() % 3;
+         uint32_t n = 1 + test_rnd() % SAMPLES;
+         int32_t want, got, pos;
+         trig_reset(&t);
+         for (uint32_t k = 0; k < ncond; k++)
+         {
+            conds[k].type = test_rnd() % 5;
+            //Mostly a few low channels so that the conditions often meet.  sigrok sends one
+            //condition per channel, which is all the masks can hold.
+            do
+            {
+               conds[k].chan = (test_rnd() % 4) ? test_rnd() % 3 : test_rnd() % chans;
+            } while (((k > 0) && (conds[k].chan == conds[0].chan)) ||
+                     ((k > 1) && (conds[k].chan == conds[1].chan)));
+            CHECK(trig_add(&t, conds[k].type, conds[k].chan));
+         }
+         CHECK(trig_enabled(&t));
+         pat_fill(buf, n, bps, (chans == 32) ? 0xFFFFFFFF : (1u << chans) - 1,
+                   (test_rnd() % 2) ? PAT_20PCT : PAT_RANDOM, r);
+         want = ref_scan(conds, ncond, buf, n, bps);
+         trig_arm(&t);
+         got = trig_scan(&t, buf, n, bps);
+         CHECK(got == want);
+         //The same search in pieces of an even number of samples, as segments are
+         trig_arm(&t);
+         got = -1;
+         for (uint32_t start = 0; (start < n) && (got < 0);)
+         {
+            uint32_t len = 2 + 2 * (test_rnd() % 64);
+            if (len > n - start)
+            {
+               len = n - start;
+            }
+            pos = trig_scan(&t, buf + ((bps ? start * bps : start / 2)), len, bps);
+            if (pos >= 0)
+            {
+               got = start + pos;
+            }
+            start += len;
+         }
+         CHECK(got == want);
+         if (test_fails)
+         {
+            printf("bps %u samples %u conditions %u want %d got %d\n", bps, n, ncond, want, got);
+            return TEST_RESULT();
+         }
+         found += (want >= 0);
+         runs++;
+      }
+   }
+   printf("%u searches, %u found the trigger\n", runs, found);
+   //Most searches should find it, but not all of them
+   CHECK((found > runs / 4) && (found < runs));
+   return TEST_RESULT();
+}
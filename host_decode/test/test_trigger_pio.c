@@ -0,0 +1,125 @@
+//The trigger PIO programs run on a model of the state machine, one sample of the inputs per
+//PIO clock.  For each condition type the irq must be set a clock or two after the first
+//sample that meets the condition on its own (as trig_scan finds it), and never after the
+//sample where all of the conditions meet, since the PIO only tells the firmware where to
+//start its own search.
+#include "sr_trigger.h"
+#include "pio_sim.h"
+#include "test_util.h"
+
+#define SAMPLES 2000
+//Clocks from the sample to the irq being set, which depends on the path through the program
+#define MIN_LAT 1
+#define MAX_LAT 2
+
+static uint32_t wave[SAMPLES];
+
+static uint32_t wave_pins(uint64_t cycle, void *ctx)
+{
+   return wave[(cycle < SAMPLES) ? cycle : SAMPLES - 1];
+}
+
+//Clock at which the program sets irq 0, or -1
+static int32_t run_pio(const sr_trig_t *t)
+{
+   uint16_t prog[TRIG_PIO_MAX_INSTR];
+   pio_sim_t s;
+   uint32_t len = trig_pio_program(t, prog, &s.jmp_pin);
+   uint32_t jmp_pin = s.jmp_pin;
+   CHECK((len > 0) && (len <= TRIG_PIO_MAX_INSTR));
+   pio_sim_init(&s, prog, 0, wave_pins, 0);
+   s.jmp_pin = jmp_pin;
+   s.wrap = len - 1;
+   for (uint32_t c = 0; c < SAMPLES + 10; c++)
+   {
+      pio_sim_step(&s);
+      CHECK(!s.bad);
+      if (s.irq)
+      {
+         CHECK(s.irq == 1);
+         return c;
+      }
+   }
+   return -1;
+}
+
+static int32_t scan(sr_trig_t *t)
+{
+   trig_arm(t);
+   return trig_scan(t, (const uint8_t *)wave, SAMPLES, 4);
+}
+
+int main(void)
+{
+   static const char *names[5] = {"low", "high", "rising", "falling", "change"};
+   sr_trig_t t, one;
+   uint32_t jmp_pin;
+   uint16_t prog[TRIG_PIO_MAX_INSTR];
+   uint32_t runs = 0;
+
+   trig_reset(&t);
+   CHECK(trig_pio_program(&t, prog, &jmp_pin) == 0);
+
+   test_rs = 5;
+   for (uint32_t r = 0; r < 4000; r++)
+   {
+      uint32_t type = r % 5;
+      uint32_t chan = test_rnd() % 32;
+      int32_t want, got, all;
+      //Pulses of one sample and longer, with the other channels changing around them
+      pat_fill((uint8_t *)wave, SAMPLES, 4, 0xFFFFFFFF, (r & 8) ? PAT_1PCT : PAT_20PCT, r);
+      for (uint32_t i = 0; i < SAMPLES; i++)
+      {
+         if ((test_rnd() % 400) == 0)
+         {
+            wave[i] ^= 1u << chan;
+         }
+      }
+      //A single condition
+      trig_reset(&t);
+      trig_add(&t, type, chan);
+      want = scan(&t);
+      got = run_pio(&t);
+      if (want < 0)
+      {
+         CHECK(got < 0);
+      }
+      else
+      {
+         CHECK((got >= want + MIN_LAT) && (got <= want + MAX_LAT));
+      }
+      //More conditions on other channels.  The program only waits on one of them, so the irq
+      //may come early, but it must not miss the full trigger.  One condition per channel, as
+      //sigrok sends them.
+      trig_add(&t, test_rnd() % 5, (chan + 1 + test_rnd() % 15) % 32);
+      trig_add(&t, test_rnd() % 2, (chan + 16 + test_rnd() % 16) % 32);
+      all = scan(&t);
+      got = run_pio(&t);
+      if (all >= 0)
+      {
+         CHECK((got >= 0) && (got <= all + MAX_LAT));
+      }
+      //The channel it waits on is the one trig_pio_program picked, and it can't be late for it
+      trig_pio_program(&t, prog, &jmp_pin);
+      trig_reset(&one);
+      if (t.risemask || t.fallmask || t.chgmask)
+      {
+         type = t.risemask ? 2 : t.fallmask ? 3 : 4;
+      }
+      else
+      {
+         type = t.lvl1mask ? 1 : 0;
+      }
+      trig_add(&one, type, jmp_pin);
+      want = scan(&one);
+      CHECK((want < 0) ? (got < 0) : ((got >= want + MIN_LAT) && (got <= want + MAX_LAT)));
+      if (test_fails)
+      {
+         printf("run %u %s on D%u want %d got %d all %d\n", r, names[r % 5], chan, want, got, all);
+         return TEST_RESULT();
+      }
+      runs++;
+   }
+   printf("%u programs run\n", runs);
+   return TEST_RESULT();
+}
@@ -0,0 +1,206 @@
+//usb_tx_write and usb_tx_push against a mock of the tinyusb CDC fifo.  The mock has the
+//256 byte fifo of the pico stdio configuration and starts a 64 byte packet whenever the
+//endpoint is idle and the fifo holds a full one, as tud_cdc_write does.  tud_task completes
+//the packet on the endpoint unless the host is stalled, and moves the clock on.
+#include "sr_usb_tx.h"
+#include "pico/stdio_usb.h"
+#include "test_util.h"
+
+#define FIFO_SIZE 256
+#define PACKET 64
+#define TASK_US 50
+
+static uint8_t fifo[FIFO_SIZE];
+static uint32_t fifo_cnt;
+static uint8_t ep[PACKET];      // packet on the endpoint
+static uint32_t ep_len;
+static bool ep_busy;
+static bool ready = true;
+static uint32_t stall_tasks;    // tud_task calls before the host reads again, -1 for never
+static uint64_t now_us;
+static uint8_t host[1 << 20];   // bytes the host received
+static uint32_t host_len;
+static uint32_t tasks, flushes, packets, short_packets;
+
+bool tud_ready(void)
+{
+   return ready;
+}
+
+uint32_t time_us_32(void)
+{
+   return (uint32_t)now_us;
+}
+
+uint64_t time_us_64(void)
+{
+   return now_us;
+}
+
+static void ep_start(uint32_t n)
+{
+   if (ep_busy || (n == 0))
+   {
+      return;
+   }
+   memcpy(ep, fifo, n);
+   memmove(fifo, fifo + n, fifo_cnt - n);
+   fifo_cnt -= n;
+   ep_len = n;
+   ep_busy = true;
+}
+
+uint32_t tud_cdc_write_available(void)
+{
+   return FIFO_SIZE - fifo_cnt;
+}
+
+uint32_t tud_cdc_write(const void *buffer, uint32_t bufsize)
+{
+   uint32_t n = (bufsize < tud_cdc_write_available()) ? bufsize : tud_cdc_write_available();
+   memcpy(fifo + fifo_cnt, buffer, n);
+   fifo_cnt += n;
+   if (fifo_cnt >= PACKET)
+   {
+      ep_start(PACKET);
+   }
+   return n;
+}
+
+uint32_t tud_cdc_write_flush(void)
+{
+   flushes++;
+   ep_start((fifo_cnt < PACKET) ? fifo_cnt : PACKET);
+   return ep_len;
+}
+
+void tud_task(void)
+{
+   tasks++;
+   now_us += TASK_US;
+   if (stall_tasks)
+   {
+      if (stall_tasks != (uint32_t)-1)
+      {
+         stall_tasks--;
+      }
+      return;
+   }
+   if (ep_busy)
+   {
+      memcpy(host + host_len, ep, ep_len);
+      host_len += ep_len;
+      packets++;
+      short_packets += (ep_len < PACKET);
+      ep_busy = false;
+      if (fifo_cnt >= PACKET)
+      {
+         ep_start(PACKET);
+      }
+   }
+}
+
+static void mock_reset(void)
+{
+   fifo_cnt = 0;
+   ep_busy = false;
+   ready = true;
+   stall_tasks = 0;
+   host_len = 0;
+   tasks = flushes = packets = short_packets = 0;
+}
+
+//Everything sent so far reaches the host
+static void drain(sr_usb_tx_t *u)
+{
+   for (int i = 0; (i < 100) && (fifo_cnt || ep_busy); i++)
+   {
+      usb_tx_push(u);
+   }
+}
+
+int main(void)
+{
+   static uint8_t data[100000];
+   sr_stats_t st;
+   sr_usb_tx_t u = {&usb_cdc_port, &st, 0};
+   uint32_t n, chunk;
+   for (uint32_t i = 0; i < sizeof(data); i++)
+   {
+      data[i] = 0x80 | (i * 7) | (i >> 9);
+   }
+
+   //Batching: tinyusb is only serviced when the fifo is full, so a host that keeps up sees
+   //full packets, and there is no flush until the push at the end of the segment
+   mock_reset();
+   memset(&st, 0, sizeof(st));
+   n = 0;
+   for (uint32_t i = 0; n < 50000; i++)
+   {
+      chunk = 1 + (i * 37) % 100;
+      CHECK(usb_tx_write(&u, data + n, chunk) == chunk);
+      n += chunk;
+   }
+   CHECK(flushes == 0);
+   CHECK(short_packets == 0);
+   //Each tud_task frees a packet, so it runs about once per packet once the fifo is full
+   CHECK(tasks <= n / PACKET);
+   CHECK(host_len + fifo_cnt + (ep_busy ? ep_len : 0) == n);
+   drain(&u);
+   CHECK(host_len == n);
+   CHECK(memcmp(host, data, n) == 0);
+   CHECK(short_packets <= 1);
+   CHECK(st.stalls > 0);
+   CHECK(st.usb_us >= tasks * TASK_US - TASK_US);
+
+   //A short stall delays the write but doesn't lose anything, and the bytes written once the
+   //host reads again are counted as USB limited
+   mock_reset();
+   memset(&st, 0, sizeof(st));
+   u.stall_bytes = 0;
+   CHECK(usb_tx_write(&u, data, FIFO_SIZE + PACKET) == FIFO_SIZE + PACKET);
+   stall_tasks = 20;
+   CHECK(usb_tx_write(&u, data + FIFO_SIZE + PACKET, 1000) == 1000);
+   CHECK(st.stalls == 2);
+   CHECK(u.stall_bytes > 0);
+   CHECK(u.stall_bytes <= 1000);
+   drain(&u);
+   CHECK(host_len == FIFO_SIZE + PACKET + 1000);
+   CHECK(memcmp(host, data, host_len) == 0);
+
+   //A host that stops reading makes the write give up after the stdio timeout, with the
+   //fifo and the endpoint full
+   mock_reset();
+   memset(&st, 0, sizeof(st));
+   stall_tasks = -1;
+   uint64_t t0 = now_us;
+   n = usb_tx_write(&u, data, 5000);
+   CHECK(n == FIFO_SIZE + PACKET);
+   CHECK(now_us - t0 > PICO_STDIO_USB_STDOUT_TIMEOUT_US);
+   CHECK(now_us - t0 <= PICO_STDIO_USB_STDOUT_TIMEOUT_US + 2 * TASK_US);
+   CHECK(st.stalls == 1);
+   CHECK(st.usb_us == now_us - t0);
+   CHECK(host_len == 0);
+   //The next write waits for the timeout again rather than from the last byte taken
+   t0 = now_us;
+   CHECK(usb_tx_write(&u, data, 10) == 0);
+   CHECK(now_us - t0 > PICO_STDIO_USB_STDOUT_TIMEOUT_US);
+
+   //Unplugged, nothing is written and tinyusb isn't run
+   mock_reset();
+   ready = false;
+   CHECK(usb_tx_write(&u, data, 100) == 0);
+   usb_tx_push(&u);
+   CHECK((tasks == 0) && (fifo_cnt == 0) && (flushes == 0));
+
+   //The push sends the partial packet, and is timed as USB time
+   mock_reset();
+   memset(&st, 0, sizeof(st));
+   CHECK(usb_tx_write(&u, data, 10) == 10);
+   CHECK((tasks == 0) && !ep_busy);
+   usb_tx_push(&u);
+   CHECK((flushes == 1) && (tasks == 1));
+   CHECK((host_len == 10) && (short_packets == 1));
+   CHECK(st.usb_us == TASK_US);
+   return TEST_RESULT();
+}
@@ -0,0 +1,87 @@
+//Helpers shared by the host tests: a check macro that counts failures, a pseudo random
+//generator, sample access in pat_fill's layout, and an encoder sink that keeps the bytes
+//in memory.
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sr_pattern.h"
+
+static int test_fails;
+
+#define CHECK(c) \
+   do \
+   { \
+      if (!(c)) \
+      { \
+         printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); \
+         test_fails++; \
+      } \
+   } while (0)
+
+// Exit status of a test's main
+#define TEST_RESULT() ((test_fails) ? (printf("%d failed\n", test_fails), 1) : 0)
+
+static uint32_t test_rs = 1;
+
+static inline uint32_t test_rnd(void)
+{
+   test_rs = test_rs * 1103515245u + 12345u;
+   return test_rs >> 1;
+}
+
+static inline void test_put(uint8_t *buf, uint32_t i, uint8_t bps, uint32_t v)
+{
+   if (bps == 0)
+   {
+      buf[i >> 1] = (i & 1) ? ((buf[i >> 1] & 0xF) | (v << 4)) : ((buf[i >> 1] & 0xF0) | v);
+   }
+   else if (bps == 1)
+   {
+      buf[i] = v;
+   }
+   else if (bps == 2)
+   {
+      ((uint16_t *)buf)[i] = v;
+   }
+   else
+   {
+      ((uint32_t *)buf)[i] = v;
+   }
+}
+
+static inline uint32_t test_get(const uint8_t *buf, uint32_t i, uint8_t bps)
+{
+   if (bps == 0)
+   {
+      return (buf[i >> 1] >> ((i & 1) * 4)) & 0xF;
+   }
+   else if (bps == 1)
+   {
+      return buf[i];
+   }
+   else if (bps == 2)
+   {
+      return ((const uint16_t *)buf)[i];
+   }
+   return ((const uint32_t *)buf)[i];
+}
+
+// Encoded bytes collected by test_sink
+static uint8_t *test_out;
+static size_t test_len, test_cap;
+
+static inline void test_sink(const char *buf, int length)
+{
+   if (test_len + length > test_cap)
+   {
+      test_cap = (test_len + length) * 2;
+      test_out = realloc(test_out, test_cap);
+   }
+   memcpy(test_out + test_len, buf, length);
+   test_len += length;
+}
+
+#endif
@@ -0,0 +1,299 @@
+//The vendor bulk class driver against a mock of the tinyusb device layer.  The mock has one
+//bulk IN endpoint that takes a transfer at a time once it is claimed, and the host completes
+//the transfers when the test says so.  Writes of random sizes with flushes at the segment
+//ends must reach the host in order as whole buffers, a flush must end the host's read with a
+//short packet or a zero length one, and failed transfers, claims that fail and bus resets
+//must not wedge the driver.
+#include "tusb.h"
+#include "device/usbd_pvt.h"
+#include "sr_vbulk.h"
+#include "test_util.h"
+
+#define EP_IN 0x83
+#define EP_SIZE 64
+
+static bool ready = true;
+static bool ep_open, ep_claimed, ep_busy;
+static uint32_t claim_fails; // claims to refuse
+static uint8_t *xfer_buf;
+static uint16_t xfer_len;
+static uint8_t host[1 << 22];
+static uint32_t host_len, xfers, short_xfers, zlps, last_len, flushes, bad_calls;
+static const usbd_class_driver_t *drv;
+
+bool tud_ready(void)
+{
+   return ready;
+}
+
+bool usbd_edpt_open(uint8_t rhport, tusb_desc_endpoint_t const *desc_ep)
+{
+   ep_open = (desc_ep->bEndpointAddress == EP_IN) && (desc_ep->bmAttributes == TUSB_XFER_BULK);
+   return ep_open;
+}
+
+bool usbd_edpt_claim(uint8_t rhport, uint8_t ep_addr)
+{
+   if (claim_fails)
+   {
+      claim_fails--;
+      return false;
+   }
+   if (!ep_open || (ep_addr != EP_IN) || ep_busy || ep_claimed)
+   {
+      bad_calls++;
+      return false;
+   }
+   ep_claimed = true;
+   return true;
+}
+
+bool usbd_edpt_release(uint8_t rhport, uint8_t ep_addr)
+{
+   if (!ep_claimed)
+   {
+      bad_calls++;
+   }
+   ep_claimed = false;
+   return true;
+}
+
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes)
+{
+   if (!ep_claimed || ep_busy || (ep_addr != EP_IN))
+   {
+      bad_calls++;
+      return false;
+   }
+   ep_busy = true;
+   xfer_buf = buffer;
+   xfer_len = total_bytes;
+   return true;
+}
+
+//The host finishes the transfer on the endpoint, which releases the claim as tinyusb does
+static bool complete(xfer_result_t result)
+{
+   if (!ep_busy)
+   {
+      return false;
+   }
+   if (result == XFER_RESULT_SUCCESS)
+   {
+      memcpy(host + host_len, xfer_buf, xfer_len);
+      host_len += xfer_len;
+   }
+   xfers++;
+   short_xfers += (xfer_len < VB_BUF_SIZE);
+   zlps += (xfer_len == 0);
+   last_len = xfer_len;
+   ep_busy = false;
+   ep_claimed = false;
+   drv->xfer_cb(0, EP_IN, result, xfer_len);
+   return true;
+}
+
+static void drain(void)
+{
+   while (complete(XFER_RESULT_SUCCESS))
+   {
+   }
+}
+
+static void flush(void)
+{
+   vb_flush();
+   flushes++;
+}
+
+//vb_tx_wait at the end of a capture, with the host reading all the while
+static void tx_wait(void)
+{
+   for (int tries = 0; tries < 100; tries++)
+   {
+      flush();
+      if (vb_idle())
+      {
+         break;
+      }
+      complete(XFER_RESULT_SUCCESS);
+   }
+   CHECK(vb_idle() && !ep_busy);
+   //The host's read ends with a short packet
+   CHECK((last_len % EP_SIZE) || (last_len == 0));
+}
+
+//The interface and endpoint descriptors of the bulk interface, after any changes by the test
+static uint8_t desc[16];
+static void make_desc(void)
+{
+   tusb_desc_interface_t *itf = (tusb_desc_interface_t *)desc;
+   tusb_desc_endpoint_t *ep = (tusb_desc_endpoint_t *)(desc + sizeof(*itf));
+   memset(desc, 0, sizeof(desc));
+   itf->bLength = sizeof(*itf);
+   itf->bDescriptorType = TUSB_DESC_INTERFACE;
+   itf->bInterfaceNumber = 2;
+   itf->bNumEndpoints = 1;
+   itf->bInterfaceClass = TUSB_CLASS_VENDOR_SPECIFIC;
+   itf->bInterfaceSubClass = VB_SUBCLASS;
+   itf->bInterfaceProtocol = VB_PROTOCOL;
+   ep->bLength = sizeof(*ep);
+   ep->bDescriptorType = TUSB_DESC_ENDPOINT;
+   ep->bEndpointAddress = EP_IN;
+   ep->bmAttributes = TUSB_XFER_BULK;
+   ep->wMaxPacketSize = EP_SIZE;
+}
+
+static uint16_t open_itf(uint16_t max_len)
+{
+   return drv->open(0, (tusb_desc_interface_t const *)desc, max_len);
+}
+
+//Write all n bytes, letting the host read when the buffers are full
+static void write_all(const uint8_t *buf, uint32_t n)
+{
+   uint32_t done = 0;
+   for (int tries = 0; (done < n) && (tries < 100000); tries++)
+   {
+      done += vb_write(buf + done, n - done);
+      if (done < n)
+      {
+         complete(XFER_RESULT_SUCCESS);
+      }
+   }
+   CHECK(done == n);
+}
+
+static uint8_t data[1 << 21];
+
+int main(void)
+{
+   uint8_t cnt;
+   uint16_t len = sizeof(tusb_desc_interface_t) + sizeof(tusb_desc_endpoint_t);
+   tusb_desc_interface_t *itf = (tusb_desc_interface_t *)desc;
+   tusb_desc_endpoint_t *ep = (tusb_desc_endpoint_t *)(desc + sizeof(*itf));
+   for (uint32_t i = 0; i < sizeof(data); i++)
+   {
+      data[i] = test_rnd() >> 5;
+   }
+   drv = usbd_app_driver_get_cb(&cnt);
+   CHECK((cnt == 1) && drv && drv->open && drv->xfer_cb && drv->reset);
+   drv->init();
+   flushes = 0;
+
+   //Nothing goes anywhere until the host configures the interface
+   CHECK(!vb_ready() && vb_idle());
+   CHECK(vb_write(data, 100) == 0);
+   flush();
+   CHECK(!ep_busy && (bad_calls == 0));
+
+   //Only the bulk interface with one IN endpoint is taken
+   make_desc();
+   itf->bInterfaceSubClass++;
+   CHECK(open_itf(len) == 0);
+   make_desc();
+   itf->bInterfaceProtocol++;
+   CHECK(open_itf(len) == 0);
+   make_desc();
+   itf->bInterfaceClass = 2;
+   CHECK(open_itf(len) == 0);
+   make_desc();
+   itf->bNumEndpoints = 2;
+   CHECK(open_itf(len) == 0);
+   make_desc();
+   ep->bEndpointAddress = 0x03;
+   CHECK(open_itf(len) == 0);
+   make_desc();
+   CHECK(open_itf(len - 1) == 0);
+   CHECK(!vb_ready());
+   CHECK(open_itf(len) == len);
+   CHECK(vb_ready() && vb_idle());
+   ready = false;
+   CHECK(!vb_ready());
+   ready = true;
+
+   //Segments of random sizes, each ended by a flush, with the host reading at random times
+   uint32_t pos = 0;
+   for (uint32_t s = 0; s < 400; s++)
+   {
+      uint32_t n = (test_rnd() % 5) ? test_rnd() % 6000 : test_rnd() % 3 * EP_SIZE;
+      uint32_t k = 0;
+      while (k < n)
+      {
+         uint32_t piece = 1 + test_rnd() % 1500;
+         if (piece > n - k)
+         {
+            piece = n - k;
+         }
+         write_all(data + pos + k, piece);
+         k += piece;
+         if (test_rnd() % 3 == 0)
+         {
+            complete(XFER_RESULT_SUCCESS);
+         }
+      }
+      pos += n;
+      flush();
+      //Everything written so far is either with the host or waiting in a transfer
+      CHECK(host_len <= pos);
+      if (test_rnd() % 4 == 0)
+      {
+         drain();
+         CHECK(vb_idle() && (host_len == pos));
+      }
+   }
+   tx_wait();
+   CHECK(!ep_claimed);
+   CHECK((host_len == pos) && (memcmp(host, data, pos) == 0));
+   //Buffers are only sent short by a flush
+   CHECK(short_xfers <= flushes);
+   CHECK(bad_calls == 0);
+
+   //Data that ends on a packet boundary is followed by one zero length packet, and only then
+   host_len = 0;
+   zlps = 0;
+   write_all(data, VB_BUF_SIZE);
+   tx_wait();
+   tx_wait();
+   CHECK((host_len == VB_BUF_SIZE) && (zlps == 1));
+   zlps = 0;
+   write_all(data, 3 * EP_SIZE);
+   tx_wait();
+   CHECK((host_len == VB_BUF_SIZE + 3 * EP_SIZE) && (zlps == 1));
+   zlps = 0;
+   write_all(data, 100);
+   tx_wait();
+   tx_wait();
+   CHECK((host_len == VB_BUF_SIZE + 3 * EP_SIZE + 100) && (zlps == 0));
+
+   //A failed transfer loses its buffer, and the next one carries on
+   host_len = 0;
+   write_all(data, 2 * VB_BUF_SIZE);
+   CHECK(complete(XFER_RESULT_FAILED));
+   drain();
+   CHECK((host_len == VB_BUF_SIZE) && (memcmp(host, data + VB_BUF_SIZE, VB_BUF_SIZE) == 0));
+   CHECK(vb_idle());
+
+   //A claim that fails is tried again while the writer waits for room
+   host_len = 0;
+   claim_fails = 3;
+   write_all(data, 5 * VB_BUF_SIZE + 10);
+   tx_wait();
+   CHECK((host_len == 5 * VB_BUF_SIZE + 10) && (memcmp(host, data, host_len) == 0));
+
+   //A bus reset drops the data waiting to be sent, and the interface must be opened again
+   write_all(data, 3 * VB_BUF_SIZE);
+   drv->reset(0);
+   ep_busy = false;
+   ep_claimed = false;
+   CHECK(!vb_ready() && vb_idle());
+   CHECK(vb_write(data, 10) == 0);
+   make_desc();
+   CHECK(open_itf(len) == len);
+   host_len = 0;
+   write_all(data, 1000);
+   tx_wait();
+   CHECK((host_len == 1000) && (memcmp(host, data, 1000) == 0));
+   CHECK(bad_calls == 0);
+   return TEST_RESULT();
+}
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include "pico/stdlib.h" //uart definitions
 #include <stdlib.h> //atoi,atol, malloc
+#include <string.h> //memcpy
 #include "hardware/gpio.h"
 #include "hardware/pio.h"
 #include "hardware/adc.h"
@@ -14,10 +15,29 @@
 #include "hardware/structs/bus_ctrl.h"
 #include "hardware/uart.h"
 #include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/vreg.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
 #include "pico/multicore.h"
 #include "tusb.h"//.tud_cdc_write...
 
 #include "sr_device.h"
+#include "sr_encode.h"
+#include "sr_spsc.h"
+#include "sr_ring.h"
+#include "sr_filter.h"
+#include "sr_spool.h"
+#include "sr_stage.h"
+#include "sr_estimate.h"
+#include "sr_event.h"
+#include "sr_plan.h"
+#include "sr_frame.h"
+#include "sr_clock.h"
+#include "sr_usb_tx.h"
+#if (VBULK_EN == 1)
+#include "sr_vbulk.h"
+#endif
 
 //forced_test_mode is a special mode that puts the device into an active sampling
 //state out of reset.  It is used for a quick way to debug features without needed
@@ -28,16 +48,56 @@ bool forced_test_mode_en=false; //true;
 bool forced_test_mode_run=false; 
 PIO pio = pio0;
 uint piosm=0;
+uint trigsm=1; //PIO state machine for the trigger, if TRIG_PIO_EN
 uint8_t *capture_buf;
+//Linker symbols for the start of the heap and the top it can grow to
+extern char __end__, __StackLimit;
+//Linker symbol for the end of the firmware image in flash, the spool uses the flash after it
+extern char __flash_binary_end;
 sr_device_t dev;
 volatile uint32_t tstart;
 volatile bool send_resp=false;
 
-uint8_t txbuf[TX_BUF_SIZE];
-uint16_t txbufidx;
-uint32_t rxbufdidx,rxbufaidx;
-uint32_t rlecnt;
-uint32_t bytecnt=0; //count of characters sent serially
+sr_encoder_t enc; //send_slices_* state, including the count of characters sent serially
+sr_filter_t filt; //glitch filter and decimation applied to digital samples before encoding
+#if (DUAL_CORE_EN == 1)
+sr_spsc_t txq; //encoded blocks from core1 waiting to be sent by core0
+uint32_t txq_wait_us; //time core1 waited for room in txq
+volatile uint32_t core1_passes; //calls of send_half core1 has finished
+#endif
+//Encoded blocks of a deep fixed capture, sent once the capture is done.  They are kept
+//in flash with the 'S' command or in the end of capture_buf with the 'Z' command.
+sr_spool_t spool;
+bool spooling; //the encoders write to the spool rather than USB
+//Encoded segments of the lossy continuous mode, held in the end of capture_buf until they
+//are known to be whole, see sr_stage.h
+sr_stage_t stage;
+bool staging; //the encoders write to the stage
+uint32_t usb_bps=EST_USB_BPS; //USB drain rate for the 'e' estimate, measured when USB was the limit
+sr_usb_tx_t usb_tx={&usb_cdc_port,&dev.stats}; //sample data output, the CDC port or vbulk_run's bulk endpoint
+#if (SPOOL_EN == 1)
+uint32_t spool_flash_base; //flash offset of the spool region
+#endif
+bool ev_run; //this capture uses the event PIO program, see sr_event.h
+uint32_t ev_sent; //records of segment num_halves already sent
+uint64_t ev_start_us; //time the event capture started
+uint64_t ev_end_us; //time a fixed event capture has all of its samples
+uint64_t ev_idle_us; //time records or a hold were last sent
+#if (VBULK_EN == 1)
+bool vbulk_run; //this capture's sample data goes to the vendor bulk endpoint, see sr_vbulk.h
+#endif
+sr_plan_t plan; //capture plan of the current configuration, see sr_plan.h
+sr_clk_t boot_clk; //the clock the device booted with, which profile 0 keeps
+sr_clk_t cur_clk; //the clock clk_sys runs at now, changed by the 'K' clock profiles
+uint32_t plan_loaded_gen; //gen of the plan whose programs are in the PIO instruction memory
+uint cap_offset,trig_offset; //where the plan's capture and trigger programs are loaded
+bool idle_done; //the IDLE teardown has been done since the last capture
+bool fr_run; //this capture fills the frames of the 'N' command, see sr_frame.h
+uint32_t fr_idx; //frames filled so far
+bool fr_filling; //the trigger of frame fr_idx was found and its samples are being copied
+uint32_t fr_fill; //samples of frame fr_idx copied so far
+uint64_t fr_next; //sample index of the end of the last frame, the next one can't start before it
+bool plan_stale=true; //a command line was received, so the configuration may have changed
 #ifdef PIN_TEST_MODE
   struct repeating_timer pt_timer;
   uint32_t pin_test_cnt=0;
@@ -48,11 +108,6 @@ uint32_t bytecnt=0; //count of characters sent serially
   uint32_t systick_array[SYSTICK_SIZE];
   uint32_t systick_idx=0;
 #endif //PIN_TEST_MODE
-//Number of bytes stored as DMA per slice, must be 1,2 or 4 to support aligned access
-//This will be be zero for 1-4 digital channels.
-uint8_t d_dma_bps; 
-uint32_t samp_remain;
-uint32_t lval,cval; //last and current digital sample values
 uint32_t num_halves; //track the number of halves we have processed
 uint32_t exp_halves; //the number of halves we expect in non-continous mode
 uint32_t halves_seen=0;
@@ -62,18 +117,27 @@ uint admachan0,admachan1,pdmachan0,pdmachan1;
 //may not be enabled so dedicate a maintence channel for each.
 uint amaintchan0,amaintchan1,pmaintchan0,pmaintchan1;
 dma_channel_config acfg0,acfg1,pcfg0,pcfg1,amcfg0,amcfg1,pmcfg0,pmcfg1;
-//Two addresses for adc and pio dma engines
-//These are read by the maintenance DMA engines and written to the 
-//PIO/ADC DMA engine write addrs
-uint32_t *amaddrs[2]={0,0};
-uint32_t *pmaddrs[2]={0,0};
+//Tables of segment addresses for the adc and pio dma engines, one table for each of the
+//two engines.  These are read by the maintenance DMA engines and written to the
+//PIO/ADC DMA engine write addrs.  The maintenance DMAs read them as a ring, so each
+//table must be aligned to its size.
+uint32_t amaddrs[2][DMA_SEGMENTS/2] __attribute__((aligned(DMA_SEGMENTS*2)));
+uint32_t pmaddrs[2][DMA_SEGMENTS/2] __attribute__((aligned(DMA_SEGMENTS*2)));
 uint32_t tmpaddr0,tmpaddr1; //temp variables for address generation
 uint32_t *tmpptr;
-uint32_t dma_halves; //number of halves observed by the dma int handler
+//number of halves (segments of the DMA ring) observed by the dma int handler
+//The "halves" naming is from when the buffer was always split in 2.
+uint32_t dma_halves;
+bool trig_prev_ok; //the previous segment was searched for the trigger and can supply pre-trigger samples
+#if (TRIG_PIO_EN == 1)
+#define TRIG_NO_MARK 0xFFFFFFFF
+uint32_t trig_pio_len; //length of the trigger PIO program, 0 if not used
+volatile uint32_t trig_mark; //dma_halves when the trigger PIO irq fired, TRIG_NO_MARK if not yet
+#endif
 volatile bool mask_xfer_err;
 int usbintin;
 uint8_t uartch;//rx uart character -ignored as only uart tx is used
-uint8_t h0intmask,h1intmask; //The required masks of ints for each half
+uint8_t h0intmask,h1intmask; //The required masks of ints for the even and odd segments
 //Keeps tracks of all interrupts we received.  Sometimes we might get an analog and not a digital
 //DMA int (or vice versa) and need to exit that handler but need to clear out pending interrupt state
 //so this stores what we have seen.
@@ -118,9 +182,8 @@ void print_DMA_chan(int chan){
 //This function also avoids the inserting of CR/LF in certain modes.
 //The tud_cdc_write_available function returns 256, and thus we have a 256B buffer to feed into
 //but the CDC serial issues in groups of 64B.  
-//Since there is another memory fifo inside the TUD code this might possibly be optimized
-//to directly write to it, rather than writing txbuf.  That might allow faster rle processing
-//but is a bit too complicated.
+//Since it calls tud_task and flushes on every write it is only used for command responses
+//and the end of capture strings, sample data goes through usb_tx_sink.
 
 void my_stdio_usb_out_chars(const char *buf, int length) {
     static uint64_t last_avail_time;
@@ -156,368 +219,633 @@ void my_stdio_usb_out_chars(const char *buf, int length) {
     }
 }
 
-//A common init for all send_slice modes 
-void send_slice_init(sr_device_t *d,uint8_t *dbuf){
-   rxbufdidx=0;
-   rxbufaidx=0;
-   txbufidx=0;
-   rlecnt=0;
-   //Adjust the number of samples to send if there are more in the dma buffer
-   samp_remain=d->samples_per_half;
-   if((d->cont==false)&&((d->scnt+samp_remain)>(d->num_samples))){
-        samp_remain=d->num_samples-d->scnt;
-        d->scnt+=samp_remain;
-        //Dprintf("SSIa sph %d scnt %d lval 0x%X rem %d ns %d\n\r",d->samples_per_half,d->scnt,lval,samp_remain,d->num_samples);
-   }else{
-        d->scnt+=d->samples_per_half;
-        //Dprintf("SSIb sph %d scnt %d lval 0x%X rem %d ns %d\n\r",d->samples_per_half,d->scnt,lval,samp_remain,d->num_samples);
-   }
+#if (VBULK_EN == 1)
+//The bulk endpoint as a port for usb_tx when vbulk_run.  vb_write only refuses bytes once both
+//transfer buffers are waiting, and tud_task is what completes the transfers and starts the next.
+const sr_usb_port_t usb_vb_port = {vb_ready, vb_write, vb_flush};
+//Send all of the sample data before the end of capture string goes out on the CDC port
+void vb_tx_wait(void) {
+    uint64_t end = time_us_64() + PICO_STDIO_USB_STDOUT_TIMEOUT_US;
+    while (vb_ready() && (time_us_64() < end)) {
+        vb_flush();
+        if (vb_idle()) {
+            break;
+        }
+        tud_task();
+    }
+}
+#endif
+//Output sink for the send_slices_* encoders, see sr_usb_tx.h
+void usb_tx_sink(const char *buf, int length) {
+    usb_tx_write(&usb_tx, (const uint8_t *)buf, (uint32_t)length);
+}
+//Push any partial packet left by usb_tx_sink
+void usb_tx_flush(void) {
+    usb_tx_push(&usb_tx);
 }
 
-//This is an optimized transmit of trace data for configurations with 4 or fewer digital channels 
-//and no analog.  Run length encoding (RLE) is used to send counts of repeated values to effeciently utilize 
-//USB CDC link bandwidth.  This is the only mode where a given serial byte can have both sample information
-//and RLE counts.
-//Samples from PIO are dma'd in 32 bit words, each containing 8 samples of 4 bits (1 nibble).
-//RLE Encoding:
-//Values 0x80-0xFF encode an rle cnt of a previous value with a new value:
-//  Bit 7 is 1 to distinguish from the rle only values.
-//  Bits 6:4 indicate a run length up to 7 cycles of the previous value
-//  Bits 3:0 are the new value.
-//For longer runs, an RLE only encoding uses decimal values 48 to 127 (0x30 to 0x7F)
-//as x8 run length values of 8..640.
-//All other ascii values (except from the abort and the end of run byte_cnt) are reserved.
-uint32_t send_slices_D4(sr_device_t *d,uint8_t *dbuf){
-   uint8_t nibcurr,niblast;
-   uint32_t cword,lword; //current and last word
-   uint32_t *cptr;
-   //Note that this function always sends the first 8 samples, even if
-   //send_slice_init sets remaining samples to zero.  That shouldn't happen
-   //as we should also be in free running mode or split the two halves
-   //into something with 8 samples.
-   send_slice_init(d,dbuf);
-   //Don't optimize the first word (eight samples) perfectly, just send them to make the for loop easier, 
-   //and setup the initial conditions for rle tracking
-   cptr=(uint32_t *) &(dbuf[0]);
-   cword=*cptr;
-   #ifdef D4_DBG
-   Dprintf("Dbuf %p cptr %p data 0x%X\n\r",(void *)&(dbuf[0]),(void *) cptr,cword);
-   #endif
-   lword=cword;
-   for (int j=0;j<8;j++){
-     nibcurr=cword&0xF;
-     txbuf[j]=(nibcurr)|0x80;
-     cword>>=4;
-   }
-   niblast=nibcurr;      
-   cptr=(uint32_t *) &(txbuf[0]);
-   txbufidx+=8;
-   rxbufdidx+=4;
-   rlecnt=0;
-   //Note that it is generally assumed that each half buffer has far more than
-   //8 samples in it, especially if pulseview is running.  But for some useages it
-   //may be only 8 so exit on the first 8. This is just mostly to prevent underflow
-   //of samp_remain when we subtract 8 from it.
-   if(d->samples_per_half<=8){
-     my_stdio_usb_out_chars(txbuf,txbufidx);
-     d->scnt+=d->samples_per_half;
-     return txbufidx;
-   }
-   //The total number of 4 bit samples remaining to process from this half.
-   //Subtract 8 because we procesed the word above.
-   samp_remain-=8;
-
-   //Process one  word (8 samples) at a time.
-   for(int i=0;i<(samp_remain>>3);i++) {
-       cptr=(uint32_t *) &(dbuf[rxbufdidx]);
-       cword=*cptr;
-       rxbufdidx+=4;
-       #ifdef D4_DBG2
-       Dprintf("dbuf0 %p dbufr %p cptr %p \n\r",dbuf,&(dbuf[rxbufdidx]),cptr);
-       #endif
-       //Send maximal RLE counts in this outer section to the txbuf, and if we accumulate a few of them
-       //push to the device so that we don't accumulate large numbers
-       //of unsent RLEs.  That allows the host to process them gradually rather than in a flood
-       //when we get a value change.
-       while(rlecnt>=640){
-         txbuf[txbufidx++]=127;
-         rlecnt-=640;
-         if(txbufidx>3){   
-            my_stdio_usb_out_chars(txbuf,txbufidx);
-            bytecnt+=txbufidx;
-            txbufidx=0;
-         }
-       }
-       //Coarse rle looks across the full word and allows a faster compare in cases with low activity factors
-       //We must make sure cword==lword and that all nibbles of cword are the same
-       if((cword==lword)&&((cword>>4)==(cword&0x0FFFFFFF))){
-         rlecnt+=8;
-         #ifdef D4_DBG2
-         Dprintf("coarse word 0x%X\n\r",cword);
-         #endif
-       }
-       else{//if coarse rle didn't match
-         #ifdef D4_DBG2
-        Dprintf("cword 0x%X nibcurr 0x%X i %d rx idx %u  rlecnt %u \n\r",cword,nibcurr,i,rxbufdidx,rlecnt);
-        #endif
-        lword=cword;
-        for (int j=0;j<8;j++){ //process all 8 nibbles
-          nibcurr=cword&0xF;
-          if(nibcurr==niblast) {
-             rlecnt++;
-          }
-          else{
-            //If the value changes we must push all remaing rles to the txbuf
-            //chngcnt++;
-            //Send intermediate 8..632 RLEs
-            if(rlecnt>7) {
-	       int rlemid=rlecnt&0x3F8;
-               txbuf[txbufidx++]=(rlemid>>3)+47;
-            } 
-            //And finally the 0..7 rle along with the new value
-            rlecnt&=0x7;
-            #ifdef D4_DBG2 //print when sample value changes
- 	       Dprintf("VChang val 0x%X rlecnt %d i%d j%d \n\r",nibcurr,rlecnt,i,j);
-            #endif		  
-            txbuf[txbufidx++]=0x80|nibcurr|rlecnt<<4;
-            rlecnt=0;
-	  }//nibcurr!=last
-          cword>>=4;
-          niblast=nibcurr;
-        }//for j
-       } //else (not a coarse rle )
-       #ifdef D4_DBG2
-       Dprintf("i %d rx idx %u  rlecnt %u \n\r",i,rxbufdidx,rlecnt);
-       Dprintf("i %u tx idx %d bufs 0x%X 0x%X 0x%X\n\r",i,txbufidx,txbuf[txbufidx-3],txbuf[txbufidx-2],txbuf[txbufidx-1]);
-       #endif
-       //Emperically found that transmitting groups of around 32B gives optimum bandwidth
-       if(txbufidx>=64){
-         my_stdio_usb_out_chars(txbuf,txbufidx);
-         bytecnt+=txbufidx;
-         txbufidx=0;
-       }
-    }//for i in samp_send>>3
-    //At the end of processing the half send any residual samples as we don't maintain state between the halves
-    //Maximal 640 values first
-    while(rlecnt>=640){
-      txbuf[txbufidx++]=127;
-      rlecnt-=640;
+//The capture was aborted or torn down, so anything still being encoded is thrown away
+static inline bool tx_stopped(void) {
+    return (dev.state == ABORTED) || (dev.state == IDLE);
+}
+#if (DUAL_CORE_EN == 1)
+//Output sink for the encoders when they run on core1.  Blocks are queued for core0 to
+//send, and if the queue is full core1 waits for core0 to drain it.  Once the capture is
+//stopped core0 no longer drains it, so the blocks are dropped rather than waited for.
+void spsc_tx_sink(const char *buf, int length) {
+    while (length > 0) {
+        int n = (length > SPSC_BLOCK_SIZE) ? SPSC_BLOCK_SIZE : length;
+        if (tx_stopped()) {
+            return;
+        }
+        if (!spsc_push(&txq, (const uint8_t *)buf, (uint16_t)n)) {
+            uint32_t t0 = time_us_32();
+            while (!spsc_push(&txq, (const uint8_t *)buf, (uint16_t)n)) {
+                if (tx_stopped()) {
+                    return;
+                }
+                tight_loop_contents();
+            }
+            txq_wait_us += time_us_32() - t0;
+        }
+        buf += n;
+        length -= n;
+    }
+}
+//Core0 side of the queue, send all queued blocks to USB.
+//A zero length block marks the end of a half buffer and flushes the partial packet.
+void usb_tx_drain(void) {
+    uint8_t *blk;
+    uint16_t len;
+    while ((blk = spsc_front(&txq, &len))) {
+        if (len) {
+            usb_tx_sink((const char *)blk, len);
+        } else {
+            usb_tx_flush();
+        }
+        spsc_pop(&txq);
     }
-    //Middle rles 8..632
-    if(rlecnt>7) {
-      int rleend=rlecnt&0x3F8;
-      txbuf[txbufidx++]=(rleend>>3)+47;
+}
+//Throw away queued blocks after an abort.  core1 must first finish a whole send_half
+//started after the state changed, as one started before may still be queuing blocks.
+//That one sees the state in spsc_tx_sink, so it finishes without waiting for room.
+void usb_tx_discard(void) {
+    uint16_t len;
+    uint32_t passes = core1_passes;
+    while ((core1_passes - passes) < 2) {
+        tight_loop_contents();
     }
-    //1..7 RLE 
-    //The rle and value encoding counts as both a sample count of rle and a new sample
-    //thus we must decrement rlecnt by 1 and resend the current value which will match the previous values
-    //(if the current value didn't match, the rlecnt would be 0).
-    if(rlecnt){
-      rlecnt&=0x7;
-      rlecnt--;
-      txbuf[txbufidx++]=0x80|nibcurr|rlecnt<<4;
-      rlecnt=0;
+    while (spsc_front(&txq, &len)) {
+        spsc_pop(&txq);
     }
-    if(txbufidx){
-       my_stdio_usb_out_chars(txbuf,txbufidx);
-       bytecnt+=txbufidx;
-       txbufidx=0;
+}
+#endif
+//Time the encoding core has spent waiting for its output to drain, which isn't encoding time.
+//With one core that is the USB waits, with two it is core1 waiting for core0 to empty txq.
+uint32_t enc_wait_us(void) {
+#if (DUAL_CORE_EN == 1)
+    return txq_wait_us;
+#else
+    return dev.stats.usb_us;
+#endif
+}
+#if (SPOOL_EN == 1)
+//Flash accesses for the spool.  Code running from flash stalls while the flash is erased
+//or programmed, so interrupts are off for each call.  The erases are done a chunk at a time
+//before the capture starts, so USB is serviced between them.
+static void spool_flash_erase(uint32_t offset, uint32_t count) {
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_erase(offset, count);
+    restore_interrupts(ints);
+    tud_task();
+}
+static void spool_flash_program(uint32_t offset, const uint8_t *data, uint32_t count) {
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_program(offset, data, count);
+    restore_interrupts(ints);
+}
+static const uint8_t *spool_flash_map(uint32_t offset) {
+    return (const uint8_t *)(XIP_BASE + offset);
+}
+const sr_flash_t spool_flash = {spool_flash_erase, spool_flash_program, spool_flash_map};
+#endif
+//Accesses for a spool in capture_buf, which needs no erase
+static void store_ram_erase(uint32_t offset, uint32_t count) {
+}
+static void store_ram_program(uint32_t offset, const uint8_t *data, uint32_t count) {
+    memcpy(&capture_buf[offset], data, count);
+}
+static const uint8_t *store_ram_map(uint32_t offset) {
+    return &capture_buf[offset];
+}
+const sr_flash_t store_ram = {store_ram_erase, store_ram_program, store_ram_map};
+//Output sink for the encoders in the lossy continuous mode
+void stage_tx_sink(const char *buf, int length) {
+    stage_write(&stage, buf, length);
+}
+//Output sink for the encoders in a spooled capture
+void spool_tx_sink(const char *buf, int length) {
+    spool_write(&spool, (const uint8_t *)buf, (uint32_t)length);
+}
+//Send the spooled blocks once the capture is done
+void spool_replay(void) {
+    const uint8_t *blk;
+    uint32_t len;
+    spool_close(&spool);
+    for (uint32_t i = 0; (blk = spool_block(&spool, i, &len)); i++) {
+        usb_tx_sink((const char *)blk, (int)len);
+        usb_tx_flush();
+    }
+}
+//Called after the encoders finish a half buffer so that any partial USB packet gets sent
+void tx_end_of_half(void) {
+    if (staging) {
+        stage_send(&stage);
+    }
+    if (spooling) {
+        spool_end_block(&spool);
+        //The capture can't continue once the spool is full
+        if (spool.full) {
+            Dprintf("Spool full\n\r");
+            dev.state = ABORTED;
+        }
+        return;
     }
+#if (DUAL_CORE_EN == 1)
+    while (!spsc_push(&txq, enc.txbuf, 0)) {
+        tight_loop_contents();
+    }
+#else
+    usb_tx_flush();
+#endif
+}
 
-}//send_slices_D4
+//Encode and send one segment of the DMA ring, starting at sample start within the segment.
+//samples_per_half is temporarily reduced so that the send_slices_* functions only send
+//the samples from start to the end of the segment.
+void send_segment(uint32_t seg,uint32_t start){
+  uint32_t dbuf_start, abuf_start;
+  uint32_t sph=dev.samples_per_half,n;
+  uint32_t t0=time_us_32(),t1,w0=enc_wait_us();
+  if(staging) stage_begin(&stage,&enc);
+  dbuf_start=dev.dbuf0_start+seg*dev.d_size;
+  abuf_start=dev.abuf0_start+seg*dev.a_size+start*dev.a_chan_cnt*(dev.adc12 ? 2 : 1);
+  //D4 mode stores two samples per byte
+  dbuf_start+=(enc.d_dma_bps) ? start*enc.d_dma_bps : start>>1;
+  //Dprintf("d buffers %d %d %d\n\r",dev.dbuf0_start,seg,dbuf_start);
+  //Dprintf("a buffers %d %d %d\n\r",dev.abuf0_start,seg,abuf_start);
+  dev.samples_per_half=sph-start;
+  if(dev.d_mask && filt_active(&filt)){
+     dev.samples_per_half=filt_run(&filt,&(capture_buf[dbuf_start]),sph-start,enc.d_dma_bps);
+  }
+  //Decimation can leave no samples if the group carries into the next segment
+  if(dev.samples_per_half){
+    send_slices(&dev,&enc,&(capture_buf[dbuf_start]),&(capture_buf[abuf_start]));
+  }
+  n=dev.samples_per_half;
+  dev.samples_per_half=sph;
+  //A staged segment that the DMA overwrote while it was encoded, or that didn't fit, is sent
+  //as a gap of the samples it held after filtering
+  if(staging&&(stage.over||seg_overflow(dma_halves,num_halves,dev.num_segs))){
+    Dprintf("Lossy drop halves %d %d\n\r",dma_halves,num_halves);
+    stage_drop(&stage,&enc,n);
+    filt_gap(&filt,0);
+  }
+  t1=time_us_32();
+  dev.stats.enc_us+=(t1-t0)-(enc_wait_us()-w0);
+  tx_end_of_half();
+  t1=time_us_32()-t0;
+  if(t1>dev.stats.peak_us) dev.stats.peak_us=t1;
+  dev.stats.bytes=enc.bytecnt;
+  dev.stats.segs++;
+}
 
-//Send a digital sample of multiple bytes with the 7 bit encoding
-void inline tx_d_samp(sr_device_t *d,uint32_t cval){
-    for(char b=0;b < d->d_tx_bps;b++){
-      txbuf[txbufidx++]=(cval|0x80);
-//      Dprintf("txds b %d cv 0x%X idx %d \n\r",b,cval,txbufidx); 
-      cval>>=7;
-    }
+//Search a segment for the device side trigger.  Nothing is sent until the trigger is found,
+//then the pre-trigger samples and the rest of the segment are sent.
+void trigger_search(uint32_t seg){
+  int32_t tidx;
+  uint32_t pre,start,remain;
+  uint32_t sph=dev.samples_per_half;
+  tidx=trig_scan(&dev.trig,&(capture_buf[dev.dbuf0_start+seg*dev.d_size]),sph,enc.d_dma_bps);
+  if(tidx<0){
+     trig_prev_ok=true;
+     return;
+  }
+  //Setting triggered re-enables the overflow checks in the interrupt handler
+  dev.triggered=true;
+  //Always send at least the sample before the trigger so that edges are also seen by the host
+  //pretrig is in sent samples, which are filt.decim captured samples each.
+  pre=(dev.pretrig) ? dev.pretrig*filt.decim : 1;
+  if(pre<=(uint32_t)tidx){
+     //Starting on a multiple of 8 samples keeps the D4 and coarse rle word reads aligned
+     start=((uint32_t)tidx-pre)&0xFFFFFFF8;
+     send_segment(seg,start);
+  }else{
+     //The rest of the pre-trigger samples come from the end of the previous segment
+     //as long as it was searched and the DMA isn't about to overwrite it.
+     if(trig_prev_ok&&((dma_halves-num_halves)<(dev.num_segs-2))){
+        remain=pre-(uint32_t)tidx;
+        if(remain>sph) remain=sph;
+        start=(sph-remain)&0xFFFFFFF8;
+        send_segment(seg_index(num_halves-1,dev.num_segs),start);
+     }
+     send_segment(seg,0);
+  }
+  if(dev.cont==false){
+     //Now that the first sample is known, stop the DMA once enough segments are filled
+     remain=(dev.scnt<dev.num_samples) ? (dev.num_samples-dev.scnt)*filt.decim : 0;
+     exp_halves=num_halves+1+(remain+sph-1)/sph;
+  }
 }
 
-//Allow for 1,2 or 4B reads of sample data to reduce memory read overhead when
-//parsing digital sample data.  This function is correct for all uses, but if included
-//the compiled code is substantially slower to the point that digital only transfers
-//can't keep up with USB rate.  Thus it is only used by the send_slices_analog which is already
-//limited to 500khz, and in the starting send_slice_1/2/4
-uint32_t  get_cval(uint8_t *dbuf){
-       uint32_t cval;
-       if(d_dma_bps==1){
-           cval=dbuf[rxbufdidx];
-       }else if(d_dma_bps==2){
-           cval=(*((uint16_t *) (dbuf+rxbufdidx)));
-       }else{
-           cval=(*((uint32_t *) (dbuf+rxbufdidx)));
-           //Mask off undefined channels
-           #ifdef DIG_26_MODE
-             //push out the gap of 3 channels
-              cval=(cval&MEM_D_MASK_L)|((cval&MEM_D_MASK_U)>>3);
-           #elif BASE_MODE
-              //mask off upper unused
-               cval=cval&MEM_D_MASK_L;
-              //No change for DIG_32_MODE as all are defined  
-           #endif
-       }
-       rxbufdidx+=d_dma_bps;
-       return cval;
+//Output sink for the 'e' estimate, which only needs the byte count
+void est_sink(const char *buf, int length) {
 }
-/*RLE encoding for 5 or more channels has two ranges.
-Decimal 48 to  79 are RLEs of 1 to 32 respectively.
-Decimal 80 to 127 are (N-78)*32 thus 64,96..80,120..1568
-Note that it is the responsibility of the caller to
-forward txbuf bytes to USB to prevent txbufidx from overflowing the size
-of txbuf. We do not always push to USB to reduce its impact
-on performance.
- */
-void inline check_rle(){
-//  Dprintf("RLEx %d\n\r",rlecnt); 
-  while(rlecnt>=1568){
-    txbuf[txbufidx++]=127;
-    rlecnt-=1568;
+//Time the encoding of a made up segment for the 'e' estimate, either with every sample
+//different (busy) or all the same.  The samples are written to the start of capture_buf,
+//so this can only be used when idle.
+void est_bench(sr_est_bench_t *b,bool busy){
+  sr_encoder_t e;
+  uint32_t sph=dev.samples_per_half,scnt=dev.scnt;
+  bool cont=dev.cont;
+  uint32_t v=0x12345678;
+  uint32_t dbytes=(dev.d_nps>1) ? EST_SAMPLES*(dev.d_nps>>1) : EST_SAMPLES/2;
+  uint8_t *abuf=&(capture_buf[dbytes]);
+  for(uint32_t i=0;i<dbytes;i++){
+    v=v*1103515245+12345;
+    capture_buf[i]=busy ? v>>24 : 0;
   }
-  if(rlecnt>32){
-     uint16_t rlediv=rlecnt>>5;
-     txbuf[txbufidx++]=rlediv+78;//was 86;
-     rlecnt-=rlediv<<5;
-    }
-  if(rlecnt){
-     txbuf[txbufidx++]=47+rlecnt;
-     rlecnt=0;
+  for(uint32_t i=0;i<EST_SAMPLES*dev.a_chan_cnt;i++){
+    v=v*1103515245+12345;
+    if(dev.adc12){((uint16_t *)abuf)[i]=busy ? v>>20 : 0x800;}
+    else{abuf[i]=busy ? v>>24 : 0x80;}
+  }
+  enc_init(&e,est_sink);
+  e.d_dma_bps=dev.d_nps>>1;
+  dev.samples_per_half=EST_SAMPLES;
+  dev.cont=true;
+  //An untimed pass loads the encoder into the XIP cache, then the fastest of the timed
+  //passes is kept so that interrupts taken during a pass aren't counted as encoding
+  send_slices(&dev,&e,capture_buf,abuf);
+  e.bytecnt=0;
+  b->enc_us=0xFFFFFFFF;
+  for(int r=0;r<EST_REPS;r++){
+    uint32_t t0=time_us_32();
+    send_slices(&dev,&e,capture_buf,abuf);
+    t0=time_us_32()-t0;
+    if(t0<b->enc_us) b->enc_us=t0;
   }
+  b->samples=EST_SAMPLES;
+  b->bytes=e.bytecnt/EST_REPS;
+  dev.samples_per_half=sph;
+  dev.scnt=scnt;
+  dev.cont=cont;
+}
+//Reply to the 'e' command with the busy and quiet rate estimates
+void est_reply(void){
+  sr_est_bench_t busy,quiet;
+  uint32_t pio_max=clk_pio_max(dev.clk_profile);
+  est_bench(&busy,true);
+  est_bench(&quiet,false);
+  sprintf(dev.rspstr,"%ux%u",est_rate(&busy,usb_bps,DUAL_CORE_EN==1,dev.a_chan_cnt,pio_max),
+                            est_rate(&quiet,usb_bps,DUAL_CORE_EN==1,dev.a_chan_cnt,pio_max));
+  Dprintf("Estimate %s busy %u us %u B quiet %u us %u B usb %u\n\r",dev.rspstr,busy.enc_us,busy.bytes,
+          quiet.enc_us,quiet.bytes,usb_bps);
+}
+
+//The 'k' reply, the system clock and the sample rate of the plan for the current configuration
+void clk_reply(void){
+  plan_update(&plan,&dev,&boot_clk);
+  sprintf(dev.rspstr,"%ux%u",plan.clk.sys_hz,plan.rate);
+  Dprintf("Clock %s exact %d\n\r",dev.rspstr,plan.clk.exact);
 }
 
-//Send txbuf to usb based on an input threshold
-void check_tx_buf(uint16_t cnt){
-  if(txbufidx>=cnt){
-//     Dprintf("txbuf idx %d cnt %d\n\r",txbufidx,cnt);
-     my_stdio_usb_out_chars(txbuf,txbufidx);
-     bytecnt+=txbufidx;
-     txbufidx=0;
+//Core voltage for a clock profile's vreg_mv
+enum vreg_voltage clk_vreg(uint32_t mv){
+  if(mv>=1200) return VREG_VOLTAGE_1_20;
+  if(mv>=1150) return VREG_VOLTAGE_1_15;
+  return VREG_VOLTAGE_DEFAULT;
+}
+
+//Move clk_sys to the PLL settings of clk.  The core voltage is raised before the clock goes up
+//and lowered after it comes down.  clk_usb and clk_adc are on the USB PLL and the timer runs
+//from clk_ref, so only the uart has to be set up again.
+void clk_apply(const sr_clk_t *clk){
+  if((clk->vco_hz==cur_clk.vco_hz)&&(clk->postdiv1==cur_clk.postdiv1)&&(clk->postdiv2==cur_clk.postdiv2)){
+    return;
+  }
+  if(clk->vreg_mv>cur_clk.vreg_mv){
+    vreg_set_voltage(clk_vreg(clk->vreg_mv));
+    sleep_ms(10);
+  }
+  set_sys_clock_pll(clk->vco_hz,clk->postdiv1,clk->postdiv2);
+  if(clk->vreg_mv<cur_clk.vreg_mv){
+    vreg_set_voltage(clk_vreg(clk->vreg_mv));
+  }
+  #if (UART_EN == 1)
+  uart_set_baudrate(uart0,UART_BAUD);
+  #endif
+  cur_clk=*clk;
+  Dprintf("clk_sys %u vco %u postdiv %u %u\n\r",clk->sys_hz,clk->vco_hz,clk->postdiv1,clk->postdiv2);
+}
+
+//Update the plan for the current configuration, and load its programs if it changed.
+//The state machines must be stopped since the instruction memory is rewritten, and before
+//the plan's clock profile changes clk_sys.
+void plan_refresh(void){
+  plan_update(&plan,&dev,&boot_clk);
+  if(plan_loaded_gen==plan.gen) return;
+  pio_sm_set_enabled(pio, piosm, false);
+  #if (TRIG_PIO_EN == 1)
+  pio_sm_set_enabled(pio, trigsm, false);
+  #endif
+  clk_apply(&plan.clk);
+  pio_clear_instruction_memory(pio);
+  if(plan.prog_len){
+    struct pio_program capture_prog = {
+      .instructions = plan.prog,
+      .length = plan.prog_len,
+      .origin = -1
+    };
+    cap_offset=pio_add_program(pio, &capture_prog);
+  }
+  #if (TRIG_PIO_EN == 1)
+  if(plan.trig_len){
+    struct pio_program trig_prog = {
+      .instructions = plan.trig_prog,
+      .length = plan.trig_len,
+      .origin = -1
+    };
+    trig_offset=pio_add_program(pio, &trig_prog);
+  }
+  #endif
+  plan_loaded_gen=plan.gen;
+  Dprintf("Plan %u ev %d decim %u segs %u samples per seg %u div %u.%u adc 0x%X\n\r",plan.gen,plan.ev_run,
+          plan.decim,plan.lay.num_segs,plan.lay.samples_per_half,plan.div_int,plan.div_frac,plan.adc_div);
+}
+
+//Event captures send the records as the DMA writes them rather than a segment at a time, so
+//a sparse input doesn't wait for a segment to fill.  This is the number of records of
+//segment num_halves that the DMA has written.  A channel's write address moves on to its
+//next segment as soon as it finishes one, before the interrupt counts it, which reads as a
+//full segment (or less than already sent with a 2 segment ring).
+uint32_t ev_written(void){
+  uint32_t chan,base,n;
+  if(dma_halves>num_halves) return dev.samples_per_half;
+  chan=(num_halves&1) ? pdmachan1 : pdmachan0;
+  base=(uint32_t)&capture_buf[dev.dbuf0_start+seg_index(num_halves,dev.num_segs)*dev.d_size];
+  n=(dma_hw->ch[chan].write_addr-base)/(EV_REC_WORDS*4);
+  return (n>dev.samples_per_half) ? dev.samples_per_half : n;
+}
+//Encode and send records first to n of segment num_halves
+void send_event_records(uint32_t first,uint32_t n){
+  uint32_t t0=time_us_32(),t1,w0=enc_wait_us();
+  uint32_t start=dev.dbuf0_start+seg_index(num_halves,dev.num_segs)*dev.d_size+first*EV_REC_WORDS*4;
+  send_events(&dev,&enc,(uint32_t *)&(capture_buf[start]),n-first);
+  t1=time_us_32();
+  dev.stats.enc_us+=(t1-t0)-(enc_wait_us()-w0);
+  tx_end_of_half();
+  t1=time_us_32()-t0;
+  if(t1>dev.stats.peak_us) dev.stats.peak_us=t1;
+  dev.stats.bytes=enc.bytecnt;
+}
+//The send_half of event captures
+void send_events_half(void){
+  uint32_t n,lag;
+  bool sent=false;
+  //Read the time before the DMA progress, so that any record older than the hold is seen
+  uint64_t now=time_us_64();
+  //A fixed capture is stopped once all of its samples are taken, and the DMA given time to
+  //empty the FIFO and the interrupt to count the last full segment
+  if((dev.state==SENDING)&&(dev.cont==false)&&(now>=ev_end_us)){
+     pio_sm_set_enabled(pio,piosm,false);
+     sleep_us(10);
+     dev.state=DMA_DONE;
+  }
+  if((dev.state==SENDING)||(dev.state==DMA_DONE)){
+    sho_cnt++;
+  }else{
+    return;
+  }
+  //The program dropped a record as the FIFO was full, so the values after it are unknown
+  if(pio_interrupt_get(pio,EV_OVF_IRQ)){
+    Dprintf("Event FIFO overflow\n\r");
+    dev.state=ABORTED;
+    return;
+  }
+  while(1){
+     n=ev_written();
+     if(n>ev_sent){
+        tx_cnt++;
+        send_event_records(ev_sent,n);
+        ev_sent=n;
+        sent=true;
+     }
+     if((ev_sent<dev.samples_per_half)||(dma_halves<=num_halves)) break;
+     //The segment is done, move on to the next one
+     lag=dma_halves-num_halves;
+     if((dev.num_segs-lag)<dev.stats.headroom) dev.stats.headroom=dev.num_segs-lag;
+     dev.stats.segs++;
+     num_halves++;
+     ev_sent=0;
+  }
+  if(sent){
+     ev_idle_us=now;
+  }else if(dev.cont&&(dev.state==SENDING)&&((now-ev_idle_us)>=(EV_IDLE_MS*1000))
+           &&((now-ev_start_us)>EV_LAG_US)){
+     send_events_hold(&dev,&enc,(uint32_t)((now-ev_start_us-EV_LAG_US)*dev.sample_rate/1000000));
+     tx_end_of_half();
+     dev.stats.bytes=enc.bytecnt;
+     ev_idle_us=now;
+  }
+  if(tx_stopped()){
+    return;
+  }
+  if(dev.usb_plus){
+    dev.state=SAMPLES_SENT;
+  }else if(dev.state==DMA_DONE){
+    //The last value is held to the end of the capture
+    send_events_hold(&dev,&enc,dev.num_samples);
+    tx_end_of_half();
+    dev.stats.bytes=enc.bytecnt;
+    dev.state=SAMPLES_SENT;
+    Dprintf("SH_SSENT events %d %d\n\r",dev.scnt,dev.num_samples);
   }
 }
-//A common first digital byte to send to establish RLE.
-//Not used for send_analog because it doesn't use RLE, and not used for D4 because it 
-//has a different RLE encoding
-void send_first_dig_sample(sr_device_t *d,uint8_t *dbuf){
-   lval=get_cval(dbuf);
-   tx_d_samp(d,lval);
-   samp_remain--;
-   rlecnt=0;
+
+#if (TRIG_PIO_EN == 1)
+//Until the trigger PIO sees the trigger condition the filled segments aren't searched, they
+//are passed over keeping only the newest for pre-trigger samples.  Passing over all but the
+//newest makes sure the PIO interrupt latency can't hide a trigger in them.
+//Once the PIO sees it, the search starts one segment before the mark for the same reason.
+//Returns the count of filled segments that can be searched.
+uint32_t trig_pio_gate(uint32_t dma_cnt){
+  uint32_t mark;
+  if((dev.triggered==false)&&trig_pio_len){
+     mark=trig_mark;
+     if(mark==TRIG_NO_MARK){
+        if(dma_cnt>(num_halves+1)){
+           num_halves=dma_cnt-1;
+           trig_arm(&dev.trig);
+           trig_prev_ok=true;
+        }
+        dma_cnt=num_halves; //nothing to search yet
+     }else if((mark>0)&&(num_halves<(mark-1))){
+        num_halves=mark-1;
+        trig_arm(&dev.trig);
+        trig_prev_ok=true;
+     }
+  }
+  return dma_cnt;
 }
-//There are three very similar functions send_slices_1B/2B/4B.
-//Each of which  is very similar but exist because if a common function 
-//is used with the get_cval in the inner loop, the performance drops 
-//substantially.  Thus each function has a 1,2, or 4B aligned read respectively.
-//We can't just always read a 4B value because the core doesn't support non-aligned accesses.
-//These must be marked noinline to ensure they remain separate functions for good performance
-//1B is 5-8 channels
-void __attribute__ ((noinline)) send_slices_1B(sr_device_t *d,uint8_t *dbuf){
-   send_slice_init(d,dbuf);
-//   Dprintf("Enter 1Ba sts %d sr %d\n\r",d->samples_per_half,samp_remain); 
-   send_first_dig_sample(d,dbuf);
-   for(int s=0;s<samp_remain;s++){
-       cval=dbuf[rxbufdidx++]; 
-       if(cval==lval){
-           rlecnt++;
-         }
-       else{
-//         Dprintf("SB n 0x%X o 0x%X rle %d ridx %d\n\r",cval,lval,rlecnt,rxbufdidx); 
-         check_rle();
-         tx_d_samp(d,cval);
-         check_tx_buf(TX_BUF_THRESH);
-       }//if cval!=lval
-       lval=cval;
-     }//for s
-  check_rle();
-  check_tx_buf(1);
-}//send_slices_1B
+#endif
 
-//2B is 9-16 channels
-//For all modes the sample bits are always continous/fully packed
-void __attribute__ ((noinline)) send_slices_2B(sr_device_t *d,uint8_t *dbuf){
-   send_slice_init(d,dbuf);
-   send_first_dig_sample(d,dbuf);
-   for(int s=0;s<samp_remain;s++){
-       cval=(*((uint16_t *) (dbuf+rxbufdidx)));
-       rxbufdidx+=2;
-       if(cval==lval){
-	     rlecnt++;
-         }
-       else{
-          check_rle();
-          tx_d_samp(d,cval);
-           check_tx_buf(TX_BUF_THRESH);
-       }//if cval!=lval
-       lval=cval;
-     }//for s
-   check_rle();
-   check_tx_buf(1);
-}//send_slices_2B
-//4B is 17-21 channels in BASE_MODE
-//It is also used with 17-26 channels in DIG_26_MODE, and 17-32 channels in DIG_32_MODE
-void __attribute__ ((noinline)) send_slices_4B(sr_device_t *d,uint8_t *dbuf){
-   send_slice_init(d,dbuf);
-   send_first_dig_sample(d,dbuf);
-   for(int s=0;s<samp_remain;s++){
-       cval=(*((uint32_t *) (dbuf+rxbufdidx)));
-       rxbufdidx+=4;
-       //Mask invalid bits, remove 29-31, and shift down 26-28 over 23-25
-       #ifdef DIG_26_MODE
-        cval=(cval&MEM_D_MASK_L)|((cval&MEM_D_MASK_U)>>3);
-       #elif BASE_MODE
-        //mask off upper unused
-        cval=cval&MEM_D_MASK_L;
-        //No change for DIG_32_MODE as all are defined  
-       #endif
-       if(cval==lval){
-      	   rlecnt++;
-         }
-       else{
-         check_rle();
-         tx_d_samp(d,cval);
-         check_tx_buf(TX_BUF_THRESH);
-       }//if cval!=lval
-       lval=cval;
-     }//for s
-   check_rle();
-   check_tx_buf(1);
-}//send_slices_4B
+//Copy the samples of segment seg, the num_halves'th, that belong to frames, and search the
+//rest of it for the next trigger.  A frame can start in the segment before, and several
+//short frames can fit in one segment.
+void frame_segment(uint32_t seg){
+  uint32_t sph=dev.samples_per_half;
+  uint64_t seg_pos=(uint64_t)num_halves*sph;
+  uint8_t *dseg=&capture_buf[dev.dbuf0_start+seg*dev.d_size];
+  uint8_t *aseg=&capture_buf[dev.abuf0_start+seg*dev.a_size];
+  uint8_t *slot;
+  uint32_t pos=0,n,pre,pseg,from;
+  int32_t tidx;
+  uint64_t start,first;
+  while(fr_idx<plan.fr.frames){
+    slot=&capture_buf[frame_slot(&plan.fr,fr_idx)];
+    if(fr_filling){
+      n=plan.fr.samples-fr_fill;
+      if(n>sph-pos) n=sph-pos;
+      frame_copy(&plan.fr,slot,fr_fill,dseg,aseg,pos,n);
+      fr_fill+=n;
+      pos+=n;
+      if(fr_fill<plan.fr.samples) break;
+      //The search for the next trigger starts right after the frame
+      fr_filling=false;
+      fr_idx++;
+      fr_next=seg_pos+pos;
+      trig_arm(&dev.trig);
+      continue;
+    }
+    if(pos>=sph) break;
+    //D4 mode stores two samples per byte
+    tidx=trig_scan(&dev.trig,dseg+((enc.d_dma_bps) ? pos*enc.d_dma_bps : pos>>1),sph-pos,enc.d_dma_bps);
+    if(tidx<0) break;
+    #if (TRIG_PIO_EN == 1)
+    //The trigger PIO program stops at its first condition, so the later frames are only
+    //found by the search
+    trig_pio_len=0;
+    #endif
+    //The pre-trigger samples are limited as in trigger_search, and so that the trigger is
+    //always in the frame and the frame doesn't overlap the last one.
+    pre=(dev.pretrig) ? dev.pretrig*filt.decim : 1;
+    if(pre>plan.fr.samples-8) pre=plan.fr.samples-8;
+    start=seg_pos+pos+(uint32_t)tidx;
+    start=(start>pre) ? (start-pre)&~7ULL : 0;
+    first=(trig_prev_ok&&(num_halves>0)&&((dma_halves-num_halves)<(dev.num_segs-2))) ? seg_pos-sph : seg_pos;
+    if(start<first) start=first;
+    if(start<fr_next) start=fr_next;
+    frame_set_start(slot,start);
+    fr_filling=true;
+    fr_fill=0;
+    if(start<seg_pos){
+       //The frame starts in the previous segment, the rest is copied from this one by the
+       //next pass of the loop
+       pseg=seg_index(num_halves-1,dev.num_segs);
+       from=(uint32_t)(start-(seg_pos-sph));
+       n=sph-from;
+       if(n>plan.fr.samples) n=plan.fr.samples;
+       frame_copy(&plan.fr,slot,0,&capture_buf[dev.dbuf0_start+pseg*dev.d_size],
+                  &capture_buf[dev.abuf0_start+pseg*dev.a_size],from,n);
+       fr_fill=n;
+    }else{
+       pos=(uint32_t)(start-seg_pos);
+    }
+  }
+  trig_prev_ok=true;
+}
 
+//The send_half of segmented captures.  Nothing is sent until every frame is filled, then
+//the main loop sends them with frame_upload.
+void send_frames_half(void){
+  uint32_t dma_cnt;
+  if((dev.state!=SENDING)&&(dev.state!=DMA_DONE)){
+    return;
+  }
+  dma_cnt=dma_halves;
+  #if (TRIG_PIO_EN == 1)
+  dma_cnt=trig_pio_gate(dma_cnt);
+  #endif
+  if(dma_cnt>num_halves){
+    if((dma_cnt-num_halves)>=(dev.num_segs-1)){
+       //The samples of a frame can't be recovered once the DMA overwrites them, but while
+       //waiting for a trigger the search can skip ahead to the newest segment
+       if(fr_filling){
+          Dprintf("Frame overflow %d halves %d %d\n\r",fr_idx,dma_cnt,num_halves);
+          dev.state=ABORTED;
+          return;
+       }
+       num_halves=dma_cnt-1;
+       trig_arm(&dev.trig);
+       trig_prev_ok=false;
+    }
+    frame_segment(seg_index(num_halves,dev.num_segs));
+    num_halves++;
+    dev.stats.segs++;
+  }
+  if(tx_stopped()){
+    return;
+  }
+  if(dev.usb_plus||(fr_idx>=plan.fr.frames)){
+    dev.state=SAMPLES_SENT;
+  }
+}
 
-//Slice transmit code, used for all cases with any analog channels 
-//All digital channels for one slice are sent first in 7 bit bytes using values 0x80 to 0xFF
-//Analog channels are sent next, with each channel taking one 7 bit byte using values 0x80 to 0xFF.
-//This does not support run length encoding because it's not clear how to define RLE on analog signals
-//This functional will only be called in BASE_MODE, as neither DIG_26_MODE or DIG_32 mode
-//have analog support
-uint32_t send_slices_analog(sr_device_t *d,uint8_t *dbuf,uint8_t *abuf){
-   send_slice_init(d,dbuf);
-   uint32_t lval=0;
-   for(int s=0;s<samp_remain;s++){
-         if(d->d_mask){
-            cval=get_cval(dbuf);
-            tx_d_samp(d,cval);
-	    //Dprintf("s %d cv %X bps %d idx t %d r %d \n\r",s,cval,d_dma_bps,txbufidx,rxbufdidx);
-         }
-         for(char i=0;i<d->a_chan_cnt;i++){
-           txbuf[txbufidx]=(abuf[rxbufaidx]>>1)|0x80;
-           txbufidx++;
-           rxbufaidx++;
-	   //Dprintf("av %X cnt %d idx t %d r %d\n\r",abuf[rxbufaidx-1],d->a_chan_cnt,txbufidx,rxbufaidx);
-         } 
-         //Since this doesn't support RLEs we don't need to buffer
-         //extra bytes to prevent txbuf overflow, but this value
-         //works well anyway
-         check_tx_buf(TX_BUF_THRESH);
-   }//for s
-   check_tx_buf(1);
-}//send_slices_analog
+//Send the frames of a segmented capture once they are all filled.  Each frame is sent as a gap
+//for the samples since the end of the last frame, a frame marker, and the frame's samples in
+//the normal encoding, so the host can place every frame on one time line.
+void frame_upload(void){
+  uint8_t *slot,*prev=NULL;
+  uint32_t sph=dev.samples_per_half,n;
+  uint64_t gap;
+  enc.sink=usb_tx_sink;
+  for(uint32_t k=0;k<plan.fr.frames;k++){
+    slot=&capture_buf[frame_slot(&plan.fr,k)];
+    gap=frame_gap(prev,slot,filt.decim,dev.num_samples);
+    while(gap){
+      n=(gap>GAP_MAX) ? GAP_MAX : (uint32_t)gap;
+      send_gap(&enc,n);
+      gap-=n;
+    }
+    send_frame_mark(&enc,k);
+    //Each frame is filtered and encoded on its own
+    filt_init(&filt,filt.decim,dev.decim_mode,dev.glitch);
+    dev.samples_per_half=plan.fr.samples;
+    if(dev.d_mask && filt_active(&filt)){
+       dev.samples_per_half=filt_run(&filt,frame_dbuf(slot),plan.fr.samples,enc.d_dma_bps);
+    }
+    dev.scnt=0;
+    send_slices(&dev,&enc,frame_dbuf(slot),frame_abuf(&plan.fr,slot));
+    usb_tx_flush();
+    prev=slot;
+  }
+  dev.samples_per_half=sph;
+  dev.stats.bytes=enc.bytecnt;
+}
 
 //This function monitors the dma interrupt handler outputs to send the remainder of a full DMA buffer.
+//In DUAL_CORE_EN mode it runs on core1, otherwise it is called from the main loop.
 void send_half(void){
-  bool sendlower;
-  uint32_t dbuf_start, abuf_start;
-  sendlower=(num_halves & 1) ? false : true;
+  uint32_t dma_cnt;
+  if(ev_run){
+    send_events_half();
+    return;
+  }
+  if(fr_run){
+    send_frames_half();
+    return;
+  }
   //return immediately if not in a sending state
   if((dev.state==SENDING)||(dev.state==DMA_DONE))
   {
@@ -526,20 +854,45 @@ void send_half(void){
     return;
   }
   //We have a full DMA buffer, send it.
-  if(dma_halves>num_halves){
+  dma_cnt=dma_halves;
+  #if (TRIG_PIO_EN == 1)
+  dma_cnt=trig_pio_gate(dma_cnt);
+  #endif
+  if(dma_cnt>num_halves){
        tx_cnt++;
-       dbuf_start=sendlower ? dev.dbuf0_start : dev.dbuf1_start;
-       abuf_start=sendlower ? dev.abuf0_start : dev.abuf1_start;
-       //Dprintf("d buffers %d %d %d\n\r",dev.dbuf0_start,dev.dbuf1_start,dbuf_start);
-       //Dprintf("a buffers %d %d %d\n\r",dev.abuf0_start,dev.abuf1_start,abuf_start);
-       if(dev.a_mask){ send_slices_analog(&dev,&(capture_buf[dbuf_start]),
-                                                 &(capture_buf[abuf_start]));}
-       else if(d_dma_bps==0){send_slices_D4(&dev,&(capture_buf[dbuf_start]));}
-       else if(d_dma_bps==1){send_slices_1B(&dev,&(capture_buf[dbuf_start]));}
-       else if(d_dma_bps==2){send_slices_2B(&dev,&(capture_buf[dbuf_start]));}
-       else {                send_slices_4B(&dev,&(capture_buf[dbuf_start]));}
-        num_halves++;
+       //Free segments left before the DMA overwrites the one about to be sent.  A buffer
+       //that is only filled once is never overwritten.
+       uint32_t lag=dma_cnt-num_halves;
+       uint32_t free_segs=(lag<dev.num_segs) ? dev.num_segs-lag : 0;
+       if((mask_xfer_err==false)&&(free_segs<dev.stats.headroom)) dev.stats.headroom=free_segs;
+       if(dev.triggered==false){
+          //If the trigger search has fallen behind so far that the DMA is about to overwrite
+          //the segment, skip ahead to the newest one.  Edges can't match across the gap.
+          if((dma_cnt-num_halves)>=(dev.num_segs-1)){
+             num_halves=dma_cnt-1;
+             trig_arm(&dev.trig);
+             trig_prev_ok=false;
+          }
+          trigger_search(seg_index(num_halves,dev.num_segs));
+       }else if((dev.cont==false)&&(dev.scnt>=dev.num_samples)){
+          //All requested samples were sent, the DMA just hasn't stopped yet
+       }else{
+          //In the lossy continuous mode, skip to the newest full segment once the DMA is
+          //about to overwrite this one, which leaves the most time to send it.
+          //The interrupt handler leaves overflows to send_segment in this mode, which drops
+          //a segment that was overwritten while it was encoded.
+          if(staging && (lag>1) && (lag>=dev.num_segs-1)){
+             send_gap(&enc,filt_gap(&filt,(lag-1)*dev.samples_per_half));
+             num_halves=dma_cnt-1;
+          }
+          send_segment(seg_index(num_halves,dev.num_segs),0);
+       }
+       num_halves++;
   }//if dma_halves>num_halves
+  //core0 may have ended the capture while the segment was sent, which it must not undo
+  if(tx_stopped()){
+    return;
+  }
   //If we ever recieve a usb_plus, consider all samples to be sent, even if not in continuous mode
   if(dev.usb_plus){
     dev.state=SAMPLES_SENT;
@@ -550,9 +903,9 @@ void send_half(void){
       dev.state=SAMPLES_SENT;
       Dprintf("SH_SSENT %d %d\n\r",dev.scnt,dev.num_samples);
     }else{
-      //Even with dma disabled, we still might have one more half buffer to send
-      //so allow this loop to be called again for the remaining half buffer
-      if(dma_halves-num_halves==1){
+      //Even with dma disabled, we still might have more segments to send
+      //so allow this loop to be called again for the remaining segments
+      if((dma_halves>num_halves)&&!seg_overflow(dma_halves,num_halves,dev.num_segs)){
         //Dprintf("ONEMORE\n\r");
       }else{
         if(mask_xfer_err==false){
@@ -566,6 +919,14 @@ void send_half(void){
   }//else
 }//send_half
 
+#if (TRIG_PIO_EN == 1)
+//The trigger PIO program saw its condition.  Record the segment being filled, the
+//trigger is in it or the one before, depending on the interrupt latency.
+void trig_int_handler(){
+  pio_set_irq0_source_enabled(pio,pis_interrupt0,false);
+  trig_mark=dma_halves;
+}
+#endif
 //Handle interrupts generated by ADC or PIO.  If both are enabled they may come in
 //either order, so wait for both if only one is seen.
 void dma_int_handler(){
@@ -598,7 +959,11 @@ void dma_int_handler(){
   //lower halves and an IRQ for either of the upper halves that we have overflowed.
   //This is rather exceptional as it means we managed to finish DMAs for both
   //halves and only called the interrupt handler once.
-  else if((mask_xfer_err==false)
+  //With more than two segments in the ring that isn't an overflow by itself, so both
+  //are counted below and the seg_overflow check decides.
+  //Until the trigger is found there is nothing to overflow, send_half just skips ahead.
+  //In the lossy continuous mode send_half handles the overflows, except in event captures.
+  else if((mask_xfer_err==false) && (dev.num_segs==2) && dev.triggered && !(dev.lossy && dev.cont && !ev_run)
        && ((currintmask&h0intmask) && (currintmask&h1intmask))){
       Dprintf("Int Overflow0 a %d b %d c %d d %d e %d halves %d %d masks %X %X %X \n\r",
              acnt,bcnt,ccnt,dcnt,ecnt,dma_halves,num_halves,currintmask,h0intmask,h1intmask);
@@ -631,10 +996,10 @@ void dma_int_handler(){
      //Dprintf("PRT %X\n",currintmask);
   }
   
-//This 2nd overflow check says if dma_halves is more than one ahead of num_halves then we are starting to 
+//This 2nd overflow check says if dma_halves is a full ring ahead of num_halves then we are starting to 
 //overwrite a buffer we are sending. Note that it is after we increment dma_halves .
-  if((mask_xfer_err==false)
-     && (dma_halves-num_halves>1))
+  if((mask_xfer_err==false) && dev.triggered && !(dev.lossy && dev.cont && !ev_run)
+     && seg_overflow(dma_halves,num_halves,dev.num_segs))
    {
     Dprintf("Int Overflow1 a %d b %d c %d d %d e %d halves %d %d masks %X %X %X \n\r",
       acnt,bcnt,ccnt,dcnt,ecnt,dma_halves,num_halves,currintmask,h0intmask,h1intmask);
@@ -642,7 +1007,9 @@ void dma_int_handler(){
     dev.state=ABORTED;
    }
    //Stop non continous mode when we reach expected number of halves
-   if(dma_halves==exp_halves){
+   //With a device trigger exp_halves is only set once the trigger is found, and the DMA may
+   //already be past it.
+   if(dma_halves>=exp_halves){
     //Dprintf("EXP_DNE %d\n\r",exp_halves); 
     dma_done=true;
    }
@@ -728,8 +1095,24 @@ void core1_entry(){
   }//core1_entry
 
 #endif //PIN_TEST_MODE
+#if (DUAL_CORE_EN == 1)
+//Core1 does nothing but encode half buffers as the DMA completes them.
+//All state changes are still made by core0 or the DMA interrupt handler except for the
+//SAMPLES_SENT/ABORTED transitions made at the end of send_half, which are only made after
+//the last block of the half has been queued.
+void core1_send_entry(){
+    while(1){
+        send_half();
+        core1_passes++;
+    }
+}
+#endif //DUAL_CORE_EN
 int main(){
     int delay=100;
+    #if (VBULK_EN == 1)
+    //tinyusb_device is linked directly for the bulk interface, so stdio_usb expects it to be up
+    tusb_init();
+    #endif
     stdio_usb_init();
     #if (UART_EN == 1)
      uart_set_format(uart0,8,1,0);
@@ -774,6 +1157,12 @@ int main(){
     Dprintf("pll_sys = %dkHz\n\r", f_pll_sys);
     uint f_clk_sys = frequency_count_khz(CLOCKS_FC0_SRC_VALUE_CLK_SYS);
     Dprintf("clk_sys = %dkHz\n\r", f_clk_sys);
+    //The plans use this rather than measuring it again, and profile 0 goes back to it
+    boot_clk.sys_hz=f_clk_sys*1000;
+    boot_clk.vco_hz=(CLK_XOSC_HZ/(pll_sys_hw->cs&PLL_CS_REFDIV_BITS))*pll_sys_hw->fbdiv_int;
+    boot_clk.postdiv1=(pll_sys_hw->prim&PLL_PRIM_POSTDIV1_BITS)>>PLL_PRIM_POSTDIV1_LSB;
+    boot_clk.postdiv2=(pll_sys_hw->prim&PLL_PRIM_POSTDIV2_BITS)>>PLL_PRIM_POSTDIV2_LSB;
+    cur_clk=boot_clk;
     #ifndef DIG_32_MODE 
     //Set GPIO23 (TP4) to control switched mode power supply noise
     //This may reduce noise into the ADC in some use cases.   
@@ -886,17 +1275,33 @@ int main(){
     bus_ctrl_hw->priority = BUSCTRL_BUS_PRIORITY_DMA_W_BITS | BUSCTRL_BUS_PRIORITY_DMA_R_BITS;
     
     init(&dev);
-    //Since RP2040 is 32 bit this should always be 4B aligned, and it must be because the PIO
-    //does DMA on a per byte basis
-    //If either malloc fails the code will just hang
-    Dprintf("Malloc %d bytes\n\r",DMA_BUF_SIZE);
-    capture_buf=malloc(DMA_BUF_SIZE);
-    Dprintf("DMA capture buf start %p\n\r",(void *)capture_buf);
-    //Ensure we leave 10k or more left for any dynamic allocations that need it
-    uint8_t *tptr;
-    tptr=malloc(10000);
-    Dprintf("10K free start %p\n\r",(void *)tptr);
-    free(tptr); 
+    #if (DUAL_CORE_EN == 1)
+    spsc_init(&txq);
+    enc_init(&enc,spsc_tx_sink);
+    #else
+    enc_init(&enc,usb_tx_sink);
+    #endif
+    //Size the capture buffer from the heap that is left, keeping ARENA_RESERVE for any other
+    //allocations.  Some of the heap may already be used so step down until malloc succeeds.
+    //The start is rounded up to a word because the PIO DMAs write 32 bits at a time.
+    uint32_t heap_size=(uint32_t)(&__StackLimit-&__end__);
+    uint8_t *arena=NULL;
+    dev.buf_size=(heap_size>ARENA_RESERVE+ARENA_STEP) ? heap_size-ARENA_RESERVE : ARENA_STEP;
+    while(((arena=malloc(dev.buf_size+3))==NULL)&&(dev.buf_size>ARENA_STEP)){
+       dev.buf_size-=ARENA_STEP;
+    }
+    //If even the smallest malloc fails the code will just hang
+    capture_buf=(uint8_t *)(((uintptr_t)arena+3)&~(uintptr_t)3);
+    dev.buf_size&=~3;
+    Dprintf("Heap %u bytes, DMA capture buf start %p size %u\n\r",heap_size,(void *)capture_buf,dev.buf_size);
+    #if (SPOOL_EN == 1)
+    //The spool uses all of the flash after the firmware image
+    uint32_t flash_end=(uint32_t)((uintptr_t)&__flash_binary_end-XIP_BASE);
+    spool_init(&spool,&spool_flash,flash_end,PICO_FLASH_SIZE_BYTES-flash_end);
+    spool_flash_base=spool.base;
+    dev.spool_size=spool.size;
+    Dprintf("Spool flash offset 0x%X size %u\n\r",spool.base,spool.size);
+    #endif
 
 
    gpio_init_mask(GPIO_D_MASK); //set as GPIO_FUNC_SIO and clear output enable
@@ -909,6 +1314,9 @@ int main(){
        //Avoid UART print conflicts by delaying core0 as core1 starts
        sleep_us(100000);
     #endif //PIN_TEST_MODE
+   #if (DUAL_CORE_EN == 1)
+       multicore_launch_core1(core1_send_entry);
+   #endif
 
 
 while(1){
@@ -945,58 +1353,91 @@ while(1){
 
           }
          if(dev.state==STARTED) {
-          bool adc_aborting=false;
-          Dprintf("STRTING\n\r");
-           //Sample rate must always be even.  Pulseview code enforces this 
-           //because it specifies a fixed set of frequencies, but sigrok cli can still odd ones.
-           dev.sample_rate>>=1;
-           dev.sample_rate<<=1;
-           //Adjust up and align to 4 to avoid rounding errors etc
-           if(dev.num_samples<16){dev.num_samples=16;}
-           dev.num_samples=(dev.num_samples+3)&0xFFFFFFFC;
-           //Divide capture buf evenly based on channel enables
-           //d_size is aligned to 4 bytes because pio operates on words
-           //These are the sizes for each half buffer in bytes
-           //Calculate relative size in terms of nibbles which is the smallest unit, thus a_chan_cnt is multiplied by 2
-           //Nibble size storage is only allow for D4 mode with no analog channels enabled
-           //For instance a D0..D5 with A0 would give 1/2 the storage to digital and 1/2 to analog
-           uint32_t d_nibbles,a_nibbles,t_nibbles; //digital, analog and total nibbles
-           d_nibbles=dev.d_nps;  //digital is in grous of 4 bits
-           //Note that this code only supports 7 bit accurate ADC modes.
-           a_nibbles=dev.a_chan_cnt*2; //1 byte per sample 
-           t_nibbles=d_nibbles+a_nibbles;
-           //total buf size must be a multiple of a_nibbles*2, d_nibbles*8, and t_nibbles so that 
-           //division is always in whole samples.
-           //Also set a multiple of 32  because the dma buffer is split in half, and
-           //the PIO does writes on 4B boundaries, and then a 4x factor for any other size/alignment issues
-           uint32_t chunk_size=t_nibbles*32;
-           if(a_nibbles) chunk_size*=a_nibbles;
-           if(d_nibbles) chunk_size*=d_nibbles;
-           uint32_t dig_bytes_per_chunk=chunk_size*d_nibbles/t_nibbles;
-           uint32_t dig_samples_per_chunk=(d_nibbles) ? dig_bytes_per_chunk*2/d_nibbles : 0;
-           uint32_t chunk_samples=d_nibbles ? dig_samples_per_chunk  : (chunk_size*2)/(a_nibbles);
-           //total chunks in entire buffer-round to 2 since we split it in half
-           uint32_t buff_chunks=(DMA_BUF_SIZE/chunk_size)&0xFFFFFFFE;
-           //round up and force power of two since we cut it in half
-           uint32_t chunks_needed=((dev.num_samples/chunk_samples)+2)&0xFFFFFFFE;
-	         Dprintf("Initial buf calcs nibbles d %d a %d t %d \n\r",d_nibbles,a_nibbles,t_nibbles);
-           Dprintf("chunk size %d(bytes) samples per chunk %d total chunks in both halves %d chunks needed %d\n\r",chunk_size,chunk_samples,buff_chunks,chunks_needed);
-           Dprintf("dbytes per chunk %d dig samples per chunk %d\n\r",dig_bytes_per_chunk,dig_samples_per_chunk);
-           //If all of the samples we need fit in two half buffers or less then we can mask the error
-           //logic that is looking for cases where we didn't send one half buffer to the host before
-           //the 2nd buffer ended because we only use each half buffer once.
-           mask_xfer_err=false;
-           //If requested samples are smaller than the buffer, reduce the size so that the 
-           //transfer completes sooner.
-           //Also, mask the sending of aborts if the requested number of samples fit into RAM
-           //Don't do this in continuous mode as the final size is unknown
-           if(dev.cont==false){
-               if(buff_chunks>chunks_needed){
-                  mask_xfer_err=true;
-                  buff_chunks=chunks_needed;
-                  //Dprintf("Reduce buf chunks to %d\n\r",buff_chunks);
-               }
+          bool aborting=false;
+          idle_done=false;
+          #if (DUAL_CORE_EN == 1)
+          //core1 must be done with the last capture before its state is reset
+          usb_tx_discard();
+          #endif
+           //The plan is normally made when the configuration changed, so this only checks it
+           plan_refresh();
+           dev.sample_rate=plan.sample_rate;
+           dev.num_samples=plan.num_samples;
+           filt_init(&filt,plan.decim,dev.decim_mode,dev.glitch);
+           uint32_t cap_samples=plan.cap_samples;
+           ev_run=plan.ev_run;
+           uint32_t d_nibbles=plan.d_nibbles;
+           uint32_t a_nibbles=plan.a_nibbles;
+           //If all of the samples we need fit in the buffer then we can mask the error
+           //logic that is looking for cases where we didn't send one segment to the host before
+           //the DMA came back around to it, because we only use each segment once.
+           //The buffer is split into a ring of segments so that a short USB stall only delays the
+           //sending of one segment while the DMA fills the others, rather than overflowing a whole half.
+           sr_layout_t lay=plan.lay;
+           fr_run=plan.fr_run;
+           if(fr_run&&!plan.lay_ok){
+              Dprintf("Frames don't fit\n\r");
+              dev.state=ABORTED;
+              aborting=true;
+           }
+           fr_idx=0;
+           fr_filling=false;
+           fr_fill=0;
+           fr_next=0;
+           spooling=false;
+           #if (SPOOL_EN == 1)
+           //A fixed capture that doesn't fit in the buffer is spooled to flash rather than
+           //streamed, as long as the segments fill slowly enough that the interrupts aren't
+           //held off for more than a segment by a flash write.
+           if(dev.spool && (dev.cont==false) && (lay.single_pass==false) && (ev_run==false) && (fr_run==false)
+              && (((uint64_t)lay.samples_per_half*1000)>=((uint64_t)SPOOL_MIN_SEG_MS*dev.sample_rate*filt.decim))){
+              //Erase for the largest expected encoding up front.  Nothing is erased once the
+              //capture has started, so one that outgrows it aborts as the spool is full.
+              spool_init(&spool,&spool_flash,spool_flash_base,dev.spool_size);
+              uint64_t spool_est=enc_worst_bytes(&dev,dev.num_samples,lay.samples_per_half/filt.decim);
+              spool_erase(&spool,(spool_est<spool.size) ? (uint32_t)spool_est : spool.size);
+              spooling=true;
+           }
+           #endif
+           //Otherwise it can be encoded into the end of the buffer, with the DMA ring
+           //reduced to the start of it, so that only the encoded size limits the depth.
+           if(dev.store && (spooling==false) && (dev.cont==false) && (lay.single_pass==false) && (ev_run==false)
+              && (fr_run==false)){
+              sr_layout_t ring;
+              uint32_t ring_size=(dev.buf_size/STORE_RING_DIV)&~3;
+              if(ring_layout(&ring,ring_size,d_nibbles,a_nibbles,cap_samples,false,DMA_SEGMENTS)){
+                 lay=ring;
+                 spool_init(&spool,&store_ram,ring_size,dev.buf_size-ring_size);
+                 spool_erase(&spool,spool.size);
+                 spooling=true;
+              }
+           }
+           if(spooling){
+              enc.sink=spool_tx_sink;
            }
+           //The lossy continuous mode stages each segment in the end of the buffer, with the
+           //DMA ring reduced to the start of it, so that a segment can be dropped as a gap.
+           staging=false;
+           if(dev.lossy && dev.cont && (ev_run==false)){
+              sr_layout_t ring;
+              uint32_t ring_size=(dev.buf_size-dev.buf_size/LOSSY_STAGE_DIV)&~3;
+              if(ring_layout(&ring,ring_size,d_nibbles,a_nibbles,cap_samples,false,DMA_SEGMENTS)){
+                 lay=ring;
+                 stage_init(&stage,&capture_buf[ring_size],dev.buf_size-ring_size,enc.sink);
+                 enc.sink=stage_tx_sink;
+                 staging=true;
+              }else{
+                 Dprintf("Lossy ring doesn't fit\n\r");
+                 dev.state=ABORTED;
+                 aborting=true;
+              }
+           }
+           #if (VBULK_EN == 1)
+           //Fall back to the serial port if the host hasn't configured the bulk interface
+           vbulk_run=dev.vbulk && vb_ready();
+           usb_tx.port=(vbulk_run) ? &usb_vb_port : &usb_cdc_port;
+           #endif
+           mask_xfer_err=lay.single_pass;
            //In mask_xfer_err mode we don't want the 2nd half to trigger back to the 1st half
            //and overwrite it's data, so set the maintenace config1's to themselves to disable chaining
            if(mask_xfer_err){
@@ -1006,14 +1447,29 @@ while(1){
                 channel_config_set_chain_to(&amcfg1,admachan0);
                 channel_config_set_chain_to(&pmcfg1,pdmachan0);
            }
-           //Give dig and analog equal fractions
-           //This is the size of each half buffer in bytes
-           dev.d_size=(buff_chunks*chunk_size*d_nibbles)/(t_nibbles*2);
-           dev.a_size=(buff_chunks*chunk_size*a_nibbles)/(t_nibbles*2);
-           dev.samples_per_half=chunk_samples*buff_chunks/2;
-           exp_halves=dev.cont ? -1 : dev.num_samples/dev.samples_per_half;
-           if(dev.cont==false && (dev.num_samples%dev.samples_per_half)) exp_halves++;
-           Dprintf("Final sizes d %d a %d mask err %d samples per half %d exp %d\n\r",dev.d_size,dev.a_size,mask_xfer_err,dev.samples_per_half,exp_halves);
+           dev.num_segs=lay.num_segs;
+           //The maintenance DMAs step through their address tables and wrap at the end
+           uint32_t ring_bits=seg_ring_bits(dev.num_segs);
+           channel_config_set_read_increment(&amcfg0, true);
+           channel_config_set_read_increment(&amcfg1, true);
+           channel_config_set_read_increment(&pmcfg0, true);
+           channel_config_set_read_increment(&pmcfg1, true);
+           channel_config_set_ring(&amcfg0,false,ring_bits);
+           channel_config_set_ring(&amcfg1,false,ring_bits);
+           channel_config_set_ring(&pmcfg0,false,ring_bits);
+           channel_config_set_ring(&pmcfg1,false,ring_bits);
+           //This is the size of each segment in bytes
+           dev.d_size=lay.d_size;
+           dev.a_size=lay.a_size;
+           dev.samples_per_half=lay.samples_per_half;
+           //With a device trigger exp_halves is set when the trigger is found
+           //Event captures are stopped by send_events_half
+           exp_halves=(dev.cont || !dev.triggered || ev_run) ? -1 : cap_samples/dev.samples_per_half;
+           if(dev.cont==false && dev.triggered && !ev_run && (cap_samples%dev.samples_per_half)) exp_halves++;
+           trig_prev_ok=false;
+           #if (TRIG_PIO_EN == 1)
+           trig_mark=TRIG_NO_MARK;
+           #endif
 
            //Clear any previous ADC over/underflow	    
             volatile uint32_t *adcfcs;
@@ -1030,20 +1486,17 @@ while(1){
           dma_channel_abort(pmaintchan0);
           dma_channel_abort(pmaintchan1);
 
+          //All digital segments come first, followed by all analog segments
           dev.dbuf0_start=0;
-          bytecnt=0;
-          dev.dbuf1_start=dev.d_size;
-          dev.abuf0_start=dev.dbuf1_start+dev.d_size;
-          dev.abuf1_start=dev.abuf0_start+dev.a_size;
+          enc.bytecnt=0;
+          dev.abuf0_start=dev.dbuf0_start+dev.d_size*dev.num_segs;
           volatile uint32_t *adcdiv;
           adcdiv=(volatile uint32_t *)(ADC_BASE+0x10);//ADC DIV
           //   Dprintf("adcdiv start %u\n\r",*adcdiv);
 	        //	  Dprintf("starting d_nps %u a_chan_cnt %u d_size %u a_size %u a_mask %X\n\r"
           //         ,dev.d_nps,dev.a_chan_cnt,dev.d_size,dev.a_size,dev.a_mask);
-          Dprintf("start offsets d0 0x%X d1 0x%X a0 0x%X a1 0x%X samperhalf %u\n\r"
-              ,dev.dbuf0_start,dev.dbuf1_start,dev.abuf0_start,dev.abuf1_start,dev.samples_per_half);
 //For debug clear out initial values, but not needed in normal operation              
-//          for(uint32_t x=0;x<DMA_BUF_SIZE;x++){
+//          for(uint32_t x=0;x<dev.buf_size;x++){
 //            capture_buf[x]=0x12; 
 //          }                  
 #ifdef PIN_TEST_MODE
@@ -1052,58 +1505,50 @@ while(1){
           }         
           systick_idx=0;       
 #endif //PIN_TEST_MODE
-          //Dprintf("starting data buf values 0x%X 0x%X\n\r",capture_buf[dev.dbuf0_start],capture_buf[dev.dbuf1_start]);
-          uint32_t adcdivint=48000000ULL/(dev.sample_rate*dev.a_chan_cnt);
+          //Dprintf("starting data buf values 0x%X\n\r",capture_buf[dev.dbuf0_start]);
           if(dev.a_chan_cnt){
       	     adc_run(false);
              //             en, dreq_en,dreq_thresh,err_in_fifo,byte_shift to 8 bit
-             adc_fifo_setup(false, true,   1,           false,       true); 
+             adc_fifo_setup(false, true,   1,           false,       !dev.adc12); 
              adc_fifo_drain();
-             //Dprintf("astart cnt %u div %f\n\r",dev.a_chan_cnt,(float)adcdivint);
              //This sdk function doesn't support support the fractional divisor
              // adc_set_clkdiv((float)(adcdivint-1));
-             //The ADC divisor has some not well documented limitations.
-             //-A value of 0 actually creates a 500khz sample clock.
-             //-Values below 96 are clamped to 96 because a conversion takes a minimum of 96 cycles.
-   	         //It is also import to subtract one from the desired divisor
-	           //because the period of ADC clock is 1+INT+FRAC/256
-	           //For the case of a requested 500khz clock, we would normally write
+             //The divisor is worked out by the plan, which leaves it 0 when the rate is
+             //faster than the ADC can convert.
+             //For the case of a requested 500khz clock, we would normally write
              //a divisor of 95, but doesn't give the desired result, so we use 
              //the 0 value instead.
-             //Fractional divisors should generally be avoided because it creates
-             //skew with digital samples.
-             uint8_t adc_frac_int;
-             adc_frac_int=(uint8_t)(((48000000ULL%dev.sample_rate)*256ULL)/dev.sample_rate);
-             if(adcdivint<=96){ 
-               Dprintf("adcdivint of %d below 96, aborting\n\r",adcdivint);
+             if(plan.adc_div==0){ 
+               Dprintf("adcdivint below 96, aborting\n\r");
                dev.state=ABORTED;
-               adc_aborting=true;
+               aborting=true;
                *adcdiv=0;
              }else{ //adcdivint legal
-	              *adcdiv=((adcdivint-1)<<8)|adc_frac_int; 
-                Dprintf("adcdiv %u frac %d adcdivint %d\n\r",*adcdiv,adc_frac_int,adcdivint);
+	              *adcdiv=plan.adc_div; 
                 //This is needed to clear the AINSEL so that when the round robin arbiter starts 
                 //we start sampling on channel 0
                 adc_select_input(0);
                 adc_set_round_robin(dev.a_mask & 0x7);
                 //             en, dreq_en,dreq_thresh,err_in_fifo,byte_shift to 8 bit
-                adc_fifo_setup(true, true,   1,           false,       true);
+                adc_fifo_setup(true, true,   1,           false,       !dev.adc12);
+                //The 12 bit mode moves the whole 16 bit FIFO value
+                channel_config_set_transfer_data_size(&acfg0, dev.adc12 ? DMA_SIZE_16 : DMA_SIZE_8);
+                channel_config_set_transfer_data_size(&acfg1, dev.adc12 ? DMA_SIZE_16 : DMA_SIZE_8);
                 //set adc0 to immediate trigger (but without adc_run it shouldn't start)
                 //adc1 and the maintenance aren't triggered because they are chained to each other
                 //                      channel, config, write_addr,                   read_addr,transfer_count,trigger)
-                dma_channel_configure(admachan0,&acfg0,&(capture_buf[dev.abuf0_start]),&adc_hw->fifo,dev.a_size,true);
-                dma_channel_configure(admachan1,&acfg1,&(capture_buf[dev.abuf1_start]),&adc_hw->fifo,dev.a_size,false);
-                //The maintenance DMA for ADC reads the capture_buff offset value and updates the ADC DMAs with it
-                amaddrs[0]=(uint32_t *)&capture_buf[dev.abuf0_start];
-                amaddrs[1]=(uint32_t *)&capture_buf[dev.abuf1_start];
+                dma_channel_configure(admachan0,&acfg0,&(capture_buf[dev.abuf0_start]),&adc_hw->fifo,dev.a_size>>dev.adc12,true);
+                dma_channel_configure(admachan1,&acfg1,&(capture_buf[dev.abuf0_start+dev.a_size]),&adc_hw->fifo,dev.a_size>>dev.adc12,false);
+                //The maintenance DMA for ADC reads the next segment address and updates the ADC DMAs with it
+                seg_addr_table(amaddrs[0],amaddrs[1],(uint32_t)&capture_buf[dev.abuf0_start],dev.a_size,dev.num_segs);
                 //This is about as close to a common/portable address offset definition between devices to
                 //find the offset of the write_addr_offset that is non-triggering.
                 tmpaddr0=DMA_BASE+DMA_CH0_WRITE_ADDR_OFFSET+(DMA_CH1_READ_ADDR_OFFSET*admachan0);
                 tmpaddr1=DMA_BASE+DMA_CH0_WRITE_ADDR_OFFSET+(DMA_CH1_READ_ADDR_OFFSET*admachan1);
                 //Dprintf("ADMA Maint %X %X %X %X %X %X\n\r",amaddrs[0],amaddrs[1],tmpaddr0,tmpaddr1,&amaddrs[0],&amaddrs[1]);
                 //                      channel, config, write_addr,            read_addr,transfer_count,trigger)
-                dma_channel_configure(amaintchan0,&amcfg0, (uint32_t *) tmpaddr0,&amaddrs[0]  ,1,false);
-                dma_channel_configure(amaintchan1,&amcfg1, (uint32_t *) tmpaddr1,&amaddrs[1]  ,1,false);
+                dma_channel_configure(amaintchan0,&amcfg0, (uint32_t *) tmpaddr0,&amaddrs[0][0]  ,1,false);
+                dma_channel_configure(amaintchan1,&amcfg1, (uint32_t *) tmpaddr1,&amaddrs[1][0]  ,1,false);
                 adc_fifo_drain();
               } //adcdivint legal
           }//any analog enabled
@@ -1126,49 +1571,36 @@ for faster parsing.
     15-16  2          3
     17-21  4          3
 */
-             dev.pin_count=0 ;
-             if(dev.d_mask&0x0000000F) dev.pin_count+=4;
-             if(dev.d_mask&0x000000F0) dev.pin_count+=4;
-             if(dev.d_mask&0x0000FF00) dev.pin_count+=8;
-             if(dev.d_mask&0x0FFF0000) dev.pin_count+=16;
-             //If 4 or less channels are enabled but ADC is also enabled, set a minimum size of 1B of PIO storage
-             if((dev.pin_count==4)&&(dev.a_chan_cnt)){dev.pin_count=8;}
-             d_dma_bps=dev.pin_count>>3;
-             //Dprintf("pin_count %d\n\r",dev.pin_count);
-             uint16_t capture_prog_instr;
-             capture_prog_instr = pio_encode_in(pio_pins, dev.pin_count);
-             //Dprintf("capture_prog_instr 0x%X\n\r",capture_prog_instr);
-             struct pio_program capture_prog = {
-                .instructions = &capture_prog_instr,
-                .length = 1,
-                .origin = -1
-             };
-             uint offset = pio_add_program(pio, &capture_prog);
+             //The pin count and the capture program come from the plan, which has already loaded the
+             //program at cap_offset
+             dev.pin_count=plan.pin_count;
+             enc.d_dma_bps=dev.pin_count>>3;
              // Configure state machine to loop over this `in` instruction forever,
-             // with autopush enabled.
+             // with autopush enabled, or over the loop of the event program.
              pio_sm_config c = pio_get_default_sm_config();
+             uint in_base;
              #ifdef DIG_26_MODE
-               sm_config_set_in_pins(&c, 0); //start at GPIO0 since uart isn't used
+               in_base=0; //start at GPIO0 since uart isn't used
              #elif DIG_32_MODE
-               sm_config_set_in_pins(&c, 0); //start at GPIO0 since uart isn't used
+               in_base=0; //start at GPIO0 since uart isn't used
              #else 
-               sm_config_set_in_pins(&c, 2); //start at GPIO2 (keep 0 and 1 for uart)
+               in_base=2; //start at GPIO2 (keep 0 and 1 for uart)
              #endif
-             sm_config_set_wrap(&c, offset, offset);
-             uint16_t div_int;              
-             uint8_t frac_int;
-             div_int=frequency_count_khz(CLOCKS_FC0_SRC_VALUE_CLK_SYS)*1000/dev.sample_rate;
-             if(div_int<1) div_int=1;
-             frac_int=(uint8_t)(((frequency_count_khz(CLOCKS_FC0_SRC_VALUE_CLK_SYS)*1000%dev.sample_rate)*256ULL)/dev.sample_rate);
-	           Dprintf("PIO sample clk %u divint %d divfrac %d \n\r",dev.sample_rate,div_int,frac_int);
-             //Unlike the ADC, the PIO int divisor does not have to subtract 1.
-             //Frequency=sysclkfreq/(CLKDIV_INT+CLKDIV_FRAC/256)
-             sm_config_set_clkdiv_int_frac(&c,div_int,frac_int);
+             sm_config_set_in_pins(&c, in_base);
+             sm_config_set_wrap(&c, cap_offset, cap_offset+plan.wrap);
+             sm_config_set_clkdiv_int_frac(&c,plan.div_int,plan.div_frac);
 
              //Since we enable digital channels in groups of 4, we always get 32 bit words
-             sm_config_set_in_shift(&c, true, true, 32);
+             //The event program shifts the pins in to the left and pushes its own records
+             if(ev_run){
+                sm_config_set_in_shift(&c, false, false, 32);
+                sm_config_set_mov_status(&c, STATUS_RX_LESSTHAN, EV_FIFO_ROOM);
+                pio_interrupt_clear(pio, EV_OVF_IRQ);
+             }else{
+                sm_config_set_in_shift(&c, true, true, 32);
+             }
              sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
-             pio_sm_init(pio, piosm, offset, &c);
+             pio_sm_init(pio, piosm, cap_offset+plan.entry, &c);
              //Analyzer arm from pico examples
              pio_sm_set_enabled(pio, piosm, false); //clear the enabled bit
              //XOR the shiftctrl field with PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS
@@ -1176,22 +1608,39 @@ for faster parsing.
              pio_sm_clear_fifos(pio, piosm); 
              //write the restart bit of PIO_CTRL
              pio_sm_restart(pio, piosm);
+             #if (TRIG_PIO_EN == 1)
+             trig_pio_len=0;
+             if((dev.triggered==false)&&plan.trig_len){
+                //The plan has already loaded the trigger program at trig_offset
+                trig_pio_len=plan.trig_len;
+                pio_sm_config tc = pio_get_default_sm_config();
+                sm_config_set_in_pins(&tc, in_base);
+                sm_config_set_jmp_pin(&tc, in_base+plan.trig_jmp_pin);
+                sm_config_set_wrap(&tc, trig_offset, trig_offset+trig_pio_len-1);
+                //Run at the full system clock so the condition is seen no later than the capture sees it
+                sm_config_set_clkdiv_int_frac(&tc,1,0);
+                pio_sm_init(pio, trigsm, trig_offset, &tc);
+                pio_interrupt_clear(pio,0);
+                pio_set_irq0_source_enabled(pio,pis_interrupt0,true);
+                irq_set_exclusive_handler(PIO0_IRQ_0, trig_int_handler);
+                irq_set_enabled(PIO0_IRQ_0, true);
+             }
+             #endif
              //Since PIO transfers 32 bit values but DMA transfers 8, the d_size is divided by 4.
-             //Dprintf("DMABufCfg d0_start %d d1_start %d d_size %d\n\r",dev.dbuf0_start,dev.dbuf1_start,dev.d_size);
+             //Dprintf("DMABufCfg d0_start %d d_size %d\n\r",dev.dbuf0_start,dev.d_size);
 	           //                    number    config   buffer target                  piosm          xfer size  trigger
              dma_channel_configure(pdmachan0,&pcfg0,&(capture_buf[dev.dbuf0_start]),&pio->rxf[piosm],dev.d_size>>2,true);
-             dma_channel_configure(pdmachan1,&pcfg1,&(capture_buf[dev.dbuf1_start]),&pio->rxf[piosm],dev.d_size>>2,false);
-             //The maintenance DMA for PIO reads the capture_buff offset value and updates the ADC DMAs with it
-             pmaddrs[0]=(uint32_t *)&capture_buf[dev.dbuf0_start];
-             pmaddrs[1]=(uint32_t *)&capture_buf[dev.dbuf1_start];
+             dma_channel_configure(pdmachan1,&pcfg1,&(capture_buf[dev.dbuf0_start+dev.d_size]),&pio->rxf[piosm],dev.d_size>>2,false);
+             //The maintenance DMA for PIO reads the next segment address and updates the PIO DMAs with it
+             seg_addr_table(pmaddrs[0],pmaddrs[1],(uint32_t)&capture_buf[dev.dbuf0_start],dev.d_size,dev.num_segs);
              //This is about as close to a common/portable address offset definition between devices to
              //find the offset of the write_addr_offset that is non-triggering.
              tmpaddr0=DMA_BASE+DMA_CH0_WRITE_ADDR_OFFSET+(DMA_CH1_READ_ADDR_OFFSET*pdmachan0);
              tmpaddr1=DMA_BASE+DMA_CH0_WRITE_ADDR_OFFSET+(DMA_CH1_READ_ADDR_OFFSET*pdmachan1);
              //Dprintf("PDMA Maint %X %X %X %X %X %X\n\r",pmaddrs[0],pmaddrs[1],tmpaddr0,tmpaddr1,&pmaddrs[0],&pmaddrs[1]);
              //                      channel, config, write_addr, read_addr,transfer_count,trigger)
-             dma_channel_configure(pmaintchan0,&pmcfg0, (uint32_t *)tmpaddr0,&pmaddrs[0]  ,1,false);
-             dma_channel_configure(pmaintchan1,&pmcfg1, (uint32_t *)tmpaddr1,&pmaddrs[1]  ,1,false);
+             dma_channel_configure(pmaintchan0,&pmcfg0, (uint32_t *)tmpaddr0,&pmaddrs[0][0]  ,1,false);
+             dma_channel_configure(pmaintchan1,&pmcfg1, (uint32_t *)tmpaddr1,&pmaddrs[1][0]  ,1,false);
 
              } //if dev.d_mask
           //Dprintf("LVL0mask 0x%X\n\r",dev.lvl0mask);
@@ -1201,13 +1650,13 @@ for faster parsing.
           //Dprintf("edgemask 0x%X\n\r",dev.chgmask);
 
           //Dprintf("capture_buf base %p \n\r",capture_buf);
-          //Dprintf("capture_buf dig %p %p \n\r",&(capture_buf[dev.dbuf0_start]),&(capture_buf[dev.dbuf1_start]));
-          //Dprintf("capture_buf analog %p %p\n\r",&(capture_buf[dev.abuf0_start]),&(capture_buf[dev.abuf1_start]));
+          //Dprintf("capture_buf dig %p \n\r",&(capture_buf[dev.dbuf0_start]));
+          //Dprintf("capture_buf analog %p\n\r",&(capture_buf[dev.abuf0_start]));
           //Dprintf("PIOSMCLKDIV 0x%X\n\r",*pio0sm0clkdiv);
 
           //Dprintf("PIO ctrl 0x%X fstts 0x%X dbg 0x%X lvl 0x%X\n\r",*pioctrl,*piofstts,*piodbg,*pioflvl);
           //Dprintf("DMA channel assignments a %d %d d %d %d\n\r",admachan0,admachan1,pdmachan0,pdmachan1);
-          if(!adc_aborting){
+          if(!aborting){
           //Clear any pending interrupts
           //All dma interrupts go through a common handler so that we can check for
           //overflows etc.
@@ -1230,11 +1679,18 @@ for faster parsing.
           }
           dma_halves=0;
           num_halves=0;
+          if(ev_run){
+            send_events_init(&enc);
+            ev_sent=0;
+          }
+          memset(&dev.stats,0,sizeof(dev.stats));
+          usb_tx.stall_bytes=0;
+          dev.stats.headroom=dev.num_segs;
           sho_cnt=0;
           tx_cnt=0;
           acnt=0;
           bcnt=0;
-          bytecnt=0;
+          enc.bytecnt=0;
           dcnt=0;
           ecnt=0;
 
@@ -1242,6 +1698,9 @@ for faster parsing.
           //Enable logic and analog close together for best possible alignment
   	      //warning - do not put printfs after this line as they will corrupt time measurement and sample start
 	        tstart=time_us_32();
+          ev_start_us=time_us_64();
+          ev_idle_us=ev_start_us;
+          ev_end_us=ev_start_us+(uint64_t)dev.num_samples*1000000/dev.sample_rate+EV_LAG_US;
           dev.state=SENDING;
 
           //Pending Interrupts must be cleared immediately before enabling the IRQ
@@ -1252,11 +1711,24 @@ for faster parsing.
           #ifdef BASE_MODE
           adc_run(true); //enable free run sample mode
           #endif
+          #if (TRIG_PIO_EN == 1)
+          if(trig_pio_len){
+             //Start the trigger watch with the capture so neither misses the other's first samples
+             pio_enable_sm_mask_in_sync(pio,(1u<<piosm)|(1u<<trigsm));
+          }else{
+             pio_sm_set_enabled(pio, piosm, true);
+          }
+          #else
           pio_sm_set_enabled(pio, piosm, true);           
+          #endif
         } //if ~adcaborting
         }//if dev.sending and not started
    //Send sample data
+   #if (DUAL_CORE_EN == 1)
+   usb_tx_drain();
+   #else
    send_half();
+   #endif
    //Drain all uart rxs (only tx is used for debug) if uart rx is not drained
    //it can cause code in the sdk to lock up serial CDC. These are rare noise/reset events
    //and thus not checked when dev.started to ensure the maintenance loop runs as fast
@@ -1300,6 +1772,20 @@ for faster parsing.
            bcnt++;
            if(process_char(&dev,(char)usbintin))
              {send_resp=true;} 
+           //Any command may have changed the configuration, the IDLE loop updates the plan
+           if((usbintin=='\n')||(usbintin=='\r')) plan_stale=true;
+           //The 'e' estimate runs the encoders, so it is done here rather than in process_char
+           if(dev.est_req){
+             est_reply();
+             dev.est_req=false;
+             send_resp=true;
+           }
+           //The 'k' reply needs the plan, which is made here for the same reason
+           if(dev.clk_req){
+             clk_reply();
+             dev.clk_req=false;
+             send_resp=true;
+           }
     }
 
 	//The libsigrok processing of aborts is not clean, and may try to report the "!" as a bad rle value.
@@ -1310,6 +1796,10 @@ for faster parsing.
 	if(dev.state==ABORTED){
  	  Dprintf("sending abort! ftm %d num_halves %d dma_halves %d sho cnt %d tx_cnt %d\n\r",
             forced_test_mode_run,num_halves,dma_halves,sho_cnt,tx_cnt);
+    #if (DUAL_CORE_EN == 1)
+    //Nothing core1 queued before the abort may follow the "!"
+    usb_tx_discard();
+    #endif
     sleep_ms(1000);
 	  my_stdio_usb_out_chars("!!!",3);
     sleep_ms(1000);
@@ -1321,16 +1811,36 @@ for faster parsing.
    if(dev.state==SAMPLES_SENT){
         //The end of sequence byte_cnt uses a "$<byte_cnt>+" format.
         char brsp[16];
+        #if (DUAL_CORE_EN == 1)
+        //core1 queues the last blocks before it moves to SAMPLES_SENT, send them first
+        usb_tx_drain();
+        #endif
         //Give the host time to finish processing samples so that the bytecnt 
         //isn't dropped on the wire
         sleep_us(10000);
-        Dprintf("Cleanup bytecnt %d\n\r",bytecnt);
-        sprintf(brsp,"$%d%c",bytecnt,'+');
+        //The host doesn't want the samples if it ended the capture
+        if(spooling && (dev.usb_plus==false)){
+           spool_replay();
+        }
+        if(fr_run && (dev.usb_plus==false)){
+           frame_upload();
+        }
+        #if (VBULK_EN == 1)
+        if(vbulk_run){
+           vb_tx_wait();
+        }
+        #endif
+        //When USB was the limit for long enough, it gives the drain rate for the 'e' estimate
+        if((dev.stats.usb_us>=EST_MIN_USB_US)&&usb_tx.stall_bytes){
+           usb_bps=(uint32_t)((uint64_t)usb_tx.stall_bytes*1000000/dev.stats.usb_us);
+        }
+        Dprintf("Cleanup bytecnt %d\n\r",enc.bytecnt);
+        sprintf(brsp,"$%d%c",enc.bytecnt,'+');
         puts_raw(brsp);
         //Print out debug information after completing, rather than before so that it doesn't 
         //delay the start of a capture
         Dprintf("Complete: SRate %d NSmp %d NHalves %d\n\r",dev.sample_rate,dev.num_samples,num_halves);
-        Dprintf("Cont %d bcnt %d\n\r",dev.cont,bytecnt);
+        Dprintf("Cont %d bcnt %d\n\r",dev.cont,enc.bytecnt);
         Dprintf("DMsk 0x%X AMsk 0x%X\n\r",dev.d_mask,dev.a_mask);
         Dprintf("Half buffers exp %d DMA %d Sent %d sampperhalf %d\n\r",exp_halves,dma_halves,num_halves,dev.samples_per_half);
         dev.state=IDLE;
@@ -1348,12 +1858,29 @@ for faster parsing.
         }
 #endif //PIN_TEST_MODE
     }
-    //Since there are so many FSM arcs, it's safest to just continually clear state
-    //if we aren't sending
-    if(dev.state==IDLE){
+    //Since there are so many FSM arcs, it's safest to clear all of the state when we
+    //get to IDLE, however we got there.  It is only done once so that the loop is free
+    //to answer commands, and the capture plan is then updated for any that changed it.
+    if((dev.state==IDLE)&&(idle_done==false)){
      //forced_test_mode is really a one shot deal as there is no way to restart it.
      //Exit the mode so that host accesses will work normally
      forced_test_mode_run=false;
+     #if (DUAL_CORE_EN == 1)
+     usb_tx_discard();
+     #endif
+     spooling=false;
+     staging=false;
+     ev_run=false;
+     fr_run=false;
+     #if (VBULK_EN == 1)
+     vbulk_run=false;
+     usb_tx.port=&usb_cdc_port;
+     #endif
+     #if (DUAL_CORE_EN == 1)
+     enc.sink=spsc_tx_sink;
+     #else
+     enc.sink=usb_tx_sink;
+     #endif
      #ifdef BASE_MODE
      adc_run(false);
      adc_fifo_drain();
@@ -1361,7 +1888,13 @@ for faster parsing.
      pio_sm_restart(pio, piosm);
      pio_sm_set_enabled(pio, piosm, false);
      pio_sm_clear_fifos(pio, piosm);
-     pio_clear_instruction_memory(pio);
+     #if (TRIG_PIO_EN == 1)
+     pio_sm_set_enabled(pio, trigsm, false);
+     pio_set_irq0_source_enabled(pio,pis_interrupt0,false);
+     irq_set_enabled(PIO0_IRQ_0, false);
+     pio_interrupt_clear(pio,0);
+     trig_pio_len=0;
+     #endif
      dma_channel_abort(admachan0);
      dma_channel_abort(admachan1);
      dma_channel_abort(pdmachan0);
@@ -1383,58 +1916,13 @@ for faster parsing.
      exp_halves=0;
      currintmask=0;
      dev.usb_plus=false;
+     idle_done=true;
   } //if IDLE
+  if((dev.state==IDLE)&&plan_stale){
+     plan_refresh();
+     plan_stale=false;
+  }
 }//while(1)
  
 
 }//main
-//Depracated trigger logic
-//This HW based trigger which should be part of send slices was tested enough to confirm the 
-//trigger value worked, however it
-//was not fully implemented because the RP2040 wasn't able to perform the trigger detection and 
-//memory buffer management to support sample rates that were substantially higher than the 
-//stream rates across USB.  Thus there wasn't a compelling reason to have it.
-//It's left as an example as to how the masks could be used.
-//  To fully support a HW based triggering, a precapture ring buffer of both digital and analog samples
-//would need to be created an managed to store and send pretrigger values. 
-//The ring buffer would need to support RLEs and would need to ensure it was sent before sending
-//other samples capture by the DMA after the trigger event. 
-/*
-//   uint32_t tlval; Trigger last val
-//   tlval=d->tlval;
-//   uint32_t all_mask=d->lvl0mask | d->lvl1mask| d->risemask | d->fallmask | d->chgmask;
-
-
-       if(d->triggered==false) {
-         uint32_t matches=0;
-         matches|=(~cval & d->lvl0mask);
-         matches|=(cval & d->lvl1mask);
-         if(d->notfirst){
-           matches|=(cval & ~tlval & d->risemask);
-           matches|=(~cval & tlval & d->fallmask);
-           matches|=(~cval & tlval & d->chgmask);
-         }
-         if(matches==all_mask){
-	   //Dprintf("Triggered c 0x%X l 0x%X \n\r",cval,tlval);
-           d->triggered=true;
-           //This sends the last val on a trigger because SW based trigger on the host needs to see its
-           //value so that rising/falling/edge triggeers will fire there too.
-           lbyte=0;
-           for(char b=0;b < d->d_tx_bps;b++){
-              cbyte=tlval&0xFF;
-              txbuf[txbufidx]=(cbyte<<b)|lbyte|0x80;
-              lbyte=cbyte>>(7-b);
-              tlval>>=8;
-	      txbufidx++;
-           } //for b          
-         }//matches==all_mask
-         d->notfirst=true;
-       }
-       if(d->triggered){ 
-             //Transmit samples if we have already triggered.
-        }
-
-//save trigger last value to support rising/falling/change values
-//      tlval=lval;
-End of depracated trigger logic
-*/
@@ -0,0 +1,72 @@
+#include <string.h>
+#include "sr_clock.h"
+
+//Profile 1 stays within the rated clock at the default core voltage.  Profiles 2 and 3
+//overclock, with the core voltage raised, and aren't guaranteed to work on every chip.
+const sr_clk_profile_t clk_profiles[CLK_PROFILES] =
+{
+   {0, 0},
+#if PICO_RP2350
+   {150000000, 0},
+#else
+   {133000000, 0},
+#endif
+   {200000000, 1150},
+   {CLK_MAX_HZ, 1200},
+};
+
+bool clk_solve(sr_clk_t *clk, const sr_clk_profile_t *prof, uint32_t pio_hz)
+{
+   uint32_t vco, pd, sys;
+   bool exact;
+   memset(clk, 0, sizeof(*clk));
+   clk->vreg_mv = prof->vreg_mv;
+   for (uint32_t fbdiv = CLK_VCO_MIN / CLK_XOSC_HZ; fbdiv <= CLK_VCO_MAX / CLK_XOSC_HZ; fbdiv++)
+   {
+      vco = fbdiv * CLK_XOSC_HZ;
+      if (vco < CLK_VCO_MIN)
+      {
+         continue;
+      }
+      for (uint32_t pd1 = 1; pd1 <= CLK_POSTDIV_MAX; pd1++)
+      {
+         for (uint32_t pd2 = 1; pd2 <= pd1; pd2++)
+         {
+            //Only whole Hz clocks, so that whole divides are exact
+            pd = pd1 * pd2;
+            if (vco % pd)
+            {
+               continue;
+            }
+            sys = vco / pd;
+            if ((sys > prof->max_hz) || (sys < CLK_SYS_MIN))
+            {
+               continue;
+            }
+            exact = pio_hz && ((sys % pio_hz) == 0) && ((sys / pio_hz) <= CLK_DIV_MAX);
+            if ((exact && !clk->exact) ||
+                ((exact == clk->exact) && ((sys > clk->sys_hz) || ((sys == clk->sys_hz) && (vco > clk->vco_hz)))))
+            {
+               clk->sys_hz = sys;
+               clk->vco_hz = vco;
+               clk->postdiv1 = pd1;
+               clk->postdiv2 = pd2;
+               clk->exact = exact;
+            }
+         }
+      }
+   }
+   return clk->exact;
+}
+
+uint32_t clk_pio_max(uint32_t profile)
+{
+   const sr_clk_profile_t *prof = &clk_profiles[(profile < CLK_PROFILES) ? profile : 0];
+   return (prof->max_hz) ? prof->max_hz : CLK_BOOT_PIO_MAX;
+}
+
+uint32_t clk_rate(uint32_t src_hz, uint32_t div_int, uint32_t div_frac)
+{
+   uint64_t div = (uint64_t)div_int * 256 + div_frac;
+   return (div) ? (uint32_t)(((uint64_t)src_hz * 256 + div / 2) / div) : 0;
+}
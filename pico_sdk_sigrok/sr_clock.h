@@ -0,0 +1,59 @@
+#ifndef SR_CLOCK_H
+#define SR_CLOCK_H
+#include <stdint.h>
+#include <stdbool.h>
+
+//System clock profiles from the 'K' command.  Profile 0 keeps the clock the device booted
+//with, and other sample rates come from a fractional PIO divider, which moves each sample by
+//up to a system clock when the ratio isn't whole.  The other profiles let clk_sys go up to
+//their max_hz, and clk_solve picks the system PLL settings so that the PIO clock is a whole
+//divide of clk_sys whenever there is one.
+//The system PLL runs from the 12MHz crystal, clk_sys = 12MHz*fbdiv/(postdiv1*postdiv2) with
+//the VCO between 750 and 1600MHz.  clk_usb and clk_adc stay on the 48MHz USB PLL, so USB
+//and the ADC dividers don't change with the profile.
+
+#define CLK_XOSC_HZ 12000000
+#define CLK_VCO_MIN 750000000
+#define CLK_VCO_MAX 1600000000
+#define CLK_POSTDIV_MAX 7
+// The USB controller needs clk_sys to be at least clk_usb
+#define CLK_SYS_MIN 48000000
+// Largest PIO clock divider
+#define CLK_DIV_MAX 65535
+// PIO clock limit with the boot clock, as before the profiles
+#define CLK_BOOT_PIO_MAX 120000000
+// Number of 'K' profiles
+#define CLK_PROFILES 4
+// Highest clk_sys of any profile, and so the highest sample rate
+#define CLK_MAX_HZ 250000000
+
+typedef struct
+{
+   uint32_t max_hz;  // highest clk_sys, 0 to keep the boot clock
+   uint32_t vreg_mv; // core voltage needed, 0 for the boot voltage
+} sr_clk_profile_t;
+
+typedef struct
+{
+   uint32_t sys_hz;   // clk_sys
+   uint32_t vco_hz;   // system PLL VCO
+   uint8_t postdiv1, postdiv2;
+   uint32_t vreg_mv;  // core voltage, 0 for the boot voltage
+   bool exact;        // the PIO clock is clk_sys divided by a whole number
+} sr_clk_t;
+
+extern const sr_clk_profile_t clk_profiles[CLK_PROFILES];
+
+// Pick the PLL settings of prof for a PIO clock of pio_hz: the fastest clk_sys up to max_hz
+// that is a whole multiple of pio_hz, or the fastest clk_sys if there is none.  A faster VCO
+// is preferred for the same clk_sys since it has less jitter.  Returns clk->exact.
+bool clk_solve(sr_clk_t *clk, const sr_clk_profile_t *prof, uint32_t pio_hz);
+
+// Highest PIO clock, and so digital sample rate, of profile: its max_hz, or CLK_BOOT_PIO_MAX
+// for the boot clock
+uint32_t clk_pio_max(uint32_t profile);
+
+// The rate of clock src_hz divided by div_int+div_frac/256, rounded to the nearest Hz
+uint32_t clk_rate(uint32_t src_hz, uint32_t div_int, uint32_t div_frac);
+
+#endif /* SR_CLOCK_H */
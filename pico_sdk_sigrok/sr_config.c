@@ -0,0 +1,177 @@
+#include <stddef.h>
+#include "sr_config.h"
+#include "sr_clock.h"
+
+#define CFG_DEC 0
+#define CFG_HEX 1
+#define CFG_TRIG 2
+
+typedef struct
+{
+   char key;
+   uint8_t type;      // CFG_DEC, CFG_HEX or CFG_TRIG
+   uint32_t min, max; // range of a number
+   size_t cfg_off;    // offset of the uint32_t in sr_config_t, not used for CFG_TRIG
+   size_t dev_off;    // offset of the uint32_t in sr_device_t that it is applied to
+} cfg_field_t;
+
+//The ranges match those of the single commands
+static const cfg_field_t cfg_fields[] =
+{
+   {'R', CFG_DEC, 5000, CLK_MAX_HZ + 16, offsetof(sr_config_t, sample_rate), offsetof(sr_device_t, sample_rate)},
+   {'L', CFG_DEC, 1, 0x7FFFFFFF, offsetof(sr_config_t, num_samples), offsetof(sr_device_t, num_samples)},
+   {'D', CFG_HEX, 0, 0xFFFFFFFF, offsetof(sr_config_t, d_mask), offsetof(sr_device_t, d_mask)},
+   {'A', CFG_HEX, 0, 0xFFFFFFFF, offsetof(sr_config_t, a_mask), offsetof(sr_device_t, a_mask)},
+   {'P', CFG_DEC, 0, 0x7FFFFFFF, offsetof(sr_config_t, pretrig), offsetof(sr_device_t, pretrig)},
+   {'T', CFG_TRIG, 0, 0, 0, 0},
+   {'N', CFG_DEC, 0, FRAME_MAX, offsetof(sr_config_t, frames), offsetof(sr_device_t, frames)},
+   {'K', CFG_DEC, 0, CLK_PROFILES - 1, offsetof(sr_config_t, clk_profile), offsetof(sr_device_t, clk_profile)},
+};
+#define CFG_NUM_FIELDS (sizeof(cfg_fields) / sizeof(cfg_fields[0]))
+
+static int cfg_digit(char c, uint8_t type)
+{
+   if ((c >= '0') && (c <= '9'))
+   {
+      return c - '0';
+   }
+   if (type == CFG_HEX)
+   {
+      if ((c >= 'A') && (c <= 'F'))
+      {
+         return c - 'A' + 10;
+      }
+      if ((c >= 'a') && (c <= 'f'))
+      {
+         return c - 'a' + 10;
+      }
+   }
+   return -1;
+}
+
+//Parse a number of at least one digit that runs to the end of the field
+static bool cfg_number(const cfg_field_t *f, const char *s, const char *end, uint32_t *val)
+{
+   uint64_t v = 0;
+   uint32_t base = (f->type == CFG_HEX) ? 16 : 10;
+   if (s == end)
+   {
+      return false;
+   }
+   for (; s < end; s++)
+   {
+      int dig = cfg_digit(*s, f->type);
+      if (dig < 0)
+      {
+         return false;
+      }
+      v = v * base + dig;
+      if (v > f->max)
+      {
+         return false;
+      }
+   }
+   if (v < f->min)
+   {
+      return false;
+   }
+   *val = (uint32_t)v;
+   return true;
+}
+
+//Parse the vxx conditions of the T field
+static bool cfg_trig(sr_trig_t *t, const char *s, const char *end)
+{
+   trig_reset(t);
+   for (; s < end; s += 3)
+   {
+      if ((end - s < 3) || (cfg_digit(s[0], CFG_DEC) < 0) || (cfg_digit(s[1], CFG_DEC) < 0)
+          || (cfg_digit(s[2], CFG_DEC) < 0))
+      {
+         return false;
+      }
+      if (!trig_add(t, s[0] - '0', (s[1] - '0') * 10 + (s[2] - '0')))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+bool cfg_parse(sr_config_t *cfg, const char *str)
+{
+   const char *s = str;
+   cfg->given = 0;
+   while (*s)
+   {
+      const char *end = s;
+      uint32_t i;
+      while (*end && (*end != ','))
+      {
+         end++;
+      }
+      for (i = 0; (i < CFG_NUM_FIELDS) && (cfg_fields[i].key != *s); i++)
+      {
+      }
+      if ((s == end) || (i == CFG_NUM_FIELDS) || (cfg->given & (1u << i)))
+      {
+         return false;
+      }
+      const cfg_field_t *f = &cfg_fields[i];
+      if (f->type == CFG_TRIG)
+      {
+         if (!cfg_trig(&cfg->trig, s + 1, end))
+         {
+            return false;
+         }
+      }
+      else if (!cfg_number(f, s + 1, end, (uint32_t *)((uint8_t *)cfg + f->cfg_off)))
+      {
+         return false;
+      }
+      cfg->given |= 1u << i;
+      s = (*end) ? end + 1 : end;
+   }
+   return true;
+}
+
+//The value of the field with key if cfg gives it, else def
+static uint32_t cfg_value(const sr_config_t *cfg, char key, uint32_t def)
+{
+   for (uint32_t i = 0; i < CFG_NUM_FIELDS; i++)
+   {
+      if ((cfg_fields[i].key == key) && (cfg->given & (1u << i)))
+      {
+         return *(const uint32_t *)((const uint8_t *)cfg + cfg_fields[i].cfg_off);
+      }
+   }
+   return def;
+}
+
+bool cfg_check(const sr_config_t *cfg, const sr_device_t *d)
+{
+   uint32_t rate = cfg_value(cfg, 'R', d->sample_rate);
+   uint32_t profile = cfg_value(cfg, 'K', d->clk_profile);
+   //Add 16 to support cfg_bits, as 'R' does
+   return rate <= clk_pio_max(profile) + 16;
+}
+
+void cfg_apply(sr_device_t *d, const sr_config_t *cfg)
+{
+   for (uint32_t i = 0; i < CFG_NUM_FIELDS; i++)
+   {
+      const cfg_field_t *f = &cfg_fields[i];
+      if (!(cfg->given & (1u << i)))
+      {
+         continue;
+      }
+      if (f->type == CFG_TRIG)
+      {
+         d->trig = cfg->trig;
+      }
+      else
+      {
+         *(uint32_t *)((uint8_t *)d + f->dev_off) = *(const uint32_t *)((const uint8_t *)cfg + f->cfg_off);
+      }
+   }
+}
@@ -0,0 +1,48 @@
+#ifndef SR_CONFIG_H
+#define SR_CONFIG_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "sr_device.h"
+
+//Batched configuration from the 'c' command, so that a capture can be set up with one line
+//and one ack rather than an 'R', 'L', 'p' and a 'D' or 'A' per channel.
+//The line is a comma separated list of fields, each a key letter followed by its value:
+//  R<rate>     sample rate, decimal
+//  L<samples>  sample limit, decimal
+//  D<mask>     digital channel mask, hex, bit n is channel n of the 'D' command
+//  A<mask>     analog channel mask, hex
+//  P<samples>  pre-trigger samples, decimal
+//  T<conds>    trigger conditions, each the vxx of a 't' command, i.e. T200110 is a rising
+//              edge on channel 0 and a high on channel 10.  They replace the current
+//              conditions, so an empty T clears them.
+//  N<frames>   frames of a segmented capture, decimal, see sr_frame.h
+//  K<profile>  system clock profile, decimal, see sr_clock.h
+//For example "cR1000000,L50000,DFF,A0,T203,P1000".  Fields that aren't given keep their
+//value, and nothing is changed unless every field is valid and the rate is within the PIO
+//limit of the clock profile, as left by the line.
+//The fields are parsed from cfg_fields, so a new field only needs a table entry.
+
+typedef struct
+{
+   uint32_t given;   // bit i set if field i of cfg_fields was given
+   uint32_t sample_rate;
+   uint32_t num_samples;
+   uint32_t d_mask, a_mask;
+   uint32_t pretrig;
+   uint32_t frames;
+   uint32_t clk_profile;
+   sr_trig_t trig;
+} sr_config_t;
+
+// Parse the fields after the 'c' into cfg.  Returns false if any field is unknown,
+// repeated or out of range.
+bool cfg_parse(sr_config_t *cfg, const char *str);
+
+// True if the sample rate that applying cfg to d leaves is within the PIO limit of the
+// clock profile it leaves
+bool cfg_check(const sr_config_t *cfg, const sr_device_t *d);
+
+// Copy the given fields of cfg to the device
+void cfg_apply(sr_device_t *d, const sr_config_t *cfg);
+
+#endif /* SR_CONFIG_H */
@@ -1,4 +1,8 @@
 #include "sr_device.h"
+#include "sr_filter.h"
+#include "sr_ring.h"
+#include "sr_config.h"
+#include "sr_clock.h"
 #include "hardware/uart.h"
 
 #include <stdarg.h>
@@ -41,16 +45,24 @@ void reset(sr_device_t *d)
    d->state==IDLE;
    d->cont = 0;
    d->scnt = 0;
-   // d->notfirst=false;
    // Set triggered by default so that we don't check for HW triggers
    // unless the driver sends a trigger command
-   // d->triggered=true;
-   // d->tlval=0;
-   // d->lvl0mask=0;
-   // d->lvl1mask=0;
-   // d->risemask=0;
-   // d->fallmask=0;
-   // d->chgmask=0;
+   d->triggered = true;
+   d->pretrig = 0;
+   trig_reset(&(d->trig));
+   d->decim = 1;
+   d->decim_mode = FILT_LAST;
+   d->glitch = 0;
+   d->enc_mode = ENC_RLE;
+   d->binary = false;
+   d->adc12 = false;
+   d->spool = false;
+   d->store = false;
+   d->lossy = false;
+   d->events = false;
+   d->vbulk = false;
+   d->frames = 0;
+   d->clk_profile = 0;
 };
 // initial post reset state
 void init(sr_device_t *d)
@@ -63,12 +75,11 @@ void init(sr_device_t *d)
    d->a_chan_cnt = 0;
    d->d_nps = 0;
    d->cmdstrptr = 0;
+   d->rearm = 0;
 }
-void tx_init(sr_device_t *d)
+// Count the enabled channels and how they are stored and sent
+void chan_counts(sr_device_t *d)
 {
-   // A reset should have already been called to restart the device.
-   // An additional one here would clear trigger and other state that had been updated
-   //     reset(d);
    d->a_chan_cnt = 0;
    for (int i = 0; i < NUM_A_CHAN; i++)
    {
@@ -103,6 +114,16 @@ void tx_init(sr_device_t *d)
       }
    }
    d->d_tx_bps = (d->d_chan_cnt + 6) / 7;
+}
+void tx_init(sr_device_t *d)
+{
+   // A reset should have already been called to restart the device.
+   // An additional one here would clear trigger and other state that had been updated
+   //     reset(d);
+   chan_counts(d);
+   // Triggers only apply to digital channels
+   d->triggered = (d->d_mask == 0) || !trig_enabled(&(d->trig));
+   trig_arm(&(d->trig));
    d->state=STARTED;
 }
 // Process incoming character stream
@@ -111,6 +132,7 @@ void tx_init(sr_device_t *d)
 int process_char(sr_device_t *d, char charin)
 {
    int tmpint, tmpint2, ret;
+   sr_layout_t lay;
    // set default rspstr for all commands that have a dataless ack
    d->rspstr[0] = '*';
    d->rspstr[1] = 0;
@@ -139,14 +161,16 @@ int process_char(sr_device_t *d, char charin)
          ret=0;
          break;
       case 'i':
-         // SREGEN,AxxyDzz,00 - num analog, analog size, num digital,version
-         sprintf(d->rspstr, "SRPICO,A%02d1D%02d,02", NUM_A_CHAN, NUM_D_CHAN);
+         // SRPICO,AxxyDzz,vv,f - num analog, analog size, num digital, version, optional commands.
+         // y stays 1 for the older hosts, 12 bit values are shown by 'H' in the features
+         sprintf(d->rspstr, "SRPICO,A%02d1D%02d,%s,%s", NUM_A_CHAN, NUM_D_CHAN, SR_VERSION, SR_FEATURES);
          Dprintf("ID rsp %s\n\r", d->rspstr);
          ret = 1;
          break;
       case 'R':
          tmpint = atol(&(d->cmdstr[1]));
-         if ((tmpint >= 5000) && (tmpint <= 120000016))
+         // Rates above the PIO limit of the clock profile are refused rather than run slower
+         if ((tmpint >= 5000) && ((uint32_t)tmpint <= (clk_pio_max(d->clk_profile) + 16)))
          { // Add 16 to support cfg_bits
             d->sample_rate = tmpint;
             // Dprintf("SMPRATE= %u\n\r",d->sample_rate);
@@ -180,7 +204,18 @@ int process_char(sr_device_t *d, char charin)
          {
             // scale and offset are both in integer uVolts
             // separated by x
-            sprintf(d->rspstr, "25700x0"); // 3.3/(2^7) and 0V offset
+            if (d->adc12)
+            {
+               sprintf(d->rspstr, "803x0"); // 3.3/(2^12) and 0V offset
+            }
+            else if (d->binary)
+            {
+               sprintf(d->rspstr, "12850x0"); // 3.3/(2^8) and 0V offset
+            }
+            else
+            {
+               sprintf(d->rspstr, "25700x0"); // 3.3/(2^7) and 0V offset
+            }
             // Dprintf("ASCL%d\n\r",tmpint);
             ret = 1;
          }
@@ -194,45 +229,279 @@ int process_char(sr_device_t *d, char charin)
          Dprintf("STRT_FIX\n\r");
          tx_init(d);
          d->cont = 0;
+         d->rearm = 'F';
          ret = 0;
          break;
       case 'C': // continous mode
          tx_init(d);
          d->cont = 1;
+         d->rearm = 'C';
          Dprintf("STRT_CONT\n\r");
          ret = 0;
          break;
+      case 'r': // re-arm - starts another capture like the last 'F' or 'C', with the configuration
+                // it has now.  The capture plan is kept, so this starts as soon as the
+                // previous capture has been torn down.  Ignored if there is nothing to repeat.
+         if ((d->state == IDLE) && d->rearm)
+         {
+            d->scnt = 0;
+            tx_init(d);
+            d->cont = (d->rearm == 'C');
+            Dprintf("STRT_REARM %c\n\r", d->rearm);
+         }
+         ret = 0;
+         break;
       case 't': // trigger -format tvxx where v is value and xx is two digit channel
-         /*HW trigger depracated
-             tmpint=d->cmdstr[1]-'0';
-                  tmpint2=atoi(&(d->cmdstr[2])); //extract channel number which starts at D2
-             //Dprintf("Trigger input %d val %d\n\r",tmpint2,tmpint);
-                  if((tmpint2>=2)&&(tmpint>=0)&&(tmpint<=4)){
-                    d->triggered=false;
-                    switch(tmpint){
-                 case 0: d->lvl0mask|=1<<(tmpint2-2);break;
-                 case 1: d->lvl1mask|=1<<(tmpint2-2);break;
-                 case 2: d->risemask|=1<<(tmpint2-2);break;
-                 case 3: d->fallmask|=1<<(tmpint2-2);break;
-                 default: d->chgmask|=1<<(tmpint2-2);break;
-               }
-                    //Dprintf("Trigger channel %d val %d 0x%X\n\r",tmpint2,tmpint,d->lvl0mask);
-               //Dprintf("LVL0mask 0x%X\n\r",d->lvl0mask);
-                    //Dprintf("LVL1mask 0x%X\n\r",d->lvl1mask);
-                    //Dprintf("risemask 0x%X\n\r",d->risemask);
-                    //Dprintf("fallmask 0x%X\n\r",d->fallmask);
-                    //Dprintf("edgemask 0x%X\n\r",d->chgmask);
-                  }else{
-               Dprintf("bad trigger channel %d val %d\n\r",tmpint2,tmpint);
-                    d->triggered=true;
-                  }
-         */
+         // v is 0 low, 1 high, 2 rising, 3 falling, 4 change
+         tmpint = d->cmdstr[1] - '0';
+         tmpint2 = atoi(&(d->cmdstr[2])); // extract channel number
+         if ((tmpint >= 0) && (tmpint2 >= 0) && trig_add(&(d->trig), tmpint, tmpint2))
+         {
+            Dprintf("Trigger channel %d val %d\n\r", tmpint2, tmpint);
+            ret = 1;
+         }
+         else
+         {
+            Dprintf("bad trigger channel %d val %d\n\r", tmpint2, tmpint);
+            ret = 0;
+         }
+         break;
+      case 'G': // sample filter - format Gvxx where v is the mode and xx is a decimal count
+         // v is 0 for the glitch filter, or FILT_LAST, FILT_OR, FILT_MAJ for decimation
+         tmpint = d->cmdstr[1] - '0';
+         tmpint2 = atoi(&(d->cmdstr[2]));
+         if ((tmpint == 0) && (tmpint2 >= 0) && (tmpint2 <= FILT_MAX_GLITCH))
+         {
+            d->glitch = tmpint2;
+            ret = 1;
+         }
+         else if ((tmpint >= FILT_LAST) && (tmpint <= FILT_MAJ) && (tmpint2 >= 1) && (tmpint2 <= FILT_MAX_DECIM))
+         {
+            d->decim_mode = tmpint;
+            d->decim = tmpint2;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("Filter mode %d cnt %d\n\r", tmpint, tmpint2);
+         break;
+      case 'E': // encoding - format Ev where v is ENC_RLE, ENC_ADAPT or ENC_DELTA
+         tmpint = atoi(&(d->cmdstr[1]));
+         if ((tmpint >= ENC_RLE) && (tmpint <= ENC_DELTA))
+         {
+            d->enc_mode = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("Encoding %d\n\r", tmpint);
+         break;
+      case 'B': // binary framing - format Bv where v is 0 for 7 bit bytes or 1 for binary
+         tmpint = atoi(&(d->cmdstr[1]));
+         if ((tmpint == 0) || (tmpint == 1))
+         {
+            d->binary = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("Binary %d\n\r", tmpint);
+         break;
+      case 'H': // analog resolution - format Hv where v is 0 for 7 bits or 1 for 12 bits
+         tmpint = atoi(&(d->cmdstr[1]));
+         if ((tmpint == 0) || (tmpint == 1))
+         {
+            d->adc12 = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("ADC 12 bit %d\n\r", tmpint);
+         break;
+      case 'S': // spool - format Sv where v is 1 to let fixed captures be spooled to flash
+         tmpint = atoi(&(d->cmdstr[1]));
+         if ((tmpint == 0) || ((tmpint == 1) && d->spool_size))
+         {
+            d->spool = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("Spool %d\n\r", tmpint);
+         break;
+      case 'Z': // compressed store - format Zv where v is 1 to let fixed captures be encoded
+                // into the sample buffer as they are captured
+         tmpint = atoi(&(d->cmdstr[1]));
+         if ((tmpint == 0) || (tmpint == 1))
+         {
+            d->store = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("Store %d\n\r", tmpint);
+         break;
+      case 'O': // overflow - format Ov where v is 0 to abort continuous captures that overflow,
+                // or 1 to skip the lost samples and send a gap marker
+         tmpint = atoi(&(d->cmdstr[1]));
+         if ((tmpint == 0) || (tmpint == 1))
+         {
+            d->lossy = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("Lossy %d\n\r", tmpint);
+         break;
+      case 'x': // event capture - format xv where v is 1 to capture digital only captures with
+                // the event PIO program, or 0 to sample every clock
+         tmpint = atoi(&(d->cmdstr[1]));
+         if ((tmpint == 0) || (tmpint == 1))
+         {
+            d->events = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("Events %d\n\r", tmpint);
+         break;
+      case 'N': // segmented capture - format Nxxx where xxx is the decimal number of frames that
+                // a fixed capture with a device trigger fills before it is sent, or 0 for off
+         tmpint = atoi(&(d->cmdstr[1]));
+         if ((d->cmdstr[1] >= '0') && (d->cmdstr[1] <= '9') && (tmpint >= 0) && (tmpint <= FRAME_MAX))
+         {
+            d->frames = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("Frames %d\n\r", tmpint);
+         break;
+      case 'K': // clock profile - format Kv where v is the system clock profile, 0 for the
+                // clock the device booted with
+         tmpint = atoi(&(d->cmdstr[1]));
+         // A profile whose PIO limit is below the sample rate already set is refused
+         if ((d->cmdstr[1] >= '0') && (d->cmdstr[1] <= '9') && (tmpint >= 0) && (tmpint < CLK_PROFILES)
+             && (d->sample_rate <= (clk_pio_max(tmpint) + 16)))
+         {
+            d->clk_profile = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("Clock profile %d\n\r", tmpint);
+         break;
+      case 'v': // vendor bulk - format vv where v is 1 to send the sample data on the vendor
+                // bulk endpoint rather than the serial port
+         tmpint = atoi(&(d->cmdstr[1]));
+         if ((tmpint == 0) || ((tmpint == 1) && (VBULK_EN == 1)))
+         {
+            d->vbulk = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         Dprintf("Vendor bulk %d\n\r", tmpint);
+         break;
+      case 's': // stats - replies with the sr_stats_t fields of the last capture, separated by x
+         sprintf(d->rspstr, "%ux%ux%ux%ux%ux%ux%u", d->stats.bytes, d->stats.segs, d->stats.headroom,
+                 d->stats.enc_us, d->stats.usb_us, d->stats.stalls, d->stats.peak_us);
+         Dprintf("Stats %s\n\r", d->rspstr);
+         ret = 1;
+         break;
+      case 'e': // estimate - replies with the sample rates that can be streamed with the enabled
+                // channels when every sample changes and when none do, separated by x.
+                // The encoders are timed on the sample buffer so it is only allowed when idle.
+         chan_counts(d);
+         if ((d->state == IDLE) && (d->d_mask || d->a_mask))
+         {
+            d->est_req = true;
+         }
+         ret = 0;
+         Dprintf("Estimate req %d\n\r", d->est_req);
+         break;
+      case 'k': // clock - replies with the system clock and the sample rate the capture gets with
+                // the current configuration and profile, separated by x.  The plan is only
+                // made when idle.
+         if (d->state == IDLE)
+         {
+            d->clk_req = true;
+         }
+         ret = 0;
+         Dprintf("Clock req %d\n\r", d->clk_req);
+         break;
+      case 'm': // memory - replies with the capture buffer bytes, the most samples a fixed
+                // capture of the enabled channels holds without depending on the USB rate,
+                // and the flash spool bytes, separated by x
+         chan_counts(d);
+         tmpint = 0;
+         if (ring_layout(&lay, d->buf_size, d->d_nps, d->a_chan_cnt * (d->adc12 ? 4 : 2), 0, false, DMA_SEGMENTS)
+             && (lay.buff_chunks > 2))
+         {
+            // A fixed capture only fills the buffer once if it needs fewer than buff_chunks-2 chunks,
+            // and the sample count is rounded up to a multiple of 4.
+            tmpint = ((lay.buff_chunks - 2) * lay.chunk_samples - 1) & ~3;
+            if ((d->a_chan_cnt == 0) && (d->decim > 1))
+            {
+               tmpint = (tmpint / d->decim) & ~3;
+            }
+         }
+         sprintf(d->rspstr, "%ux%ux%u", d->buf_size, (uint32_t)tmpint, d->spool_size);
+         Dprintf("Memory %s\n\r", d->rspstr);
          ret = 1;
          break;
       case 'p': // pretrigger count
          tmpint = atoi(&(d->cmdstr[1]));
          Dprintf("Pre-trigger samples %d cmd %s\n\r", tmpint, d->cmdstr);
-         ret = 1;
+         if (tmpint >= 0)
+         {
+            d->pretrig = tmpint;
+            ret = 1;
+         }
+         else
+         {
+            ret = 0;
+         }
+         break;
+      // batched configuration - format c followed by the comma separated fields of sr_config.h
+      case 'c':
+         {
+            sr_config_t cfg;
+            if (cfg_parse(&cfg, &(d->cmdstr[1])) && cfg_check(&cfg, d))
+            {
+               cfg_apply(d, &cfg);
+               Dprintf("Config R%u L%u D0x%X A0x%X P%u\n\r", d->sample_rate, d->num_samples, d->d_mask,
+                       d->a_mask, d->pretrig);
+               ret = 1;
+            }
+            else
+            {
+               Dprintf("bad config %s\n\r", d->cmdstr);
+               ret = 0;
+            }
+         }
          break;
       //Enable/disable Analog channel   
       // format is Axyy where x is 0 for disabled, 1 for enabled and yy is channel #
@@ -313,9 +582,9 @@ int process_char(sr_device_t *d, char charin)
       d->cmdstrptr = 0;
    }
    else // no CR/LF
-   { if (d->cmdstrptr >= 19)
+   { if (d->cmdstrptr >= CMD_STR_SIZE - 1)
       {
-         d->cmdstr[18] = 0;
+         d->cmdstr[CMD_STR_SIZE - 2] = 0;
          Dprintf("Command overflow %s\n\r", d->cmdstr);
          d->cmdstrptr = 0;
       }
@@ -2,6 +2,7 @@
 #define SR_DEVICE_H
 #include <stdint.h>
 #include <stdbool.h>
+#include "sr_trigger.h"
 
 // Pin usages
 ///////////////////////////////////
@@ -34,6 +35,43 @@
 //test patterns on the chip.  But it turns what are normally inputs to outputs and thus
 //can cause drive fights if any drivers are connected.
 //#define PIN_TEST_MODE 1
+//If set to 1, core1 runs the send_slices_* encoding of each half buffer while core0 services
+//USB and parses commands, so encoding and USB transfers overlap rather than alternate.
+//Encoded blocks are passed from core1 to core0 through the queue in sr_spsc.h.
+//PIN_TEST_MODE also uses core1 so the two can't be enabled together.
+//Set to 1 by the SR_DUAL_CORE CMake option.
+#ifndef DUAL_CORE_EN
+#define DUAL_CORE_EN 0
+#endif
+//If set to 1, a second PIO state machine watches one of the trigger channels and raises an
+//interrupt when it sees the condition, so the CPU only searches for the exact trigger sample
+//in the segments around it rather than in every segment captured before the trigger.
+#define TRIG_PIO_EN 1
+//If set to 1, the 'S' command lets fixed captures that don't fit in the capture buffer be
+//encoded into the spare flash after the firmware image and sent once the capture is done,
+//see sr_spool.h.  Flash writes stall the other core, so it can't be used with DUAL_CORE_EN
+//or PIN_TEST_MODE, and is off by default when DUAL_CORE_EN is set.
+#ifndef SPOOL_EN
+#if (DUAL_CORE_EN == 1)
+#define SPOOL_EN 0
+#else
+#define SPOOL_EN 1
+#endif
+#endif
+//Set to 1 by the SR_VBULK CMake option, which adds the vendor bulk interface of sr_vbulk.h to
+//the USB configuration so that the 'v' command can send sample data on it.
+#ifndef VBULK_EN
+#define VBULK_EN 0
+#endif
+#ifdef PIN_TEST_MODE
+  #undef DUAL_CORE_EN
+  #define DUAL_CORE_EN 0
+  #undef SPOOL_EN
+  #define SPOOL_EN 0
+#endif
+#if (SPOOL_EN == 1) && (DUAL_CORE_EN == 1)
+  #error "SPOOL_EN can't be used with DUAL_CORE_EN"
+#endif
 #undef BASE_MODE
 #undef DIG_26_MODE
 #undef DIG_32_MODE
@@ -80,13 +118,53 @@
 //#define D4_DBG 1
 //#define D4_DBG2 2
 
-// Storage size of the DMA buffer.  The buffer is split into two halves so that when the first
-// buffer fills we can send the trace data serially while the other buffer is DMA'dinto
-#ifdef PICO_RP2350
- #define DMA_BUF_SIZE 476000 //add the full 256KB increase
+// The DMA buffer is sized at boot from the free heap, so the RP2350 gets the use of its extra SRAM.
+// The buffer is split into a ring of segments so that when the first segment fills we can send
+// the trace data serially while the others are DMA'd into.
+// ARENA_RESERVE bytes of heap are left for any other dynamic allocations, and the size is
+// reduced by ARENA_STEP until the allocation succeeds.
+#define ARENA_RESERVE 10000
+#define ARENA_STEP 4096
+// Number of segments in the DMA ring, must be a power of 2 from 2 to 16.
+// More segments absorb longer USB stalls in continuous mode, at the cost of
+// more frequent DMA interrupts.
+#define DMA_SEGMENTS 8
+// Optional command letters supported by this build, listed at the end of the 'i' response
+#if (VBULK_EN == 1)
+#define SR_FEATURES "GEBHmSZseOxvcrNKk"
 #else
- #define DMA_BUF_SIZE 220000 
-#endif 
+#define SR_FEATURES "GEBHmSZseOxcrNKk"
+#endif
+// Version field of the 'i' response, 03 and up support the 'B' binary framing
+#define SR_VERSION "03"
+// Flash is erased and programmed with interrupts off, so a spooled capture needs each
+// DMA segment to take at least this long to fill, or the DMA interrupts could be missed.
+#define SPOOL_MIN_SEG_MS 50
+// An event capture that has no new records sends a hold of the samples that are known to
+// have passed every EV_IDLE_MS, so the host keeps up with an idle input.  The time is only a
+// lower bound of the sample count once EV_LAG_US is taken off, to cover the start of the PIO
+// and records still on their way through the FIFO.
+#define EV_IDLE_MS 20
+#define EV_LAG_US 100
+// With the 'Z' command a fixed capture that doesn't fit uses 1/STORE_RING_DIV of the
+// buffer as the DMA ring, and the rest holds the encoded segments until the capture is done.
+#define STORE_RING_DIV 4
+// The lossy continuous mode from the 'O1' command stages each encoded segment in
+// 1/LOSSY_STAGE_DIV of the buffer, so a segment that encodes to more than that is sent as a gap.
+#define LOSSY_STAGE_DIV 4
+// Escape for the control bytes in binary framing, see SerialProtocol.md
+#define BIN_ESC '#'
+// Start of a gap marker in the lossy continuous mode, see SerialProtocol.md
+#define GAP_MARK '-'
+// Start of a hold marker in event captures, see SerialProtocol.md
+#define HOLD_MARK '.'
+// Start of a frame marker in segmented captures, see SerialProtocol.md
+#define FRAME_MARK '/'
+// Most frames of a segmented capture from the 'N' command, see sr_frame.h
+#define FRAME_MAX 10000
+// Longest command line plus its terminator.  The 'c' batched configuration needs room for all
+// of its fields with up to 3 characters for each trigger channel.
+#define CMD_STR_SIZE 192
 // The size of the buffer sent to the CDC serial
 // The TUD CDC buffer is only 256B so it doesn't help to have more than this.
 #define TX_BUF_SIZE 260
@@ -98,10 +176,14 @@
 //(Assuming 128KB samples per half, a max rle value of 1568 we can get
 //   256*1024/2/1568=83 max length rles on a steady input).
 // Other than that the value is not very specific because the usb tub code
-// implement a 256 entry fifo that queues things up and sends max length 64B transactions
-// 20 is arbitrarly picked to ensure that if we have even a little we send it so that
-// at least something goes across the link.
-#define TX_BUF_THRESH 20
+// implement a 256 entry fifo that queues things up and sends max length 64B transactions.
+// Since usb_tx_sink no longer flushes on every call, staging a full 64B packet
+// keeps the number of sink calls per packet to about one.
+#define TX_BUF_THRESH 64
+// Digital encodings for the 'E' command
+#define ENC_RLE 0
+#define ENC_ADAPT 1
+#define ENC_DELTA 2
 typedef enum  {IDLE = 0, //initial and ending condition, also cleanup variables used when not idle
               STARTED = 1, //the host has sent a command to start sending samples
               SENDING = 2, //the dma engines etc are configured and running
@@ -109,13 +191,25 @@ typedef enum  {IDLE = 0, //initial and ending condition, also cleanup variables
               SAMPLES_SENT = 4, //all samples have been sent to the host
               ABORTED = 5 //an error , usually DMA buffer overflow, has occured
             } dev_state;
+//Transfer statistics of the last capture, reported by the 's' command so that the host can
+//see what limited a rate and channel configuration.
+typedef struct
+{
+   uint32_t bytes;    // encoded bytes sent
+   uint32_t segs;     // DMA segments sent
+   uint32_t headroom; // fewest free segments left in the DMA ring when a segment was sent
+   uint32_t enc_us;   // time spent in the encoders, less the waits for the output to drain
+   uint32_t usb_us;   // time spent waiting for room in the USB fifo and flushing it
+   uint32_t stalls;   // writes that found the USB fifo full and had to wait
+   uint32_t peak_us;  // longest time to encode and send one segment
+} sr_stats_t;
 typedef struct
 {
    uint32_t sample_rate;
    uint32_t num_samples;
    uint32_t a_mask, d_mask;
-   // number of samples for one of the 4 dma target arrays.  While this normally is related to the
-   //half buffer sizes, in the optimized sending mode the value is temporarily overrided to adjust
+   // number of samples in one segment of the DMA ring.  While this normally is related to the
+   //segment sizes, in the optimized sending mode the value is temporarily overrided to adjust
    //the number of samples sent by the send_slice* functions.
    uint32_t samples_per_half; 
    uint8_t a_chan_cnt;        // count of enabled analog channels
@@ -125,11 +219,13 @@ typedef struct
    uint8_t pin_count;
    uint8_t d_nps; // digital nibbles per slice from a PIO/DMA perspective.
    uint32_t scnt; // number of samples sent
-   char cmdstrptr;
-   char cmdstr[20];                                             // used for parsing input
-   uint32_t d_size, a_size;                                     // size of each of the two data buffers for each of a& d
-   uint32_t dbuf0_start, dbuf1_start, abuf0_start, abuf1_start; // starting memory pointers of adc buffers
-   char rspstr[20];
+   uint8_t cmdstrptr;
+   char cmdstr[CMD_STR_SIZE];                                   // used for parsing input
+   uint32_t d_size, a_size;       // size of each DMA ring segment for each of a& d
+   uint32_t dbuf0_start, abuf0_start; // starting memory offsets of the first digital and adc segments
+   uint32_t num_segs;             // number of segments the DMA ring is split into
+   uint32_t buf_size;             // bytes in the DMA capture buffer, set at boot
+   char rspstr[80];
    // mark key control variables voltatile since multiple cores might access them
    volatile dev_state state;
    volatile bool cont;
@@ -139,13 +235,51 @@ typedef struct
    //It is not a state machine state as it is somewhat asyncronous to the state
    //and could interfere with the normal orderly progression through the FSM.
    volatile bool usb_plus;
-   /*Depracated trigger logic
-   //If HW trigger enabled, uncomment all usages
-   //volatile bool notfirst;  //Have we processed at least a first sample (so that lval is correct
-   //  volatile bool triggered;
-   //  uint32_t tlval; //last digital sample value - must keep it across multiple calls to slices for trigger
-   //  uint32_t lvl0mask,lvl1mask,risemask,fallmask,chgmask;
-   End depracated trigger logic*/
+   //Device side triggering.  Until the trigger is seen the DMA ring is searched for the trigger
+   //but no samples are sent.  Once seen, sending starts pretrig samples before the trigger.
+   sr_trig_t trig;          // trigger conditions from the 't' command
+   uint32_t pretrig;        // pre-trigger sample count from the 'p' command
+   volatile bool triggered; // trigger seen (or no trigger conditions set)
+   //Sample filter from the 'G' command, see sr_filter.h.  With decimation the PIO samples at
+   //sample_rate*decim so the host still sees sample_rate.
+   uint32_t decim;      // samples combined into each sent sample, 1 is off
+   uint8_t decim_mode;  // FILT_LAST, FILT_OR or FILT_MAJ
+   uint32_t glitch;     // samples a new value must be stable for, 0 is off
+   //Encoding from the 'E' command.  ENC_ADAPT lets each segment of a digital only
+   //capture be sent with the packed encoding when it is estimated to be smaller than RLE.
+   //ENC_DELTA also lets segments with analog channels use the delta encoding.
+   uint8_t enc_mode;    // ENC_RLE, ENC_ADAPT or ENC_DELTA
+   //Binary framing from the 'B' command.  Packed blocks use all 8 bits of each byte, and
+   //captures with analog channels are always sent as packed blocks with 8 bit analog values.
+   bool binary;
+   //12 bit ADC mode from the 'H' command.  The ADC DMAs store 16 bit FIFO values and the
+   //analog channels are sent as 12 bit fields of packed blocks.
+   bool adc12;
+   //Flash spooling from the 'S' command, see SPOOL_EN
+   bool spool;
+   uint32_t spool_size;  // bytes of flash for the spool, set at boot
+   //Compressed store from the 'Z' command, see STORE_RING_DIV
+   bool store;
+   sr_stats_t stats;
+   //Lossy continuous mode from the 'O' command.  When sending falls behind the DMA, the
+   //segments about to be overwritten are skipped and replaced by a gap marker, rather than
+   //aborting the capture.
+   bool lossy;
+   //An 'e' estimate was requested, the main loop runs it and sends the reply
+   bool est_req;
+   //Event capture from the 'x' command, see sr_event.h.  Only used for digital only captures
+   //without a device trigger or sample filter, at rates the event PIO program can reach.
+   bool events;
+   //Vendor bulk streaming from the 'v' command, see VBULK_EN
+   bool vbulk;
+   //Segmented capture from the 'N' command, the number of frames or 0 for off
+   uint32_t frames;
+   //System clock profile from the 'K' command, see sr_clock.h
+   uint32_t clk_profile;
+   //A 'k' clock report was requested, the main loop makes the plan and sends the reply
+   bool clk_req;
+   //The 'F' or 'C' of the last capture, which an 'r' repeats, 0 if there hasn't been one
+   char rearm;
 } sr_device_t;
 
 // Send to debug uart
@@ -163,6 +297,9 @@ void init(sr_device_t *d);
 // Initialize the tx buffer
 void tx_init(sr_device_t *d);
 
+// Count the enabled channels and how they are stored and sent
+void chan_counts(sr_device_t *d);
+
 // Process incoming character stream
 // Return 1 if the device rspstr has a response to send to host
 // Be sure that rspstr does not have \n  or \r.
@@ -0,0 +1,808 @@
+/*Sample encoders for the sigrok wire protocol.
+ *The send_slices_* functions convert one half buffer of DMA sample data into the
+ *serial byte stream described in SerialProtocol.md.  They only touch the state in
+ *sr_encoder_t and hand completed bytes to the encoder's output sink, so this file
+ *has no PICO SDK dependencies and can also be compiled on a host.
+ */
+#include "sr_encode.h"
+#include "sr_event.h"
+
+//Setup an encoder with the output sink that receives the encoded bytes
+void enc_init(sr_encoder_t *e,sr_sink_fn sink){
+   e->txbufidx=0;
+   e->rxbufdidx=0;
+   e->rxbufaidx=0;
+   e->rlecnt=0;
+   e->lval=0;
+   e->samp_remain=0;
+   e->bytecnt=0;
+   e->d_dma_bps=0;
+   e->sink=sink;
+}
+//A common init for all send_slice modes 
+static void send_slice_init(sr_device_t *d,sr_encoder_t *e){
+   e->rxbufdidx=0;
+   e->rxbufaidx=0;
+   e->txbufidx=0;
+   e->rlecnt=0;
+   //Adjust the number of samples to send if there are more in the dma buffer
+   e->samp_remain=d->samples_per_half;
+   if((d->cont==false)&&((d->scnt+e->samp_remain)>(d->num_samples))){
+        e->samp_remain=d->num_samples-d->scnt;
+        d->scnt+=e->samp_remain;
+        //Dprintf("SSIa sph %d scnt %d e->lval 0x%X rem %d ns %d\n\r",d->samples_per_half,d->scnt,e->lval,e->samp_remain,d->num_samples);
+   }else{
+        d->scnt+=d->samples_per_half;
+        //Dprintf("SSIb sph %d scnt %d e->lval 0x%X rem %d ns %d\n\r",d->samples_per_half,d->scnt,e->lval,e->samp_remain,d->num_samples);
+   }
+}
+
+//Add one 4 bit sample to the D4 rle stream
+static inline __attribute__((always_inline)) void d4_nibble(sr_encoder_t *e,uint8_t nibcurr,uint8_t niblast){
+   if(nibcurr==niblast) {
+      e->rlecnt++;
+   }
+   else{
+     //If the value changes we must push all remaing rles to the e->txbuf
+     //Send intermediate 8..632 RLEs
+     if(e->rlecnt>7) {
+        int rlemid=e->rlecnt&0x3F8;
+        e->txbuf[e->txbufidx++]=(rlemid>>3)+47;
+     } 
+     //And finally the 0..7 rle along with the new value
+     e->rlecnt&=0x7;
+     #ifdef D4_DBG2 //print when sample value changes
+     Dprintf("VChang val 0x%X e->rlecnt %d\n\r",nibcurr,e->rlecnt);
+     #endif		  
+     e->txbuf[e->txbufidx++]=0x80|nibcurr|e->rlecnt<<4;
+     e->rlecnt=0;
+   }//nibcurr!=last
+}
+
+//This is an optimized transmit of trace data for configurations with 4 or fewer digital channels 
+//and no analog.  Run length encoding (RLE) is used to send counts of repeated values to effeciently utilize 
+//USB CDC link bandwidth.  This is the only mode where a given serial byte can have both sample information
+//and RLE counts.
+//Samples from PIO are dma'd in 32 bit words, each containing 8 samples of 4 bits (1 nibble).
+//RLE Encoding:
+//Values 0x80-0xFF encode an rle cnt of a previous value with a new value:
+//  Bit 7 is 1 to distinguish from the rle only values.
+//  Bits 6:4 indicate a run length up to 7 cycles of the previous value
+//  Bits 3:0 are the new value.
+//For longer runs, an RLE only encoding uses decimal values 48 to 127 (0x30 to 0x7F)
+//as x8 run length values of 8..640.
+//All other ascii values (except from the abort and the end of run byte_cnt) are reserved.
+uint32_t send_slices_D4(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf){
+   uint8_t nibcurr,niblast;
+   uint32_t cword,lword; //current and last word
+   uint32_t *cptr;
+   uint32_t first;
+   //Note that this function always sends the first sample, even if
+   //send_slice_init sets remaining samples to zero.  That shouldn't happen
+   //as we should also be in free running mode or split the two halves
+   //into something with 8 samples.
+   send_slice_init(d,e);
+   //Normally there are many words of samples, but the sample filter can leave any number
+   first=(e->samp_remain<8) ? e->samp_remain : 8;
+   if(first==0) first=1;
+   //Don't optimize the first word (eight samples) perfectly, just send them to make the for loop easier, 
+   //and setup the initial conditions for rle tracking
+   cptr=(uint32_t *) &(dbuf[0]);
+   cword=*cptr;
+   #ifdef D4_DBG
+   Dprintf("Dbuf %p cptr %p data 0x%X\n\r",(void *)&(dbuf[0]),(void *) cptr,cword);
+   #endif
+   lword=cword;
+   for (int j=0;j<first;j++){
+     nibcurr=cword&0xF;
+     e->txbuf[j]=(nibcurr)|0x80;
+     cword>>=4;
+   }
+   niblast=nibcurr;      
+   cptr=(uint32_t *) &(e->txbuf[0]);
+   e->txbufidx+=first;
+   e->rxbufdidx+=4;
+   e->rlecnt=0;
+   //Note that it is generally assumed that each half buffer has far more than
+   //8 samples in it, especially if pulseview is running.  But for some useages it
+   //may be only 8 so exit on the first 8. This is just mostly to prevent underflow
+   //of e->samp_remain when we subtract 8 from it.
+   //send_slice_init already counted the samples in d->scnt.
+   if(e->samp_remain<=8){
+     e->sink(e->txbuf,e->txbufidx);
+     e->bytecnt+=e->txbufidx;
+     e->txbufidx=0;
+     return e->bytecnt;
+   }
+   //The total number of 4 bit samples remaining to process from this half.
+   //Subtract 8 because we procesed the word above.
+   e->samp_remain-=8;
+
+   //Process one  word (8 samples) at a time.
+   for(int i=0;i<(e->samp_remain>>3);i++) {
+       cptr=(uint32_t *) &(dbuf[e->rxbufdidx]);
+       cword=*cptr;
+       e->rxbufdidx+=4;
+       #ifdef D4_DBG2
+       Dprintf("dbuf0 %p dbufr %p cptr %p \n\r",dbuf,&(dbuf[e->rxbufdidx]),cptr);
+       #endif
+       //Send maximal RLE counts in this outer section to the e->txbuf, and if we accumulate a few of them
+       //push to the device so that we don't accumulate large numbers
+       //of unsent RLEs.  That allows the host to process them gradually rather than in a flood
+       //when we get a value change.
+       while(e->rlecnt>=640){
+         e->txbuf[e->txbufidx++]=127;
+         e->rlecnt-=640;
+         if(e->txbufidx>3){   
+            e->sink(e->txbuf,e->txbufidx);
+            e->bytecnt+=e->txbufidx;
+            e->txbufidx=0;
+         }
+       }
+       //Coarse rle looks across the full word and allows a faster compare in cases with low activity factors
+       //We must make sure cword==lword and that all nibbles of cword are the same
+       if((cword==lword)&&((cword>>4)==(cword&0x0FFFFFFF))){
+         e->rlecnt+=8;
+         #ifdef D4_DBG2
+         Dprintf("coarse word 0x%X\n\r",cword);
+         #endif
+       }
+       else{//if coarse rle didn't match
+         #ifdef D4_DBG2
+        Dprintf("cword 0x%X nibcurr 0x%X i %d rx idx %u  e->rlecnt %u \n\r",cword,nibcurr,i,e->rxbufdidx,e->rlecnt);
+        #endif
+        lword=cword;
+        for (int j=0;j<8;j++){ //process all 8 nibbles
+          nibcurr=cword&0xF;
+          d4_nibble(e,nibcurr,niblast);
+          cword>>=4;
+          niblast=nibcurr;
+        }//for j
+       } //else (not a coarse rle )
+       #ifdef D4_DBG2
+       Dprintf("i %d rx idx %u  e->rlecnt %u \n\r",i,e->rxbufdidx,e->rlecnt);
+       Dprintf("i %u tx idx %d bufs 0x%X 0x%X 0x%X\n\r",i,e->txbufidx,e->txbuf[e->txbufidx-3],e->txbuf[e->txbufidx-2],e->txbuf[e->txbufidx-1]);
+       #endif
+       //Emperically found that transmitting groups of around 32B gives optimum bandwidth
+       if(e->txbufidx>=64){
+         e->sink(e->txbuf,e->txbufidx);
+         e->bytecnt+=e->txbufidx;
+         e->txbufidx=0;
+       }
+    }//for i in samp_send>>3
+    //Samples left over after the last full word, only seen when the sample filter is used
+    if(e->samp_remain&7){
+       cword=*((uint32_t *) &(dbuf[e->rxbufdidx]));
+       for (int j=0;j<(e->samp_remain&7);j++){
+         nibcurr=cword&0xF;
+         d4_nibble(e,nibcurr,niblast);
+         cword>>=4;
+         niblast=nibcurr;
+       }
+    }
+    //At the end of processing the half send any residual samples as we don't maintain state between the halves
+    //Maximal 640 values first
+    while(e->rlecnt>=640){
+      e->txbuf[e->txbufidx++]=127;
+      e->rlecnt-=640;
+    }
+    //Middle rles 8..632
+    if(e->rlecnt>7) {
+      int rleend=e->rlecnt&0x3F8;
+      e->txbuf[e->txbufidx++]=(rleend>>3)+47;
+    }
+    //1..7 RLE 
+    //The rle and value encoding counts as both a sample count of rle and a new sample
+    //thus we must decrement e->rlecnt by 1 and resend the current value which will match the previous values
+    //(if the current value didn't match, the e->rlecnt would be 0).
+    //If the rle was a multiple of 8 the middle rle already covered it.
+    e->rlecnt&=0x7;
+    if(e->rlecnt){
+      e->rlecnt--;
+      e->txbuf[e->txbufidx++]=0x80|nibcurr|e->rlecnt<<4;
+      e->rlecnt=0;
+    }
+    if(e->txbufidx){
+       e->sink(e->txbuf,e->txbufidx);
+       e->bytecnt+=e->txbufidx;
+       e->txbufidx=0;
+    }
+
+}//send_slices_D4
+
+//Send a digital sample of multiple bytes with the 7 bit encoding
+static inline void tx_d_samp(sr_device_t *d,sr_encoder_t *e,uint32_t cval){
+    for(char b=0;b < d->d_tx_bps;b++){
+      e->txbuf[e->txbufidx++]=(cval|0x80);
+//      Dprintf("txds b %d cv 0x%X idx %d \n\r",b,cval,e->txbufidx); 
+      cval>>=7;
+    }
+}
+
+//Allow for 1,2 or 4B reads of sample data to reduce memory read overhead when
+//parsing digital sample data.  This function is correct for all uses, but if included
+//the compiled code is substantially slower to the point that digital only transfers
+//can't keep up with USB rate.  Thus it is only used by the send_slices_analog which is already
+//limited to 500khz, and in the starting send_slice_1/2/4
+static uint32_t get_cval(sr_encoder_t *e,uint8_t *dbuf){
+       uint32_t cval;
+       if(e->d_dma_bps==1){
+           cval=dbuf[e->rxbufdidx];
+       }else if(e->d_dma_bps==2){
+           cval=(*((uint16_t *) (dbuf+e->rxbufdidx)));
+       }else{
+           cval=(*((uint32_t *) (dbuf+e->rxbufdidx)));
+           //Mask off undefined channels
+           #ifdef DIG_26_MODE
+             //push out the gap of 3 channels
+              cval=(cval&MEM_D_MASK_L)|((cval&MEM_D_MASK_U)>>3);
+           #elif BASE_MODE
+              //mask off upper unused
+               cval=cval&MEM_D_MASK_L;
+              //No change for DIG_32_MODE as all are defined  
+           #endif
+       }
+       e->rxbufdidx+=e->d_dma_bps;
+       return cval;
+}
+/*RLE encoding for 5 or more channels has two ranges.
+Decimal 48 to  79 are RLEs of 1 to 32 respectively.
+Decimal 80 to 127 are (N-78)*32 thus 64,96..80,120..1568
+Note that it is the responsibility of the caller to
+forward txbuf bytes to USB to prevent txbufidx from overflowing the size
+of txbuf. We do not always push to USB to reduce its impact
+on performance.
+ */
+static inline void check_rle(sr_encoder_t *e){
+//  Dprintf("RLEx %d\n\r",e->rlecnt); 
+  while(e->rlecnt>=1568){
+    e->txbuf[e->txbufidx++]=127;
+    e->rlecnt-=1568;
+  }
+  if(e->rlecnt>32){
+     uint16_t rlediv=e->rlecnt>>5;
+     e->txbuf[e->txbufidx++]=rlediv+78;//was 86;
+     e->rlecnt-=rlediv<<5;
+    }
+  if(e->rlecnt){
+     e->txbuf[e->txbufidx++]=47+e->rlecnt;
+     e->rlecnt=0;
+  }
+}
+
+//Send txbuf to the output sink based on an input threshold
+static void check_tx_buf(sr_encoder_t *e,uint16_t cnt){
+  if(e->txbufidx>=cnt){
+//     Dprintf("e->txbuf idx %d cnt %d\n\r",e->txbufidx,cnt);
+     e->sink(e->txbuf,e->txbufidx);
+     e->bytecnt+=e->txbufidx;
+     e->txbufidx=0;
+  }
+}
+//A common first digital byte to send to establish RLE.
+//Not used for send_analog because it doesn't use RLE, and not used for D4 because it 
+//has a different RLE encoding
+static void send_first_dig_sample(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf){
+   e->lval=get_cval(e,dbuf);
+   tx_d_samp(d,e,e->lval);
+   e->samp_remain--;
+   e->rlecnt=0;
+}
+//Per sample RLE tracking for the 5+ channel modes.  A sample that matches the last
+//value only increments the rle count, otherwise the pending rle and the new value are sent.
+static inline __attribute__ ((always_inline)) void rle_slice(sr_device_t *d,sr_encoder_t *e,uint32_t cval){
+   if(cval==e->lval){
+      e->rlecnt++;
+   }
+   else{
+      check_rle(e);
+      tx_d_samp(d,e,cval);
+      check_tx_buf(e,TX_BUF_THRESH);
+   }//if cval!=e->lval
+   e->lval=cval;
+}
+//There are three very similar functions send_slices_1B/2B/4B.
+//Each of which  is very similar but exist because if a common function 
+//is used with the get_cval in the inner loop, the performance drops 
+//substantially.  Thus each function has a 1,2, or 4B aligned read respectively.
+//We can't just always read a 4B value because the core doesn't support non-aligned accesses.
+//These must be marked noinline to ensure they remain separate functions for good performance
+//The 1B and 2B versions also have a coarse rle similar to send_slices_D4. Once the read index
+//is word aligned they read 4 (or 2) samples at a time and compare them to the last value
+//replicated across a word, and only look at individual samples if the word doesn't match.
+//1B is 5-8 channels
+void __attribute__ ((noinline)) send_slices_1B(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf){
+   uint32_t cword,lword;
+   uint32_t s=0;
+   send_slice_init(d,e);
+//   Dprintf("Enter 1Ba sts %d sr %d\n\r",d->samples_per_half,e->samp_remain); 
+   send_first_dig_sample(d,e,dbuf);
+   //Single samples until the read index is word aligned
+   while((e->rxbufdidx&3)&&(s<e->samp_remain)){
+      rle_slice(d,e,dbuf[e->rxbufdidx++]);
+      s++;
+   }
+   lword=e->lval*0x01010101;
+   //Process one word (4 samples) at a time
+   for(;(s+4)<=e->samp_remain;s+=4){
+       cword=*((uint32_t *) (dbuf+e->rxbufdidx));
+       e->rxbufdidx+=4;
+       if(cword==lword){
+          e->rlecnt+=4;
+       }
+       else{
+          //Samples are stored lowest byte first
+          for(int j=0;j<4;j++){
+             rle_slice(d,e,cword&0xFF);
+             cword>>=8;
+          }
+          lword=e->lval*0x01010101;
+       }
+     }//for s
+   //Remaining samples that don't fill a word
+   for(;s<e->samp_remain;s++){
+      rle_slice(d,e,dbuf[e->rxbufdidx++]);
+   }
+  check_rle(e);
+  check_tx_buf(e,1);
+}//send_slices_1B
+
+//2B is 9-16 channels
+//For all modes the sample bits are always continous/fully packed
+void __attribute__ ((noinline)) send_slices_2B(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf){
+   uint32_t cword,lword;
+   uint32_t s=0;
+   send_slice_init(d,e);
+   send_first_dig_sample(d,e,dbuf);
+   //Single samples until the read index is word aligned
+   while((e->rxbufdidx&3)&&(s<e->samp_remain)){
+      rle_slice(d,e,(*((uint16_t *) (dbuf+e->rxbufdidx))));
+      e->rxbufdidx+=2;
+      s++;
+   }
+   lword=e->lval|(e->lval<<16);
+   //Process one word (2 samples) at a time
+   for(;(s+2)<=e->samp_remain;s+=2){
+       cword=*((uint32_t *) (dbuf+e->rxbufdidx));
+       e->rxbufdidx+=4;
+       if(cword==lword){
+          e->rlecnt+=2;
+       }
+       else{
+          rle_slice(d,e,cword&0xFFFF);
+          rle_slice(d,e,cword>>16);
+          lword=e->lval|(e->lval<<16);
+       }
+     }//for s
+   //Remaining sample that doesn't fill a word
+   if(s<e->samp_remain){
+      rle_slice(d,e,(*((uint16_t *) (dbuf+e->rxbufdidx))));
+      e->rxbufdidx+=2;
+   }
+   check_rle(e);
+   check_tx_buf(e,1);
+}//send_slices_2B
+//4B is 17-21 channels in BASE_MODE
+//It is also used with 17-26 channels in DIG_26_MODE, and 17-32 channels in DIG_32_MODE
+void __attribute__ ((noinline)) send_slices_4B(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf){
+   uint32_t cval;
+   send_slice_init(d,e);
+   send_first_dig_sample(d,e,dbuf);
+   for(int s=0;s<e->samp_remain;s++){
+       cval=(*((uint32_t *) (dbuf+e->rxbufdidx)));
+       e->rxbufdidx+=4;
+       //Mask invalid bits, remove 29-31, and shift down 26-28 over 23-25
+       #ifdef DIG_26_MODE
+        cval=(cval&MEM_D_MASK_L)|((cval&MEM_D_MASK_U)>>3);
+       #elif BASE_MODE
+        //mask off upper unused
+        cval=cval&MEM_D_MASK_L;
+        //No change for DIG_32_MODE as all are defined  
+       #endif
+       if(cval==e->lval){
+      	   e->rlecnt++;
+         }
+       else{
+         check_rle(e);
+         tx_d_samp(d,e,cval);
+         check_tx_buf(e,TX_BUF_THRESH);
+       }//if cval!=e->lval
+       e->lval=cval;
+     }//for s
+   check_rle(e);
+   check_tx_buf(e,1);
+}//send_slices_4B
+
+
+//Slice transmit code, used for all cases with any analog channels 
+//All digital channels for one slice are sent first in 7 bit bytes using values 0x80 to 0xFF
+//Analog channels are sent next, with each channel taking one 7 bit byte using values 0x80 to 0xFF.
+//This does not support run length encoding because it's not clear how to define RLE on analog signals
+//This functional will only be called in BASE_MODE, as neither DIG_26_MODE or DIG_32 mode
+//have analog support
+uint32_t send_slices_analog(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf,uint8_t *abuf){
+   send_slice_init(d,e);
+   uint32_t cval;
+   for(int s=0;s<e->samp_remain;s++){
+         if(d->d_mask){
+            cval=get_cval(e,dbuf);
+            tx_d_samp(d,e,cval);
+	    //Dprintf("s %d cv %X bps %d idx t %d r %d \n\r",s,cval,e->d_dma_bps,e->txbufidx,e->rxbufdidx);
+         }
+         for(char i=0;i<d->a_chan_cnt;i++){
+           e->txbuf[e->txbufidx]=(abuf[e->rxbufaidx]>>1)|0x80;
+           e->txbufidx++;
+           e->rxbufaidx++;
+	   //Dprintf("av %X cnt %d idx t %d r %d\n\r",abuf[e->rxbufaidx-1],d->a_chan_cnt,e->txbufidx,e->rxbufaidx);
+         } 
+         //Since this doesn't support RLEs we don't need to buffer
+         //extra bytes to prevent e->txbuf overflow, but this value
+         //works well anyway
+         check_tx_buf(e,TX_BUF_THRESH);
+   }//for s
+   check_tx_buf(e,1);
+}//send_slices_analog
+
+//Read digital sample i of a half without disturbing the encoder's read position.
+//D4 modes store two samples per byte, lowest nibble first.
+static uint32_t peek_cval(sr_encoder_t *e,uint8_t *dbuf,uint32_t i){
+   uint32_t cval,idx;
+   if(e->d_dma_bps==0){
+      return (dbuf[i>>1]>>((i&1)<<2))&0xF;
+   }
+   idx=e->rxbufdidx;
+   e->rxbufdidx=i*e->d_dma_bps;
+   cval=get_cval(e,dbuf);
+   e->rxbufdidx=idx;
+   return cval;
+}
+
+//Estimate how many of every 256 samples in the half differ from the sample before them.
+//Only ENC_PROBES evenly spaced pairs are compared so the cost doesn't depend on the half size.
+//The stride is forced odd so that it can't line up with power of 2 clock periods.
+uint32_t enc_activity(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf){
+   uint32_t n=d->samples_per_half;
+   uint32_t probes,step,chg=0;
+   if(n<2) return 0;
+   probes=(n-1<ENC_PROBES) ? n-1 : ENC_PROBES;
+   step=((n-1)/probes)|1;
+   for(uint32_t i=0,p=0;(p<probes)&&(i+1<n);p++,i+=step){
+      if(peek_cval(e,dbuf,i)!=peek_cval(e,dbuf,i+1)) chg++;
+   }
+   return (chg<<8)/probes;
+}
+
+//Decide if the packed encoding will be smaller than RLE for this half.  Costs are in 1/256ths
+//of a byte per sample.  With RLE every changed sample costs the full d_tx_bps bytes (one byte in
+//D4 mode) and a run between changes costs about one more byte, while packed always costs
+//d_chan_cnt/7 bytes (d_chan_cnt/8 with binary framing).  Packed must win by 1/8 so that a
+//marginal estimate keeps the RLE default.
+bool enc_pick_packed(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf){
+   uint32_t act,rle,packed;
+   if((d->enc_mode==ENC_RLE)&&(d->binary==false)) return false;
+   act=enc_activity(d,e,dbuf);
+   packed=(d->d_chan_cnt<<8)/(d->binary ? 8 : 7);
+   if(e->d_dma_bps==0){
+      rle=act;
+   }else{
+      rle=act*d->d_tx_bps+((act*(256-act))>>8);
+   }
+   return (packed+(packed>>3))<rle;
+}
+
+//Width of the analog values in packed and delta blocks
+uint32_t enc_a_bits(sr_device_t *d){
+   if(d->adc12) return 12;
+   return d->binary ? 8 : 7;
+}
+
+//Read analog value i of a half at enc_a_bits width
+static inline uint32_t get_aval(sr_device_t *d,uint8_t *abuf,uint32_t i){
+   if(d->adc12) return ((uint16_t *)abuf)[i]&0xFFF;
+   return d->binary ? abuf[i] : abuf[i]>>1;
+}
+
+//Add one byte of a binary framed block, escaping the bytes the host treats as control
+static inline void tx_bin(sr_encoder_t *e,uint8_t b){
+   if((b=='!')||(b=='$')||(b==BIN_ESC)){
+      e->txbuf[e->txbufidx++]=BIN_ESC;
+      b^=0x20;
+   }
+   e->txbuf[e->txbufidx++]=b;
+}
+
+//Add cnt bits to the packed stream and send the whole bytes
+static inline void pk_bits(sr_device_t *d,sr_encoder_t *e,uint64_t *acc,uint32_t *bits,uint32_t val,uint32_t cnt){
+   *acc|=((uint64_t)val)<<*bits;
+   *bits+=cnt;
+   if(d->binary){
+      while(*bits>=8){
+         tx_bin(e,*acc&0xFF);
+         *acc>>=8;
+         *bits-=8;
+      }
+   }else{
+      while(*bits>=7){
+         e->txbuf[e->txbufidx++]=(*acc&0x7F)|0x80;
+         *acc>>=7;
+         *bits-=7;
+      }
+   }
+}
+
+//Start a packed or delta block with its type and the number of samples in three 7 bit bytes
+static void tx_block_hdr(sr_encoder_t *e,char type){
+   e->txbuf[e->txbufidx++]=type;
+   for(int b=0;b<3;b++){
+      e->txbuf[e->txbufidx++]=((e->samp_remain>>(7*b))&0x7F)|0x80;
+   }
+}
+
+//Packed encoding, used for busy digital only halves selected by enc_pick_packed and for all
+//halves with analog channels when binary framing or the 12 bit ADC mode is on.
+//The block starts with '&' and the number of samples in three 7 bit bytes (lowest first),
+//followed by the slices as one continuous bit stream, lowest bit first.  Each slice is the
+//d_chan_cnt digital bits, then enc_a_bits for each analog channel (abuf holds 16 bit values in
+//the adc12 mode).  The stream is sent 7 bits per
+//byte OR'd with 0x80, or 8 bits per byte with escapes for binary framing, and the last byte is
+//zero filled.  Unlike tx_d_samp no bits are wasted at the top of each sample, so 8 channels take
+//8/7 bytes per sample rather than 2.
+void send_slices_packed(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf,uint8_t *abuf){
+   uint64_t acc=0;
+   uint32_t bits=0,cval;
+   uint32_t abits=enc_a_bits(d);
+   uint32_t mask=(d->d_chan_cnt>=32) ? 0xFFFFFFFF : (1u<<d->d_chan_cnt)-1;
+   send_slice_init(d,e);
+   tx_block_hdr(e,'&');
+   for(uint32_t s=0;s<e->samp_remain;s++){
+      if(d->d_mask){
+         if(e->d_dma_bps==0){
+            cval=(dbuf[s>>1]>>((s&1)<<2));
+         }else{
+            cval=get_cval(e,dbuf);
+         }
+         pk_bits(d,e,&acc,&bits,cval&mask,d->d_chan_cnt);
+      }
+      for(char i=0;i<d->a_chan_cnt;i++){
+         pk_bits(d,e,&acc,&bits,get_aval(d,abuf,e->rxbufaidx++),abits);
+      }
+      check_tx_buf(e,TX_BUF_THRESH);
+   }
+   if(bits){
+      pk_bits(d,e,&acc,&bits,0,d->binary ? 8-bits : 7-bits);
+   }
+   check_tx_buf(e,1);
+}//send_slices_packed
+
+//Decide if the delta encoding will be smaller than packed analog values for this half.
+//Each analog value costs a 4 bit code, plus enc_a_bits when the step from the last value of the
+//channel doesn't fit in the code, so ENC_PROBES pairs of neighbouring values are checked.
+bool enc_pick_delta(sr_device_t *d,sr_encoder_t *e,uint8_t *abuf){
+   uint32_t n=d->samples_per_half;
+   uint32_t probes,step,small=0,abits,delta,raw;
+   int32_t diff;
+   if((d->enc_mode!=ENC_DELTA)||(d->a_chan_cnt==0)||(n<2)) return false;
+   abits=enc_a_bits(d);
+   probes=(n-1<ENC_PROBES) ? n-1 : ENC_PROBES;
+   step=((n-1)/probes)|1;
+   for(uint32_t i=0,p=0;(p<probes)&&(i+1<n);p++,i+=step){
+      uint32_t c=p%d->a_chan_cnt;
+      diff=(int32_t)get_aval(d,abuf,(i+1)*d->a_chan_cnt+c)-(int32_t)get_aval(d,abuf,i*d->a_chan_cnt+c);
+      if((diff>=-DELTA_MAX)&&(diff<=DELTA_MAX)) small++;
+   }
+   //In bits per 256 analog values
+   delta=(4<<8)+(((probes-small)*abits)<<8)/probes;
+   raw=abits<<8;
+   return (delta+(delta>>3))<raw;
+}
+
+//Delta encoding for halves with analog channels, selected by enc_pick_delta.
+//The block starts with '%' and the number of samples like a packed block, and uses the same
+//bit stream.  Each slice has a 1 bit flag that is set if the digital value changed, followed
+//by the d_chan_cnt digital bits when set.  Then each analog channel has a 4 bit signed step
+//from that channel's last value, or DELTA_ESC followed by the enc_a_bits value when the step
+//doesn't fit.  The last values start over in each block, so the first slice is always escaped.
+void send_slices_delta(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf,uint8_t *abuf){
+   uint64_t acc=0;
+   uint32_t bits=0,cval,aval;
+   uint32_t abits=enc_a_bits(d);
+   uint32_t mask=(d->d_chan_cnt>=32) ? 0xFFFFFFFF : (1u<<d->d_chan_cnt)-1;
+   int32_t last[DELTA_MAX_A_CHAN],diff;
+   for(int i=0;i<DELTA_MAX_A_CHAN;i++) last[i]=-(1<<16);
+   send_slice_init(d,e);
+   tx_block_hdr(e,'%');
+   for(uint32_t s=0;s<e->samp_remain;s++){
+      if(d->d_mask){
+         cval=get_cval(e,dbuf)&mask;
+         if((s==0)||(cval!=e->lval)){
+            pk_bits(d,e,&acc,&bits,1,1);
+            pk_bits(d,e,&acc,&bits,cval,d->d_chan_cnt);
+            e->lval=cval;
+         }else{
+            pk_bits(d,e,&acc,&bits,0,1);
+         }
+      }
+      for(char i=0;i<d->a_chan_cnt;i++){
+         aval=get_aval(d,abuf,e->rxbufaidx++);
+         diff=(int32_t)aval-last[i];
+         if((diff>=-DELTA_MAX)&&(diff<=DELTA_MAX)){
+            pk_bits(d,e,&acc,&bits,diff&0xF,4);
+         }else{
+            pk_bits(d,e,&acc,&bits,DELTA_ESC,4);
+            pk_bits(d,e,&acc,&bits,aval,abits);
+         }
+         last[i]=aval;
+      }
+      check_tx_buf(e,TX_BUF_THRESH);
+   }
+   if(bits){
+      pk_bits(d,e,&acc,&bits,0,d->binary ? 8-bits : 7-bits);
+   }
+   check_tx_buf(e,1);
+}//send_slices_delta
+
+//The worst case of each encoding send_slices may pick.  RLE costs at most d_tx_bps bytes per
+//sample (one in D4 mode) and the 7 bit analog slices a byte per analog channel more.  Packed
+//and delta blocks are only counted when they can be picked, at their bits per slice, and
+//with binary framing every byte of them may be escaped.
+uint64_t enc_worst_bytes(sr_device_t *d,uint32_t samples,uint32_t sph){
+   uint32_t abits=enc_a_bits(d),bits=0,dbits;
+   uint64_t rle=0,blk=0,segs;
+   sph=(sph) ? sph : 1;
+   segs=((uint64_t)samples+sph-1)/sph;
+   if(d->a_chan_cnt==0){
+      rle=(uint64_t)samples*d->d_tx_bps;
+      if((d->enc_mode!=ENC_RLE)||d->binary) bits=d->d_chan_cnt;
+   }else{
+      if(d->binary||d->adc12){
+         bits=d->d_chan_cnt+d->a_chan_cnt*abits;
+      }else{
+         rle=(uint64_t)samples*(d->d_tx_bps+d->a_chan_cnt);
+      }
+      if(d->enc_mode==ENC_DELTA){
+         dbits=((d->d_mask) ? 1+d->d_chan_cnt : 0)+d->a_chan_cnt*(4+abits);
+         bits=(dbits>bits) ? dbits : bits;
+      }
+   }
+   if(bits){
+      blk=((uint64_t)samples*bits+(d->binary ? 7 : 6))/(d->binary ? 8 : 7);
+      blk*=(d->binary) ? 2 : 1;
+   }
+   return ((rle>blk) ? rle : blk)+segs*ENC_SEG_BYTES;
+}
+
+//Encode d->samples_per_half samples with the encoding picked for the enabled channels
+void send_slices(sr_device_t *d,sr_encoder_t *e,uint8_t *dbuf,uint8_t *abuf){
+  if(d->a_mask && enc_pick_delta(d,e,abuf)){ send_slices_delta(d,e,dbuf,abuf);}
+  else if(d->a_mask && (d->binary || d->adc12)){ send_slices_packed(d,e,dbuf,abuf);}
+  else if(d->a_mask){                           send_slices_analog(d,e,dbuf,abuf);}
+  else if(enc_pick_packed(d,e,dbuf)){           send_slices_packed(d,e,dbuf,0);}
+  else if(e->d_dma_bps==0){send_slices_D4(d,e,dbuf);}
+  else if(e->d_dma_bps==1){send_slices_1B(d,e,dbuf);}
+  else if(e->d_dma_bps==2){send_slices_2B(d,e,dbuf);}
+  else {                   send_slices_4B(d,e,dbuf);}
+}
+
+//A gap, hold or frame marker with a count of up to GAP_MAX samples in four 7 bit bytes (lowest
+//first), OR'd with 0x80 in either framing
+static void put_count_mark(sr_encoder_t *e,uint8_t mark,uint32_t count){
+   e->txbuf[e->txbufidx++]=mark;
+   for(int b=0;b<4;b++){
+      e->txbuf[e->txbufidx++]=((count>>(7*b))&0x7F)|0x80;
+   }
+}
+
+//Gap marker: GAP_MARK and the dropped sample count.  The segments before and after don't
+//share any rle state, so the host can place the gap exactly between them.
+void send_gap(sr_encoder_t *e,uint32_t count){
+   uint32_t n;
+   while(count){
+      n=(count>GAP_MAX) ? GAP_MAX : count;
+      put_count_mark(e,GAP_MARK,n);
+      count-=n;
+   }
+   e->sink(e->txbuf,e->txbufidx);
+   e->bytecnt+=e->txbufidx;
+   e->txbufidx=0;
+}
+
+//Frame marker: FRAME_MARK and the frame number.  Like a gap it is only sent between
+//segments, and the frame after it starts with a full sample.
+void send_frame_mark(sr_encoder_t *e,uint32_t frame){
+   put_count_mark(e,FRAME_MARK,frame&GAP_MAX);
+   e->sink(e->txbuf,e->txbufidx);
+   e->bytecnt+=e->txbufidx;
+   e->txbufidx=0;
+}
+
+void send_events_init(sr_encoder_t *e){
+   e->ev_cnt=0xFFFFFFFF;
+   e->ev_pos=0;
+   e->ev_next=0;
+   e->ev_first=true;
+   e->lval=0;
+}
+//Hold marker: HOLD_MARK and a count of samples that repeat the last value
+static void ev_hold(sr_encoder_t *e,uint32_t count){
+   uint32_t n;
+   while(count){
+      n=(count>GAP_MAX) ? GAP_MAX : count;
+      put_count_mark(e,HOLD_MARK,n);
+      check_tx_buf(e,TX_BUF_THRESH);
+      count-=n;
+   }
+}
+//Send a new value after the last one was held for run more samples
+static void ev_change(sr_device_t *d,sr_encoder_t *e,uint32_t run,uint32_t val){
+   if(run>=HOLD_MIN){
+      ev_hold(e,run);
+      run=0;
+   }
+   if(e->d_dma_bps==0){
+      //D4, rles of 8..640 and then the last 0..7 with the value
+      while(run>=640){
+         e->txbuf[e->txbufidx++]=127;
+         run-=640;
+      }
+      if(run>7){
+         e->txbuf[e->txbufidx++]=((run&0x3F8)>>3)+47;
+      }
+      e->txbuf[e->txbufidx++]=0x80|val|(run&7)<<4;
+   }else{
+      e->rlecnt=run;
+      check_rle(e);
+      tx_d_samp(d,e,val);
+   }
+   check_tx_buf(e,TX_BUF_THRESH);
+}
+//Digital value of the pins word of a record, with the same channel remapping as get_cval.
+//Pins that aren't enabled channels can still make records, which are dropped as no change.
+static inline uint32_t ev_value(sr_device_t *d,uint32_t pins){
+#ifdef DIG_26_MODE
+   pins=(pins&MEM_D_MASK_L)|((pins&MEM_D_MASK_U)>>3);
+#endif
+   return pins&d->d_mask;
+}
+//The counts are wrap safe, so a continuous capture only needs a record at least every 2^32
+//samples.
+void send_events(sr_device_t *d,sr_encoder_t *e,const uint32_t *ev,uint32_t n){
+   uint32_t val,pos,run;
+   for(uint32_t i=0;i<n;i++,ev+=EV_REC_WORDS){
+      pos=e->ev_pos+(e->ev_cnt-ev[1]);
+      //A fixed capture ends at num_samples and any later records are dropped
+      if((d->cont==false)&&(pos>=d->num_samples)){
+         break;
+      }
+      e->ev_cnt=ev[1];
+      e->ev_pos=pos;
+      val=ev_value(d,ev[0]);
+      if(e->ev_first||(val!=e->lval)){
+         //A hold sent by send_events_hold may already cover some of the run, but never
+         //goes past the record
+         run=pos-e->ev_next;
+         ev_change(d,e,run,val);
+         e->ev_next+=run+1;
+         e->lval=val;
+         e->ev_first=false;
+      }
+   }
+   d->scnt=e->ev_next;
+   check_tx_buf(e,1);
+}
+
+void send_events_hold(sr_device_t *d,sr_encoder_t *e,uint32_t pos){
+   if(e->ev_first){
+      return;
+   }
+   //A fixed capture is at most num_samples, otherwise pos may have wrapped, and a time
+   //based pos may not have caught up with the last record yet
+   if((d->cont==false)&&(pos>d->num_samples)){
+      pos=d->num_samples;
+   }
+   if((d->cont==false) ? (pos>e->ev_next) : ((int32_t)(pos-e->ev_next)>0)){
+      ev_hold(e,pos-e->ev_next);
+      e->ev_next=pos;
+      d->scnt=pos;
+      check_tx_buf(e,1);
+   }
+}
@@ -0,0 +1,109 @@
+#ifndef SR_ENCODE_H
+#define SR_ENCODE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "sr_device.h"
+
+// Sample pairs compared by enc_activity for each half
+#define ENC_PROBES 64
+// Analog delta codes are 4 bit signed steps, with the unused -8 escaping to a full value
+#define DELTA_MAX 7
+#define DELTA_ESC 0x8
+// The ADC round robin covers at most 8 inputs
+#define DELTA_MAX_A_CHAN 8
+
+//Receives encoded bytes from the send_slices_* functions.  On the device this is the
+//USB CDC link, but any function with this signature can be used (i.e. a file or
+//a byte counter when the encoders are compiled on a host).
+typedef void (*sr_sink_fn)(const char *buf, int length);
+
+//All state used while encoding one half buffer of samples.
+typedef struct
+{
+   uint8_t txbuf[TX_BUF_SIZE];
+   uint16_t txbufidx;
+   uint32_t rxbufdidx, rxbufaidx; // read index into the digital and analog buffers
+   uint32_t rlecnt;
+   uint32_t lval;        // last digital sample value
+   uint32_t samp_remain; // samples left to send in the current half
+   uint32_t bytecnt;     // count of characters sent serially
+   // Number of bytes stored as DMA per slice, must be 1,2 or 4 to support aligned access
+   // This will be be zero for 1-4 digital channels.
+   uint8_t d_dma_bps;
+   sr_sink_fn sink;
+   // Event capture state, kept across segments, see send_events
+   uint32_t ev_cnt;  // PIO count of the last record
+   uint32_t ev_pos;  // sample index of the last record
+   uint32_t ev_next; // samples sent so far, including any hold of the last value
+   bool ev_first;    // no record seen yet
+} sr_encoder_t;
+
+// Setup an encoder with the output sink that receives the encoded bytes
+void enc_init(sr_encoder_t *e, sr_sink_fn sink);
+
+// 1-4 digital channels, no analog, with the D4 RLE encoding
+uint32_t send_slices_D4(sr_device_t *d, sr_encoder_t *e, uint8_t *dbuf);
+
+// 5 or more digital channels, no analog, stored as 1,2 or 4 bytes per sample
+void send_slices_1B(sr_device_t *d, sr_encoder_t *e, uint8_t *dbuf);
+void send_slices_2B(sr_device_t *d, sr_encoder_t *e, uint8_t *dbuf);
+void send_slices_4B(sr_device_t *d, sr_encoder_t *e, uint8_t *dbuf);
+
+// Any configuration with analog channels enabled
+uint32_t send_slices_analog(sr_device_t *d, sr_encoder_t *e, uint8_t *dbuf, uint8_t *abuf);
+
+// Estimated count of changed samples per 256 in the current half
+uint32_t enc_activity(sr_device_t *d, sr_encoder_t *e, uint8_t *dbuf);
+
+// True if enc_mode is ENC_ADAPT and the packed encoding should be used for the current half
+bool enc_pick_packed(sr_device_t *d, sr_encoder_t *e, uint8_t *dbuf);
+
+// Any configuration, packed bit stream with a block header.  abuf is only used with analog channels.
+void send_slices_packed(sr_device_t *d, sr_encoder_t *e, uint8_t *dbuf, uint8_t *abuf);
+
+// Width of the analog values in packed and delta blocks, 7, 8 or 12 bits
+uint32_t enc_a_bits(sr_device_t *d);
+
+// True if enc_mode is ENC_DELTA and the delta encoding should be used for the current half
+bool enc_pick_delta(sr_device_t *d, sr_encoder_t *e, uint8_t *abuf);
+
+// Any configuration with analog channels, delta coded analog values with a block header
+void send_slices_delta(sr_device_t *d, sr_encoder_t *e, uint8_t *dbuf, uint8_t *abuf);
+
+// Encode the current half with the encoding picked for the enabled channels and enc_mode
+void send_slices(sr_device_t *d, sr_encoder_t *e, uint8_t *dbuf, uint8_t *abuf);
+
+// Bytes a segment can add to the worst case of its samples: a block header and the escaped
+// last byte of the bit stream, or the run pending at its end
+#define ENC_SEG_BYTES 8
+
+// Most bytes send_slices can send for samples samples in segments of sph samples, when
+// every sample changes, for sizing a store before a capture
+uint64_t enc_worst_bytes(sr_device_t *d, uint32_t samples, uint32_t sph);
+
+// Samples carried by one gap marker, the 28 bits of its four 7 bit count bytes
+#define GAP_MAX 0x0FFFFFFF
+
+// Send gap markers for count samples dropped by the lossy continuous mode.  Only used between
+// segments, when the encoder holds no pending bytes.
+void send_gap(sr_encoder_t *e, uint32_t count);
+
+// Send a frame marker before frame number frame of a segmented capture.  Only used between
+// frames, when the encoder holds no pending bytes.
+void send_frame_mark(sr_encoder_t *e, uint32_t frame);
+
+// Holds shorter than this are sent as rles, longer ones as hold markers
+#define HOLD_MIN 2048
+
+// Start an event capture
+void send_events_init(sr_encoder_t *e);
+
+// Event capture, n records of EV_REC_WORDS words from the event PIO program, see sr_event.h.
+// Each change is sent as a new value in the normal encoding of the digital channels.
+void send_events(sr_device_t *d, sr_encoder_t *e, const uint32_t *ev, uint32_t n);
+
+// The event capture has reached at least sample pos, so the last value is held until then.
+// In a fixed capture pos is limited to num_samples, and is num_samples at the end.
+void send_events_hold(sr_device_t *d, sr_encoder_t *e, uint32_t pos);
+
+#endif /* SR_ENCODE_H */
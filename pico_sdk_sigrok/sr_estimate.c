@@ -0,0 +1,28 @@
+#include "sr_estimate.h"
+
+uint32_t est_rate(const sr_est_bench_t *b, uint32_t usb_bps, bool overlap, uint32_t a_chan_cnt, uint32_t pio_max)
+{
+   uint64_t enc_ps, usb_ps, t_ps, rate;
+   uint32_t hw_max = a_chan_cnt ? EST_ADC_MAX / a_chan_cnt : pio_max;
+   if ((b->samples == 0) || (usb_bps == 0))
+   {
+      return 0;
+   }
+   //Picoseconds per sample for each side
+   enc_ps = (uint64_t)b->enc_us * 1000000 / b->samples;
+   usb_ps = ((uint64_t)b->bytes * 1000000000 / usb_bps) * 1000 / b->samples;
+   if (overlap)
+   {
+      t_ps = (enc_ps > usb_ps) ? enc_ps : usb_ps;
+   }
+   else
+   {
+      t_ps = enc_ps + usb_ps;
+   }
+   if (t_ps == 0)
+   {
+      return hw_max;
+   }
+   rate = 1000000000000ULL * EST_MARGIN_PCT / (t_ps * 100);
+   return (rate > hw_max) ? hw_max : (uint32_t)rate;
+}
@@ -0,0 +1,35 @@
+#ifndef SR_ESTIMATE_H
+#define SR_ESTIMATE_H
+#include <stdint.h>
+#include <stdbool.h>
+
+//Model for the 'e' estimate of the highest sample rate that can be streamed without the
+//DMA ring overflowing.  The device times the encoder on a segment of made up samples and
+//the rate is limited by that time plus the time for USB to drain the encoded bytes, or the
+//larger of the two when encoding runs on its own core.  It has no device dependencies so
+//it can be checked on a host against recorded timings.
+// Samples in the made up segment, and the timed passes over it of which the fastest is used
+#define EST_SAMPLES 4096
+#define EST_REPS 4
+// USB drain rate until one is measured, from the 300-400KB/sec seen on a 12Mbit link
+#define EST_USB_BPS 350000
+// A drain rate is only measured from captures that waited on USB for at least this long
+#define EST_MIN_USB_US 20000
+// Percent of the predicted ceiling that is reported, to leave room for USB hiccups
+#define EST_MARGIN_PCT 80
+// Hardware limit of the ADC.  The PIO limit depends on the clock profile, see clk_pio_max.
+#define EST_ADC_MAX 500000
+
+typedef struct
+{
+   uint32_t samples; // samples encoded
+   uint32_t enc_us;  // time to encode them
+   uint32_t bytes;   // encoded bytes
+} sr_est_bench_t;
+
+// Sample rate that can be sustained for the bench results, USB drain rate in bytes per
+// second, whether encoding overlaps USB, the enabled analog channels (which share the ADC), and
+// the PIO limit of the clock profile.
+uint32_t est_rate(const sr_est_bench_t *b, uint32_t usb_bps, bool overlap, uint32_t a_chan_cnt, uint32_t pio_max);
+
+#endif /* SR_ESTIMATE_H */
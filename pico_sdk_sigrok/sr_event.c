@@ -0,0 +1,42 @@
+#include "sr_event.h"
+#include "hardware/pio_instructions.h"
+
+uint32_t ev_pio_program(uint32_t pins, uint16_t *instr, uint32_t *wrap, uint32_t *entry)
+{
+   uint32_t len = 0;
+   //x is the last pins value, y the current one, and osr the sample count.
+   //Loop, one sample every EV_PIO_CYCLES clocks when nothing changes.
+   instr[len++] = pio_encode_mov(pio_isr, pio_null);             //0: read the pins
+   instr[len++] = pio_encode_in(pio_pins, pins);                 //1
+   instr[len++] = pio_encode_mov(pio_y, pio_isr);                //2
+   instr[len++] = pio_encode_jmp_x_ne_y(11);                     //3: changed goto 11
+   instr[len++] = pio_encode_mov(pio_y, pio_osr);                //4: count the sample
+   instr[len++] = pio_encode_jmp_y_dec(6);                       //5
+   *wrap = len;
+   instr[len++] = pio_encode_mov(pio_osr, pio_y);                //6: wrap to 0
+   //Start, the first sample always counts as a change.  The delay keeps it the same number
+   //of clocks from the in as the loop.
+   *entry = len;
+   instr[len++] = pio_encode_mov_not(pio_osr, pio_null);         //7: count from 0xFFFFFFFF
+   instr[len++] = pio_encode_mov(pio_isr, pio_null);             //8
+   instr[len++] = pio_encode_in(pio_pins, pins);                 //9
+   instr[len++] = pio_encode_mov(pio_y, pio_isr) | pio_encode_delay(1); //10
+   //Changed.  A record is only pushed when the FIFO has room for both of its words, checked
+   //with the mov status set up by EV_FIFO_ROOM.  Otherwise the record is dropped and irq
+   //EV_OVF_IRQ set, so a full FIFO can't stall the program or split a record.
+   instr[len++] = pio_encode_mov(pio_x, pio_y);                  //11
+   instr[len++] = pio_encode_mov(pio_y, pio_status);             //12
+   instr[len++] = pio_encode_jmp_not_y(21);                      //13: no room goto 21
+   instr[len++] = pio_encode_push(false, false);                 //14: the pins still in the isr
+   instr[len++] = pio_encode_mov(pio_isr, pio_osr);              //15
+   instr[len++] = pio_encode_push(false, false);                 //16: the count
+   //Count this sample and the one that the record takes the time of, and go on at 6
+   instr[len++] = pio_encode_mov(pio_y, pio_osr);                //17
+   instr[len++] = pio_encode_jmp_y_dec(19);                      //18
+   instr[len++] = pio_encode_jmp_y_dec(6);                       //19
+   instr[len++] = pio_encode_jmp(6);                             //20: the count wrapped
+   //The delay takes the place of the pushes so the timing doesn't change
+   instr[len++] = pio_encode_irq_set(false, EV_OVF_IRQ) | pio_encode_delay(1); //21
+   instr[len++] = pio_encode_jmp(17);                            //22
+   return len;
+}
@@ -0,0 +1,36 @@
+#ifndef SR_EVENT_H
+#define SR_EVENT_H
+#include <stdint.h>
+#include <stdbool.h>
+
+//Event capture.  Rather than sampling every clock into the DMA ring, a PIO program compares
+//each sample with the last one and only pushes a record when the inputs change, so an idle
+//input costs no DMA bandwidth and no encoding time.  Each record is two words, the pins
+//(lowest pin in bit 0) and a count of the sample it was seen in.  The count starts at
+//0xFFFFFFFF for the first sample and counts down, so ~count is the sample index.
+//The first sample is always pushed so the starting values are known.
+//Each sample takes EV_PIO_CYCLES PIO clocks, and a change takes two samples to push, so the
+//sample after a change isn't compared and a pulse must be at least two samples wide.
+//The pushes don't block, as a stalled program would lose its place in time.  A record that
+//finds the FIFO too full is dropped and sets PIO irq EV_OVF_IRQ, and the capture aborts.
+
+// PIO clocks per sample of the event program
+#define EV_PIO_CYCLES 7
+// Length of the program made by ev_pio_program
+#define EV_PIO_MAX_INSTR 23
+// The program only pushes a record while the joined RX FIFO holds fewer than this many words,
+// the value for sm_config_set_mov_status with STATUS_RX_LESSTHAN
+#define EV_FIFO_ROOM 7
+// PIO irq set when a record is dropped
+#define EV_OVF_IRQ 1
+// Words per event record
+#define EV_REC_WORDS 2
+
+// Build the event PIO program for pins pins from the in_pins base, with the in shift to the
+// left, no autopush and the mov status of EV_FIFO_ROOM.  jmp targets are relative to the
+// start of the program (pio_add_program relocates them).  *wrap is the last instruction of
+// the loop, which wraps to the start, and *entry is where the state machine must start.
+// Returns the number of instructions.
+uint32_t ev_pio_program(uint32_t pins, uint16_t *instr, uint32_t *wrap, uint32_t *entry);
+
+#endif /* SR_EVENT_H */
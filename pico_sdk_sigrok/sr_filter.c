@@ -0,0 +1,162 @@
+#include "sr_filter.h"
+
+void filt_init(sr_filter_t *f, uint32_t decim, uint8_t mode, uint32_t glitch)
+{
+   f->decim = (decim) ? decim : 1;
+   f->mode = mode;
+   f->glitch = glitch;
+   f->lval = 0;
+   f->pend = 0;
+   f->first = true;
+   f->gcnt = 0;
+   f->acc = 0;
+   for (int i = 0; i < 32; i++)
+   {
+      f->stable[i] = 0;
+      f->votes[i] = 0;
+   }
+}
+
+bool filt_active(const sr_filter_t *f)
+{
+   return (f->decim > 1) || (f->glitch > 1);
+}
+
+static inline uint32_t filt_get(const uint8_t *buf, uint32_t i, uint8_t bps)
+{
+   if (bps == 0)
+   {
+      return (buf[i >> 1] >> ((i & 1) * 4)) & 0xF;
+   }
+   else if (bps == 1)
+   {
+      return buf[i];
+   }
+   else if (bps == 2)
+   {
+      return ((const uint16_t *)buf)[i];
+   }
+   return ((const uint32_t *)buf)[i];
+}
+
+//Output index j is never past input index i, and for nibbles only the one nibble is
+//written, so writing in place never overwrites a sample that hasn't been read.
+static inline void filt_put(uint8_t *buf, uint32_t j, uint32_t val, uint8_t bps)
+{
+   if (bps == 0)
+   {
+      uint8_t shift = (j & 1) * 4;
+      buf[j >> 1] = (buf[j >> 1] & ~(0xF << shift)) | (val << shift);
+   }
+   else if (bps == 1)
+   {
+      buf[j] = val;
+   }
+   else if (bps == 2)
+   {
+      ((uint16_t *)buf)[j] = val;
+   }
+   else
+   {
+      ((uint32_t *)buf)[j] = val;
+   }
+}
+
+uint32_t filt_run(sr_filter_t *f, uint8_t *buf, uint32_t n, uint8_t bps)
+{
+   uint32_t j = 0;
+   uint32_t cval;
+   uint32_t width = (bps) ? bps * 8 : 4;
+   for (uint32_t i = 0; i < n; i++)
+   {
+      cval = filt_get(buf, i, bps);
+      if (f->glitch > 1)
+      {
+         if (f->first)
+         {
+            f->lval = cval;
+         }
+         else
+         {
+            //Only the channels that differ from the accepted value are counted, so an idle
+            //sample costs one compare.  A channel that went back has lost its count.
+            uint32_t diff = cval ^ f->lval;
+            uint32_t pend = f->pend & diff;
+            while (diff)
+            {
+               uint32_t b = __builtin_ctz(diff);
+               uint32_t bit = 1u << b;
+               diff &= ~bit;
+               f->stable[b] = (pend & bit) ? f->stable[b] + 1 : 1;
+               if (f->stable[b] >= f->glitch)
+               {
+                  f->lval ^= bit;
+                  pend &= ~bit;
+               }
+               else
+               {
+                  pend |= bit;
+               }
+            }
+            f->pend = pend;
+         }
+         f->first = false;
+         cval = f->lval;
+      }
+      if (f->decim <= 1)
+      {
+         filt_put(buf, j++, cval, bps);
+         continue;
+      }
+      if (f->mode == FILT_OR)
+      {
+         f->acc |= cval;
+      }
+      else if (f->mode == FILT_MAJ)
+      {
+         for (uint32_t b = 0; cval && (b < width); b++, cval >>= 1)
+         {
+            f->votes[b] += cval & 1;
+         }
+      }
+      else
+      {
+         f->acc = cval;
+      }
+      if (++f->gcnt < f->decim)
+      {
+         continue;
+      }
+      if (f->mode == FILT_MAJ)
+      {
+         f->acc = 0;
+         for (uint32_t b = 0; b < width; b++)
+         {
+            if ((f->votes[b] * 2) > f->decim)
+            {
+               f->acc |= 1u << b;
+            }
+            f->votes[b] = 0;
+         }
+      }
+      filt_put(buf, j++, f->acc, bps);
+      f->acc = 0;
+      f->gcnt = 0;
+   }
+   return j;
+}
+
+uint32_t filt_gap(sr_filter_t *f, uint32_t n)
+{
+   uint32_t out = (uint32_t)(((uint64_t)f->gcnt + n) / f->decim);
+   f->gcnt = (uint32_t)(((uint64_t)f->gcnt + n) % f->decim);
+   f->acc = 0;
+   f->pend = 0;
+   f->first = true;
+   for (int i = 0; i < 32; i++)
+   {
+      f->stable[i] = 0;
+      f->votes[i] = 0;
+   }
+   return out;
+}
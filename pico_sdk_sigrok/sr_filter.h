@@ -0,0 +1,51 @@
+#ifndef SR_FILTER_H
+#define SR_FILTER_H
+#include <stdint.h>
+#include <stdbool.h>
+
+//Glitch filter and decimation of digital samples, run in place on a DMA segment before
+//it is passed to the send_slices_* encoders.
+//The glitch filter only accepts a new level on a channel once that channel has held it for
+//glitch samples in a row, so all edges are delayed by glitch-1 samples, and a glitch on one
+//channel doesn't hold back or swallow the edges of the others.
+//Decimation then combines each group of decim samples into one, either by keeping the
+//last sample of the group, by ORing them or by a per channel majority vote.
+//Groups and glitch counts are carried across calls so segments can be any length.
+#define FILT_LAST 1
+#define FILT_OR 2
+#define FILT_MAJ 3
+#define FILT_MAX_DECIM 1000
+#define FILT_MAX_GLITCH 1000
+
+typedef struct
+{
+   uint32_t decim;  // samples per output sample, 1 is off
+   uint8_t mode;    // FILT_LAST, FILT_OR or FILT_MAJ
+   uint32_t glitch; // samples a new value must be stable for, 0 or 1 is off
+   uint32_t lval;   // glitch filter: accepted value
+   uint32_t pend;   // glitch filter: channels that differ from lval, and for how many samples
+   uint16_t stable[32];
+   bool first;      // no samples yet
+   uint32_t gcnt;   // decimation: samples in the current group
+   uint32_t acc;    // decimation: OR of the current group
+   uint16_t votes[32]; // decimation: count of 1s per channel in the current group
+} sr_filter_t;
+
+// Set the configuration and clear all state, i.e. at the start of a capture
+void filt_init(sr_filter_t *f, uint32_t decim, uint8_t mode, uint32_t glitch);
+
+// True if filt_run changes the samples
+bool filt_active(const sr_filter_t *f);
+
+// Filter n samples of buf in place.  bps is the DMA bytes per sample with 0 meaning 4 bit
+// samples packed in nibbles.  Returns the number of samples left at the start of buf.
+uint32_t filt_run(sr_filter_t *f, uint8_t *buf, uint32_t n, uint8_t bps);
+
+// Account for n samples dropped by the lossy continuous mode, which may be 0 after a segment
+// that was filtered and then dropped.  The glitch filter starts over and the current group
+// loses the values it held, as the samples on either side of the drop aren't adjacent.
+// Returns the number of filtered samples the dropped ones stand for, so that the timeline
+// keeps its length.
+uint32_t filt_gap(sr_filter_t *f, uint32_t n);
+
+#endif /* SR_FILTER_H */
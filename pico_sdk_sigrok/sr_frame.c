@@ -0,0 +1,71 @@
+#include <string.h>
+#include "sr_frame.h"
+
+bool frame_layout(sr_frames_t *f, uint32_t buf_size, uint32_t d_nibbles, uint32_t a_nibbles,
+                  uint32_t cap_samples, uint32_t frames, uint32_t max_segs)
+{
+   uint32_t ring_size = (buf_size / FRAME_RING_DIV) & ~3u;
+   if ((frames == 0) || !ring_layout(&f->lay, ring_size, d_nibbles, a_nibbles, 0, false, max_segs))
+   {
+      return false;
+   }
+   f->base = (f->lay.d_size + f->lay.a_size) * f->lay.num_segs;
+   f->frames = frames;
+   f->samples = (cap_samples + 7) & ~7u;
+   //Samples are a multiple of 8 so these are whole bytes, and whole words unless only
+   //4 bit samples are stored
+   f->d_bytes = f->samples * d_nibbles / 2;
+   f->a_bytes = f->samples * a_nibbles / 2;
+   f->slot_size = (FRAME_HDR_SIZE + f->d_bytes + f->a_bytes + 3) & ~3u;
+   return ((uint64_t)f->slot_size * frames) <= (buf_size - f->base);
+}
+
+uint32_t frame_slot(const sr_frames_t *f, uint32_t k)
+{
+   return f->base + k * f->slot_size;
+}
+
+void frame_copy(const sr_frames_t *f, uint8_t *slot, uint32_t fill, const uint8_t *dseg,
+                const uint8_t *aseg, uint32_t from, uint32_t n)
+{
+   //Bytes per 8 samples
+   uint32_t d8 = f->d_bytes / (f->samples / 8);
+   uint32_t a8 = f->a_bytes / (f->samples / 8);
+   if (d8)
+   {
+      memcpy(frame_dbuf(slot) + fill / 8 * d8, dseg + from / 8 * d8, n / 8 * d8);
+   }
+   if (a8)
+   {
+      memcpy(frame_abuf(f, slot) + fill / 8 * a8, aseg + from / 8 * a8, n / 8 * a8);
+   }
+}
+
+void frame_set_start(uint8_t *slot, uint64_t start)
+{
+   memcpy(slot, &start, sizeof(start));
+}
+
+uint64_t frame_start(const uint8_t *slot)
+{
+   uint64_t start;
+   memcpy(&start, slot, sizeof(start));
+   return start;
+}
+
+uint8_t *frame_dbuf(uint8_t *slot)
+{
+   return slot + FRAME_HDR_SIZE;
+}
+
+uint8_t *frame_abuf(const sr_frames_t *f, uint8_t *slot)
+{
+   return slot + FRAME_HDR_SIZE + f->d_bytes;
+}
+
+uint64_t frame_gap(const uint8_t *prev, const uint8_t *slot, uint32_t decim, uint32_t num_samples)
+{
+   uint64_t end = prev ? frame_start(prev) / decim + num_samples : 0;
+   uint64_t start = frame_start(slot) / decim;
+   return (start > end) ? start - end : 0;
+}
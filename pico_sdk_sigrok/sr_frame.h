@@ -0,0 +1,62 @@
+#ifndef SR_FRAME_H
+#define SR_FRAME_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "sr_ring.h"
+
+//Segmented capture from the 'N' command.  A fixed capture with a device trigger is repeated
+//for each of N frames without going back to the host: after each trigger the frame's samples
+//are copied out of the DMA ring into a slot of capture_buf, and the search for the next
+//trigger carries on from the sample after the frame, so the dead time between frames is at
+//most a few samples.  Once every slot is filled they are sent in one transfer.
+//The start of capture_buf is a small DMA ring, as for the 'Z' store, and the rest is split
+//into the slots.  Each slot has a header with the sample index of the frame's first sample,
+//counted in captured samples from the start of the capture, followed by the frame's digital
+//and then analog samples in the same format the DMA writes them.
+//Frames start on a multiple of 8 samples and hold a multiple of 8, so that the D4 nibbles and
+//the 32 bit words the PIO writes are never split.
+
+// The DMA ring is 1/FRAME_RING_DIV of the buffer
+#define FRAME_RING_DIV 4
+// Bytes at the start of each slot for the frame's first sample index
+#define FRAME_HDR_SIZE 8
+
+typedef struct
+{
+   sr_layout_t lay;         // DMA ring at the start of the buffer
+   uint32_t base;           // offset of the first slot, after the ring
+   uint32_t frames;         // number of slots
+   uint32_t samples;        // captured samples per frame
+   uint32_t d_bytes, a_bytes; // bytes of digital and analog samples per frame
+   uint32_t slot_size;      // bytes per slot including the header
+} sr_frames_t;
+
+// Divide buf_size bytes into the DMA ring and frames slots of cap_samples samples with
+// d_nibbles of digital and a_nibbles of analog data per sample.  Returns false if the
+// ring can't be made or the slots don't fit.
+bool frame_layout(sr_frames_t *f, uint32_t buf_size, uint32_t d_nibbles, uint32_t a_nibbles,
+                  uint32_t cap_samples, uint32_t frames, uint32_t max_segs);
+
+// Offset in the buffer of slot k
+uint32_t frame_slot(const sr_frames_t *f, uint32_t k);
+
+// Copy n samples starting at sample from of a DMA segment, whose digital and analog samples
+// are dseg and aseg, to sample fill of slot.  from, n and fill are multiples of 8.
+void frame_copy(const sr_frames_t *f, uint8_t *slot, uint32_t fill, const uint8_t *dseg,
+                const uint8_t *aseg, uint32_t from, uint32_t n);
+
+// Set and get the index of the first sample of the frame in slot
+void frame_set_start(uint8_t *slot, uint64_t start);
+uint64_t frame_start(const uint8_t *slot);
+
+// Digital samples of the frame in slot, which follow the header
+uint8_t *frame_dbuf(uint8_t *slot);
+// Analog samples of the frame in slot, which follow the digital ones
+uint8_t *frame_abuf(const sr_frames_t *f, uint8_t *slot);
+
+// Sent samples between the end of the frame before slot (prev, or NULL for the first frame)
+// and its start, where each sent sample is decim captured ones and a frame is num_samples
+// sent samples.  This is the gap sent before the frame.
+uint64_t frame_gap(const uint8_t *prev, const uint8_t *slot, uint32_t decim, uint32_t num_samples);
+
+#endif /* SR_FRAME_H */
@@ -0,0 +1,186 @@
+#include <string.h>
+#include "sr_plan.h"
+#include "hardware/pio_instructions.h"
+
+void plan_key(sr_plan_key_t *key, const sr_device_t *d, const sr_clk_t *boot)
+{
+   //memset so that the padding compares equal as well
+   memset(key, 0, sizeof(*key));
+   //Sample rate must always be even.  Pulseview code enforces this
+   //because it specifies a fixed set of frequencies, but sigrok cli can still odd ones.
+   key->sample_rate = d->sample_rate & ~1u;
+   //Adjust up and align to 4 to avoid rounding errors etc
+   key->num_samples = (d->num_samples < 16) ? 16 : d->num_samples;
+   key->num_samples = (key->num_samples + 3) & 0xFFFFFFFC;
+   key->d_mask = d->d_mask;
+   key->a_mask = d->a_mask;
+   key->decim = d->decim;
+   key->glitch = d->glitch;
+   key->lvl0mask = d->trig.lvl0mask;
+   key->lvl1mask = d->trig.lvl1mask;
+   key->risemask = d->trig.risemask;
+   key->fallmask = d->trig.fallmask;
+   key->chgmask = d->trig.chgmask;
+   key->buf_size = d->buf_size;
+   key->sys_hz = boot->sys_hz;
+   key->frames = d->frames;
+   key->clk_profile = d->clk_profile;
+   key->cont = d->cont;
+   key->events = d->events;
+   key->adc12 = d->adc12;
+}
+
+bool plan_update(sr_plan_t *p, sr_device_t *d, const sr_clk_t *boot)
+{
+   sr_plan_key_t key;
+   const sr_clk_profile_t *prof;
+   uint32_t max_hz;
+   chan_counts(d);
+   plan_key(&key, d, boot);
+   if (p->valid && (memcmp(&key, &p->key, sizeof(key)) == 0))
+   {
+      return false;
+   }
+   p->key = key;
+   p->valid = true;
+   p->gen++;
+   p->sample_rate = key.sample_rate;
+   p->num_samples = key.num_samples;
+   //The boot clock keeps its old PIO limit, the other profiles can run the PIO at their
+   //fastest clk_sys
+   prof = &clk_profiles[(key.clk_profile < CLK_PROFILES) ? key.clk_profile : 0];
+   max_hz = clk_pio_max(key.clk_profile);
+   //Decimation only applies to digital only captures, and the PIO can't sample faster
+   //than the system clock.  From here num_samples is in sent samples, and the DMA
+   //counts are in captured samples.
+   p->decim = (d->a_chan_cnt) ? 1 : key.decim;
+   if (p->sample_rate && (p->decim > (max_hz / p->sample_rate)))
+   {
+      p->decim = max_hz / p->sample_rate;
+   }
+   if (p->decim < 1)
+   {
+      p->decim = 1;
+   }
+   p->cap_samples = p->num_samples * p->decim;
+   //Triggers only apply to digital channels
+   p->triggered = (key.d_mask == 0) || !trig_enabled(&(d->trig));
+   //Event captures need the sample filter off and no device trigger, and a rate the
+   //event PIO program can reach.  Other captures sample every clock, which the host
+   //decodes the same way.
+   p->ev_run = key.events && key.d_mask && (d->a_chan_cnt == 0) && p->triggered && (p->decim == 1)
+               && (key.glitch == 0)
+               && (((uint64_t)p->sample_rate * EV_PIO_CYCLES) <= ((prof->max_hz) ? prof->max_hz : boot->sys_hz));
+   //Divide capture buf evenly based on channel enables
+   //Calculate relative size in terms of nibbles which is the smallest unit, thus a_chan_cnt is multiplied by 2
+   //Nibble size storage is only allow for D4 mode with no analog channels enabled
+   //For instance a D0..D5 with A0 would give 1/2 the storage to digital and 1/2 to analog
+   p->d_nibbles = d->d_nps;
+   //Event captures store records rather than samples, and always use the ring
+   if (p->ev_run)
+   {
+      p->d_nibbles = EV_REC_WORDS * 8;
+   }
+   //1 byte per sample, or 2 for the 12 bit ADC mode
+   p->a_nibbles = d->a_chan_cnt * (key.adc12 ? 4 : 2);
+   //A fixed capture without a device trigger is reduced to the samples it needs, and only
+   //fills the buffer once if they fit.  Continuous captures and those waiting for a device
+   //trigger use the buffer as a ring.
+   p->lay_ok = ring_layout(&p->lay, key.buf_size, p->d_nibbles, p->a_nibbles, p->cap_samples,
+                           (key.cont == false) && p->triggered && !p->ev_run, DMA_SEGMENTS);
+   //A segmented capture needs a fixed capture that waits for a device trigger, and the
+   //buffer is split between a smaller ring and the frames
+   p->fr_run = key.frames && (key.cont == false) && !p->triggered;
+   if (p->fr_run)
+   {
+      p->lay_ok = frame_layout(&p->fr, key.buf_size, p->d_nibbles, p->a_nibbles, p->cap_samples,
+                               key.frames, DMA_SEGMENTS);
+      p->lay = p->fr.lay;
+   }
+   //Pin count is kept to 4, 8, 16 or 32 so that a sample is always read with a single
+   //byte/word/dword read.  If 4 or less channels are enabled but ADC is also enabled, set a
+   //minimum size of 1B of PIO storage.
+   p->pin_count = 0;
+   if (key.d_mask & 0x0000000F) p->pin_count += 4;
+   if (key.d_mask & 0x000000F0) p->pin_count += 4;
+   if (key.d_mask & 0x0000FF00) p->pin_count += 8;
+   if (key.d_mask & 0x0FFF0000) p->pin_count += 16;
+   if ((p->pin_count == 4) && (d->a_chan_cnt)) p->pin_count = 8;
+   p->wrap = 0;
+   p->entry = 0;
+   p->prog_len = 0;
+   p->pio_rate = p->sample_rate * p->decim;
+   if (p->ev_run)
+   {
+      //The event program only reads up to the highest enabled channel
+      uint32_t ev_pins = 32 - __builtin_clz(key.d_mask);
+      #ifdef DIG_26_MODE
+      //Channels 23 and up are on GPIO26-28
+      if (ev_pins > 23) ev_pins += 3;
+      #endif
+      p->prog_len = ev_pio_program(ev_pins, p->prog, &p->wrap, &p->entry);
+      //The event program takes EV_PIO_CYCLES clocks for each sample
+      p->pio_rate *= EV_PIO_CYCLES;
+   }
+   else if (key.d_mask)
+   {
+      p->prog[0] = pio_encode_in(pio_pins, p->pin_count);
+      p->prog_len = 1;
+   }
+   //Profile 0 keeps the boot clock, the others pick the PLL settings for this PIO clock
+   if (prof->max_hz)
+   {
+      clk_solve(&p->clk, prof, p->pio_rate);
+   }
+   else
+   {
+      p->clk = *boot;
+   }
+   //Unlike the ADC, the PIO int divisor does not have to subtract 1.
+   //Frequency=sysclkfreq/(CLKDIV_INT+CLKDIV_FRAC/256)
+   p->div_int = 1;
+   p->div_frac = 0;
+   if (p->pio_rate)
+   {
+      p->div_int = (uint16_t)(p->clk.sys_hz / p->pio_rate);
+      if (p->div_int < 1) p->div_int = 1;
+      p->div_frac = (uint8_t)((((uint64_t)(p->clk.sys_hz % p->pio_rate)) * 256ULL) / p->pio_rate);
+      //Rates above clk_sys run at clk_sys
+      if (p->pio_rate > p->clk.sys_hz) p->div_frac = 0;
+   }
+   //The ADC divisor has some not well documented limitations.
+   //-A value of 0 actually creates a 500khz sample clock.
+   //-Values below 96 are clamped to 96 because a conversion takes a minimum of 96 cycles.
+   //It is also import to subtract one from the desired divisor
+   //because the period of ADC clock is 1+INT+FRAC/256
+   //Fractional divisors should generally be avoided because it creates
+   //skew with digital samples.
+   p->adc_div = 0;
+   if (d->a_chan_cnt && p->sample_rate)
+   {
+      uint32_t adcdivint = 48000000ULL / (p->sample_rate * d->a_chan_cnt);
+      uint8_t adc_frac_int = (uint8_t)(((48000000ULL % p->sample_rate) * 256ULL) / p->sample_rate);
+      if (adcdivint > 96)
+      {
+         p->adc_div = ((adcdivint - 1) << 8) | adc_frac_int;
+      }
+   }
+   //The sent sample rate is the PIO clock over the PIO clocks per sent sample, or for analog
+   //only captures the ADC rate shared by the channels
+   p->rate = 0;
+   if (p->pio_rate)
+   {
+      p->rate = clk_rate(p->clk.sys_hz, p->div_int, p->div_frac) / (p->pio_rate / p->sample_rate);
+   }
+   else if (d->a_chan_cnt)
+   {
+      p->rate = ((p->adc_div) ? clk_rate(48000000, (p->adc_div >> 8) + 1, p->adc_div & 0xFF) : 500000) / d->a_chan_cnt;
+   }
+   p->trig_len = 0;
+   p->trig_jmp_pin = 0;
+   if (!p->triggered)
+   {
+      p->trig_len = trig_pio_program(&(d->trig), p->trig_prog, &p->trig_jmp_pin);
+   }
+   return true;
+}
@@ -0,0 +1,71 @@
+#ifndef SR_PLAN_H
+#define SR_PLAN_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "sr_device.h"
+#include "sr_ring.h"
+#include "sr_event.h"
+#include "sr_trigger.h"
+#include "sr_frame.h"
+#include "sr_clock.h"
+
+//Capture plan.  Everything about a capture that only depends on the configuration, i.e. the
+//PIO programs, clock dividers and DMA ring layout, is worked out when the configuration
+//changes rather than when the capture starts, so that an 'F', 'C' or 'r' only has to load
+//the registers.  The plan keeps the configuration it was made from in key, and plan_update
+//only makes a new one when that differs.
+//The spool and store decisions, and anything else that depends on the state of the device
+//rather than its configuration, are still made at the start of the capture.
+
+//The configuration a plan is made from.  The rate and sample count are already rounded the
+//way the capture uses them, so that the rounding done at the start doesn't change the key.
+typedef struct
+{
+   uint32_t sample_rate, num_samples;
+   uint32_t d_mask, a_mask;
+   uint32_t decim, glitch;
+   uint32_t lvl0mask, lvl1mask, risemask, fallmask, chgmask;
+   uint32_t buf_size;
+   uint32_t sys_hz;
+   uint32_t frames;
+   uint32_t clk_profile;
+   bool cont, events, adc12;
+} sr_plan_key_t;
+
+typedef struct
+{
+   sr_plan_key_t key;
+   bool valid;             // key holds the configuration of this plan
+   uint32_t gen;           // incremented by each new plan, so a user can tell it changed
+   uint32_t sample_rate;   // even sample rate
+   uint32_t num_samples;   // sent samples, at least 16 and a multiple of 4
+   uint32_t decim;         // decimation, limited so the PIO doesn't need more than the clock profile allows
+   uint32_t cap_samples;   // samples the PIO captures
+   bool triggered;         // no device trigger conditions apply
+   bool ev_run;            // the capture uses the event PIO program, see sr_event.h
+   uint32_t d_nibbles, a_nibbles;
+   bool fr_run;            // the capture fills the frames of a segmented capture, see sr_frame.h
+   sr_frames_t fr;         // frame slots, and the ring in fr.lay
+   sr_layout_t lay;        // DMA ring layout
+   bool lay_ok;            // ring_layout succeeded, or frame_layout for a segmented capture
+   uint8_t pin_count;      // pins read by the capture program, 4, 8, 16 or 32
+   uint16_t prog[EV_PIO_MAX_INSTR]; // capture program
+   uint32_t prog_len, wrap, entry;  // wrap and entry are relative to the start of prog
+   uint32_t pio_rate;      // PIO clock
+   sr_clk_t clk;           // system clock for the capture, see sr_clock.h
+   uint16_t div_int;       // PIO clock divider of clk.sys_hz
+   uint8_t div_frac;
+   uint32_t adc_div;       // ADC DIV register value, 0 if the rate is too fast for the ADC
+   uint32_t rate;          // sample rate the dividers give, which 'k' reports
+   uint16_t trig_prog[TRIG_PIO_MAX_INSTR]; // trigger program, see TRIG_PIO_EN
+   uint32_t trig_len, trig_jmp_pin;
+} sr_plan_t;
+
+// Fill key from the configuration of d, with the clock the device booted with
+void plan_key(sr_plan_key_t *key, const sr_device_t *d, const sr_clk_t *boot);
+
+// Make a new plan if the configuration of d differs from the one p was made from.
+// Also updates the channel counts of d.  Returns true if a new plan was made.
+bool plan_update(sr_plan_t *p, sr_device_t *d, const sr_clk_t *boot);
+
+#endif /* SR_PLAN_H */
@@ -0,0 +1,97 @@
+#include "sr_ring.h"
+
+uint32_t seg_index(uint32_t seg_cnt, uint32_t num_segs)
+{
+   return seg_cnt & (num_segs - 1);
+}
+
+bool seg_overflow(uint32_t dma_segs, uint32_t sent_segs, uint32_t num_segs)
+{
+   //The segment at dma_segs is being written, and the one at sent_segs is being sent.
+   //Once they are num_segs apart they are the same segment.
+   return (dma_segs - sent_segs) > (num_segs - 1);
+}
+
+uint32_t seg_count(uint32_t buff_chunks, uint32_t max_segs, bool single_pass)
+{
+   uint32_t num_segs = single_pass ? 2 : max_segs;
+   //Every segment must hold at least one whole chunk
+   while ((num_segs > 2) && (buff_chunks < num_segs))
+   {
+      num_segs >>= 1;
+   }
+   return num_segs;
+}
+
+void seg_addr_table(uint32_t *tbl0, uint32_t *tbl1, uint32_t base, uint32_t seg_size, uint32_t num_segs)
+{
+   for (uint32_t i = 0; i < num_segs / 2; i++)
+   {
+      tbl0[i] = base + seg_size * seg_index(2 * i + 2, num_segs);
+      tbl1[i] = base + seg_size * seg_index(2 * i + 3, num_segs);
+   }
+}
+
+uint32_t seg_ring_bits(uint32_t num_segs)
+{
+   uint32_t bits = 0;
+   //num_segs/2 entries of 4 bytes
+   while ((1u << bits) < (num_segs * 2))
+   {
+      bits++;
+   }
+   return bits;
+}
+
+bool ring_layout(sr_layout_t *l, uint32_t buf_size, uint32_t d_nibbles, uint32_t a_nibbles,
+                 uint32_t cap_samples, bool fixed, uint32_t max_segs)
+{
+   uint32_t t_nibbles = d_nibbles + a_nibbles;
+   uint32_t chunks_needed;
+   if (t_nibbles == 0)
+   {
+      return false;
+   }
+   //The chunk must be a multiple of a_nibbles*2, d_nibbles*8, and t_nibbles so that
+   //division is always in whole samples.
+   //Also a multiple of 32 because the dma buffer is split into segments, and
+   //the PIO does writes on 4B boundaries, and then a 4x factor for any other size/alignment issues
+   l->chunk_size = t_nibbles * 32;
+   if (a_nibbles)
+   {
+      l->chunk_size *= a_nibbles;
+   }
+   if (d_nibbles)
+   {
+      l->chunk_size *= d_nibbles;
+   }
+   if (d_nibbles)
+   {
+      l->chunk_samples = (l->chunk_size * d_nibbles / t_nibbles) * 2 / d_nibbles;
+   }
+   else
+   {
+      l->chunk_samples = (l->chunk_size * 2) / a_nibbles;
+   }
+   //Total chunks in the entire buffer, rounded to 2 since it is split into at least two segments
+   l->buff_chunks = (buf_size / l->chunk_size) & 0xFFFFFFFE;
+   if (l->buff_chunks < 2)
+   {
+      return false;
+   }
+   chunks_needed = ((cap_samples / l->chunk_samples) + 2) & 0xFFFFFFFE;
+   //If the requested samples are smaller than the buffer, reduce the size so that the
+   //transfer completes sooner, and only fill it once.
+   l->single_pass = false;
+   if (fixed && (l->buff_chunks > chunks_needed))
+   {
+      l->single_pass = true;
+      l->buff_chunks = chunks_needed;
+   }
+   l->num_segs = seg_count(l->buff_chunks, max_segs, l->single_pass);
+   l->buff_chunks -= l->buff_chunks % l->num_segs;
+   l->d_size = (l->buff_chunks * l->chunk_size * d_nibbles) / (t_nibbles * l->num_segs);
+   l->a_size = (l->buff_chunks * l->chunk_size * a_nibbles) / (t_nibbles * l->num_segs);
+   l->samples_per_half = l->chunk_samples * l->buff_chunks / l->num_segs;
+   return true;
+}
@@ -0,0 +1,50 @@
+#ifndef SR_RING_H
+#define SR_RING_H
+#include <stdint.h>
+#include <stdbool.h>
+
+//Bookkeeping for the ring of DMA segments that capture_buf is split into.
+//The PIO and ADC DMA engines fill segments 0..num_segs-1 in order and then wrap, while
+//send_half drains them in the same order.  Even segments are written by DMA channel 0
+//and odd segments by channel 1, and each channel has a maintenance DMA that walks a table
+//of write addresses so that the channels can leap frog each other around the ring.
+//The counts of filled and sent segments (dma_halves and num_halves) only ever increase,
+//so a segment index is always its count modulo num_segs, which must be a power of 2.
+
+// Segment index of the n'th filled or sent segment
+uint32_t seg_index(uint32_t seg_cnt, uint32_t num_segs);
+
+// True if the DMA has filled so many segments that it is writing into one that hasn't been sent
+bool seg_overflow(uint32_t dma_segs, uint32_t sent_segs, uint32_t num_segs);
+
+// Number of segments to split buff_chunks into, a power of 2 from 2 to max_segs.
+// The buffer is only split in half when it is used once rather than as a ring.
+uint32_t seg_count(uint32_t buff_chunks, uint32_t max_segs, bool single_pass);
+
+// Fill the write address tables read by the two maintenance DMAs.  Each table has
+// num_segs/2 entries, starting with the 2nd segment written by its channel since
+// the channel's first segment is programmed directly.
+void seg_addr_table(uint32_t *tbl0, uint32_t *tbl1, uint32_t base, uint32_t seg_size, uint32_t num_segs);
+
+// Size in bytes of one address table as a power of 2, as used for the DMA read ring
+uint32_t seg_ring_bits(uint32_t num_segs);
+
+//How the capture buffer is divided for one capture
+typedef struct
+{
+   uint32_t chunk_size;       // bytes in the smallest unit that holds whole samples of all channels
+   uint32_t chunk_samples;    // samples in one chunk
+   uint32_t buff_chunks;      // chunks used in the whole buffer
+   uint32_t num_segs;         // segments in the DMA ring
+   uint32_t d_size, a_size;   // bytes of digital and analog samples in each segment
+   uint32_t samples_per_half; // samples in each segment
+   bool single_pass;          // the samples fit so the buffer is only filled once
+} sr_layout_t;
+
+// Divide buf_size bytes between d_nibbles of digital and a_nibbles of analog data per sample.
+// With fixed set the buffer is reduced to what cap_samples needs and only filled once when
+// they fit.  Returns false if no channels are enabled or the buffer can't hold two chunks.
+bool ring_layout(sr_layout_t *l, uint32_t buf_size, uint32_t d_nibbles, uint32_t a_nibbles,
+                 uint32_t cap_samples, bool fixed, uint32_t max_segs);
+
+#endif /* SR_RING_H */
@@ -0,0 +1,107 @@
+#include "sr_spool.h"
+
+#include <string.h>
+
+void spool_init(sr_spool_t *s, const sr_flash_t *flash, uint32_t base, uint32_t size)
+{
+   uint32_t start = (base + SPOOL_SECTOR - 1) & ~(SPOOL_SECTOR - 1);
+   s->flash = flash;
+   s->base = start;
+   s->size = (size > (start - base)) ? (size - (start - base)) & ~(SPOOL_SECTOR - 1) : 0;
+   s->erased = 0;
+   s->len = 0;
+   s->blocks = 0;
+   s->full = false;
+}
+
+uint32_t spool_erase(sr_spool_t *s, uint32_t bytes)
+{
+   uint32_t cnt;
+   if (bytes > s->size)
+   {
+      bytes = s->size;
+   }
+   while (s->erased < bytes)
+   {
+      //Sectors up to the next chunk boundary, then whole chunks
+      cnt = SPOOL_ERASE_CHUNK - ((s->base + s->erased) & (SPOOL_ERASE_CHUNK - 1));
+      if (cnt > (s->size - s->erased))
+      {
+         cnt = s->size - s->erased;
+      }
+      s->flash->erase(s->base + s->erased, cnt);
+      s->erased += cnt;
+   }
+   return s->erased;
+}
+
+//Program the staged page, which spool_write has kept inside the erased part
+static void spool_page(sr_spool_t *s, uint32_t offset)
+{
+   s->flash->program(s->base + offset, s->page, SPOOL_PAGE);
+}
+
+bool spool_write(sr_spool_t *s, const uint8_t *buf, uint32_t n)
+{
+   uint32_t pidx, cnt;
+   if (s->full || ((s->erased - s->len) < n))
+   {
+      s->full = true;
+      return false;
+   }
+   while (n)
+   {
+      pidx = s->len & (SPOOL_PAGE - 1);
+      cnt = SPOOL_PAGE - pidx;
+      if (cnt > n)
+      {
+         cnt = n;
+      }
+      memcpy(&(s->page[pidx]), buf, cnt);
+      s->len += cnt;
+      buf += cnt;
+      n -= cnt;
+      if ((s->len & (SPOOL_PAGE - 1)) == 0)
+      {
+         spool_page(s, s->len - SPOOL_PAGE);
+      }
+   }
+   return true;
+}
+
+void spool_end_block(sr_spool_t *s)
+{
+   //Skip empty blocks, and merge into the last block once the index is full
+   if (s->len == (s->blocks ? s->index[s->blocks - 1] : 0))
+   {
+      return;
+   }
+   if (s->blocks < SPOOL_MAX_BLOCKS)
+   {
+      s->blocks++;
+   }
+   s->index[s->blocks - 1] = s->len;
+}
+
+void spool_close(sr_spool_t *s)
+{
+   uint32_t pidx = s->len & (SPOOL_PAGE - 1);
+   spool_end_block(s);
+   if (pidx)
+   {
+      memset(&(s->page[pidx]), 0xFF, SPOOL_PAGE - pidx);
+      spool_page(s, s->len - pidx);
+   }
+}
+
+const uint8_t *spool_block(sr_spool_t *s, uint32_t i, uint32_t *n)
+{
+   uint32_t start;
+   if (i >= s->blocks)
+   {
+      return 0;
+   }
+   start = i ? s->index[i - 1] : 0;
+   *n = s->index[i] - start;
+   return s->flash->map(s->base + start);
+}
@@ -0,0 +1,64 @@
+#ifndef SR_SPOOL_H
+#define SR_SPOOL_H
+#include <stdint.h>
+#include <stdbool.h>
+
+//Spool of encoded sample data in the flash behind the firmware image, used by the deep
+//fixed captures that don't fit in capture_buf.  The encoders write the same bytes they would
+//send to USB, one block per segment, and once the capture is done the blocks are read back
+//and sent.  Flash can only be programmed in pages after it was erased in sectors, so
+//bytes are staged in a page buffer.  All erases are done by spool_erase before the capture
+//starts, since an erase holds the interrupts off for longer than a segment may take to fill,
+//and a capture that outgrows the erased part of the region is full.
+//All flash accesses go through sr_flash_t so that the spool can be run against a mock, or
+//against the end of the capture buffer for the 'Z' compressed store.
+#define SPOOL_PAGE 256
+#define SPOOL_SECTOR 4096
+// Erases done by spool_erase, the flash erases aligned 64KB blocks much faster than sectors
+#define SPOOL_ERASE_CHUNK 65536
+// Blocks tracked in the index, later blocks are merged into the last one
+#define SPOOL_MAX_BLOCKS 512
+
+typedef struct
+{
+   // offset and count are multiples of SPOOL_SECTOR
+   void (*erase)(uint32_t offset, uint32_t count);
+   // offset is a multiple of SPOOL_PAGE and count is SPOOL_PAGE
+   void (*program)(uint32_t offset, const uint8_t *data, uint32_t count);
+   // readable pointer to the data at offset
+   const uint8_t *(*map)(uint32_t offset);
+} sr_flash_t;
+
+typedef struct
+{
+   const sr_flash_t *flash;
+   uint32_t base, size; // spool region, both multiples of SPOOL_SECTOR
+   uint32_t erased;     // bytes erased from the start of the region
+   uint32_t len;        // bytes written, including those still in page
+   uint8_t page[SPOOL_PAGE];
+   uint32_t blocks;     // entries used in index
+   uint32_t index[SPOOL_MAX_BLOCKS]; // end of each block
+   bool full;           // a write didn't fit in the region
+} sr_spool_t;
+
+// Setup an empty spool in size bytes of flash at base.  The region is trimmed to whole sectors.
+void spool_init(sr_spool_t *s, const sr_flash_t *flash, uint32_t base, uint32_t size);
+
+// Erase enough of the region for bytes of data, limited to the region size.  Only the
+// erased part can be written.  Returns the bytes erased so far.
+uint32_t spool_erase(sr_spool_t *s, uint32_t bytes);
+
+// Add n bytes to the current block.  Returns false, and sets full, if they don't fit in
+// the erased part of the region.
+bool spool_write(sr_spool_t *s, const uint8_t *buf, uint32_t n);
+
+// End the current block
+void spool_end_block(sr_spool_t *s);
+
+// Program the last partial page so that all written bytes can be read
+void spool_close(sr_spool_t *s);
+
+// Return block i and its length in n, or NULL if there is no such block
+const uint8_t *spool_block(sr_spool_t *s, uint32_t i, uint32_t *n);
+
+#endif /* SR_SPOOL_H */
@@ -0,0 +1,56 @@
+#include "sr_spsc.h"
+
+#include <string.h>
+
+//__sync_synchronize is a full memory barrier (a dmb on the cortex M cores).  It orders
+//the block data against the head/tail update that hands the block to the other core.
+void spsc_init(sr_spsc_t *q)
+{
+   q->head = 0;
+   q->tail = 0;
+}
+
+bool spsc_push(sr_spsc_t *q, const uint8_t *buf, uint16_t length)
+{
+   uint32_t head = q->head;
+   if ((head - q->tail) >= SPSC_BLOCKS)
+   {
+      return false;
+   }
+   uint32_t idx = head & (SPSC_BLOCKS - 1);
+   if (length > SPSC_BLOCK_SIZE)
+   {
+      length = SPSC_BLOCK_SIZE;
+   }
+   memcpy(q->data[idx], buf, length);
+   q->len[idx] = length;
+   __sync_synchronize();
+   q->head = head + 1;
+   return true;
+}
+
+uint8_t *spsc_front(sr_spsc_t *q, uint16_t *length)
+{
+   uint32_t tail = q->tail;
+   if (q->head == tail)
+   {
+      return 0;
+   }
+   //Don't read the block until we know the head update that published it was seen
+   __sync_synchronize();
+   uint32_t idx = tail & (SPSC_BLOCKS - 1);
+   *length = q->len[idx];
+   return q->data[idx];
+}
+
+void spsc_pop(sr_spsc_t *q)
+{
+   //Finish reading the block before handing it back to the producer
+   __sync_synchronize();
+   q->tail = q->tail + 1;
+}
+
+uint32_t spsc_count(sr_spsc_t *q)
+{
+   return q->head - q->tail;
+}
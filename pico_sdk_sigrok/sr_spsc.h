@@ -0,0 +1,41 @@
+#ifndef SR_SPSC_H
+#define SR_SPSC_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "sr_device.h"
+
+//Lock free single producer, single consumer queue of encoded sample blocks.
+//In DUAL_CORE_EN mode core1 runs the send_slices_* encoders and pushes the blocks
+//they produce, while core0 pops them and writes them to USB.
+//Only the producer writes head and only the consumer writes tail, so no locks are needed
+//as long as the block data is visible before the index update that publishes it.
+//SPSC_BLOCKS must be a power of 2.
+#define SPSC_BLOCKS 16
+#define SPSC_BLOCK_SIZE TX_BUF_SIZE
+
+typedef struct
+{
+   uint8_t data[SPSC_BLOCKS][SPSC_BLOCK_SIZE];
+   uint16_t len[SPSC_BLOCKS];
+   volatile uint32_t head; // number of blocks pushed, only written by the producer
+   volatile uint32_t tail; // number of blocks popped, only written by the consumer
+} sr_spsc_t;
+
+// Empty the queue, only safe when neither core is using it
+void spsc_init(sr_spsc_t *q);
+
+// Producer: copy length bytes into the next free block.
+// Returns false without copying if the queue is full.
+bool spsc_push(sr_spsc_t *q, const uint8_t *buf, uint16_t length);
+
+// Consumer: return the oldest block and its length, or NULL if the queue is empty.
+// The block stays valid until spsc_pop is called.
+uint8_t *spsc_front(sr_spsc_t *q, uint16_t *length);
+
+// Consumer: release the block returned by spsc_front
+void spsc_pop(sr_spsc_t *q);
+
+// Consumer: number of blocks waiting
+uint32_t spsc_count(sr_spsc_t *q);
+
+#endif /* SR_SPSC_H */
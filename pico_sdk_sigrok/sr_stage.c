@@ -0,0 +1,55 @@
+#include "sr_stage.h"
+
+#include <string.h>
+
+void stage_init(sr_stage_t *s, uint8_t *buf, uint32_t size, sr_sink_fn out)
+{
+   s->buf = buf;
+   s->size = size;
+   s->len = 0;
+   s->mark = 0;
+   s->bytecnt = 0;
+   s->over = false;
+   s->out = out;
+}
+
+void stage_write(sr_stage_t *s, const char *buf, int length)
+{
+   //Once a segment doesn't fit the rest of it is thrown away, it is dropped as a whole
+   if (s->over || ((s->size - s->len) < (uint32_t)length))
+   {
+      s->over = true;
+      return;
+   }
+   memcpy(&(s->buf[s->len]), buf, length);
+   s->len += length;
+}
+
+void stage_begin(sr_stage_t *s, const sr_encoder_t *e)
+{
+   s->mark = s->len;
+   s->bytecnt = e->bytecnt;
+   s->over = false;
+}
+
+void stage_drop(sr_stage_t *s, sr_encoder_t *e, uint32_t n)
+{
+   //Any gap staged before the segment is kept
+   s->len = s->mark;
+   s->over = false;
+   e->bytecnt = s->bytecnt;
+   if (n)
+   {
+      send_gap(e, n);
+   }
+}
+
+void stage_send(sr_stage_t *s)
+{
+   if (s->len)
+   {
+      s->out((const char *)s->buf, s->len);
+   }
+   s->len = 0;
+   s->mark = 0;
+}
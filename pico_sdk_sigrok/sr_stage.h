@@ -0,0 +1,40 @@
+#ifndef SR_STAGE_H
+#define SR_STAGE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "sr_encode.h"
+
+//Staging of the encoded segments of the lossy continuous mode.  Each segment is encoded into
+//a buffer rather than straight to USB, and is only sent once it is known to be whole.  If the
+//DMA overwrote the segment while it was encoded, or its encoding didn't fit, it is replaced
+//with a gap marker for the samples it held.  A USB stall then only delays whole segments,
+//and the ones that send_half skips while it waits are sent as gaps too, so the capture never
+//has to abort.
+typedef struct
+{
+   uint8_t *buf;
+   uint32_t size;
+   uint32_t len;     // bytes staged
+   uint32_t mark;    // len at the start of the segment
+   uint32_t bytecnt; // encoder bytecnt at the start of the segment
+   bool over;        // the segment didn't fit
+   sr_sink_fn out;   // where the staged bytes are sent
+} sr_stage_t;
+
+// Setup an empty stage of size bytes at buf, sending to out
+void stage_init(sr_stage_t *s, uint8_t *buf, uint32_t size, sr_sink_fn out);
+
+// Add length encoded bytes, the body of the encoders' sink
+void stage_write(sr_stage_t *s, const char *buf, int length);
+
+// Start a segment encoded by e
+void stage_begin(sr_stage_t *s, const sr_encoder_t *e);
+
+// Replace the segment since stage_begin with a gap of n samples.  The encoders' sink must
+// be the stage.
+void stage_drop(sr_stage_t *s, sr_encoder_t *e, uint32_t n);
+
+// Send the staged bytes to out and empty the stage
+void stage_send(sr_stage_t *s);
+
+#endif /* SR_STAGE_H */
@@ -0,0 +1,177 @@
+#include "sr_trigger.h"
+#include "sr_device.h"
+#include "hardware/pio_instructions.h"
+
+void trig_reset(sr_trig_t *t)
+{
+   t->lvl0mask = 0;
+   t->lvl1mask = 0;
+   t->risemask = 0;
+   t->fallmask = 0;
+   t->chgmask = 0;
+   trig_arm(t);
+}
+
+bool trig_add(sr_trig_t *t, uint32_t type, uint32_t chan)
+{
+   if (chan >= NUM_D_CHAN)
+   {
+      return false;
+   }
+   switch (type)
+   {
+   case 0: t->lvl0mask |= 1u << chan; break;
+   case 1: t->lvl1mask |= 1u << chan; break;
+   case 2: t->risemask |= 1u << chan; break;
+   case 3: t->fallmask |= 1u << chan; break;
+   case 4: t->chgmask |= 1u << chan; break;
+   default: return false;
+   }
+   return true;
+}
+
+bool trig_enabled(const sr_trig_t *t)
+{
+   return (t->lvl0mask | t->lvl1mask | t->risemask | t->fallmask | t->chgmask) != 0;
+}
+
+void trig_arm(sr_trig_t *t)
+{
+   t->lval = 0;
+   t->first = true;
+}
+
+bool trig_match(const sr_trig_t *t, uint32_t cval, uint32_t lval, bool first)
+{
+   uint32_t all_mask = t->lvl0mask | t->lvl1mask | t->risemask | t->fallmask | t->chgmask;
+   uint32_t matches = 0;
+   matches |= (~cval & t->lvl0mask);
+   matches |= (cval & t->lvl1mask);
+   if (!first)
+   {
+      matches |= (cval & ~lval & t->risemask);
+      matches |= (~cval & lval & t->fallmask);
+      matches |= ((cval ^ lval) & t->chgmask);
+   }
+   return matches == all_mask;
+}
+
+int32_t trig_scan(sr_trig_t *t, const uint8_t *buf, uint32_t n, uint8_t bps)
+{
+   uint32_t cval;
+   for (uint32_t i = 0; i < n; i++)
+   {
+      if (bps == 0)
+      {
+         cval = (buf[i >> 1] >> ((i & 1) * 4)) & 0xF;
+      }
+      else if (bps == 1)
+      {
+         cval = buf[i];
+      }
+      else if (bps == 2)
+      {
+         cval = ((const uint16_t *)buf)[i];
+      }
+      else
+      {
+         cval = ((const uint32_t *)buf)[i];
+         //Same channel remapping as the send_slices_4B
+#ifdef DIG_26_MODE
+         cval = (cval & MEM_D_MASK_L) | ((cval & MEM_D_MASK_U) >> 3);
+#elif BASE_MODE
+         cval = cval & MEM_D_MASK_L;
+#endif
+      }
+      if (trig_match(t, cval, t->lval, t->first))
+      {
+         t->lval = cval;
+         t->first = false;
+         return (int32_t)i;
+      }
+      t->lval = cval;
+      t->first = false;
+   }
+   return -1;
+}
+
+//Lowest channel set in mask
+static uint32_t trig_lowest_chan(uint32_t mask)
+{
+   uint32_t chan = 0;
+   while ((mask & 1) == 0)
+   {
+      mask >>= 1;
+      chan++;
+   }
+   return chan;
+}
+
+uint32_t trig_pio_program(const sr_trig_t *t, uint16_t *instr, uint32_t *jmp_pin)
+{
+   uint32_t len = 0;
+   uint32_t pin;
+   uint32_t type;
+   if (t->risemask)
+   {
+      type = 2;
+      pin = trig_lowest_chan(t->risemask);
+   }
+   else if (t->fallmask)
+   {
+      type = 3;
+      pin = trig_lowest_chan(t->fallmask);
+   }
+   else if (t->chgmask)
+   {
+      type = 4;
+      pin = trig_lowest_chan(t->chgmask);
+   }
+   else if (t->lvl1mask)
+   {
+      type = 1;
+      pin = trig_lowest_chan(t->lvl1mask);
+   }
+   else if (t->lvl0mask)
+   {
+      type = 0;
+      pin = trig_lowest_chan(t->lvl0mask);
+   }
+   else
+   {
+      return 0;
+   }
+#ifdef DIG_26_MODE
+   //Undo the send_slices_4B channel remapping, the upper channels are on GPIO26-28
+   if (pin >= 23)
+   {
+      pin += 3;
+   }
+#endif
+   *jmp_pin = pin;
+   switch (type)
+   {
+   case 0: instr[len++] = pio_encode_wait_pin(false, pin); break;
+   case 1: instr[len++] = pio_encode_wait_pin(true, pin); break;
+   case 2:
+      instr[len++] = pio_encode_wait_pin(false, pin);
+      instr[len++] = pio_encode_wait_pin(true, pin);
+      break;
+   case 3:
+      instr[len++] = pio_encode_wait_pin(true, pin);
+      instr[len++] = pio_encode_wait_pin(false, pin);
+      break;
+   default:
+      //Wait for the opposite of the current level, the jmp targets are fixed offsets
+      instr[len++] = pio_encode_jmp_pin(3);      //0: if high goto 3
+      instr[len++] = pio_encode_wait_pin(true, pin);  //1: low now, wait for high
+      instr[len++] = pio_encode_jmp(4);          //2: goto 4
+      instr[len++] = pio_encode_wait_pin(false, pin); //3: high now, wait for low
+      break;
+   }
+   instr[len++] = pio_encode_irq_set(false, 0);
+   //Stop here until the capture is restarted
+   instr[len] = pio_encode_jmp(len);
+   len++;
+   return len;
+}
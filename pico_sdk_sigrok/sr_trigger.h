@@ -0,0 +1,49 @@
+#ifndef SR_TRIGGER_H
+#define SR_TRIGGER_H
+#include <stdint.h>
+#include <stdbool.h>
+
+//Digital trigger masks and matching state.
+//Each mask bit is a digital channel number (the same numbering as the 'D' command).
+//A sample triggers when every channel in any mask meets its condition.
+typedef struct
+{
+   uint32_t lvl0mask, lvl1mask, risemask, fallmask, chgmask;
+   uint32_t lval; // last sample value, kept across segments for the edge conditions
+   bool first;    // no previous sample yet, so edges can't match
+} sr_trig_t;
+
+// Clear all trigger conditions
+void trig_reset(sr_trig_t *t);
+
+// Add a condition for channel chan. type is 0 low, 1 high, 2 rising, 3 falling, 4 change.
+// Returns false if the type or channel is invalid.
+bool trig_add(sr_trig_t *t, uint32_t type, uint32_t chan);
+
+// True if any trigger condition is set
+bool trig_enabled(const sr_trig_t *t);
+
+// Restart edge tracking, i.e. at the start of a capture or after skipping samples
+void trig_arm(sr_trig_t *t);
+
+// Does cval (with previous value lval) meet the trigger conditions
+bool trig_match(const sr_trig_t *t, uint32_t cval, uint32_t lval, bool first);
+
+// Search n samples of DMA data for the trigger.  bps is the DMA bytes per sample with 0
+// meaning 4 bit samples packed in nibbles.  Returns the index of the first matching
+// sample or -1, and updates lval/first so that a search can continue in the next segment.
+int32_t trig_scan(sr_trig_t *t, const uint8_t *buf, uint32_t n, uint8_t bps);
+
+// Maximum length of the program made by trig_pio_program
+#define TRIG_PIO_MAX_INSTR 6
+
+// Build a PIO program that waits for one of the trigger conditions and then sets PIO irq 0.
+// An edge condition is preferred over a level since it is more selective.  The condition is
+// only the one channel, so the program can set the irq before the full trigger matches, but
+// never after.  Pin numbers are relative to the capture in_pins base and jmp targets are
+// relative to the start of the program (pio_add_program relocates them).
+// *jmp_pin is set to the pin to use with sm_config_set_jmp_pin.
+// Returns the number of instructions, or 0 if no conditions are set.
+uint32_t trig_pio_program(const sr_trig_t *t, uint16_t *instr, uint32_t *jmp_pin);
+
+#endif /* SR_TRIGGER_H */
@@ -0,0 +1,111 @@
+//USB descriptors for the VBULK_EN build.  These are the pico_stdio_usb descriptors with the
+//vendor bulk interface of sr_vbulk.h added after the CDC interfaces.  The pico_stdio_usb reset
+//interface, and the reset by setting 1200 baud, aren't available in this build.
+//The VID/PID are the pico sdk CDC ones.  Linux and libusb match the bulk interface by its
+//subclass and protocol, Windows needs a WinUSB driver to be installed for it (i.e. with Zadig).
+#include "pico/unique_id.h"
+#include "tusb.h"
+#include "sr_vbulk.h"
+
+#define USBD_VID (0x2E8A) // Raspberry Pi
+#if PICO_RP2040
+#define USBD_PID (0x000a) // Raspberry Pi Pico SDK CDC for RP2040
+#else
+#define USBD_PID (0x0009) // Raspberry Pi Pico SDK CDC
+#endif
+#define USBD_MANUFACTURER "Raspberry Pi"
+#define USBD_PRODUCT "Pico"
+
+#define USBD_VBULK_DESC_LEN (9 + 7)
+#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + USBD_VBULK_DESC_LEN)
+#define USBD_MAX_POWER_MA (250)
+
+#define USBD_ITF_CDC (0) // needs 2 interfaces
+#define USBD_ITF_VBULK (2)
+#define USBD_ITF_MAX (3)
+
+#define USBD_CDC_EP_CMD (0x81)
+#define USBD_CDC_EP_OUT (0x02)
+#define USBD_CDC_EP_IN (0x82)
+#define USBD_CDC_CMD_MAX_SIZE (8)
+#define USBD_CDC_IN_OUT_MAX_SIZE (64)
+#define USBD_VBULK_EP_IN (0x83)
+#define USBD_VBULK_MAX_SIZE (64)
+
+#define USBD_STR_0 (0x00)
+#define USBD_STR_MANUF (0x01)
+#define USBD_STR_PRODUCT (0x02)
+#define USBD_STR_SERIAL (0x03)
+#define USBD_STR_CDC (0x04)
+#define USBD_STR_VBULK (0x05)
+
+static const tusb_desc_device_t usbd_desc_device = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USBD_VID,
+    .idProduct = USBD_PID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = USBD_STR_MANUF,
+    .iProduct = USBD_STR_PRODUCT,
+    .iSerialNumber = USBD_STR_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+static const uint8_t usbd_desc_cfg[USBD_DESC_LEN] = {
+    TUD_CONFIG_DESCRIPTOR(1, USBD_ITF_MAX, USBD_STR_0, USBD_DESC_LEN, 0, USBD_MAX_POWER_MA),
+    TUD_CDC_DESCRIPTOR(USBD_ITF_CDC, USBD_STR_CDC, USBD_CDC_EP_CMD,
+        USBD_CDC_CMD_MAX_SIZE, USBD_CDC_EP_OUT, USBD_CDC_EP_IN, USBD_CDC_IN_OUT_MAX_SIZE),
+    //Vendor interface with one bulk IN endpoint
+    9, TUSB_DESC_INTERFACE, USBD_ITF_VBULK, 0, 1, TUSB_CLASS_VENDOR_SPECIFIC, VB_SUBCLASS, VB_PROTOCOL, USBD_STR_VBULK,
+    7, TUSB_DESC_ENDPOINT, USBD_VBULK_EP_IN, TUSB_XFER_BULK, U16_TO_U8S_LE(USBD_VBULK_MAX_SIZE), 0,
+};
+
+static char usbd_serial_str[PICO_UNIQUE_BOARD_ID_SIZE_BYTES * 2 + 1];
+
+static const char *const usbd_desc_str[] = {
+    [USBD_STR_MANUF] = USBD_MANUFACTURER,
+    [USBD_STR_PRODUCT] = USBD_PRODUCT,
+    [USBD_STR_SERIAL] = usbd_serial_str,
+    [USBD_STR_CDC] = "Board CDC",
+    [USBD_STR_VBULK] = "Sigrok bulk",
+};
+
+const uint8_t *tud_descriptor_device_cb(void) {
+    return (const uint8_t *)&usbd_desc_device;
+}
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index) {
+    (void)index;
+    return usbd_desc_cfg;
+}
+
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+#define USBD_DESC_STR_MAX (20)
+    static uint16_t desc_str[USBD_DESC_STR_MAX];
+    uint8_t len;
+    (void)langid;
+    //The serial number is the board id, read the first time it is needed
+    if (!usbd_serial_str[0]) {
+        pico_get_unique_board_id_string(usbd_serial_str, sizeof(usbd_serial_str));
+    }
+    if (index == 0) {
+        desc_str[1] = 0x0409; // supported language is English
+        len = 1;
+    } else {
+        if (index >= sizeof(usbd_desc_str) / sizeof(usbd_desc_str[0])) {
+            return NULL;
+        }
+        const char *str = usbd_desc_str[index];
+        for (len = 0; len < USBD_DESC_STR_MAX - 1 && str[len]; ++len) {
+            desc_str[1 + len] = str[len];
+        }
+    }
+    // first byte is length (including header), second byte is string type
+    desc_str[0] = (uint16_t)((TUSB_DESC_STRING << 8) | (2 * len + 2));
+    return desc_str;
+}
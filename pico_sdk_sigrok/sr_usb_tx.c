@@ -0,0 +1,78 @@
+#include "sr_usb_tx.h"
+#include "tusb.h"
+#include "pico/time.h"
+#include "pico/stdio_usb.h"
+
+//tud_ready and tud_cdc_write are inline so they are wrapped for the port table
+static bool cdc_ready(void)
+{
+   // See https://github.com/pico-coder/sigrok-pico/pull/63/.
+   // tud_ready does not rely on DTR so use it rather than tud_cdc_connected
+   return tud_ready();
+}
+
+static uint32_t cdc_write(const uint8_t *buf, uint32_t n)
+{
+   return tud_cdc_write(buf, n);
+}
+
+static void cdc_flush(void)
+{
+   tud_cdc_write_flush();
+}
+
+const sr_usb_port_t usb_cdc_port = {cdc_ready, cdc_write, cdc_flush};
+
+uint32_t usb_tx_write(sr_usb_tx_t *u, const uint8_t *buf, uint32_t length)
+{
+   uint64_t last_avail_time;
+   uint32_t n, sent = 0, t0;
+   bool stalled = false;
+   if (!u->port->ready())
+   {
+      return 0;
+   }
+   last_avail_time = time_us_64();
+   while (sent < length)
+   {
+      n = u->port->write(buf + sent, length - sent);
+      sent += n;
+      if (n)
+      {
+         last_avail_time = time_us_64();
+         if (stalled)
+         {
+            u->stall_bytes += n;
+         }
+      }
+      if (sent < length)
+      {
+         //fifo is full, let tinyusb send packets to make room
+         t0 = time_us_32();
+         if (!stalled)
+         {
+            stalled = true;
+            u->stats->stalls++;
+         }
+         tud_task();
+         u->stats->usb_us += time_us_32() - t0;
+         if (!u->port->ready() || (time_us_64() > last_avail_time + PICO_STDIO_USB_STDOUT_TIMEOUT_US))
+         {
+            break;
+         }
+      }
+   }
+   return sent;
+}
+
+void usb_tx_push(sr_usb_tx_t *u)
+{
+   uint32_t t0;
+   if (u->port->ready())
+   {
+      t0 = time_us_32();
+      u->port->flush();
+      tud_task();
+      u->stats->usb_us += time_us_32() - t0;
+   }
+}
@@ -0,0 +1,41 @@
+#ifndef SR_USB_TX_H
+#define SR_USB_TX_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "sr_device.h"
+
+//Sample data output to USB, behind the encoders' usb_tx_sink.
+//tud_cdc_write already starts a 64B USB transaction whenever the TUD fifo holds a full packet,
+//so rather than a tud_task and flush on every call, tinyusb is only serviced when the fifo has
+//no room left, and usb_tx_push sends the final partial packet once per segment.
+//The encoders don't write directly into the TUD fifo.  It is private to the tinyusb cdc driver
+//and tud_cdc_write is the only way in, so txbuf is still used for staging and each byte is
+//copied once.  The vendor bulk interface of VBULK_EN is another port with the same calls.
+
+//The calls of one USB data path
+typedef struct
+{
+   bool (*ready)(void);                              // the host can receive data
+   uint32_t (*write)(const uint8_t *buf, uint32_t n); // copy up to n bytes, returns the bytes taken
+   void (*flush)(void);                              // start sending a partial packet
+} sr_usb_port_t;
+
+typedef struct
+{
+   const sr_usb_port_t *port;
+   sr_stats_t *stats;    // usb_us and stalls are counted here
+   uint32_t stall_bytes; // bytes written while USB was the limit, for the 'e' estimate
+} sr_usb_tx_t;
+
+// The CDC serial port
+extern const sr_usb_port_t usb_cdc_port;
+
+// Write length bytes to the port, running tud_task while it has no room.  Gives up once no
+// bytes were taken for PICO_STDIO_USB_STDOUT_TIMEOUT_US or the port stops being ready.
+// Returns the bytes written.
+uint32_t usb_tx_write(sr_usb_tx_t *u, const uint8_t *buf, uint32_t length);
+
+// Start sending any partial packet left by usb_tx_write
+void usb_tx_push(sr_usb_tx_t *u);
+
+#endif /* SR_USB_TX_H */
@@ -0,0 +1,172 @@
+#include <string.h>
+#include "tusb.h"
+#include "device/usbd_pvt.h"
+#include "sr_vbulk.h"
+
+static sr_vbulk_t vb;
+
+//Start a transfer of the next buffer if it is waiting and the endpoint is free.
+//busy is only cleared by the transfer callback, after send has moved on, so the writer can't
+//see a free endpoint while the callback for the last transfer is still pending.
+static void vb_kick(void)
+{
+   uint8_t i = vb.send;
+   if (!vb.ep_in || vb.busy || !vb.full[i])
+   {
+      return;
+   }
+   if (!usbd_edpt_claim(vb.rhport, vb.ep_in))
+   {
+      return;
+   }
+   vb.busy = true;
+   if (!usbd_edpt_xfer(vb.rhport, vb.ep_in, vb.buf[i], vb.len[i]))
+   {
+      vb.busy = false;
+      usbd_edpt_release(vb.rhport, vb.ep_in);
+   }
+}
+
+//Queue the buffer being written and move the writes to the other one
+static void vb_queue(void)
+{
+   uint8_t i = vb.fill;
+   vb.open_end = vb.len[i] && ((vb.len[i] % vb.ep_size) == 0);
+   vb.full[i] = true;
+   vb.fill = i ^ 1;
+   vb_kick();
+}
+
+bool vb_ready(void)
+{
+   return vb.ep_in && tud_ready();
+}
+
+uint32_t vb_write(const uint8_t *buf, uint32_t n)
+{
+   uint32_t done = 0;
+   if (!vb.ep_in)
+   {
+      return 0;
+   }
+   while ((done < n) && !vb.full[vb.fill])
+   {
+      uint8_t i = vb.fill;
+      uint32_t cnt = VB_BUF_SIZE - vb.len[i];
+      if (cnt > n - done)
+      {
+         cnt = n - done;
+      }
+      memcpy(&vb.buf[i][vb.len[i]], buf + done, cnt);
+      vb.len[i] += cnt;
+      done += cnt;
+      if (vb.len[i] == VB_BUF_SIZE)
+      {
+         vb_queue();
+      }
+   }
+   //A buffer that couldn't claim the endpoint is tried again while the writer waits for room
+   if (done < n)
+   {
+      vb_kick();
+   }
+   return done;
+}
+
+void vb_flush(void)
+{
+   uint8_t i = vb.fill;
+   //An empty buffer is sent as a zero length packet
+   if (vb.ep_in && !vb.full[i] && (vb.len[i] || vb.open_end))
+   {
+      vb_queue();
+   }
+   else
+   {
+      vb_kick();
+   }
+}
+
+bool vb_idle(void)
+{
+   return !vb.ep_in || (!vb.full[0] && !vb.full[1]);
+}
+
+//tinyusb class driver
+static void vb_init(void)
+{
+   memset(&vb, 0, sizeof(vb));
+}
+
+static bool vb_deinit(void)
+{
+   return true;
+}
+
+//Any data not yet sent is dropped when the host resets or reconfigures the device
+static void vb_reset(uint8_t rhport)
+{
+   (void)rhport;
+   vb_init();
+}
+
+static uint16_t vb_open(uint8_t rhport, tusb_desc_interface_t const *itf, uint16_t max_len)
+{
+   uint16_t len = sizeof(tusb_desc_interface_t) + sizeof(tusb_desc_endpoint_t);
+   tusb_desc_endpoint_t const *ep = (tusb_desc_endpoint_t const *)tu_desc_next(itf);
+   TU_VERIFY((itf->bInterfaceClass == TUSB_CLASS_VENDOR_SPECIFIC) && (itf->bInterfaceSubClass == VB_SUBCLASS)
+             && (itf->bInterfaceProtocol == VB_PROTOCOL) && (itf->bNumEndpoints == 1), 0);
+   TU_VERIFY(max_len >= len, 0);
+   TU_VERIFY((ep->bDescriptorType == TUSB_DESC_ENDPOINT) && (tu_edpt_dir(ep->bEndpointAddress) == TUSB_DIR_IN), 0);
+   TU_VERIFY(usbd_edpt_open(rhport, ep), 0);
+   vb_init();
+   vb.rhport = rhport;
+   vb.ep_size = tu_edpt_packet_size(ep);
+   vb.ep_in = ep->bEndpointAddress;
+   return len;
+}
+
+//There are no class or vendor requests
+static bool vb_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const *request)
+{
+   (void)rhport;
+   (void)stage;
+   (void)request;
+   return false;
+}
+
+//A failed transfer is dropped like a sent one, the host sees it as a gap in the byte count
+static bool vb_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+   uint8_t i = vb.send;
+   (void)rhport;
+   (void)result;
+   (void)xferred_bytes;
+   TU_VERIFY(ep_addr == vb.ep_in);
+   vb.len[i] = 0;
+   vb.send = i ^ 1;
+   vb.full[i] = false;
+   vb.busy = false;
+   vb_kick();
+   return true;
+}
+
+static const usbd_class_driver_t vb_driver =
+{
+#if CFG_TUSB_DEBUG >= 2
+   .name = "SR_VBULK",
+#endif
+   .init = vb_init,
+   .deinit = vb_deinit,
+   .reset = vb_reset,
+   .open = vb_open,
+   .control_xfer_cb = vb_control_xfer_cb,
+   .xfer_cb = vb_xfer_cb,
+   .sof = NULL
+};
+
+usbd_class_driver_t const *usbd_app_driver_get_cb(uint8_t *driver_count)
+{
+   *driver_count = 1;
+   return &vb_driver;
+}
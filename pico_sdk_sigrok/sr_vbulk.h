@@ -0,0 +1,49 @@
+#ifndef SR_VBULK_H
+#define SR_VBULK_H
+#include <stdint.h>
+#include <stdbool.h>
+
+//Vendor bulk streaming.  With VBULK_EN the USB configuration has a vendor class interface with
+//one bulk IN endpoint next to the CDC serial port.  Commands and replies stay on the CDC port,
+//but after a 'v1' command the sample data of a capture is sent on the bulk endpoint, which
+//isn't limited by the CDC fifo and can be read by the host with several transfers in flight.
+//The data is staged in two buffers, so that the encoders fill one while the other is being
+//sent.  A buffer is handed to the endpoint as one transfer, which the USB controller sends as
+//back to back packets without waiting for tud_task between them.
+//The class driver only uses the tinyusb usbd endpoint calls so that it can be run against a
+//mock of the device layer.
+// Bytes in each of the two transfer buffers
+#define VB_BUF_SIZE 4096
+// Interface subclass and protocol that identify the bulk interface to the host
+#define VB_SUBCLASS 0x53
+#define VB_PROTOCOL 0x01
+
+typedef struct
+{
+   uint8_t rhport;
+   uint8_t ep_in;           // bulk IN endpoint address, 0 until the host configures the interface
+   uint16_t ep_size;        // max packet size of ep_in
+   uint8_t fill;            // buffer being written, only changed by vb_write and vb_flush
+   uint8_t send;            // next buffer to send, only changed by the transfer callback
+   uint16_t len[2];         // bytes in each buffer
+   volatile bool full[2];   // buffer is waiting to be sent or is being sent
+   volatile bool busy;      // a transfer is on the endpoint
+   bool open_end;           // the last buffer queued ended on a packet boundary
+   uint8_t buf[2][VB_BUF_SIZE];
+} sr_vbulk_t;
+
+// The host has configured the bulk interface
+bool vb_ready(void);
+
+// Copy up to n bytes into the buffers, starting a transfer for each buffer that fills.
+// Returns the bytes taken, which is less than n when both buffers are waiting to be sent.
+uint32_t vb_write(const uint8_t *buf, uint32_t n);
+
+// Send the partially filled buffer, or a zero length packet if the last transfer ended on a
+// packet boundary, so that the transfer the host is reading completes.
+void vb_flush(void);
+
+// Nothing is waiting to be sent
+bool vb_idle(void);
+
+#endif /* SR_VBULK_H */
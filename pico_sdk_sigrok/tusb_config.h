@@ -0,0 +1,18 @@
+#ifndef _TUSB_CONFIG_H_
+#define _TUSB_CONFIG_H_
+
+//tinyusb configuration for the VBULK_EN build, which links tinyusb_device itself so that the
+//USB configuration can have the vendor bulk interface next to the stdio CDC port.
+//The CDC settings match those of the pico_stdio_usb configuration used otherwise.
+//The MCU and OS are set by the pico sdk tinyusb libraries.
+#define CFG_TUSB_RHPORT0_MODE (OPT_MODE_DEVICE)
+#define CFG_TUD_ENDPOINT0_SIZE (64)
+
+#define CFG_TUD_CDC (1)
+#define CFG_TUD_CDC_RX_BUFSIZE (256)
+#define CFG_TUD_CDC_TX_BUFSIZE (256)
+
+//The bulk interface uses the sr_vbulk.c application driver rather than the tinyusb vendor class
+#define CFG_TUD_VENDOR (0)
+
+#endif /* _TUSB_CONFIG_H_ */